@@ -27,6 +27,17 @@ int stufftext_frame;
 
 void CL_FinishTimeDemo (void);
 
+cvar_t	cl_demopacked = {"cl_demopacked", "0", true};	// record compressed, seekable demos
+cvar_t	cl_demoblocktime = {"cl_demoblocktime", "5"};	// max seconds of recording held in one block
+cvar_t	cl_demosnapshot = {"cl_demosnapshot", "10"};	// seconds between playback seek points, 0 = off
+cvar_t	cl_demospeed = {"cl_demospeed", "1"};			// playback rate, 0 freezes the demo
+
+#define	DEMO_PACKEDID	(('2'<<24)+('Z'<<16)+('D'<<8)+'Q')	// little-endian "QDZ2"
+#define	DEMO_BLOCKHEADER	8			// rawlen and packedlen before each block
+#define	DEMO_BLOCKSIZE	0x10000		// raw message bytes gathered into one block
+#define	DEMO_NUMBLOCKS	4			// blocks that can wait on the writer thread
+#define	DEMO_RECORDSIZE	16			// length and view angles before each message
+
 /*
 ==============================================================================
 
@@ -68,6 +79,8 @@ void CL_StopPlayback (void)
 	cls.demobufferlength = 0;
 	// jkrige - pk3 file support
 
+	CL_ClearDemoSnapshots ();
+
 
 	if (cls.timedemo)
 		CL_FinishTimeDemo ();
@@ -85,6 +98,247 @@ void CL_StopPlayback (void)
 	// jkrige - stop demo music playback
 }
 
+/*
+==============================================================================
+
+DEMO WRITER
+
+Recorded messages are gathered into large blocks in memory.  Full blocks
+are handed to a writer thread that does the file i/o, so recording costs a
+memcpy per message instead of several fwrites and an fflush.
+
+A classic demo is the track line followed by the raw message records.  A
+packed demo (cl_demopacked 1) is laid out as
+
+	int		DEMO_PACKEDID
+	int		forcetrack
+	blocks:
+		int		rawlen
+		int		packedlen		// 0 = stored uncompressed
+		byte	data[packedlen ? packedlen : rawlen]
+
+where each block holds whole message records, zlib compressed.  Blocks are
+cut at least every cl_demoblocktime seconds, so a crash loses no more than
+that.  Playback seeks through the client state snapshots taken as it goes,
+since a block start alone has none of the state needed to resume there.
+==============================================================================
+*/
+
+typedef struct
+{
+	byte		data[DEMO_BLOCKSIZE];
+	int			len;
+	float		time;			// cl.mtime[0] when the first message went in, to cut it
+	qboolean	queued;			// owned by the writer thread until cleared
+} demoblock_t;
+
+static demoblock_t	*demo_blocks;
+static int			demo_head;		// block being filled by the client
+static int			demo_tail;		// next block the writer thread will write
+static qboolean		demo_packed;
+static qboolean		demo_quit;
+static byte			*demo_packbuf;	// writer thread's compression output
+
+static sys_thread_t	demo_thread;
+static sys_mutex_t	demo_lock;
+static sys_event_t	demo_work;		// client -> writer: a block was queued
+static sys_event_t	demo_done;		// writer -> client: a block was released
+
+static void CL_DemoPutLong (byte *buf, int l)
+{
+	buf[0] = l & 255;
+	buf[1] = (l >> 8) & 255;
+	buf[2] = (l >> 16) & 255;
+	buf[3] = (l >> 24) & 255;
+}
+
+static int CL_DemoGetLong (byte *buf)
+{
+	return buf[0] + (buf[1] << 8) + (buf[2] << 16) + (buf[3] << 24);
+}
+
+/*
+====================
+CL_WriteDemoBlock
+
+Called from the writer thread, or inline when there is none
+====================
+*/
+static void CL_WriteDemoBlock (demoblock_t *b)
+{
+	byte	header[DEMO_BLOCKHEADER];
+	int		packedlen;
+
+	if (!demo_packed)
+	{
+		fwrite (b->data, b->len, 1, cls.demofile);
+		fflush (cls.demofile);
+		return;
+	}
+
+	packedlen = Zip_Deflate (b->data, b->len, demo_packbuf, DEMO_BLOCKSIZE);
+	if (packedlen >= b->len)
+		packedlen = -1;		// didn't shrink, store it
+
+	CL_DemoPutLong (header, b->len);
+	CL_DemoPutLong (header + 4, (packedlen < 0) ? 0 : packedlen);
+	fwrite (header, sizeof(header), 1, cls.demofile);
+
+	if (packedlen < 0)
+		fwrite (b->data, b->len, 1, cls.demofile);
+	else
+		fwrite (demo_packbuf, packedlen, 1, cls.demofile);
+	fflush (cls.demofile);
+}
+
+static void CL_DemoWriterThread (void *parm)
+{
+	demoblock_t	*b;
+	qboolean	queued, quit;
+
+	while (1)
+	{
+		b = &demo_blocks[demo_tail];
+
+		Sys_LockMutex (demo_lock);
+		queued = b->queued;
+		quit = demo_quit;
+		Sys_UnlockMutex (demo_lock);
+
+		if (!queued)
+		{
+			if (quit)
+				break;
+			Sys_WaitEvent (demo_work, -1);
+			continue;
+		}
+
+		CL_WriteDemoBlock (b);
+
+		Sys_LockMutex (demo_lock);
+		b->queued = false;
+		Sys_UnlockMutex (demo_lock);
+
+		demo_tail = (demo_tail + 1) % DEMO_NUMBLOCKS;
+		Sys_SignalEvent (demo_done);
+	}
+}
+
+/*
+====================
+CL_QueueDemoBlock
+
+Passes the block being filled to the writer and moves on to the next one,
+waiting if the writer has fallen a whole ring behind
+====================
+*/
+static void CL_QueueDemoBlock (void)
+{
+	demoblock_t	*b;
+	qboolean	queued;
+
+	b = &demo_blocks[demo_head];
+	if (!b->len)
+		return;
+
+	if (!demo_thread)
+	{
+		CL_WriteDemoBlock (b);
+		b->len = 0;
+		return;
+	}
+
+	Sys_LockMutex (demo_lock);
+	b->queued = true;
+	Sys_UnlockMutex (demo_lock);
+	Sys_SignalEvent (demo_work);
+
+	demo_head = (demo_head + 1) % DEMO_NUMBLOCKS;
+	b = &demo_blocks[demo_head];
+
+	while (1)
+	{
+		Sys_LockMutex (demo_lock);
+		queued = b->queued;
+		Sys_UnlockMutex (demo_lock);
+
+		if (!queued)
+			break;
+		Sys_WaitEvent (demo_done, -1);
+	}
+
+	b->len = 0;
+}
+
+/*
+====================
+CL_OpenDemoWriter
+
+cls.demofile must be open with the demo header written
+====================
+*/
+static void CL_OpenDemoWriter (qboolean packed)
+{
+	demo_blocks = malloc (DEMO_NUMBLOCKS * sizeof(demoblock_t));
+	demo_packbuf = malloc (DEMO_BLOCKSIZE);
+	if (!demo_blocks || !demo_packbuf)
+		Sys_Error ("CL_OpenDemoWriter: not enough memory");
+
+	memset (demo_blocks, 0, DEMO_NUMBLOCKS * sizeof(demoblock_t));
+	demo_head = demo_tail = 0;
+	demo_packed = packed;
+	demo_quit = false;
+
+	demo_lock = Sys_CreateMutex ();
+	demo_work = Sys_CreateEvent ();
+	demo_done = Sys_CreateEvent ();
+	if (demo_lock && demo_work && demo_done)
+		demo_thread = Sys_CreateThread (CL_DemoWriterThread, NULL);
+	else
+		demo_thread = NULL;
+}
+
+/*
+====================
+CL_CloseDemoFile
+
+Flushes everything still buffered and closes the demo
+====================
+*/
+void CL_CloseDemoFile (void)
+{
+	if (!cls.demorecording)
+		return;
+
+	CL_QueueDemoBlock ();
+
+	if (demo_thread)
+	{
+		Sys_LockMutex (demo_lock);
+		demo_quit = true;
+		Sys_UnlockMutex (demo_lock);
+		Sys_SignalEvent (demo_work);
+
+		Sys_WaitThread (demo_thread);
+		demo_thread = NULL;
+	}
+
+	Sys_DestroyEvent (demo_done);
+	Sys_DestroyEvent (demo_work);
+	Sys_DestroyMutex (demo_lock);
+	demo_done = demo_work = NULL;
+	demo_lock = NULL;
+
+	free (demo_blocks);
+	free (demo_packbuf);
+	demo_blocks = NULL;
+	demo_packbuf = NULL;
+
+	fclose (cls.demofile);
+	cls.demofile = NULL;
+	cls.demorecording = false;
+}
+
 /*
 ====================
 CL_WriteDemoMessage
@@ -94,19 +348,261 @@ Dumps the current net message, prefixed by the length and view angles
 */
 void CL_WriteDemoMessage (void)
 {
-	int		len;
-	int		i;
-	float	f;
+	demoblock_t	*b;
+	int			i;
+	union
+	{
+		float	f;
+		int		l;
+	} dat;
+
+	b = &demo_blocks[demo_head];
+
+// start a new block when this one is full or has been open long enough
+	if (b->len && (b->len + DEMO_RECORDSIZE + net_message.cursize > DEMO_BLOCKSIZE
+		|| cl.mtime[0] < b->time || cl.mtime[0] - b->time >= cl_demoblocktime.value))
+	{
+		CL_QueueDemoBlock ();
+		b = &demo_blocks[demo_head];
+	}
 
-	len = LittleLong (net_message.cursize);
-	fwrite (&len, 4, 1, cls.demofile);
+	if (!b->len)
+		b->time = cl.mtime[0];
+
+	CL_DemoPutLong (b->data + b->len, net_message.cursize);
 	for (i=0 ; i<3 ; i++)
 	{
-		f = LittleFloat (cl.viewangles[i]);
-		fwrite (&f, 4, 1, cls.demofile);
+		dat.f = cl.viewangles[i];
+		CL_DemoPutLong (b->data + b->len + 4 + i*4, dat.l);
 	}
-	fwrite (net_message.data, net_message.cursize, 1, cls.demofile);
-	fflush (cls.demofile);
+	b->len += DEMO_RECORDSIZE;
+
+	memcpy (b->data + b->len, net_message.data, net_message.cursize);
+	b->len += net_message.cursize;
+}
+
+/*
+====================
+CL_UnpackDemo
+
+Expands a packed demo in cls.demobuffer to the classic message layout that
+CL_GetMessage reads
+====================
+*/
+static qboolean CL_UnpackDemo (void)
+{
+	byte		*in, *end, *out;
+	int			rawlen, packedlen, total, numblocks, i;
+
+	end = cls.demobuffer + cls.demobufferlength;
+
+// size it up first; a truncated last block (crashed recording) is dropped
+	total = numblocks = 0;
+	for (in = cls.demobuffer + 8 ; in + DEMO_BLOCKHEADER <= end ; in += DEMO_BLOCKHEADER + (packedlen ? packedlen : rawlen))
+	{
+		rawlen = CL_DemoGetLong (in);
+		packedlen = CL_DemoGetLong (in + 4);
+		if (rawlen <= 0 || rawlen > DEMO_BLOCKSIZE || packedlen < 0 || packedlen >= rawlen)
+			break;
+		if (in + DEMO_BLOCKHEADER + (packedlen ? packedlen : rawlen) > end)
+			break;
+
+		total += rawlen;
+		numblocks++;
+	}
+
+	if (!numblocks)
+		return false;
+
+	out = malloc (total + 1);
+	if (!out)
+		Sys_Error ("CL_UnpackDemo: not enough memory");
+	out[total] = 0;
+
+	total = 0;
+	in = cls.demobuffer + 8;
+	for (i=0 ; i<numblocks ; i++)
+	{
+		rawlen = CL_DemoGetLong (in);
+		packedlen = CL_DemoGetLong (in + 4);
+		in += DEMO_BLOCKHEADER;
+
+		if (!packedlen)
+			memcpy (out + total, in, rawlen);
+		else if (Zip_Inflate (in, packedlen, out + total, rawlen) != rawlen)
+		{
+			Con_Printf ("Demo block %i is corrupt\n", i);
+			break;
+		}
+
+		total += rawlen;
+		in += packedlen ? packedlen : rawlen;
+	}
+
+	if (!i)
+	{
+		free (out);
+		return false;
+	}
+
+	cls.forcetrack = CL_DemoGetLong (cls.demobuffer + 4);
+
+	free (cls.demobuffer);
+	cls.demobuffer = out;
+	cls.demobufferlength = total;
+	cls.demobufferposition = 0;
+
+	return true;
+}
+
+/*
+==============================================================================
+
+DEMO SNAPSHOTS
+
+While a demo plays, a copy of the client state is taken every
+cl_demosnapshot seconds, together with the buffer position of the next
+message.  A seek restores the closest snapshot at or before the target and
+parses forward from there, so a jump costs one restore plus a few seconds
+of messages instead of a replay from the start.
+
+Snapshots refer to the models and sounds of the current map, so they are
+dropped whenever the client state is cleared.
+==============================================================================
+*/
+
+typedef struct
+{
+	int				position;		// demobuffer offset of the next message
+	client_state_t	cl;
+
+	char			names[MAX_SCOREBOARD][MAX_SCOREBOARDNAME];
+	float			entertime[MAX_SCOREBOARD];
+	int				frags[MAX_SCOREBOARD];
+	int				colors[MAX_SCOREBOARD];
+
+	lightstyle_t	lightstyles[MAX_LIGHTSTYLES];
+	int				numentities;
+	entity_t		*entities;		// cl_entities[0 .. numentities-1]
+} demosnap_t;
+
+static demosnap_t	*demo_snaps;
+static int			demo_numsnaps;
+static int			demo_maxsnaps;
+
+/*
+====================
+CL_ClearDemoSnapshots
+====================
+*/
+void CL_ClearDemoSnapshots (void)
+{
+	int		i;
+
+	for (i=0 ; i<demo_numsnaps ; i++)
+		free (demo_snaps[i].entities);
+
+	if (demo_snaps)
+		free (demo_snaps);
+
+	demo_snaps = NULL;
+	demo_numsnaps = demo_maxsnaps = 0;
+}
+
+/*
+====================
+CL_DemoSnapshot
+
+Called on a message boundary during playback
+====================
+*/
+static void CL_DemoSnapshot (void)
+{
+	demosnap_t	*snap;
+	int			i;
+
+	if (cls.timedemo || cls.signon != SIGNONS || cl_demosnapshot.value <= 0)
+		return;
+
+	if (demo_numsnaps)
+	{
+		snap = &demo_snaps[demo_numsnaps-1];
+		if (cls.demobufferposition <= snap->position)
+			return;		// replaying ground that is already covered
+		if (cl.mtime[0] - snap->cl.mtime[0] < cl_demosnapshot.value)
+			return;
+	}
+
+	if (demo_numsnaps == demo_maxsnaps)
+	{
+		snap = realloc (demo_snaps, (demo_maxsnaps + 64) * sizeof(demosnap_t));
+		if (!snap)
+			return;
+		demo_snaps = snap;
+		demo_maxsnaps += 64;
+	}
+
+	snap = &demo_snaps[demo_numsnaps];
+	snap->entities = malloc (cl.num_entities * sizeof(entity_t) + 1);
+	if (!snap->entities)
+		return;
+
+	snap->position = cls.demobufferposition;
+	snap->cl = cl;
+
+	for (i=0 ; i<cl.maxclients ; i++)
+	{
+		memcpy (snap->names[i], cl.scores[i].name, MAX_SCOREBOARDNAME);
+		snap->entertime[i] = cl.scores[i].entertime;
+		snap->frags[i] = cl.scores[i].frags;
+		snap->colors[i] = cl.scores[i].colors;
+	}
+
+	memcpy (snap->lightstyles, cl_lightstyle, sizeof(cl_lightstyle));
+	snap->numentities = cl.num_entities;
+	memcpy (snap->entities, cl_entities, cl.num_entities * sizeof(entity_t));
+
+	demo_numsnaps++;
+}
+
+/*
+====================
+CL_RestoreDemoSnapshot
+====================
+*/
+static void CL_RestoreDemoSnapshot (demosnap_t *snap)
+{
+	scoreboard_t	*scores;
+	int				i, numentities;
+
+	numentities = cl.num_entities;
+	scores = cl.scores;
+
+	cl = snap->cl;
+	cl.scores = scores;
+	cl.time = cl.oldtime = cl.mtime[0];
+
+	for (i=0 ; i<cl.maxclients ; i++)
+	{
+		memcpy (cl.scores[i].name, snap->names[i], MAX_SCOREBOARDNAME);
+		cl.scores[i].entertime = snap->entertime[i];
+		cl.scores[i].frags = snap->frags[i];
+		cl.scores[i].colors = snap->colors[i];
+		CL_NewTranslation (i);
+	}
+
+	memcpy (cl_lightstyle, snap->lightstyles, sizeof(cl_lightstyle));
+	memcpy (cl_entities, snap->entities, snap->numentities * sizeof(entity_t));
+	if (numentities > snap->numentities)
+		memset (cl_entities + snap->numentities, 0, (numentities - snap->numentities) * sizeof(entity_t));
+
+// transient effects belong to the time we left
+	memset (cl_dlights, 0, sizeof(cl_dlights));
+	memset (cl_beams, 0, sizeof(cl_beams));
+	R_ClearParticles ();
+	S_StopDynamicSounds ();
+
+	cls.demobufferposition = snap->position;
 }
 
 /*
@@ -196,10 +692,65 @@ Handles recording and playback of demos, on top of NET_ code
 	return r;
 }*/
 
-int CL_GetMessage (void)
+/*
+====================
+CL_ReadDemoMessage
+
+Pulls the next message out of the demo buffer, whether or not it is due
+====================
+*/
+static int CL_ReadDemoMessage (void)
 {
-	int		r, i;
+	int		i;
 	float	f;
+
+	if (cls.demobufferlength - cls.demobufferposition < DEMO_RECORDSIZE)
+	{
+		CL_StopPlayback ();
+		return 0;
+	}
+
+	//fread (&net_message.cursize, 4, 1, cls.demofile);
+	net_message.cursize = ( (cls.demobuffer[cls.demobufferposition + 3] << 24) + (cls.demobuffer[cls.demobufferposition + 2] << 16) + (cls.demobuffer[cls.demobufferposition + 1] << 8) + (cls.demobuffer[cls.demobufferposition + 0]) );
+	cls.demobufferposition += 4;
+	net_message.cursize = LittleLong (net_message.cursize);
+
+	VectorCopy (cl.mviewangles[0], cl.mviewangles[1]);
+	for (i=0 ; i<3 ; i++)
+	{
+		//r = fread (&f, 4, 1, cls.demofile);
+		memcpy(&f, &cls.demobuffer[cls.demobufferposition], 4);
+		cls.demobufferposition += 4;
+		cl.mviewangles[0][i] = LittleFloat (f);
+	}
+
+	if (net_message.cursize > MAX_MSGLEN)
+		Sys_Error ("Demo message > MAX_MSGLEN");
+
+	//r = fread (net_message.data, net_message.cursize, 1, cls.demofile);
+	//if (r != 1)
+	//{
+	//	CL_StopPlayback ();
+	//	return 0;
+	//}
+
+	if(net_message.cursize == 0 || net_message.cursize > (cls.demobufferlength - cls.demobufferposition))
+	{
+		CL_StopPlayback ();
+		return 0;
+	}
+
+	for(i = 0; i < net_message.cursize; i++)
+	{
+		net_message.data[i] = cls.demobuffer[cls.demobufferposition++];
+	}
+
+	return 1;
+}
+
+int CL_GetMessage (void)
+{
+	int		r;
 	
 	if	(cls.demoplayback)
 	{
@@ -233,44 +784,10 @@ int CL_GetMessage (void)
 			}
 		}
 		
-	// get the next message
-
-		//fread (&net_message.cursize, 4, 1, cls.demofile);
-		net_message.cursize = ( (cls.demobuffer[cls.demobufferposition + 3] << 24) + (cls.demobuffer[cls.demobufferposition + 2] << 16) + (cls.demobuffer[cls.demobufferposition + 1] << 8) + (cls.demobuffer[cls.demobufferposition + 0]) );
-		cls.demobufferposition += 4;
-		net_message.cursize = LittleLong (net_message.cursize);
-
-		VectorCopy (cl.mviewangles[0], cl.mviewangles[1]);
-		for (i=0 ; i<3 ; i++)
-		{
-			//r = fread (&f, 4, 1, cls.demofile);
-			memcpy(&f, &cls.demobuffer[cls.demobufferposition], 4);
-			cls.demobufferposition += 4;
-			cl.mviewangles[0][i] = LittleFloat (f);
-		}
+	// remember where we are for seeking
+		CL_DemoSnapshot ();
 
-		if (net_message.cursize > MAX_MSGLEN)
-			Sys_Error ("Demo message > MAX_MSGLEN");
-
-		//r = fread (net_message.data, net_message.cursize, 1, cls.demofile);
-		//if (r != 1)
-		//{
-		//	CL_StopPlayback ();
-		//	return 0;
-		//}
-
-		if(net_message.cursize == 0 || net_message.cursize > (cls.demobufferlength - cls.demobufferposition))
-		{
-			CL_StopPlayback ();
-			return 0;
-		}
-
-		for(i = 0; i < net_message.cursize; i++)
-		{
-			net_message.data[i] = cls.demobuffer[cls.demobufferposition++];
-		}
-
-		return 1;
+		return CL_ReadDemoMessage ();
 	}
 
 	while (1)
@@ -319,9 +836,7 @@ void CL_Stop_f (void)
 	CL_WriteDemoMessage ();
 
 // finish up
-	fclose (cls.demofile);
-	cls.demofile = NULL;
-	cls.demorecording = false;
+	CL_CloseDemoFile ();
 	Con_Printf ("Completed demo\n");
 }
 
@@ -391,8 +906,18 @@ void CL_Record_f (void)
 	}
 
 	cls.forcetrack = track;
-	fprintf (cls.demofile, "%i\n", cls.forcetrack);
-	
+	if (cl_demopacked.value)
+	{
+		byte	header[8];
+
+		CL_DemoPutLong (header, DEMO_PACKEDID);
+		CL_DemoPutLong (header + 4, cls.forcetrack);
+		fwrite (header, sizeof(header), 1, cls.demofile);
+	}
+	else
+		fprintf (cls.demofile, "%i\n", cls.forcetrack);
+
+	CL_OpenDemoWriter (cl_demopacked.value != 0);
 	cls.demorecording = true;
 }
 
@@ -404,6 +929,8 @@ CL_PlayDemo_f
 play [demoname]
 ====================
 */
+static void CL_PlayDemo (char *demoname);
+
 
 // jkrige - get rid of the menu and/or console
 #define	m_none	0	// enumerated menu state from menu.c
@@ -468,11 +995,6 @@ extern	int	m_state;
 }*/
 void CL_PlayDemo_f (void)
 {
-	char	name[256];
-	int c;
-	//int fi;
-	qboolean neg = false;
-
 	if (cmd_source != src_command)
 		return;
 
@@ -482,6 +1004,16 @@ void CL_PlayDemo_f (void)
 		return;
 	}
 
+	CL_PlayDemo (Cmd_Argv(1));
+}
+
+static void CL_PlayDemo (char *demoname)
+{
+	char	name[256];
+	int c;
+	//int fi;
+	qboolean neg = false;
+
 //
 // disconnect from server
 //
@@ -490,7 +1022,8 @@ void CL_PlayDemo_f (void)
 //
 // open the demo file
 //
-	strcpy (name, Cmd_Argv(1));
+	Q_strncpy (name, demoname, sizeof(name) - 5);
+	name[sizeof(name) - 5] = 0;
 	COM_DefaultExtension (name, ".dem");
 
 	Con_Printf ("Playing demo from %s.\n", name);
@@ -512,16 +1045,30 @@ void CL_PlayDemo_f (void)
 	cls.state = ca_connected;
 	cls.forcetrack = 0;
 
-	while ((c = cls.demobuffer[cls.demobufferposition++]) != '\n')
+	if (cls.demobufferlength >= 8 && CL_DemoGetLong (cls.demobuffer) == DEMO_PACKEDID)
 	{
-		if (c == '-')
-			neg = true;
-		else
-			cls.forcetrack = cls.forcetrack * 10 + (c - '0');
+		if (!CL_UnpackDemo ())
+		{
+			Con_Printf ("ERROR: %s is not a valid packed demo.\n", name);
+			cls.demonum = -1;		// stop demo loop
+			CL_StopPlayback ();
+			return;
+		}
 	}
+	else
+	{
+		while (cls.demobufferposition < cls.demobufferlength
+			&& (c = cls.demobuffer[cls.demobufferposition++]) != '\n')
+		{
+			if (c == '-')
+				neg = true;
+			else
+				cls.forcetrack = cls.forcetrack * 10 + (c - '0');
+		}
 
-	if (neg)
-		cls.forcetrack = -cls.forcetrack;
+		if (neg)
+			cls.forcetrack = -cls.forcetrack;
+	}
 
 	// jkrige - get rid of the menu and/or console
 	if (key_dest == key_console || key_dest == key_menu)
@@ -543,6 +1090,283 @@ void CL_PlayDemo_f (void)
 // jkrige - pk3 file support
 
 
+/*
+====================
+CL_DemoFastForward
+
+Parses demo messages without waiting on the clock until the server time
+reaches target
+====================
+*/
+static void CL_DemoFastForward (double target)
+{
+	while (cls.demoplayback && cls.signon == SIGNONS && cl.mtime[0] < target)
+	{
+	// let a stuffed command (a reconnect for the next map) run first,
+	// the same as CL_GetMessage does
+		if (stufftext_frame == host_framecount)
+			break;
+
+		CL_DemoSnapshot ();
+		if (!CL_ReadDemoMessage ())
+			break;
+		CL_ParseServerMessage ();
+	}
+
+	if (!cls.demoplayback)
+		return;
+
+// don't play back the burst of sounds that were started on the way
+	S_StopDynamicSounds ();
+	cl.time = cl.oldtime = cl.mtime[0];
+}
+
+/*
+====================
+CL_DemoSeek_f
+
+demoseek <time>			jump to a server time on the current map
+demoseek +<seconds>		skip forward
+demoseek -<seconds>		rewind
+====================
+*/
+void CL_DemoSeek_f (void)
+{
+	char	*s;
+	double	target;
+	int		i;
+
+	if (cmd_source != src_command)
+		return;
+
+	if (Cmd_Argc() != 2)
+	{
+		Con_Printf ("demoseek <time> | +<seconds> | -<seconds>\n");
+		return;
+	}
+
+	if (!cls.demoplayback || cls.timedemo || cls.signon != SIGNONS)
+	{
+		Con_Printf ("Not playing a demo.\n");
+		return;
+	}
+
+	s = Cmd_Argv(1);
+	if (s[0] == '+')
+		target = cl.mtime[0] + Q_atof(s + 1);
+	else if (s[0] == '-')
+		target = cl.mtime[0] - Q_atof(s + 1);
+	else
+		target = Q_atof(s);
+
+// find the last snapshot at or before the target
+	for (i=demo_numsnaps-1 ; i>=0 ; i--)
+		if (demo_snaps[i].cl.mtime[0] <= target)
+			break;
+
+	if (target < cl.mtime[0])
+	{
+		if (!demo_numsnaps)
+		{
+			Con_Printf ("Can't rewind, no snapshots taken yet.\n");
+			return;
+		}
+		if (i < 0)
+			i = 0;		// nothing before the first snapshot on this map
+		CL_RestoreDemoSnapshot (&demo_snaps[i]);
+	}
+	else if (i >= 0 && demo_snaps[i].position > cls.demobufferposition)
+		CL_RestoreDemoSnapshot (&demo_snaps[i]);	// skip ground already indexed
+
+	CL_DemoFastForward (target);
+}
+
+/*
+==============================================================================
+
+TIMEDEMO STATISTICS
+
+Each timed frame records how long the frame stages took, so a run can
+report percentiles rather than just the average.  With a stats file the
+numbers are also written out as json for tracking regressions.
+==============================================================================
+*/
+
+static char *td_stagenames[NUM_FRAMESTAGES] =
+{
+	"total",
+	"server",
+	"clientparse",
+	"rsetup",
+	"world",
+	"entities",
+	"particles",
+	"render",
+	"sound"
+};
+
+static float	*td_frametimes;		// [td_numframes][NUM_FRAMESTAGES] milliseconds
+static int		td_numframes;
+static int		td_maxframes;
+static char		td_statsfile[MAX_OSPATH];
+static char		td_demoname[MAX_QPATH];
+
+/*
+====================
+CL_TimeDemoFrame
+
+Called at the end of every host frame while a timedemo is running
+====================
+*/
+void CL_TimeDemoFrame (void)
+{
+	float	*f;
+	int		i;
+
+// the first frame holds the loading time
+	if (!cls.timedemo || host_framecount <= cls.td_startframe)
+		return;
+
+	if (td_numframes == td_maxframes)
+	{
+		f = realloc (td_frametimes, (td_maxframes + 4096) * NUM_FRAMESTAGES * sizeof(float));
+		if (!f)
+			return;
+		td_frametimes = f;
+		td_maxframes += 4096;
+	}
+
+	f = td_frametimes + td_numframes * NUM_FRAMESTAGES;
+	for (i=0 ; i<NUM_FRAMESTAGES ; i++)
+		f[i] = host_stagetime[i] * 1000;
+	td_numframes++;
+}
+
+static int CL_CompareFloats (const void *a, const void *b)
+{
+	float	fa, fb;
+
+	fa = *(const float *)a;
+	fb = *(const float *)b;
+
+	if (fa < fb)
+		return -1;
+	if (fa > fb)
+		return 1;
+	return 0;
+}
+
+// nearest-rank percentile of a sorted list
+static float CL_Percentile (float *sorted, int count, float percent)
+{
+	int		i;
+
+	i = (int)ceil (percent / 100 * count) - 1;
+	if (i < 0)
+		i = 0;
+	if (i >= count)
+		i = count - 1;
+
+	return sorted[i];
+}
+
+/*
+====================
+CL_WriteTimeDemoStats
+
+Returns false if the statistics asked for couldn't be produced
+====================
+*/
+static qboolean CL_WriteTimeDemoStats (int frames, float time)
+{
+	float	*sorted, sum;
+	char	name[MAX_OSPATH];
+	FILE	*f;
+	int		i, j;
+
+	if (!td_numframes)
+	{
+		Con_Printf ("No frames were timed.\n");
+		return false;
+	}
+
+	sorted = malloc (td_numframes * sizeof(float));
+	if (!sorted)
+		return false;
+
+	f = NULL;
+	if (td_statsfile[0])
+	{
+		sprintf (name, "%s/%s", com_gamedir, td_statsfile);
+		f = fopen (name, "w");
+		if (!f)
+		{
+			Con_Printf ("ERROR: couldn't open %s.\n", name);
+			free (sorted);
+			return false;
+		}
+	}
+
+	if (f)
+	{
+		fprintf (f, "{\n");
+		fprintf (f, "\t\"demo\": \"%s\",\n", td_demoname);
+		fprintf (f, "\t\"frames\": %i,\n", frames);
+		fprintf (f, "\t\"seconds\": %.3f,\n", time);
+		fprintf (f, "\t\"fps\": %.2f,\n", frames / time);
+		fprintf (f, "\t\"stages_ms\": {\n");
+	}
+
+	for (j=0 ; j<NUM_FRAMESTAGES ; j++)
+	{
+		sum = 0;
+		for (i=0 ; i<td_numframes ; i++)
+		{
+			sorted[i] = td_frametimes[i * NUM_FRAMESTAGES + j];
+			sum += sorted[i];
+		}
+		qsort (sorted, td_numframes, sizeof(float), CL_CompareFloats);
+
+		if (j == fs_total)
+			Con_Printf ("frame ms: p50 %.2f  p95 %.2f  p99 %.2f  max %.2f\n",
+				CL_Percentile (sorted, td_numframes, 50), CL_Percentile (sorted, td_numframes, 95),
+				CL_Percentile (sorted, td_numframes, 99), sorted[td_numframes-1]);
+
+		if (f)
+			fprintf (f, "\t\t\"%s\": { \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }%s\n",
+				td_stagenames[j], sum / td_numframes,
+				CL_Percentile (sorted, td_numframes, 50), CL_Percentile (sorted, td_numframes, 95),
+				CL_Percentile (sorted, td_numframes, 99), sorted[td_numframes-1],
+				(j < NUM_FRAMESTAGES - 1) ? "," : "");
+	}
+
+	if (f)
+	{
+		fprintf (f, "\t}\n}\n");
+		fclose (f);
+		Con_Printf ("Wrote %s\n", name);
+	}
+
+	free (sorted);
+	return true;
+}
+
+/*
+====================
+CL_BenchmarkDone
+
+Ends a -benchmark run, so an unattended one never waits on anybody
+====================
+*/
+void CL_BenchmarkDone (qboolean ok)
+{
+	if (!COM_CheckParm ("-benchmark"))
+		return;
+
+	// ahead of anything else queued, a Host_Error may have queued a success
+	Cbuf_InsertText (ok ? "quit 0\n" : "quit 1\n");
+}
+
 /*
 ====================
 CL_FinishTimeDemo
@@ -553,8 +1377,10 @@ void CL_FinishTimeDemo (void)
 {
 	int		frames;
 	float	time;
+	qboolean	ok;
 	
 	cls.timedemo = false;
+	host_stagetiming = false;
 	
 // the first frame didn't count
 	frames = (host_framecount - cls.td_startframe) - 1;
@@ -562,13 +1388,22 @@ void CL_FinishTimeDemo (void)
 	if (!time)
 		time = 1;
 	Con_Printf ("%i frames %5.1f seconds %5.1f fps\n", frames, time, frames/time);
+
+	ok = CL_WriteTimeDemoStats (frames, time);
+
+	free (td_frametimes);
+	td_frametimes = NULL;
+	td_numframes = td_maxframes = 0;
+
+// a -benchmark run is done now
+	CL_BenchmarkDone (ok);
 }
 
 /*
 ====================
 CL_TimeDemo_f
 
-timedemo [demoname]
+timedemo [demoname] [statsfile]
 ====================
 */
 void CL_TimeDemo_f (void)
@@ -576,13 +1411,26 @@ void CL_TimeDemo_f (void)
 	if (cmd_source != src_command)
 		return;
 
-	if (Cmd_Argc() != 2)
+	if (Cmd_Argc() != 2 && Cmd_Argc() != 3)
 	{
-		Con_Printf ("timedemo <demoname> : gets demo speeds\n");
+		Con_Printf ("timedemo <demoname> [statsfile] : gets demo speeds\n");
+		CL_BenchmarkDone (false);
 		return;
 	}
 
-	CL_PlayDemo_f ();
+	if (Cmd_Argc() == 3 && strstr(Cmd_Argv(2), ".."))
+	{
+		Con_Printf ("Relative pathnames are not allowed.\n");
+		CL_BenchmarkDone (false);
+		return;
+	}
+
+	CL_PlayDemo (Cmd_Argv(1));
+	if (!cls.demoplayback)
+	{
+		CL_BenchmarkDone (false);
+		return;
+	}
 	
 // cls.td_starttime will be grabbed at the second frame of the demo, so
 // all the loading time doesn't get counted
@@ -590,6 +1438,18 @@ void CL_TimeDemo_f (void)
 	cls.timedemo = true;
 	cls.td_startframe = host_framecount;
 
+	Q_strncpy (td_demoname, Cmd_Argv(1), sizeof(td_demoname) - 1);
+	td_demoname[sizeof(td_demoname) - 1] = 0;
+	td_statsfile[0] = 0;
+	if (Cmd_Argc() == 3)
+	{
+		Q_strncpy (td_statsfile, Cmd_Argv(2), sizeof(td_statsfile) - 1);
+		td_statsfile[sizeof(td_statsfile) - 1] = 0;
+	}
+
+	td_numframes = 0;
+	host_stagetiming = true;
+
 	// jkrige - moved to CL_PlayDemo_f()
 	//cls.td_lastframe = -1;		// get a new message this frame
 	// jkrige - moved to CL_PlayDemo_f()
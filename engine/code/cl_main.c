@@ -83,6 +83,9 @@ void CL_ClearState (void)
 	memset (cl_temp_entities, 0, sizeof(cl_temp_entities));
 	memset (cl_beams, 0, sizeof(cl_beams));
 
+// demo snapshots point at the old map's models
+	CL_ClearDemoSnapshots ();
+
 //
 // allocate the efrags and chain together into a free list
 //
@@ -669,7 +672,13 @@ int CL_ReadFromServer (void)
 	int		ret;
 
 	cl.oldtime = cl.time;
-	cl.time += host_frametime;
+	if (cls.demoplayback && !cls.timedemo)
+	{
+		if (cl_demospeed.value > 0)
+			cl.time += host_frametime * cl_demospeed.value;
+	}
+	else
+		cl.time += host_frametime;
 	
 	do
 	{
@@ -769,6 +778,10 @@ void CL_Init (void)
 	Cvar_RegisterVariable (&cl_anglespeedkey);
 	Cvar_RegisterVariable (&cl_shownet);
 	Cvar_RegisterVariable (&cl_nolerp);
+	Cvar_RegisterVariable (&cl_demopacked);
+	Cvar_RegisterVariable (&cl_demoblocktime);
+	Cvar_RegisterVariable (&cl_demosnapshot);
+	Cvar_RegisterVariable (&cl_demospeed);
 
 	// jkrige - configurable fps caps
 	Cvar_RegisterVariable (&cl_maxfps);
@@ -794,5 +807,6 @@ void CL_Init (void)
 	Cmd_AddCommand ("stop", CL_Stop_f);
 	Cmd_AddCommand ("playdemo", CL_PlayDemo_f);
 	Cmd_AddCommand ("timedemo", CL_TimeDemo_f);
+	Cmd_AddCommand ("demoseek", CL_DemoSeek_f);
 }
 
@@ -215,6 +215,7 @@ void CL_ParseServerInfo (void)
 	char	*str;
 	int		i;
 	int		nummodels, numsounds;
+	int		oldbudget;
 	char	model_precache[MAX_MODELS][MAX_QPATH];
 	char	sound_precache[MAX_SOUNDS][MAX_QPATH];
 	
@@ -239,7 +240,9 @@ void CL_ParseServerInfo (void)
 		Con_Printf("Bad maxclients (%u) from server\n", cl.maxclients);
 		return;
 	}
+	oldbudget = Hunk_SetBudget (hb_client);
 	cl.scores = Hunk_AllocName (cl.maxclients*sizeof(*cl.scores), "scores");
+	Hunk_SetBudget (oldbudget);
 
 // parse gametype
 	cl.gametype = MSG_ReadByte ();
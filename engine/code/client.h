@@ -72,7 +72,7 @@ typedef struct
 
 // jkrige - increase dlights
 //#define	MAX_DLIGHTS		32
-#define	MAX_DLIGHTS		64
+#define	MAX_DLIGHTS		256		// no more, the renderer keeps light numbers in bytes
 // jkrige - increase dlights
 
 
@@ -296,6 +296,11 @@ extern	cvar_t	cl_autofire;
 extern	cvar_t	cl_shownet;
 extern	cvar_t	cl_nolerp;
 
+extern	cvar_t	cl_demopacked;
+extern	cvar_t	cl_demoblocktime;
+extern	cvar_t	cl_demosnapshot;
+extern	cvar_t	cl_demospeed;
+
 // jkrige - configurable fps caps
 extern	cvar_t	cl_maxfps;
 // jkrige - configurable fps caps
@@ -388,11 +393,16 @@ char *Key_KeynumToString (int keynum);
 //
 void CL_StopPlayback (void);
 int CL_GetMessage (void);
+void CL_CloseDemoFile (void);
+void CL_ClearDemoSnapshots (void);
 
 void CL_Stop_f (void);
 void CL_Record_f (void);
 void CL_PlayDemo_f (void);
 void CL_TimeDemo_f (void);
+void CL_DemoSeek_f (void);
+void CL_TimeDemoFrame (void);
+void CL_BenchmarkDone (qboolean ok);
 
 //
 // cl_parse.c
@@ -76,6 +76,28 @@ void Cbuf_Init (void)
 }
 
 
+// text from the server thread, held until the main thread waits for it
+static sizebuf_t	cmd_deferred;
+
+/*
+============
+Cbuf_FlushDeferred
+
+Adds the text the server thread added while it ran
+============
+*/
+void Cbuf_FlushDeferred (void)
+{
+	if (!cmd_deferred.cursize)
+		return;
+
+	if (cmd_text.cursize + cmd_deferred.cursize >= cmd_text.maxsize)
+		Con_Printf ("Cbuf_AddText: overflow\n");
+	else
+		SZ_Write (&cmd_text, cmd_deferred.data, cmd_deferred.cursize);
+	cmd_deferred.cursize = 0;
+}
+
 /*
 ============
 Cbuf_AddText
@@ -89,6 +111,12 @@ void Cbuf_AddText (char *text)
 	
 	l = Q_strlen (text);
 
+	if (Host_OnServerThread ())
+	{
+		SZ_GrowWrite (&cmd_deferred, text, l);
+		return;
+	}
+
 	if (cmd_text.cursize + l >= cmd_text.maxsize)
 	{
 		Con_Printf ("Cbuf_AddText: overflow\n");
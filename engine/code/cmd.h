@@ -42,6 +42,9 @@ void Cbuf_AddText (char *text);
 // as new commands are generated from the console or keybindings,
 // the text is added to the end of the command buffer.
 
+void Cbuf_FlushDeferred (void);
+// adds the text held from the pipelined server thread
+
 void Cbuf_InsertText (char *text);
 // when a command wants to issue other commands immediately, the text is
 // inserted at the beginning of the buffer, before any remaining unexecuted
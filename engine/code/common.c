@@ -28,6 +28,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // jkrige - scale2d
 
 
+#ifdef _MSC_VER
+#define THREADLOCAL	__declspec(thread)
+#else
+#define THREADLOCAL	__thread
+#endif
+
 #define NUM_SAFE_ARGVS  7
 
 static char     *largv[MAX_NUM_ARGVS + NUM_SAFE_ARGVS + 1];
@@ -825,6 +831,37 @@ void SZ_Write (sizebuf_t *buf, void *data, int length)
 	Q_memcpy (SZ_GetSpace(buf,length),data,length);         
 }
 
+/*
+==============
+SZ_GrowWrite
+
+Appends to a buffer that grows with realloc instead of overflowing.  The
+buffer starts zeroed; it holds what the server thread leaves for the main
+thread, which is why it can't come from the zone or the hunk.
+==============
+*/
+void SZ_GrowWrite (sizebuf_t *buf, void *data, int length)
+{
+	int		newsize;
+	byte	*newdata;
+
+	if (buf->cursize + length > buf->maxsize)
+	{
+		newsize = buf->maxsize ? buf->maxsize : 4096;
+		while (newsize < buf->cursize + length)
+			newsize *= 2;
+
+		newdata = realloc (buf->data, newsize);
+		if (!newdata)
+			Sys_Error ("SZ_GrowWrite: couldn't grow to %i bytes", newsize);
+		buf->data = newdata;
+		buf->maxsize = newsize;
+	}
+
+	Q_memcpy (buf->data + buf->cursize, data, length);
+	buf->cursize += length;
+}
+
 void SZ_Print (sizebuf_t *buf, char *data)
 {
 	int             len;
@@ -1218,7 +1255,7 @@ FIXME: make this buffer size safe someday
 char    *va(char *format, ...)
 {
 	va_list         argptr;
-	static char             string[1024];
+	static THREADLOCAL char	string[1024];	// the pipelined server frame uses it too
 	
 	va_start (argptr, format);
 	vsprintf (string, format,argptr);
@@ -1278,6 +1315,9 @@ typedef struct pack_s
 	int             handle;
 	int             numfiles;
 	packfile_t      *files;
+
+	byte	*mapped;		// the whole pak, read only, or NULL
+	int		mappedlen;
 } pack_t;
 
 //
@@ -1350,7 +1390,8 @@ void COM_Path_f (void)
 	{
 		if (s->pack)
 		{
-			Con_Printf ("%s (%i files)\n", s->pack->filename, s->pack->numfiles);
+			Con_Printf ("%s (%i files%s)\n", s->pack->filename, s->pack->numfiles,
+				s->pack->mapped ? ", mapped" : "");
 		}
 		else
 			Con_Printf ("%s\n", s->filename);
@@ -1388,7 +1429,7 @@ void COM_WriteFile (char *filename, void *data, int len)
 ============
 COM_CreatePath
 
-Only used for CopyFile
+Creates the directories leading up to a file
 ============
 */
 void    COM_CreatePath (char *path)
@@ -1407,6 +1448,29 @@ void    COM_CreatePath (char *path)
 }
 
 
+/*
+============
+COM_BlockHash
+
+32 bit FNV-1a, for telling whether a file changed
+============
+*/
+unsigned COM_BlockHash (byte *data, int length)
+{
+	unsigned	hash;
+	int			i;
+
+	hash = 2166136261u;
+	for (i=0 ; i<length ; i++)
+	{
+		hash ^= data[i];
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+
 /*
 ===========
 COM_CopyFile
@@ -1848,6 +1912,65 @@ byte *COM_LoadStackFile (char *path, void *buffer, int bufsize)
 	return buf;
 }
 
+/*
+============
+COM_MapFile
+
+Returns the file straight out of a mapped .pak, without a copy.  The data
+is read only and is not 0 terminated, com_filesize has the length.
+Returns NULL if the file isn't in a mapped .pak, or a loose file or pk3
+comes first in the path; load it the usual way then.
+============
+*/
+byte *COM_MapFile (char *path)
+{
+	searchpath_t    *search;
+	char            netpath[MAX_OSPATH];
+	pack_t          *pak;
+	packfile_t      *file;
+	int             i;
+
+	search = com_searchpaths;
+	if (proghack)
+	{	// same hack as COM_FindFile
+		if (!strcmp(path, "progs.dat"))
+			search = search->next;
+	}
+
+	for ( ; search ; search = search->next)
+	{
+		if (search->pack)
+		{
+			pak = search->pack;
+			for (i=0, file=pak->files ; i<pak->numfiles ; i++, file++)
+			{
+				if (strcmp (file->name, path))
+					continue;
+
+				if (!pak->mapped || file->filepos < 0 || file->filelen < 0
+				|| file->filepos + file->filelen > pak->mappedlen)
+					return NULL;
+				com_filesize = file->filelen;
+				return pak->mapped + file->filepos;
+			}
+		}
+		else
+		{
+			if (!static_registered)
+			{
+				if ( strchr (path, '/') || strchr (path,'\\'))
+					continue;
+			}
+
+			sprintf (netpath, "%s/%s", search->filename, path);
+			if (Sys_FileTime (netpath) != -1)
+				return NULL;	// a loose file overrides the paks after it
+		}
+	}
+
+	return NULL;
+}
+
 /*
 =================
 COM_LoadPackFile
@@ -1920,6 +2043,10 @@ pack_t *COM_LoadPackFile (char *packfile)
 	pack->handle = packhandle;
 	pack->numfiles = numpackfiles;
 	pack->files = newfiles;
+
+// loaders that only read can take files straight out of the mapping
+	if (!COM_CheckParm ("-nomappak"))
+		pack->mapped = Sys_MapFile (packfile, &pack->mappedlen);
 	
 	Con_Printf ("Added packfile %s (%i files)\n", packfile, numpackfiles);
 	return pack;
@@ -45,6 +45,7 @@ void SZ_Free (sizebuf_t *buf);
 void SZ_Clear (sizebuf_t *buf);
 void *SZ_GetSpace (sizebuf_t *buf, int length);
 void SZ_Write (sizebuf_t *buf, void *data, int length);
+void SZ_GrowWrite (sizebuf_t *buf, void *data, int length);	// realloced, for the server thread
 void SZ_Print (sizebuf_t *buf, char *data);	// strcats onto the sizebuf
 
 //============================================================================
@@ -175,6 +176,8 @@ struct cache_user_s;
 extern	char	com_gamedir[MAX_OSPATH];
 
 void COM_WriteFile (char *filename, void *data, int len);
+void COM_CreatePath (char *path);
+unsigned COM_BlockHash (byte *data, int length);
 int COM_OpenFile (char *filename, int *hndl);
 int COM_FOpenFile (char *filename, FILE **file);
 void COM_CloseFile (int h);
@@ -188,6 +191,7 @@ byte *COM_FReadFile (FILE *file, int len);
 
 
 byte *COM_LoadStackFile (char *path, void *buffer, int bufsize);
+byte *COM_MapFile (char *path);		// read only, NULL if not in a mapped pak
 byte *COM_LoadTempFile (char *path);
 byte *COM_LoadHunkFile (char *path);
 void COM_LoadCacheFile (char *path, struct cache_user_s *cu);
@@ -423,6 +423,42 @@ Handles cursor positioning, line wrapping, etc
 */
 #define	MAXPRINTMSG	4096
 // FIXME: make a buffer size safe vsprintf?
+
+// prints from the server thread, held until the main thread waits for it
+static sizebuf_t	con_deferred;
+
+static void Con_Defer (char *msg)
+{
+	SZ_GrowWrite (&con_deferred, msg, strlen (msg));
+}
+
+/*
+================
+Con_FlushDeferred
+
+Prints what the server thread said while it ran
+================
+*/
+void Con_FlushDeferred (void)
+{
+	char	msg[MAXPRINTMSG];
+	char	*s;
+	int		len, left;
+
+	s = (char *)con_deferred.data;
+	left = con_deferred.cursize;
+	con_deferred.cursize = 0;
+	while (left > 0)
+	{
+		len = left < MAXPRINTMSG - 1 ? left : MAXPRINTMSG - 1;
+		memcpy (msg, s, len);
+		msg[len] = 0;
+		s += len;
+		left -= len;
+
+		Con_Printf ("%s", msg);
+	}
+}
 void Con_Printf (char *fmt, ...)
 {
 	va_list		argptr;
@@ -432,6 +468,13 @@ void Con_Printf (char *fmt, ...)
 	va_start (argptr,fmt);
 	vsprintf (msg,fmt,argptr);
 	va_end (argptr);
+
+// the server thread can't touch the console or the screen
+	if (Host_OnServerThread ())
+	{
+		Con_Defer (msg);
+		return;
+	}
 	
 // also echo to debugging console
 	Sys_Printf ("%s", msg);	// also echo to debugging console
@@ -503,6 +546,12 @@ void Con_SafePrintf (char *fmt, ...)
 	vsprintf (msg,fmt,argptr);
 	va_end (argptr);
 
+	if (Host_OnServerThread ())
+	{
+		Con_Defer (msg);
+		return;
+	}
+
 	temp = scr_disabled_for_loading;
 	scr_disabled_for_loading = true;
 	Con_Printf ("%s", msg);
@@ -146,6 +146,16 @@ char *Cvar_CompleteVariable (char *partial)
 }
 
 
+// sets from the server thread, name and value pairs held until the main
+// thread waits for it; the server sees its own set a frame late
+static sizebuf_t	cvar_deferred;
+
+static void Cvar_Defer (char *var_name, char *value)
+{
+	SZ_GrowWrite (&cvar_deferred, var_name, strlen (var_name) + 1);
+	SZ_GrowWrite (&cvar_deferred, value, strlen (value) + 1);
+}
+
 /*
 ============
 Cvar_Set
@@ -163,6 +173,13 @@ void Cvar_Set (char *var_name, char *value)
 		return;
 	}
 
+// the main thread reads the string the zone would free under it
+	if (Host_OnServerThread ())
+	{
+		Cvar_Defer (var_name, value);
+		return;
+	}
+
 	changed = Q_strcmp(var->string, value);
 	
 	Z_Free (var->string);	// free the old value string
@@ -185,6 +202,28 @@ void Cvar_Set (char *var_name, char *value)
 	// jkrige - deathmatch/coop not at the same time fix
 }
 
+/*
+============
+Cvar_FlushDeferred
+
+Makes the sets the server thread did while it ran
+============
+*/
+void Cvar_FlushDeferred (void)
+{
+	char	*s, *end, *value;
+
+	s = (char *)cvar_deferred.data;
+	end = s + cvar_deferred.cursize;
+	cvar_deferred.cursize = 0;
+	while (s < end)
+	{
+		value = s + strlen (s) + 1;
+		Cvar_Set (s, value);
+		s = value + strlen (value) + 1;
+	}
+}
+
 /*
 ============
 Cvar_SetValue
@@ -73,6 +73,9 @@ void 	Cvar_Set (char *var_name, char *value);
 void	Cvar_SetValue (char *var_name, float value);
 // expands value to a string and calls Cvar_Set
 
+void	Cvar_FlushDeferred (void);
+// makes the sets held from the pipelined server thread
+
 float	Cvar_VariableValue (char *var_name);
 // returns 0 if not defined or non numeric
 
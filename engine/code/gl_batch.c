@@ -0,0 +1,203 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// gl_batch.c -- textured quads gathered into as few draws as possible
+
+#include "quakedef.h"
+
+// The 2D drawing and the sprites add their quads here instead of drawing
+// them one at a time.  Quads with the same texture and blending are kept
+// together and drawn with one call once something different is wanted,
+// the batch is full, or GL_FlushBatch is called before other drawing or a
+// matrix change.
+//
+// A batch is copied into a streaming vertex buffer used as a ring, through
+// an unsynchronized map of the space after the last batch, so the card can
+// still be reading the earlier ones.  When the ring is full it is orphaned
+// and filled again from the front.
+
+#define	MAX_BATCH_QUADS		1024
+#define	BATCH_RING_BATCHES	8		// full batches the ring holds
+
+cvar_t	gl_batch = {"gl_batch", "1"};
+
+int		c_batch_quads, c_batch_draws;
+
+static batchvert_t	batchverts[MAX_BATCH_QUADS*4];
+static int			numbatchverts;
+static int			batchtexture, batchflags;
+
+static GLuint		batchvbo;
+static int			batchringsize, batchringofs;
+
+/*
+================
+GL_InitBatch
+================
+*/
+void GL_InitBatch (void)
+{
+	Cvar_RegisterVariable (&gl_batch);
+
+	numbatchverts = 0;
+	if (!GLEW_VERSION_3_0 && !GLEW_ARB_map_buffer_range)
+		return;		// drawn from client memory
+
+	batchringsize = BATCH_RING_BATCHES * sizeof(batchverts);
+	batchringofs = 0;
+
+	glGenBuffers (1, &batchvbo);
+	GL_BindBuffer (GL_ARRAY_BUFFER, batchvbo);
+	glBufferData (GL_ARRAY_BUFFER, batchringsize, NULL, GL_STREAM_DRAW);
+	GL_BindBuffer (GL_ARRAY_BUFFER, 0);
+}
+
+/*
+================
+GL_BatchQuad
+
+Returns the four vertices of a new quad for the caller to fill in,
+counter-clockwise from the top left on screen.  texnum is ignored with
+BATCH_NOTEXTURE.
+================
+*/
+batchvert_t *GL_BatchQuad (int texnum, int flags)
+{
+	batchvert_t	*v;
+
+	if (flags & BATCH_NOTEXTURE)
+		texnum = 0;
+
+	if (numbatchverts && (texnum != batchtexture || flags != batchflags
+		|| numbatchverts == MAX_BATCH_QUADS*4 || !gl_batch.value))
+		GL_FlushBatch ();
+
+	batchtexture = texnum;
+	batchflags = flags;
+
+	v = &batchverts[numbatchverts];
+	numbatchverts += 4;
+	c_batch_quads++;
+
+	return v;
+}
+
+/*
+================
+GL_BatchUpload
+
+Copies the batch into the ring, and returns false if it has to be drawn
+from client memory instead
+================
+*/
+static qboolean GL_BatchUpload (int *offset)
+{
+	int		size;
+	void	*dest;
+
+	size = numbatchverts * sizeof(batchvert_t);
+
+	GL_BindBuffer (GL_ARRAY_BUFFER, batchvbo);
+	if (batchringofs + size > batchringsize)
+	{
+		// the card keeps the old storage until it's done with it
+		glBufferData (GL_ARRAY_BUFFER, batchringsize, NULL, GL_STREAM_DRAW);
+		batchringofs = 0;
+	}
+
+	dest = glMapBufferRange (GL_ARRAY_BUFFER, batchringofs, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (!dest)
+	{
+		GL_BindBuffer (GL_ARRAY_BUFFER, 0);
+		return false;
+	}
+
+	memcpy (dest, batchverts, size);
+	glUnmapBuffer (GL_ARRAY_BUFFER);
+
+	*offset = batchringofs;
+	batchringofs += size;
+	return true;
+}
+
+/*
+================
+GL_FlushBatch
+
+Draws everything batched so far, and leaves the state the way the 2D code
+and sprites expect it
+================
+*/
+void GL_FlushBatch (void)
+{
+	batchvert_t	*base;
+	int			offset;
+	qboolean	buffered;
+
+	if (!numbatchverts)
+		return;
+
+	if (batchflags & BATCH_NOTEXTURE)
+		GL_Disable (GL_TEXTURE_2D);
+	else
+		GL_Bind (batchtexture);
+
+	if (batchflags & BATCH_BLEND)
+	{
+		GL_Disable (GL_ALPHA_TEST);
+		GL_Enable (GL_BLEND);
+	}
+
+	buffered = batchvbo && GL_BatchUpload (&offset);
+	base = buffered ? (batchvert_t *)(size_t)offset : batchverts;
+
+	glEnableClientState (GL_VERTEX_ARRAY);
+	glEnableClientState (GL_COLOR_ARRAY);
+	glVertexPointer (3, GL_FLOAT, sizeof(batchvert_t), base->xyz);
+	glColorPointer (4, GL_UNSIGNED_BYTE, sizeof(batchvert_t), base->color);
+	if (!(batchflags & BATCH_NOTEXTURE))
+	{
+		glEnableClientState (GL_TEXTURE_COORD_ARRAY);
+		glTexCoordPointer (2, GL_FLOAT, sizeof(batchvert_t), base->st);
+	}
+
+	glDrawArrays (GL_QUADS, 0, numbatchverts);
+
+	glDisableClientState (GL_VERTEX_ARRAY);
+	glDisableClientState (GL_COLOR_ARRAY);
+	glDisableClientState (GL_TEXTURE_COORD_ARRAY);
+	if (buffered)
+		GL_BindBuffer (GL_ARRAY_BUFFER, 0);
+
+	// the color array leaves the current color undefined
+	glColor4f (1, 1, 1, 1);
+
+	if (batchflags & BATCH_NOTEXTURE)
+		GL_Enable (GL_TEXTURE_2D);
+
+	if (batchflags & BATCH_BLEND)
+	{
+		GL_Disable (GL_BLEND);
+		GL_Enable (GL_ALPHA_TEST);
+	}
+
+	c_batch_draws++;
+	numbatchverts = 0;
+}
@@ -54,7 +54,7 @@ void blur(PHsurface *sources, PHsurface *dests, int count, float offset, Directi
 
 
 	// set up the filter
-    glUseProgram(filterProg);
+    GL_UseProgram(filterProg);
     loc = glGetUniformLocation(filterProg, "source");
     glUniform1i(loc, 0);
     loc = glGetUniformLocation(filterProg, "coefficients");
@@ -174,10 +174,10 @@ void R_Bloom_Process(void)
 
 
 	// pass filter into pass0[0]
-    glUseProgram(passProg);
+    GL_UseProgram(passProg);
     loc = glGetUniformLocation(passProg, "source");
     glUniform1i(loc, 0);
-    glEnable(GL_TEXTURE_2D);
+    GL_Enable(GL_TEXTURE_2D);
 	GL_Bind(scenebase.texture);
     phBindSurface(pass0, false);
 	glBegin(GL_QUADS);
@@ -186,11 +186,11 @@ void R_Bloom_Process(void)
 	glTexCoord2i(1, 1); glVertex2i(1, 1);
     glTexCoord2i(1, 0); glVertex2i(1, -1);
     glEnd();
-    glUseProgram(0);
+    GL_UseProgram(0);
 
 
 	// downsample the scene into the source surfaces
-	glEnable(GL_TEXTURE_2D);
+	GL_Enable(GL_TEXTURE_2D);
 	GL_Bind(pass0[0].texture);
 
 	for (p = 1; p < BLOOM_FILTER_COUNT; p++)
@@ -213,13 +213,13 @@ void R_Bloom_Process(void)
     blur(pass1, pass0, BLOOM_FILTER_COUNT, 1.0f, VERTICAL);
 
 
-	glUseProgram(combineProg);
+	GL_UseProgram(combineProg);
     for (p = 0; p < BLOOM_FILTER_COUNT; p++)
     {
         char name[] = "Pass#";
 
-        glActiveTexture(GL_TEXTURE0 + p);
-		glEnable(GL_TEXTURE_2D);
+        GL_ActiveTexture(GL_TEXTURE0 + p);
+		GL_Enable(GL_TEXTURE_2D);
 		GL_Bind(pass0[p].texture);
 
         sprintf(name, "Pass%d", p);
@@ -229,14 +229,14 @@ void R_Bloom_Process(void)
 
 
 	// combine original scene
-	glActiveTexture(GL_TEXTURE0 + BLOOM_FILTER_COUNT);
+	GL_ActiveTexture(GL_TEXTURE0 + BLOOM_FILTER_COUNT);
 
 	if(cl.worldmodel && r_viewleaf->contents <= CONTENTS_WATER)
 		GL_Bind(scenepass0.texture);
 	else
 		GL_Bind(scenebase.texture);
 
-	glEnable(GL_TEXTURE_2D);
+	GL_Enable(GL_TEXTURE_2D);
     loc = glGetUniformLocation(combineProg, "Scene");
     glUniform1i(loc, BLOOM_FILTER_COUNT);
 }
@@ -254,10 +254,10 @@ void R_Bloom_Clear(void)
 
 	for (p = 0; p < BLOOM_FILTER_COUNT; p++)
     {
-        glActiveTexture(GL_TEXTURE0 + p);
-        glDisable(GL_TEXTURE_2D);
+        GL_ActiveTexture(GL_TEXTURE0 + p);
+        GL_Disable(GL_TEXTURE_2D);
     }
 
-    glActiveTexture(GL_TEXTURE0 + BLOOM_FILTER_COUNT);
-    glDisable(GL_TEXTURE_2D);
+    GL_ActiveTexture(GL_TEXTURE0 + BLOOM_FILTER_COUNT);
+    GL_Disable(GL_TEXTURE_2D);
 }
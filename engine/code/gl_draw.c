@@ -108,9 +108,13 @@ void GL_Bind (int texnum)
 {
 	if (gl_nobind.value)
 		texnum = char_texture;
-	if (currenttexture == texnum)
+	if (currenttexture == texnum && gl_statecache.value)
+	{
+		c_gl_bindsdropped++;
 		return;
+	}
 	currenttexture = texnum;
+	c_gl_binds++;
 
 // jkrige - opengl's bind function
 //#ifdef _WIN32
@@ -143,7 +147,7 @@ byte		scrap_texels[MAX_SCRAPS][BLOCK_WIDTH*BLOCK_HEIGHT*4];
 qboolean	scrap_dirty;
 int			scrap_texnum;
 
-// returns a texture number and the position inside it
+// returns a texture number and the position inside it, or -1
 int Scrap_AllocBlock (int w, int h, int *x, int *y)
 {
 	int		i, j;
@@ -182,7 +186,7 @@ int Scrap_AllocBlock (int w, int h, int *x, int *y)
 		return texnum;
 	}
 
-	Sys_Error ("Scrap_AllocBlock: full");
+	return -1;	// full, the caller gives the pic its own texture
 }
 
 int	scrap_uploads;
@@ -225,6 +229,41 @@ byte		menuplyr_pixels[4096];
 int		pic_texels;
 int		pic_count;
 
+/*
+================
+Draw_ScrapPic
+
+Puts the pixels of a little pic into the scrap, so it is drawn from the same
+texture as the others.  Returns false when there's no room.
+================
+*/
+qboolean Draw_ScrapPic (qpic_t *p, glpic_t *gl)
+{
+	int		x, y;
+	int		i, j, k;
+	int		texnum;
+
+	texnum = Scrap_AllocBlock (p->width, p->height, &x, &y);
+	if (texnum == -1)
+		return false;
+
+	scrap_dirty = true;
+	k = 0;
+	for (i=0 ; i<p->height ; i++)
+		for (j=0 ; j<p->width ; j++, k++)
+			scrap_texels[texnum][(y+i)*BLOCK_WIDTH + x + j] = p->data[k];
+	texnum += scrap_texnum;
+	gl->texnum = texnum;
+	gl->sl = (x+0.01)/(float)BLOCK_WIDTH;
+	gl->sh = (x+p->width-0.01)/(float)BLOCK_WIDTH;
+	gl->tl = (y+0.01)/(float)BLOCK_WIDTH;
+	gl->th = (y+p->height-0.01)/(float)BLOCK_WIDTH;
+
+	pic_count++;
+	pic_texels += p->width*p->height;
+	return true;
+}
+
 qpic_t *Draw_PicFromWad (char *name)
 {
 	qpic_t	*p;
@@ -234,36 +273,14 @@ qpic_t *Draw_PicFromWad (char *name)
 	gl = (glpic_t *)p->data;
 
 	// load little ones into the scrap
-	if (p->width < 64 && p->height < 64)
-	{
-		int		x, y;
-		int		i, j, k;
-		int		texnum;
-
-		texnum = Scrap_AllocBlock (p->width, p->height, &x, &y);
-		scrap_dirty = true;
-		k = 0;
-		for (i=0 ; i<p->height ; i++)
-			for (j=0 ; j<p->width ; j++, k++)
-				scrap_texels[texnum][(y+i)*BLOCK_WIDTH + x + j] = p->data[k];
-		texnum += scrap_texnum;
-		gl->texnum = texnum;
-		gl->sl = (x+0.01)/(float)BLOCK_WIDTH;
-		gl->sh = (x+p->width-0.01)/(float)BLOCK_WIDTH;
-		gl->tl = (y+0.01)/(float)BLOCK_WIDTH;
-		gl->th = (y+p->height-0.01)/(float)BLOCK_WIDTH;
-
-		pic_count++;
-		pic_texels += p->width*p->height;
-	}
-	else
-	{
-		gl->texnum = GL_LoadPicTexture (p);
-		gl->sl = 0;
-		gl->sh = 1;
-		gl->tl = 0;
-		gl->th = 1;
-	}
+	if (p->width < 64 && p->height < 64 && Draw_ScrapPic (p, gl))
+		return p;
+
+	gl->texnum = GL_LoadPicTexture (p);
+	gl->sl = 0;
+	gl->sh = 1;
+	gl->tl = 0;
+	gl->th = 1;
 
 	return p;
 }
@@ -308,6 +325,12 @@ qpic_t	*Draw_CachePic (char *path)
 	pic->pic.height = dat->height;
 
 	gl = (glpic_t *)pic->pic.data;
+
+	// the menu pics go in the scrap too while there's room, so a
+	// menu is drawn from one texture
+	if (dat->width < 128 && dat->height < 128 && Draw_ScrapPic (dat, gl))
+		return &pic->pic;
+
 	gl->texnum = GL_LoadPicTexture (dat);
 	gl->sl = 0;
 	gl->sh = 1;
@@ -713,10 +736,41 @@ void Draw_Init (void)
 	//
 	draw_disc = Draw_PicFromWad ("disc");
 	draw_backtile = Draw_PicFromWad ("backtile");
+
+	GL_InitBatch ();
 }
 
 
 
+static byte	draw_white[4] = {255, 255, 255, 255};
+
+/*
+================
+Draw_BatchRect
+
+Adds a screen rectangle to the 2D batch
+================
+*/
+static void Draw_BatchRect (int texnum, int flags, float x, float y, float w, float h,
+	float sl, float tl, float sh, float th, byte *color)
+{
+	batchvert_t	*v;
+	int			i;
+
+	v = GL_BatchQuad (texnum, flags);
+
+	v[0].xyz[0] = x;	v[0].xyz[1] = y;	v[0].st[0] = sl;	v[0].st[1] = tl;
+	v[1].xyz[0] = x+w;	v[1].xyz[1] = y;	v[1].st[0] = sh;	v[1].st[1] = tl;
+	v[2].xyz[0] = x+w;	v[2].xyz[1] = y+h;	v[2].st[0] = sh;	v[2].st[1] = th;
+	v[3].xyz[0] = x;	v[3].xyz[1] = y+h;	v[3].st[0] = sl;	v[3].st[1] = th;
+
+	for (i=0 ; i<4 ; i++)
+	{
+		v[i].xyz[2] = 0;
+		memcpy (v[i].color, color, 4);
+	}
+}
+
 /*
 ================
 Draw_Character
@@ -750,18 +804,7 @@ void Draw_Character (int x, int y, int num)
 	fcol = col*0.0625;
 	size = 0.0625;
 
-	GL_Bind (char_texture);
-
-	glBegin (GL_QUADS);
-	glTexCoord2f (fcol, frow);
-	glVertex2f (x, y);
-	glTexCoord2f (fcol + size, frow);
-	glVertex2f (x+8, y);
-	glTexCoord2f (fcol + size, frow + size);
-	glVertex2f (x+8, y+8);
-	glTexCoord2f (fcol, frow + size);
-	glVertex2f (x, y+8);
-	glEnd ();
+	Draw_BatchRect (char_texture, 0, x, y, 8, 8, fcol, frow, fcol + size, frow + size, draw_white);
 }
 
 /*
@@ -803,29 +846,16 @@ void Draw_AlphaPic (int x, int y, qpic_t *pic, float alpha)
 	unsigned short	*pusdest;
 	int				v, u;
 	glpic_t			*gl;
+	byte			color[4];
 
 	if (scrap_dirty)
 		Scrap_Upload ();
 	gl = (glpic_t *)pic->data;
-	glDisable(GL_ALPHA_TEST);
-	glEnable (GL_BLEND);
 //	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 //	glCullFace(GL_FRONT);
-	glColor4f (1,1,1,alpha);
-	GL_Bind (gl->texnum);
-	glBegin (GL_QUADS);
-	glTexCoord2f (gl->sl, gl->tl);
-	glVertex2f (x, y);
-	glTexCoord2f (gl->sh, gl->tl);
-	glVertex2f (x+pic->width, y);
-	glTexCoord2f (gl->sh, gl->th);
-	glVertex2f (x+pic->width, y+pic->height);
-	glTexCoord2f (gl->sl, gl->th);
-	glVertex2f (x, y+pic->height);
-	glEnd ();
-	glColor4f (1,1,1,1);
-	glEnable(GL_ALPHA_TEST);
-	glDisable (GL_BLEND);
+	color[0] = color[1] = color[2] = 255;
+	color[3] = (byte)(bound (0, alpha, 1) * 255);
+	Draw_BatchRect (gl->texnum, BATCH_BLEND, x, y, pic->width, pic->height, gl->sl, gl->tl, gl->sh, gl->th, color);
 }
 
 
@@ -844,18 +874,7 @@ void Draw_Pic (int x, int y, qpic_t *pic)
 	if (scrap_dirty)
 		Scrap_Upload ();
 	gl = (glpic_t *)pic->data;
-	glColor4f (1,1,1,1);
-	GL_Bind (gl->texnum);
-	glBegin (GL_QUADS);
-	glTexCoord2f (gl->sl, gl->tl);
-	glVertex2f (x, y);
-	glTexCoord2f (gl->sh, gl->tl);
-	glVertex2f (x+pic->width, y);
-	glTexCoord2f (gl->sh, gl->th);
-	glVertex2f (x+pic->width, y+pic->height);
-	glTexCoord2f (gl->sl, gl->th);
-	glVertex2f (x, y+pic->height);
-	glEnd ();
+	Draw_BatchRect (gl->texnum, 0, x, y, pic->width, pic->height, gl->sl, gl->tl, gl->sh, gl->th, draw_white);
 }
 
 
@@ -893,6 +912,7 @@ void Draw_TransPicTranslate (int x, int y, qpic_t *pic, byte *translation)
 	byte			*src;
 	int				p;
 
+	GL_FlushBatch ();	// a quad still waiting may use the old translation
 	GL_Bind (translate_texture);
 
 	c = pic->width * pic->height;
@@ -918,17 +938,7 @@ void Draw_TransPicTranslate (int x, int y, qpic_t *pic, byte *translation)
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	// jkrige - use "point sampled" texture mode
 
-	glColor3f (1,1,1);
-	glBegin (GL_QUADS);
-	glTexCoord2f (0, 0);
-	glVertex2f (x, y);
-	glTexCoord2f (1, 0);
-	glVertex2f (x+pic->width, y);
-	glTexCoord2f (1, 1);
-	glVertex2f (x+pic->width, y+pic->height);
-	glTexCoord2f (0, 1);
-	glVertex2f (x, y+pic->height);
-	glEnd ();
+	Draw_BatchRect (translate_texture, 0, x, y, pic->width, pic->height, 0, 0, 1, 1, draw_white);
 }
 
 // jkrige - print version info to the console
@@ -990,18 +1000,7 @@ refresh window.
 */
 void Draw_TileClear (int x, int y, int w, int h)
 {
-	glColor3f (1,1,1);
-	GL_Bind (*(int *)draw_backtile->data);
-	glBegin (GL_QUADS);
-	glTexCoord2f (x/64.0, y/64.0);
-	glVertex2f (x, y);
-	glTexCoord2f ( (x+w)/64.0, y/64.0);
-	glVertex2f (x+w, y);
-	glTexCoord2f ( (x+w)/64.0, (y+h)/64.0);
-	glVertex2f (x+w, y+h);
-	glTexCoord2f ( x/64.0, (y+h)/64.0 );
-	glVertex2f (x, y+h);
-	glEnd ();
+	Draw_BatchRect (*(int *)draw_backtile->data, 0, x, y, w, h, x/64.0, y/64.0, (x+w)/64.0, (y+h)/64.0, draw_white);
 }
 
 
@@ -1014,21 +1013,13 @@ Fills a box of pixels with a single color
 */
 void Draw_Fill (int x, int y, int w, int h, int c)
 {
-	glDisable (GL_TEXTURE_2D);
-	glColor3f (host_basepal[c*3]/255.0,
-		host_basepal[c*3+1]/255.0,
-		host_basepal[c*3+2]/255.0);
-
-	glBegin (GL_QUADS);
-
-	glVertex2f (x,y);
-	glVertex2f (x+w, y);
-	glVertex2f (x+w, y+h);
-	glVertex2f (x, y+h);
+	byte	color[4];
 
-	glEnd ();
-	glColor3f (1,1,1);
-	glEnable (GL_TEXTURE_2D);
+	color[0] = host_basepal[c*3];
+	color[1] = host_basepal[c*3+1];
+	color[2] = host_basepal[c*3+2];
+	color[3] = 255;
+	Draw_BatchRect (0, BATCH_NOTEXTURE, x, y, w, h, 0, 0, 0, 0, color);
 }
 //=============================================================================
 
@@ -1040,20 +1031,9 @@ Draw_FadeScreen
 */
 void Draw_FadeScreen (void)
 {
-	glEnable (GL_BLEND);
-	glDisable (GL_TEXTURE_2D);
-	glColor4f (0, 0, 0, 0.8);
-	glBegin (GL_QUADS);
+	static byte	color[4] = {0, 0, 0, 204};
 
-	glVertex2f (0,0);
-	glVertex2f (vid.width, 0);
-	glVertex2f (vid.width, vid.height);
-	glVertex2f (0, vid.height);
-
-	glEnd ();
-	glColor4f (1,1,1,1);
-	glEnable (GL_TEXTURE_2D);
-	glDisable (GL_BLEND);
+	Draw_BatchRect (0, BATCH_BLEND|BATCH_NOTEXTURE, 0, 0, vid.width, vid.height, 0, 0, 0, 0, color);
 
 	//Sbar_Changed(); // jkrige - always draw sbar
 }
@@ -1072,8 +1052,10 @@ void Draw_BeginDisc (void)
 {
 	if (!draw_disc)
 		return;
+	GL_FlushBatch ();
 	glDrawBuffer  (GL_FRONT);
 	Draw_Pic (vid.width - 24, 0, draw_disc);
+	GL_FlushBatch ();
 	glDrawBuffer  (GL_BACK);
 }
 
@@ -1099,6 +1081,8 @@ Setup as if the screen was 320*200
 */
 void GL_Set2D (void)
 {
+	GL_FlushBatch ();
+
 	glViewport (glx, gly, glwidth, glheight);
 
 	glMatrixMode(GL_PROJECTION);
@@ -1108,10 +1092,10 @@ void GL_Set2D (void)
 	glMatrixMode(GL_MODELVIEW);
     glLoadIdentity ();
 
-	glDisable (GL_DEPTH_TEST);
-	glDisable (GL_CULL_FACE);
-	glDisable (GL_BLEND);
-	glEnable (GL_ALPHA_TEST);
+	GL_Disable (GL_DEPTH_TEST);
+	GL_Disable (GL_CULL_FACE);
+	GL_Disable (GL_BLEND);
+	GL_Enable (GL_ALPHA_TEST);
 //	glDisable (GL_ALPHA_TEST);
 
 	glColor4f (1,1,1,1);
@@ -2061,7 +2045,7 @@ int GL_LoadTexture (char *identifier, char *textype, int width, int height, byte
 		// jkrige - fullbright pixels
 
 
-		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+		GL_TexEnvMode (GL_MODULATE);
 	}
 
 	return glt->texnum;
@@ -228,8 +228,8 @@ void R_FrameBuffer_Process(void)
     GLint		loc;
 
 	glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-	glEnable(GL_TEXTURE_2D);
+	GL_TexEnvMode (GL_REPLACE);
+	GL_Enable(GL_TEXTURE_2D);
 
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -246,10 +246,10 @@ void R_FrameBuffer_Process(void)
 
 
 	// pass filter into scenepass0
-    glUseProgram(passProg);
+    GL_UseProgram(passProg);
     loc = glGetUniformLocation(passProg, "source");
     glUniform1i(loc, 0);
-    glEnable(GL_TEXTURE_2D);
+    GL_Enable(GL_TEXTURE_2D);
 	GL_Bind(scenebase.texture);
     phBindSurface(&scenepass0, false);
 	glBegin(GL_QUADS);
@@ -258,7 +258,7 @@ void R_FrameBuffer_Process(void)
 	glTexCoord2i(1, 1); glVertex2i(1, 1);
     glTexCoord2i(1, 0); glVertex2i(1, -1);
     glEnd();
-    glUseProgram(0);
+    GL_UseProgram(0);
 
 
 	if(r_viewleaf->contents <= CONTENTS_WATER)
@@ -270,19 +270,19 @@ void R_FrameBuffer_Process(void)
 		blur(&scenepass1, &scenepass0, 1, 1.5f, VERTICAL);
 	}
 
-	glUseProgram(0);
+	GL_UseProgram(0);
 
 	
 	if (gl_bloom.value == 0.0f)
 	{
-		glActiveTexture(GL_TEXTURE0);
+		GL_ActiveTexture(GL_TEXTURE0);
 
 		if(r_viewleaf->contents <= CONTENTS_WATER)
 			GL_Bind(scenepass0.texture);
 		else
 			GL_Bind(scenebase.texture);
 
-		glEnable(GL_TEXTURE_2D);
+		GL_Enable(GL_TEXTURE_2D);
 	}
 }
 
@@ -314,15 +314,15 @@ void R_FrameBuffer_End(void)
     glEnd();
 
 
-	glUseProgram(0);
+	GL_UseProgram(0);
 
 	R_Bloom_Clear();
 	
 	// back to normal window-system-provided framebuffer (unbind)
     glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
 
-    glActiveTexture(GL_TEXTURE0);
-	glEnable(GL_TEXTURE_2D);
+    GL_ActiveTexture(GL_TEXTURE0);
+	GL_Enable(GL_TEXTURE_2D);
 
 	//we probably need to delete the framebuffers somewhere using the glDeleteFramebuffersEXT function
 }
@@ -0,0 +1,394 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// gl_lightgrid.c -- light sampled from the lightmaps on a grid
+
+#include "quakedef.h"
+
+// R_LightPoint traces down the bsp to the floor under the point and reads
+// its lightmap.  When a map comes in, that is done once for every point of
+// a grid over the open parts of the world, keeping each light style apart
+// so the styles can still animate, along with the direction most of the
+// light comes from.  Lookups are then a blend of the eight points around.
+//
+// The grid is in blocks of 8*8*8 points and blocks that are all solid are
+// left out.
+
+#define	LIGHTGRID_XY		32		// spacing of the points
+#define	LIGHTGRID_Z			64		// the floor is what's sampled, so less up and down
+
+#define	LIGHTBLOCK_SHIFT	3
+#define	LIGHTBLOCK_SIZE		(1<<LIGHTBLOCK_SHIFT)
+#define	LIGHTBLOCK_CELLS	(LIGHTBLOCK_SIZE*LIGHTBLOCK_SIZE*LIGHTBLOCK_SIZE)
+
+#define	LIGHTDIR_RANGE		1024	// how far to look for light coming from each side
+
+#define	LIGHTCELL_SOLID		1
+
+typedef struct
+{
+	byte		styles[MAXLIGHTMAPS];	// 255 after the last one
+	byte		rgb[MAXLIGHTMAPS][3];	// the floor below, each style at full
+	signed char	dir[3];					// light comes from here, scaled to 127
+	byte		flags;
+} lightcell_t;
+
+typedef struct lightgrid_s
+{
+	vec3_t		origin;					// the first point
+	int			size[3];				// in points
+	int			blocks[3];				// in blocks
+	int			*blockcells;			// first cell of each block, -1 if solid
+	lightcell_t	*cells;
+	int			numblocks;				// that aren't solid
+} lightgrid_t;
+
+cvar_t	r_lightgrid = {"r_lightgrid", "1", true};
+
+static vec3_t	lightgrid_spacing = {LIGHTGRID_XY, LIGHTGRID_XY, LIGHTGRID_Z};
+
+/*
+=============
+R_LightGridPoint
+
+Where point x, y, z of the grid is
+=============
+*/
+static void R_LightGridPoint (lightgrid_t *grid, int x, int y, int z, vec3_t p)
+{
+	p[0] = grid->origin[0] + x * lightgrid_spacing[0];
+	p[1] = grid->origin[1] + y * lightgrid_spacing[1];
+	p[2] = grid->origin[2] + z * lightgrid_spacing[2];
+}
+
+/*
+=============
+R_LightGridOpen
+
+True if a point is in the open, where something could want light
+=============
+*/
+static qboolean R_LightGridOpen (vec3_t p)
+{
+	int		contents;
+
+	contents = Mod_PointInLeaf (p, cl.worldmodel)->contents;
+	return contents != CONTENTS_SOLID && contents != CONTENTS_SKY;
+}
+
+/*
+=============
+R_LightGridCheckBlock
+
+Job that marks the blocks with any open point in them
+=============
+*/
+static void R_LightGridCheckBlock (void *parm, int index)
+{
+	lightgrid_t	*grid;
+	int			bx, by, bz, x, y, z;
+	vec3_t		p;
+
+	grid = parm;
+	bx = index % grid->blocks[0];
+	by = (index / grid->blocks[0]) % grid->blocks[1];
+	bz = index / (grid->blocks[0] * grid->blocks[1]);
+
+	grid->blockcells[index] = -1;
+	for (z=bz<<LIGHTBLOCK_SHIFT ; z<(bz+1)<<LIGHTBLOCK_SHIFT && z<grid->size[2] ; z++)
+		for (y=by<<LIGHTBLOCK_SHIFT ; y<(by+1)<<LIGHTBLOCK_SHIFT && y<grid->size[1] ; y++)
+			for (x=bx<<LIGHTBLOCK_SHIFT ; x<(bx+1)<<LIGHTBLOCK_SHIFT && x<grid->size[0] ; x++)
+			{
+				R_LightGridPoint (grid, x, y, z, p);
+				if (R_LightGridOpen (p))
+				{
+					grid->blockcells[index] = 0;
+					return;
+				}
+			}
+}
+
+/*
+=============
+R_LightGridBrightness
+
+How much light reaches p along the line to end, all styles at normal
+=============
+*/
+static int R_LightGridBrightness (vec3_t p, vec3_t end)
+{
+	msurface_t	*surf;
+	byte		styles[MAXLIGHTMAPS];
+	int			rgb[MAXLIGHTMAPS][3];
+	int			i, maps, ds, dt, total;
+
+	surf = RecursiveLightTrace (cl.worldmodel->nodes, p, end, &ds, &dt);
+	if (!surf)
+		return 0;
+
+	total = 0;
+	maps = R_SampleLightStyles (surf, ds, dt, styles, rgb);
+	for (i=0 ; i<maps ; i++)
+		total += rgb[i][0] + rgb[i][1] + rgb[i][2];
+	return total;
+}
+
+/*
+=============
+R_LightGridBakeCell
+=============
+*/
+static void R_LightGridBakeCell (lightcell_t *cell, vec3_t p)
+{
+	msurface_t	*surf;
+	int			rgb[MAXLIGHTMAPS][3];
+	int			i, j, maps, ds, dt;
+	float		light, length;
+	vec3_t		end, dir;
+
+	memset (cell->styles, 255, sizeof(cell->styles));
+	memset (cell->rgb, 0, sizeof(cell->rgb));
+
+	if (!R_LightGridOpen (p))
+	{
+		cell->flags = LIGHTCELL_SOLID;
+		return;
+	}
+	cell->flags = 0;
+
+// what R_LightPoint would see, style by style
+	VectorCopy (p, end);
+	end[2] -= 2048;
+	surf = RecursiveLightTrace (cl.worldmodel->nodes, p, end, &ds, &dt);
+	if (surf)
+	{
+		maps = R_SampleLightStyles (surf, ds, dt, cell->styles, rgb);
+		for (i=0 ; i<maps ; i++)
+			for (j=0 ; j<3 ; j++)
+				cell->rgb[i][j] = bound (0, rgb[i][j], 255);
+	}
+
+// a brighter wall on one side means the lights are over that way, and
+// light on the floor or the ceiling is light from above
+	VectorClear (dir);
+	for (i=0 ; i<3 ; i++)
+	{
+		VectorCopy (p, end);
+		end[i] += LIGHTDIR_RANGE;
+		light = R_LightGridBrightness (p, end);
+		dir[i] += light;
+
+		VectorCopy (p, end);
+		end[i] -= LIGHTDIR_RANGE;
+		light = R_LightGridBrightness (p, end);
+		dir[i] += i == 2 ? light : -light;
+	}
+	dir[2] *= 0.5;
+
+	length = VectorNormalize (dir);
+	if (length < 1)
+	{
+		VectorClear (dir);
+		dir[2] = 1;		// nothing to go by, from above like it always was
+	}
+
+	cell->dir[0] = (signed char)(dir[0] * 127);
+	cell->dir[1] = (signed char)(dir[1] * 127);
+	cell->dir[2] = (signed char)(dir[2] * 127);
+}
+
+/*
+=============
+R_LightGridBakeBlock
+
+Job for one block
+=============
+*/
+static void R_LightGridBakeBlock (void *parm, int index)
+{
+	lightgrid_t	*grid;
+	lightcell_t	*cell;
+	int			bx, by, bz, x, y, z;
+	vec3_t		p;
+
+	grid = parm;
+	if (grid->blockcells[index] < 0)
+		return;		// all solid
+	bx = index % grid->blocks[0];
+	by = (index / grid->blocks[0]) % grid->blocks[1];
+	bz = index / (grid->blocks[0] * grid->blocks[1]);
+
+	cell = grid->cells + grid->blockcells[index];
+	for (z=0 ; z<LIGHTBLOCK_SIZE ; z++)
+		for (y=0 ; y<LIGHTBLOCK_SIZE ; y++)
+			for (x=0 ; x<LIGHTBLOCK_SIZE ; x++, cell++)
+			{
+				R_LightGridPoint (grid, (bx<<LIGHTBLOCK_SHIFT) + x, (by<<LIGHTBLOCK_SHIFT) + y, (bz<<LIGHTBLOCK_SHIFT) + z, p);
+				R_LightGridBakeCell (cell, p);
+			}
+}
+
+/*
+=============
+R_BuildLightGrid
+
+Called by R_NewMap once the world is in
+=============
+*/
+void R_BuildLightGrid (void)
+{
+	lightgrid_t	*grid;
+	model_t		*world;
+	int			i, numblocks;
+	double		start;
+
+	world = cl.worldmodel;
+	world->lightgrid = NULL;
+	if (!r_lightgrid.value || !world->lightdata)
+		return;
+
+	start = Sys_PreciseTime ();
+
+	grid = Hunk_AllocName (sizeof(*grid), "lightgrid");
+	for (i=0 ; i<3 ; i++)
+	{
+		grid->origin[i] = floor (world->mins[i] / lightgrid_spacing[i]) * lightgrid_spacing[i];
+		grid->size[i] = (int)ceil ((world->maxs[i] - grid->origin[i]) / lightgrid_spacing[i]) + 1;
+		grid->blocks[i] = (grid->size[i] + LIGHTBLOCK_SIZE - 1) >> LIGHTBLOCK_SHIFT;
+	}
+	numblocks = grid->blocks[0] * grid->blocks[1] * grid->blocks[2];
+	grid->blockcells = Hunk_AllocName (numblocks * sizeof(int), "lightgrid");
+
+	Job_Run (R_LightGridCheckBlock, grid, numblocks);
+
+	grid->numblocks = 0;
+	for (i=0 ; i<numblocks ; i++)
+	{
+		if (grid->blockcells[i] < 0)
+			continue;
+		grid->blockcells[i] = grid->numblocks * LIGHTBLOCK_CELLS;
+		grid->numblocks++;
+	}
+	grid->cells = Hunk_AllocName (grid->numblocks * LIGHTBLOCK_CELLS * sizeof(lightcell_t), "lightgrid");
+
+	Job_Run (R_LightGridBakeBlock, grid, numblocks);
+
+	world->lightgrid = grid;
+
+	Con_DPrintf ("light grid: %i of %i blocks, %iK, %.0f ms\n", grid->numblocks, numblocks,
+		(int)(grid->numblocks * LIGHTBLOCK_CELLS * sizeof(lightcell_t) + numblocks * sizeof(int)) / 1024,
+		(Sys_PreciseTime () - start) * 1000);
+}
+
+/*
+=============
+R_LightGridCell
+
+The cell at point x, y, z, or NULL off the grid or in a solid block
+=============
+*/
+static lightcell_t *R_LightGridCell (lightgrid_t *grid, int x, int y, int z)
+{
+	int		block;
+
+	if (x < 0 || y < 0 || z < 0 || x >= grid->size[0] || y >= grid->size[1] || z >= grid->size[2])
+		return NULL;
+
+	block = ((z >> LIGHTBLOCK_SHIFT) * grid->blocks[1] + (y >> LIGHTBLOCK_SHIFT)) * grid->blocks[0] + (x >> LIGHTBLOCK_SHIFT);
+	if (grid->blockcells[block] < 0)
+		return NULL;
+
+	x &= LIGHTBLOCK_SIZE-1;
+	y &= LIGHTBLOCK_SIZE-1;
+	z &= LIGHTBLOCK_SIZE-1;
+	return grid->cells + grid->blockcells[block] + (z * LIGHTBLOCK_SIZE + y) * LIGHTBLOCK_SIZE + x;
+}
+
+/*
+=============
+R_LightGridSample
+
+Blends the open points around p with the light styles as they are now.
+color is what R_LightPoint gives, dir (if not NULL) the way to the light.
+False if there is no grid or no open point near, for the exact trace.
+Safe to call from jobs.
+=============
+*/
+qboolean R_LightGridSample (vec3_t p, vec3_t color, vec3_t dir)
+{
+	lightgrid_t	*grid;
+	lightcell_t	*cell;
+	int			i, j, corner, base[3];
+	float		frac[3], w, total, scale;
+	vec3_t		c;
+
+	grid = cl.worldmodel->lightgrid;
+	if (!grid || !r_lightgrid.value)
+		return false;
+
+	for (i=0 ; i<3 ; i++)
+	{
+		frac[i] = (p[i] - grid->origin[i]) / lightgrid_spacing[i];
+		base[i] = (int)floor (frac[i]);
+		frac[i] -= base[i];
+	}
+
+	VectorClear (color);
+	if (dir)
+		VectorClear (dir);
+	total = 0;
+	for (corner=0 ; corner<8 ; corner++)
+	{
+		cell = R_LightGridCell (grid, base[0] + (corner&1), base[1] + ((corner>>1)&1), base[2] + (corner>>2));
+		if (!cell || (cell->flags & LIGHTCELL_SOLID))
+			continue;
+
+		w = ((corner&1) ? frac[0] : 1 - frac[0])
+			* (((corner>>1)&1) ? frac[1] : 1 - frac[1])
+			* ((corner>>2) ? frac[2] : 1 - frac[2]);
+		if (w <= 0)
+			continue;
+
+		VectorClear (c);
+		for (i=0 ; i<MAXLIGHTMAPS && cell->styles[i] != 255 ; i++)
+		{
+			scale = d_lightstylevalue[cell->styles[i]] * (1.0f / 256.0f);
+			for (j=0 ; j<3 ; j++)
+				c[j] += cell->rgb[i][j] * scale;
+		}
+		VectorMA (color, w, c, color);
+
+		if (dir)
+		{
+			dir[0] += cell->dir[0] * w;
+			dir[1] += cell->dir[1] * w;
+			dir[2] += cell->dir[2] * w;
+		}
+		total += w;
+	}
+
+	if (total < 0.001)
+		return false;
+
+	VectorScale (color, 1 / total, color);
+	if (dir && VectorNormalize (dir) == 0)
+		dir[2] = 1;
+
+	return true;
+}
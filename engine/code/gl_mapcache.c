@@ -0,0 +1,326 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// gl_mapcache.c -- derived world data saved beside the map
+
+#include "quakedef.h"
+
+// Once the world has been set up for drawing, what is slow to derive from
+// the bsp goes to maps/<name>.mcache: surface extents and flags, where each
+// surface sits in the lightmaps, and the warp and display list polys.  The
+// next load of the same map reads it back instead of subdividing warps,
+// packing lightmaps and building display lists.
+//
+// The file holds no pointers, the polys of a surface are just the next
+// records in the poly lump, so it doesn't care where it is loaded.  It is
+// in native byte order.  The key is a hash of the .bsp and of the .lit, so
+// changing either one, or gl_coloredlight, makes it rebuild.
+
+#define	MAPCACHE_IDENT		(('C'<<24)+('M'<<16)+('Q'<<8)+'I')	// little-endian "IQMC"
+#define	MAPCACHE_VERSION	2
+
+typedef struct
+{
+	int			ident;
+	int			version;
+
+	unsigned	bsphash, lithash;
+	int			bsplen, litlen;
+
+	int			numsurfaces;
+	int			surfofs;			// mapcachesurf_t [numsurfaces]
+	int			allocofs, allocsize;	// lightmap block usage after the world
+	int			numpolys;
+	int			polyofs, polylen;	// mapcachepoly_t + verts, in surface order
+} mapcacheheader_t;
+
+typedef struct
+{
+	short		texturemins[2];
+	short		extents[2];
+	int			flags;
+	int			light_s, light_t;
+	int			lightmaptexturenum;
+	int			numpolys;
+} mapcachesurf_t;
+
+typedef struct
+{
+	int			numverts;
+	int			flags;
+	// followed by numverts * VERTEXSIZE floats
+} mapcachepoly_t;
+
+// a glpoly_t with numverts, kept pointer aligned when packed together
+#define	POLYSIZE(numverts)	(((int)sizeof(glpoly_t) + ((numverts)-4) * VERTEXSIZE*(int)sizeof(float) + 7) & ~7)
+
+#define	MAX_CACHEPOLYVERTS	1024
+
+cvar_t	gl_mapcache = {"gl_mapcache", "1", true};
+
+extern char	loadname[];
+
+/*
+=================
+Mod_MapCacheName
+=================
+*/
+static void Mod_MapCacheName (model_t *mod, char *name)
+{
+	strcpy (name, mod->name);
+	COM_StripExtension (name, name);
+	strcat (name, ".mcache");
+}
+
+/*
+=================
+Mod_MapCacheLumpOk
+=================
+*/
+static qboolean Mod_MapCacheLumpOk (int ofs, int len, int filelen)
+{
+	if (ofs < (int)sizeof(mapcacheheader_t) || (ofs & 3) || len < 0)
+		return false;
+	return ofs <= filelen - len;
+}
+
+/*
+=================
+Mod_LoadMapCache
+
+Fills in the surfaces of loadmodel from the map cache, false if there is no
+cache for this exact bsp and lit
+=================
+*/
+qboolean Mod_LoadMapCache (model_t *mod)
+{
+	char				name[MAX_QPATH];
+	byte				*buf, *p, *end;
+	mapcacheheader_t	*header;
+	mapcachesurf_t		*in;
+	mapcachepoly_t		*cp;
+	msurface_t			*out, check;
+	glpoly_t			*poly, **link;
+	byte				*polymem;
+	int					i, j, length, memsize, numpolys;
+
+	if (!gl_mapcache.value)
+		return false;
+
+	Mod_MapCacheName (mod, name);
+	buf = COM_LoadTempFile (name);
+	if (!buf)
+		return false;
+	length = com_filesize;
+
+	header = (mapcacheheader_t *)buf;
+	if (length < (int)sizeof(*header)
+		|| header->ident != MAPCACHE_IDENT || header->version != MAPCACHE_VERSION
+		|| header->bsphash != mod->bsphash || header->bsplen != mod->bsplen
+		|| header->lithash != mod->lithash || header->litlen != mod->litlen
+		|| header->numsurfaces != mod->numsurfaces || header->numpolys < 0
+		|| !Mod_MapCacheLumpOk (header->surfofs, header->numsurfaces * sizeof(mapcachesurf_t), length)
+		|| !Mod_MapCacheLumpOk (header->allocofs, header->allocsize, length)
+		|| !Mod_MapCacheLumpOk (header->polyofs, header->polylen, length))
+	{
+		Con_DPrintf ("%s is out of date\n", name);
+		return false;
+	}
+
+// size the polys, checking every record stays inside the lump
+	p = buf + header->polyofs;
+	end = p + header->polylen;
+	memsize = 0;
+	for (i=0 ; i<header->numpolys ; i++)
+	{
+		if (end - p < (int)sizeof(mapcachepoly_t))
+			break;
+		cp = (mapcachepoly_t *)p;
+		if (cp->numverts < 1 || cp->numverts > MAX_CACHEPOLYVERTS)
+			break;
+		p += sizeof(mapcachepoly_t) + cp->numverts * VERTEXSIZE*sizeof(float);
+		if (p > end)
+			break;
+		memsize += POLYSIZE(cp->numverts);
+	}
+	numpolys = i;
+
+	j = 0;
+	in = (mapcachesurf_t *)(buf + header->surfofs);
+	for (i=0 ; i<header->numsurfaces ; i++)
+	{
+		if (in[i].numpolys < 0)
+			break;
+		j += in[i].numpolys;
+	}
+	if (numpolys != header->numpolys || p != end || i != header->numsurfaces || j != numpolys)
+	{
+		Con_Printf ("%s is damaged\n", name);
+		return false;
+	}
+
+// the key says the surfaces are the bsp's, but their lightmaps must still
+// land inside the blocks
+	for (i=0, out=mod->surfaces ; i<header->numsurfaces ; i++, out++)
+	{
+		if (in[i].flags & ~(SURF_PLANEBACK|SURF_DRAWSKY|SURF_DRAWTURB|SURF_DRAWTILED))
+			break;
+		if ((in[i].flags ^ out->flags) & SURF_PLANEBACK)
+			break;
+
+		check = *out;
+		check.extents[0] = in[i].extents[0];
+		check.extents[1] = in[i].extents[1];
+		check.flags = in[i].flags;
+		check.light_s = in[i].light_s;
+		check.light_t = in[i].light_t;
+		check.lightmaptexturenum = in[i].lightmaptexturenum;
+		if (!GL_LightmapPlaceOk (&check))
+			break;
+	}
+	if (i != header->numsurfaces)
+	{
+		Con_Printf ("%s is damaged\n", name);
+		return false;
+	}
+
+// one block for all the polys, and the lightmap usage for GL_BuildLightmaps
+	polymem = Hunk_AllocName (memsize, loadname);
+	mod->mapcachealloc = Hunk_AllocName (header->allocsize, loadname);
+	mod->mapcacheallocsize = header->allocsize;
+	memcpy (mod->mapcachealloc, buf + header->allocofs, header->allocsize);
+
+	p = buf + header->polyofs;
+	for (i=0, out=mod->surfaces ; i<header->numsurfaces ; i++, in++, out++)
+	{
+		out->texturemins[0] = in->texturemins[0];
+		out->texturemins[1] = in->texturemins[1];
+		out->extents[0] = in->extents[0];
+		out->extents[1] = in->extents[1];
+		out->flags = in->flags;
+		out->light_s = in->light_s;
+		out->light_t = in->light_t;
+		out->lightmaptexturenum = in->lightmaptexturenum;
+
+		link = &out->polys;
+		for (j=0 ; j<in->numpolys ; j++)
+		{
+			cp = (mapcachepoly_t *)p;
+			poly = (glpoly_t *)polymem;
+			poly->numverts = cp->numverts;
+			poly->flags = cp->flags;
+			memcpy (poly->verts, cp+1, cp->numverts * VERTEXSIZE*sizeof(float));
+
+			*link = poly;
+			link = &poly->next;
+
+			p += sizeof(mapcachepoly_t) + cp->numverts * VERTEXSIZE*sizeof(float);
+			polymem += POLYSIZE(cp->numverts);
+		}
+		*link = NULL;
+	}
+
+	Con_DPrintf ("Loaded %s\n", name);
+	return true;
+}
+
+/*
+=================
+Mod_WriteMapCache
+
+Called once the world's surfaces have their lightmaps and display lists,
+alloc is the lightmap block usage after packing it
+=================
+*/
+void Mod_WriteMapCache (model_t *mod, int *alloc, int allocsize)
+{
+	char				name[MAX_QPATH], path[MAX_OSPATH];
+	byte				*buf, *p;
+	mapcacheheader_t	*header;
+	mapcachesurf_t		*out;
+	mapcachepoly_t		*cp;
+	msurface_t			*in;
+	glpoly_t			*poly;
+	int					i, length, numpolys, polylen;
+
+	if (!gl_mapcache.value)
+		return;
+
+	numpolys = polylen = 0;
+	for (i=0, in=mod->surfaces ; i<mod->numsurfaces ; i++, in++)
+	{
+		for (poly=in->polys ; poly ; poly=poly->next)
+		{
+			if (poly->numverts > MAX_CACHEPOLYVERTS)
+				return;
+			numpolys++;
+			polylen += sizeof(mapcachepoly_t) + poly->numverts * VERTEXSIZE*sizeof(float);
+		}
+	}
+
+	length = sizeof(mapcacheheader_t) + mod->numsurfaces * sizeof(mapcachesurf_t) + allocsize + polylen;
+	buf = Hunk_TempAlloc (length);
+
+	header = (mapcacheheader_t *)buf;
+	header->ident = MAPCACHE_IDENT;
+	header->version = MAPCACHE_VERSION;
+	header->bsphash = mod->bsphash;
+	header->bsplen = mod->bsplen;
+	header->lithash = mod->lithash;
+	header->litlen = mod->litlen;
+	header->numsurfaces = mod->numsurfaces;
+	header->surfofs = sizeof(mapcacheheader_t);
+	header->allocofs = header->surfofs + mod->numsurfaces * sizeof(mapcachesurf_t);
+	header->allocsize = allocsize;
+	header->numpolys = numpolys;
+	header->polyofs = header->allocofs + allocsize;
+	header->polylen = polylen;
+
+	out = (mapcachesurf_t *)(buf + header->surfofs);
+	p = buf + header->polyofs;
+	for (i=0, in=mod->surfaces ; i<mod->numsurfaces ; i++, in++, out++)
+	{
+		out->texturemins[0] = in->texturemins[0];
+		out->texturemins[1] = in->texturemins[1];
+		out->extents[0] = in->extents[0];
+		out->extents[1] = in->extents[1];
+		out->flags = in->flags & ~SURF_UNDERWATER;	// Mod_LoadLeafs sets it after the cache is read
+		out->light_s = in->light_s;
+		out->light_t = in->light_t;
+		out->lightmaptexturenum = in->lightmaptexturenum;
+		out->numpolys = 0;
+
+		for (poly=in->polys ; poly ; poly=poly->next)
+		{
+			cp = (mapcachepoly_t *)p;
+			cp->numverts = poly->numverts;
+			cp->flags = poly->flags;
+			memcpy (cp+1, poly->verts, poly->numverts * VERTEXSIZE*sizeof(float));
+			p += sizeof(mapcachepoly_t) + poly->numverts * VERTEXSIZE*sizeof(float);
+			out->numpolys++;
+		}
+	}
+
+	memcpy (buf + header->allocofs, alloc, allocsize);
+
+	Mod_MapCacheName (mod, name);
+	sprintf (path, "%s/%s", com_gamedir, name);
+	COM_CreatePath (path);
+	COM_WriteFile (name, buf, length);
+}
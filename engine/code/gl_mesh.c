@@ -282,6 +282,130 @@ void BuildTris (void)
 }
 
 
+extern	float	r_avertexnormals[][3];
+
+static aliasvert_t		aliasverts[8192];
+
+/*
+================
+GL_MakeAliasModelTriangles
+
+Turns the strips and fans of the command list into a triangle list over
+the draw order, and pulls out the s/t of each vertex, for drawing with
+vertex arrays or buffers
+================
+*/
+static int GL_MakeAliasModelTriangles (unsigned short *indexes, float *st)
+{
+	int			k, count, first, numindexes;
+	int			*order;
+	qboolean	fan;
+
+	order = commands;
+	numindexes = 0;
+	first = 0;
+	while ((count = *order++) != 0)
+	{
+		fan = count < 0;
+		if (fan)
+			count = -count;
+
+		for (k=0 ; k<count ; k++)
+		{
+			*st++ = ((float *)order)[0];
+			*st++ = ((float *)order)[1];
+			order += 2;
+
+			if (k < 2)
+				continue;
+
+			// keep the winding of the strip or fan
+			if (fan)
+			{
+				*indexes++ = first;
+				*indexes++ = first + k - 1;
+			}
+			else if (k & 1)
+			{
+				*indexes++ = first + k - 1;
+				*indexes++ = first + k - 2;
+			}
+			else
+			{
+				*indexes++ = first + k - 2;
+				*indexes++ = first + k - 1;
+			}
+			*indexes++ = first + k;
+			numindexes += 3;
+		}
+		first += count;
+	}
+
+	return numindexes;
+}
+
+/*
+================
+GL_MakeAliasModelBuffers
+
+Puts the model in vertex buffers for the alias shader: the s/t of each
+vertex in draw order, then every pose one after the other, and the
+triangle list over them
+================
+*/
+static void GL_MakeAliasModelBuffers (model_t *m, aliashdr_t *hdr)
+{
+	int			i, j, index;
+	trivertx_t	*verts;
+	aliasvert_t	*out;
+
+	m->aliasnumindexes = 0;
+	if (!r_aliasprogram)
+		return;
+
+	if (!m->aliasvbo)
+	{
+		glGenBuffers (1, &m->aliasvbo);
+		glGenBuffers (1, &m->aliasibo);
+	}
+
+	GL_BindBuffer (GL_ELEMENT_ARRAY_BUFFER, m->aliasibo);
+	glBufferData (GL_ELEMENT_ARRAY_BUFFER, hdr->numindexes * sizeof(unsigned short),
+		(byte *)hdr + hdr->indexes, GL_STATIC_DRAW);
+
+	GL_BindBuffer (GL_ARRAY_BUFFER, m->aliasvbo);
+	glBufferData (GL_ARRAY_BUFFER, hdr->poseverts * (2*sizeof(float) + hdr->numposes * sizeof(aliasvert_t)), NULL, GL_STATIC_DRAW);
+	glBufferSubData (GL_ARRAY_BUFFER, 0, hdr->poseverts * 2*sizeof(float), (byte *)hdr + hdr->texcoords);
+
+	// one pose at a time through the conversion buffer
+	verts = (trivertx_t *)((byte *)hdr + hdr->posedata);
+	for (i=0 ; i<hdr->numposes ; i++)
+	{
+		for (j=0, out=aliasverts ; j<hdr->poseverts ; j++, out++, verts++)
+		{
+			index = verts->lightnormalindex;
+			if (index >= NUMVERTEXNORMALS)
+				index = 0;
+
+			out->v[0] = verts->v[0];
+			out->v[1] = verts->v[1];
+			out->v[2] = verts->v[2];
+			out->v[3] = 0;
+			out->normal[0] = (signed char)(r_avertexnormals[index][0] * 127.0f);
+			out->normal[1] = (signed char)(r_avertexnormals[index][1] * 127.0f);
+			out->normal[2] = (signed char)(r_avertexnormals[index][2] * 127.0f);
+			out->normal[3] = 0;
+		}
+		glBufferSubData (GL_ARRAY_BUFFER, hdr->poseverts * (2*sizeof(float) + i * sizeof(aliasvert_t)),
+			hdr->poseverts * sizeof(aliasvert_t), aliasverts);
+	}
+
+	GL_BindBuffer (GL_ARRAY_BUFFER, 0);
+	GL_BindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	m->aliasnumindexes = hdr->numindexes;
+}
+
 /*
 ================
 GL_MakeAliasModelDisplayLists
@@ -293,6 +417,8 @@ void GL_MakeAliasModelDisplayLists (model_t *m, aliashdr_t *hdr)
 	maliasgroup_t	*paliasgroup;
 	int			*cmds;
 	trivertx_t	*verts;
+	unsigned short	*indexes;
+	float		*st;
 	char	cache[MAX_QPATH], fullpath[MAX_OSPATH], *c;
 	FILE	*f;
 	int		len;
@@ -358,5 +484,13 @@ void GL_MakeAliasModelDisplayLists (model_t *m, aliashdr_t *hdr)
 	for (i=0 ; i<paliashdr->numposes ; i++)
 		for (j=0 ; j<numorder ; j++)
 			*verts++ = poseverts[i][vertexorder[j]];
+
+	indexes = Hunk_Alloc (paliashdr->numtris * 3 * sizeof(unsigned short));
+	paliashdr->indexes = (byte *)indexes - (byte *)paliashdr;
+	st = Hunk_Alloc (numorder * 2 * sizeof(float));
+	paliashdr->texcoords = (byte *)st - (byte *)paliashdr;
+	paliashdr->numindexes = GL_MakeAliasModelTriangles (indexes, st);
+
+	GL_MakeAliasModelBuffers (m, paliashdr);
 }
 
@@ -31,6 +31,9 @@ void Mod_LoadSpriteModel (model_t *mod, void *buffer);
 void Mod_LoadBrushModel (model_t *mod, void *buffer);
 void Mod_LoadAliasModel (model_t *mod, void *buffer);
 model_t *Mod_LoadModel (model_t *mod, qboolean crash);
+void Mod_LoadTimes_f (void);
+
+extern cvar_t	gl_mapcache;
 
 byte	mod_novis[MAX_MAP_LEAFS/8];
 
@@ -54,6 +57,9 @@ void Mod_Init (void)
 	// jkrige - quake2 warps
 
 	memset (mod_novis, 0xff, sizeof(mod_novis));
+
+	Cvar_RegisterVariable (&gl_mapcache);
+	Cmd_AddCommand ("mod_loadtimes", Mod_LoadTimes_f);
 }
 
 /*
@@ -112,11 +118,13 @@ mleaf_t *Mod_PointInLeaf (vec3_t p, model_t *model)
 /*
 ===================
 Mod_DecompressVis
+
+Into the caller's buffer, as the render and the pipelined server both
+want a pvs at once
 ===================
 */
-byte *Mod_DecompressVis (byte *in, model_t *model)
+byte *Mod_DecompressVis (byte *in, model_t *model, byte *decompressed)
 {
-	static byte	decompressed[MAX_MAP_LEAFS/8];
 	int		c;
 	byte	*out;
 	int		row;
@@ -158,11 +166,11 @@ byte *Mod_DecompressVis (byte *in, model_t *model)
 	return decompressed;
 }
 
-byte *Mod_LeafPVS (mleaf_t *leaf, model_t *model)
+byte *Mod_LeafPVS (mleaf_t *leaf, model_t *model, byte *buffer)
 {
 	if (leaf == model->leafs)
 		return mod_novis;
-	return Mod_DecompressVis (leaf->compressed_vis, model);
+	return Mod_DecompressVis (leaf->compressed_vis, model, buffer);
 }
 
 /*
@@ -244,6 +252,7 @@ model_t *Mod_LoadModel (model_t *mod, qboolean crash)
 	void	*d;
 	unsigned *buf;
 	byte	stackbuf[1024];		// avoid dirtying the cache heap
+	int		oldbudget;
 
 	if (!mod->needload)
 	{
@@ -266,9 +275,13 @@ model_t *Mod_LoadModel (model_t *mod, qboolean crash)
 	}
 	
 //
-// load the file
+// load the file, brush models straight out of a mapped pak
 //
-	buf = (unsigned *)COM_LoadStackFile (mod->name, stackbuf, sizeof(stackbuf));
+	buf = (unsigned *)COM_MapFile (mod->name);
+	if (buf && (LittleLong(*buf) == IDPOLYHEADER || LittleLong(*buf) == IDSPRITEHEADER))
+		buf = NULL;		// alias and sprite loaders change the data in place
+	if (!buf)
+		buf = (unsigned *)COM_LoadStackFile (mod->name, stackbuf, sizeof(stackbuf));
 	if (!buf)
 	{
 		if (crash)
@@ -293,18 +306,22 @@ model_t *Mod_LoadModel (model_t *mod, qboolean crash)
 	switch (LittleLong(*(unsigned *)buf))
 	{
 	case IDPOLYHEADER:
+		oldbudget = Hunk_SetBudget (hb_models);
 		Mod_LoadAliasModel (mod, buf);
 		break;
 		
 	case IDSPRITEHEADER:
+		oldbudget = Hunk_SetBudget (hb_models);
 		Mod_LoadSpriteModel (mod, buf);
 		break;
 	
 	default:
+		oldbudget = Hunk_SetBudget (hb_world);
 		Mod_LoadBrushModel (mod, buf);
 		break;
 	}
 
+	Hunk_SetBudget (oldbudget);
 	return mod;
 }
 
@@ -344,7 +361,9 @@ Mod_LoadTextures
 void Mod_LoadTextures (lump_t *l)
 {
 	int		i, j, pixels, num, max, altmax;
-	miptex_t	*mt;
+	int		nummiptex, dataofs;
+	miptex_t	*mt, *in;
+	miptex_t	header;		// swapped copy, the lump may be mapped read only
 	texture_t	*tx, *tx2;
 	texture_t	*anims[10];
 	texture_t	*altanims[10];
@@ -368,17 +387,19 @@ void Mod_LoadTextures (lump_t *l)
 	}
 	m = (dmiptexlump_t *)(mod_base + l->fileofs);
 	
-	m->nummiptex = LittleLong (m->nummiptex);
+	nummiptex = LittleLong (m->nummiptex);
 	
-	loadmodel->numtextures = m->nummiptex;
-	loadmodel->textures = Hunk_AllocName (m->nummiptex * sizeof(*loadmodel->textures) , loadname);
+	loadmodel->numtextures = nummiptex;
+	loadmodel->textures = Hunk_AllocName (nummiptex * sizeof(*loadmodel->textures) , loadname);
 
-	for (i=0 ; i<m->nummiptex ; i++)
+	for (i=0 ; i<nummiptex ; i++)
 	{
-		m->dataofs[i] = LittleLong(m->dataofs[i]);
-		if (m->dataofs[i] == -1)
+		dataofs = LittleLong(m->dataofs[i]);
+		if (dataofs == -1)
 			continue;
-		mt = (miptex_t *)((byte *)m + m->dataofs[i]);
+		in = (miptex_t *)((byte *)m + dataofs);
+		mt = &header;
+		*mt = *in;
 		mt->width = LittleLong (mt->width);
 		mt->height = LittleLong (mt->height);
 		for (j=0 ; j<MIPLEVELS ; j++)
@@ -397,7 +418,7 @@ void Mod_LoadTextures (lump_t *l)
 			tx->offsets[j] = mt->offsets[j] + sizeof(texture_t) - sizeof(miptex_t);
 
 		// the pixels immediately follow the structures
-		memcpy ( tx+1, mt+1, pixels);
+		memcpy ( tx+1, in+1, pixels);
 
 		// jkrige - fullbright pixels
 		fbr_pixels = pixels;
@@ -477,7 +498,7 @@ void Mod_LoadTextures (lump_t *l)
 //
 // sequence the animations
 //
-	for (i=0 ; i<m->nummiptex ; i++)
+	for (i=0 ; i<nummiptex ; i++)
 	{
 		tx = loadmodel->textures[i];
 		if (!tx || tx->name[0] != '+')
@@ -510,7 +531,7 @@ void Mod_LoadTextures (lump_t *l)
 		else
 			Sys_Error ("Bad animating texture %s", tx->name);
 
-		for (j=i+1 ; j<m->nummiptex ; j++)
+		for (j=i+1 ; j<nummiptex ; j++)
 		{
 			tx2 = loadmodel->textures[j];
 			if (!tx2 || tx2->name[0] != '+')
@@ -581,6 +602,7 @@ void Mod_LoadLighting (lump_t *l)
 	byte	*in, *out, *data;
 	byte	d;
 	char	litfilename[MAX_QPATH];
+	qboolean	mapped;
 
 	GL_SetupLightmapFmt(false);	// setup the lightmap format to reflect any
 					// changes via the cvar gl_lightmapfmt
@@ -600,9 +622,18 @@ void Mod_LoadLighting (lump_t *l)
 			COM_StripExtension(litfilename, litfilename/*, sizeof(litfilename)*/);
 			strcat(litfilename, ".lit");
 			Con_DPrintf("trying to load %s\n", litfilename);
-			data = (byte*) COM_LoadHunkFile (litfilename);
+			data = COM_MapFile (litfilename);	// used in place, read only
+			mapped = (data != NULL);
+			if (!data)
+				data = (byte*) COM_LoadHunkFile (litfilename);
 			if (data)
 			{
+				if (gl_mapcache.value)
+				{
+					loadmodel->lithash = COM_BlockHash (data, com_filesize);
+					loadmodel->litlen = com_filesize;
+				}
+
 				if (data[0] == 'Q' && data[1] == 'L' && data[2] == 'I' && data[3] == 'T')
 				{
 					i = LittleLong(((int *)data)[1]);
@@ -634,6 +665,13 @@ void Mod_LoadLighting (lump_t *l)
 							}
 							Con_DPrintf("Mod_LoadLighting: Loaded white light.\n");
 
+							if (mapped)
+							{	// blended below, so it needs a copy after all
+								in = Hunk_AllocName (com_filesize, "light");
+								memcpy (in, data, com_filesize);
+								data = in;
+							}
+
 							// allocate memory and load light data from .bsp
 							mark = Hunk_LowMark();
 							loadmodel->lightdata = /*(byte *)*/ Hunk_AllocName (l->filelen, "light");
@@ -1005,6 +1043,55 @@ void CalcSurfaceExtents (msurface_t *s)
 }
 
 
+/*
+=================
+Mod_SetupFaces
+
+Extents and warp subdivision for a chunk of faces, these are the bulk of the
+face work and every face is independent
+=================
+*/
+#define	FACES_PER_JOB	1024
+
+void Mod_SetupFaces (void *parm, int chunk)
+{
+	msurface_t	*out;
+	int			i, surfnum, end;
+
+	surfnum = chunk * FACES_PER_JOB;
+	end = surfnum + FACES_PER_JOB;
+	if (end > loadmodel->numsurfaces)
+		end = loadmodel->numsurfaces;
+
+	for (out = loadmodel->surfaces + surfnum ; surfnum<end ; surfnum++, out++)
+	{
+		CalcSurfaceExtents (out);
+
+	// set the drawing flags flag
+		
+		if (!Q_strncmp(out->texinfo->texture->name,"sky",3))	// sky
+		{
+			out->flags |= (SURF_DRAWSKY | SURF_DRAWTILED);
+#ifndef QUAKE2
+			GL_SubdivideSurface (out);	// cut up polygon for warps
+#endif
+			continue;
+		}
+		
+		if (!Q_strncmp(out->texinfo->texture->name,"*",1))		// turbulent
+		{
+			out->flags |= (SURF_DRAWTURB | SURF_DRAWTILED);
+			for (i=0 ; i<2 ; i++)
+			{
+				out->extents[i] = 16384;
+				out->texturemins[i] = -8192;
+			}
+			GL_SubdivideSurface (out);	// cut up polygon for warps
+			continue;
+		}
+	}
+}
+
 /*
 =================
 Mod_LoadFaces
@@ -1031,6 +1118,7 @@ void Mod_LoadFaces (lump_t *l)
 		out->firstedge = LittleLong(in->firstedge);
 		out->numedges = LittleShort(in->numedges);		
 		out->flags = 0;
+		out->dlights = -1;
 
 		planenum = LittleShort(in->planenum);
 		side = LittleShort(in->side);
@@ -1041,8 +1129,6 @@ void Mod_LoadFaces (lump_t *l)
 
 		out->texinfo = loadmodel->texinfo + LittleShort (in->texinfo);
 
-		CalcSurfaceExtents (out);
-				
 	// lighting info
 
 		for (i=0 ; i<MAXLIGHTMAPS ; i++)
@@ -1070,32 +1156,10 @@ void Mod_LoadFaces (lump_t *l)
 		else
 			out->overbright = false;
 		// jkrige - overbrights
-
-		
-	// set the drawing flags flag
-		
-		if (!Q_strncmp(out->texinfo->texture->name,"sky",3))	// sky
-		{
-			out->flags |= (SURF_DRAWSKY | SURF_DRAWTILED);
-#ifndef QUAKE2
-			GL_SubdivideSurface (out);	// cut up polygon for warps
-#endif
-			continue;
-		}
-		
-		if (!Q_strncmp(out->texinfo->texture->name,"*",1))		// turbulent
-		{
-			out->flags |= (SURF_DRAWTURB | SURF_DRAWTILED);
-			for (i=0 ; i<2 ; i++)
-			{
-				out->extents[i] = 16384;
-				out->texturemins[i] = -8192;
-			}
-			GL_SubdivideSurface (out);	// cut up polygon for warps
-			continue;
-		}
-
 	}
+
+	if (!Mod_LoadMapCache (loadmodel))
+		Job_Run (Mod_SetupFaces, NULL, (count + FACES_PER_JOB - 1) / FACES_PER_JOB);
 }
 
 
@@ -1414,6 +1478,190 @@ float RadiusFromBounds (vec3_t mins, vec3_t maxs)
 	return Length (corner);
 }
 
+/*
+=================
+Brush model lumps
+
+The lumps are loaded in waves: everything whose inputs are done goes out to
+the job threads together.  Textures upload to GL and lighting and entities
+open files, so those run on the main thread while the workers go.  Faces
+splits itself into a job, so it goes alone.
+=================
+*/
+enum
+{
+	ML_VERTEXES, ML_EDGES, ML_SURFEDGES, ML_TEXTURES, ML_LIGHTING, ML_PLANES,
+	ML_TEXINFO, ML_FACES, ML_MARKSURFACES, ML_VISIBILITY, ML_LEAFS, ML_NODES,
+	ML_CLIPNODES, ML_ENTITIES, ML_SUBMODELS, ML_NUMLUMPS
+};
+
+#define	ML(x)		(1<<ML_##x)
+
+#define	ML_MAIN		1		// main thread only
+#define	ML_ALONE	2		// runs its own job
+
+typedef struct
+{
+	char	*name;
+	void	(*load) (lump_t *l);
+	int		lump;
+	int		depends;		// ML() bits that have to be loaded first
+	int		flags;
+} modlump_t;
+
+static modlump_t	mod_lumps[ML_NUMLUMPS] =
+{
+	{"vertexes", Mod_LoadVertexes, LUMP_VERTEXES, 0, 0},
+	{"edges", Mod_LoadEdges, LUMP_EDGES, 0, 0},
+	{"surfedges", Mod_LoadSurfedges, LUMP_SURFEDGES, 0, 0},
+	{"textures", Mod_LoadTextures, LUMP_TEXTURES, 0, ML_MAIN},
+	{"lighting", Mod_LoadLighting, LUMP_LIGHTING, 0, ML_MAIN},
+	{"planes", Mod_LoadPlanes, LUMP_PLANES, 0, 0},
+	{"texinfo", Mod_LoadTexinfo, LUMP_TEXINFO, ML(TEXTURES), 0},
+	{"faces", Mod_LoadFaces, LUMP_FACES, ML(PLANES)|ML(TEXINFO)|ML(LIGHTING)|ML(VERTEXES)|ML(EDGES)|ML(SURFEDGES), ML_MAIN|ML_ALONE},
+	{"marksurfaces", Mod_LoadMarksurfaces, LUMP_MARKSURFACES, ML(FACES), 0},
+	{"visibility", Mod_LoadVisibility, LUMP_VISIBILITY, 0, 0},
+	{"leafs", Mod_LoadLeafs, LUMP_LEAFS, ML(MARKSURFACES)|ML(VISIBILITY), 0},
+	{"nodes", Mod_LoadNodes, LUMP_NODES, ML(PLANES)|ML(LEAFS), 0},
+	{"clipnodes", Mod_LoadClipnodes, LUMP_CLIPNODES, ML(PLANES), 0},
+	{"entities", Mod_LoadEntities, LUMP_ENTITIES, 0, ML_MAIN},
+	{"submodels", Mod_LoadSubmodels, LUMP_MODELS, 0, 0}
+};
+
+typedef struct
+{
+	double	time;
+	int		thread;
+	int		wave;
+} modlumptime_t;
+
+static dheader_t		*mod_header;
+static int				mod_wave[ML_NUMLUMPS];
+static modlumptime_t	mod_lumptimes[ML_NUMLUMPS];
+
+static char		mod_timedname[MAX_QPATH];
+static double	mod_timedwall;
+static int		mod_timedwaves;
+
+/*
+=================
+Mod_LoadLump
+=================
+*/
+static void Mod_LoadLump (int n)
+{
+	modlump_t	*ml;
+	double		start;
+
+	ml = &mod_lumps[n];
+
+	start = Sys_PreciseTime ();
+	PROF_BEGIN(ml->name);
+	ml->load (&mod_header->lumps[ml->lump]);
+	PROF_END();
+
+	mod_lumptimes[n].time = Sys_PreciseTime () - start;
+	mod_lumptimes[n].thread = Job_ThreadNum ();
+}
+
+static void Mod_LoadLumpJob (void *parm, int index)
+{
+	Mod_LoadLump (mod_wave[index]);
+}
+
+/*
+=================
+Mod_LoadLumps
+=================
+*/
+static void Mod_LoadLumps (dheader_t *header)
+{
+	int		n, done, ready, numwave, waves;
+	int		mainlumps[ML_NUMLUMPS], nummain;
+	double	start;
+
+	mod_header = header;
+	start = Sys_PreciseTime ();
+
+	done = 0;
+	for (waves=0 ; done != (1<<ML_NUMLUMPS)-1 ; waves++)
+	{
+		ready = numwave = nummain = 0;
+		for (n=0 ; n<ML_NUMLUMPS ; n++)
+		{
+			if (done & (1<<n) || (done & mod_lumps[n].depends) != mod_lumps[n].depends)
+				continue;
+			if (mod_lumps[n].flags & ML_ALONE)
+				continue;
+			ready |= 1<<n;
+			mod_lumptimes[n].wave = waves;
+			if (mod_lumps[n].flags & ML_MAIN)
+				mainlumps[nummain++] = n;
+			else
+				mod_wave[numwave++] = n;
+		}
+
+		if (!ready)
+		{	// only lumps that want the job threads to themselves are left
+			for (n=0 ; n<ML_NUMLUMPS ; n++)
+			{
+				if (done & (1<<n) || (done & mod_lumps[n].depends) != mod_lumps[n].depends)
+					continue;
+				ready |= 1<<n;
+				mod_lumptimes[n].wave = waves;
+				Mod_LoadLump (n);
+			}
+			if (!ready)
+				Sys_Error ("Mod_LoadLumps: circular lump dependencies");
+			done |= ready;
+			continue;
+		}
+
+		Job_Begin (Mod_LoadLumpJob, NULL, numwave);
+		for (n=0 ; n<nummain ; n++)
+			Mod_LoadLump (mainlumps[n]);
+		Job_Finish ();
+
+		done |= ready;
+	}
+
+	strcpy (mod_timedname, loadmodel->name);
+	mod_timedwall = Sys_PreciseTime () - start;
+	mod_timedwaves = waves;
+}
+
+/*
+=================
+Mod_LoadTimes_f
+
+Where the time went loading the last brush model
+=================
+*/
+void Mod_LoadTimes_f (void)
+{
+	modlumptime_t	*t;
+	double			sum;
+	int				n;
+
+	if (!mod_timedname[0])
+	{
+		Con_Printf ("No brush model loaded yet.\n");
+		return;
+	}
+
+	Con_Printf ("%s, %i job threads\n", mod_timedname, Job_NumThreads ());
+	Con_Printf ("lump            ms wave thread\n");
+
+	sum = 0;
+	for (n=0, t=mod_lumptimes ; n<ML_NUMLUMPS ; n++, t++)
+	{
+		Con_Printf ("%-12s %7.2f %4i %6i\n", mod_lumps[n].name, t->time * 1000, t->wave, t->thread);
+		sum += t->time;
+	}
+
+	Con_Printf ("%i waves, %.2f ms wall, %.2f ms in lumps\n", mod_timedwaves, mod_timedwall * 1000, sum * 1000);
+}
+
 /*
 =================
 Mod_LoadBrushModel
@@ -1423,12 +1671,17 @@ void Mod_LoadBrushModel (model_t *mod, void *buffer)
 {
 	int			i, j;
 	dheader_t	*header;
+	dheader_t	swapped;	// the file may be mapped read only
 	dmodel_t 	*bm;
 	
 	loadmodel->type = mod_brush;
+	loadmodel->lightgrid = NULL;	// R_NewMap builds it
+	loadmodel->surfbuckets = NULL;
+	loadmodel->bucketsurfs = NULL;
 
 
-	header = (dheader_t *)buffer;
+	swapped = *(dheader_t *)buffer;
+	header = &swapped;
 
 	i = LittleLong (header->version);
 
@@ -1443,29 +1696,26 @@ void Mod_LoadBrushModel (model_t *mod, void *buffer)
 	}
 	// jkrige - bsp version crash
 
+// key for the map cache
+	mod->bsphash = mod->lithash = 0;
+	mod->bsplen = mod->litlen = 0;
+	mod->mapcachealloc = NULL;
+	mod->mapcacheallocsize = 0;
+	if (gl_mapcache.value)
+	{
+		mod->bsphash = COM_BlockHash (buffer, com_filesize);
+		mod->bsplen = com_filesize;
+	}
+
 // swap all the lumps
-	mod_base = (byte *)header;
+	mod_base = (byte *)buffer;
 
 	for (i=0 ; i<sizeof(dheader_t)/4 ; i++)
 		((int *)header)[i] = LittleLong ( ((int *)header)[i]);
 
 // load into heap
 	
-	Mod_LoadVertexes (&header->lumps[LUMP_VERTEXES]);
-	Mod_LoadEdges (&header->lumps[LUMP_EDGES]);
-	Mod_LoadSurfedges (&header->lumps[LUMP_SURFEDGES]);
-	Mod_LoadTextures (&header->lumps[LUMP_TEXTURES]);
-	Mod_LoadLighting (&header->lumps[LUMP_LIGHTING]);
-	Mod_LoadPlanes (&header->lumps[LUMP_PLANES]);
-	Mod_LoadTexinfo (&header->lumps[LUMP_TEXINFO]);
-	Mod_LoadFaces (&header->lumps[LUMP_FACES]);
-	Mod_LoadMarksurfaces (&header->lumps[LUMP_MARKSURFACES]);
-	Mod_LoadVisibility (&header->lumps[LUMP_VISIBILITY]);
-	Mod_LoadLeafs (&header->lumps[LUMP_LEAFS]);
-	Mod_LoadNodes (&header->lumps[LUMP_NODES]);
-	Mod_LoadClipnodes (&header->lumps[LUMP_CLIPNODES]);
-	Mod_LoadEntities (&header->lumps[LUMP_ENTITIES]);
-	Mod_LoadSubmodels (&header->lumps[LUMP_MODELS]);
+	Mod_LoadLumps (header);
 
 	Mod_MakeHull0 ();
 	
@@ -2020,6 +2270,19 @@ void Mod_LoadAliasModel (model_t *mod, void *buffer)
 	//
 	GL_MakeAliasModelDisplayLists (mod, pheader);
 
+//
+// a model that ran into a new hunk segment isn't in one piece, and its
+// offsets span the gap; load it again with the room set aside
+//
+	if (!Hunk_LowContiguous (start))
+	{
+		total = Hunk_LowSizeSince (start);
+		Hunk_FreeToLowMark (start);
+		Hunk_ReserveLow (total);
+		Mod_LoadAliasModel (mod, buffer);
+		return;
+	}
+
 //
 // move the complete, relocatable alias model to the cache
 //	
@@ -154,7 +154,7 @@ typedef struct msurface_s
 	int			dlightframe;
 	// jkrige - increase dlights
 	//int			dlightbits;
-	byte dlightbits[(MAX_DLIGHTS + 7) / 8];
+	int			dlights;		// first r_surfdlights link when dlightframe is current
 	// jkrige - increase dlights
 
 	int			lightmaptexturenum;
@@ -169,6 +169,18 @@ typedef struct msurface_s
 
 } msurface_t;
 
+// a node's surfaces that share a texture and the flags the world walk
+// tests, so it can cull and chain them together
+#define	SURFBUCKET_FLAGS	(SURF_PLANEBACK|SURF_UNDERWATER|SURF_DRAWSKY|SURF_DRAWTURB)
+
+typedef struct
+{
+	texture_t	*texture;
+	int			flags;			// SURF_PLANEBACK, SURF_UNDERWATER, SURF_DRAWSKY, SURF_DRAWTURB
+	int			firstsurf;		// into model_t bucketsurfs
+	int			numsurfs;
+} surfbucket_t;
+
 typedef struct mnode_s
 {
 // common with leaf
@@ -185,6 +197,9 @@ typedef struct mnode_s
 
 	unsigned short		firstsurface;
 	unsigned short		numsurfaces;
+
+	int			firstbucket;	// into model_t surfbuckets
+	int			numbuckets;
 } mnode_t;
 
 
@@ -207,6 +222,9 @@ typedef struct mleaf_s
 	int			nummarksurfaces;
 	int			key;			// BSP sequence number for leaf's contents
 	byte		ambient_sound_level[NUM_AMBIENTS];
+
+	int			occlframe;		// r_framecount of the last occlusion query
+	int			occlquery;
 } mleaf_t;
 
 // !!! if this is changed, it must be changed in asm_i386.h too !!!
@@ -326,6 +344,9 @@ typedef struct {
 	int					poseverts;
 	int					posedata;	// numposes*poseverts trivert_t
 	int					commands;	// gl command list with embedded s/t
+	int					indexes;	// the commands as a triangle list
+	int					numindexes;
+	int					texcoords;	// poseverts s/t pairs
 	int					gl_texturenum[MAX_SKINS][4];
 	int					texels[MAX_SKINS];	// only for player skins
 
@@ -339,6 +360,15 @@ typedef struct {
 	maliasframedesc_t	frames[1];	// variable sized
 } aliashdr_t;
 
+#define NUMVERTEXNORMALS	162
+
+// one vertex of a pose in the model's vertex buffer
+typedef struct
+{
+	byte		v[4];			// trivertx_t position, w unused
+	signed char	normal[4];		// r_avertexnormals scaled to 127, w unused
+} aliasvert_t;
+
 #define	MAXALIASVERTS	1024
 #define	MAXALIASFRAMES	256
 #define	MAXALIASTRIS	2048
@@ -435,6 +465,26 @@ typedef struct model_s
 	byte		*lightdata;
 	char		*entities;
 
+//
+// map cache key, and the lightmap block usage when the surfaces came from it
+//
+	unsigned	bsphash, lithash;
+	int			bsplen, litlen;
+	int			*mapcachealloc;
+	int			mapcacheallocsize;
+
+	struct lightgrid_s	*lightgrid;	// world only, see gl_lightgrid.c
+
+	surfbucket_t	*surfbuckets;	// world only, R_BuildSurfaceBuckets
+	msurface_t		**bucketsurfs;
+
+//
+// alias vertex buffers: the s/t of the draw order, then every pose, and a
+// triangle list, built by GL_MakeAliasModelDisplayLists
+//
+	unsigned	aliasvbo, aliasibo;
+	int			aliasnumindexes;
+
 //
 // additional model data
 //
@@ -451,6 +501,11 @@ void	*Mod_Extradata (model_t *mod);	// handles caching
 void	Mod_TouchModel (char *name);
 
 mleaf_t *Mod_PointInLeaf (float *p, model_t *model);
-byte	*Mod_LeafPVS (mleaf_t *leaf, model_t *model);
+float	RadiusFromBounds (vec3_t mins, vec3_t maxs);
+byte	*Mod_LeafPVS (mleaf_t *leaf, model_t *model, byte *buffer);	// buffer is MAX_MAP_LEAFS/8
+
+qboolean Mod_LoadMapCache (model_t *mod);
+qboolean GL_LightmapPlaceOk (msurface_t *surf);
+void	Mod_WriteMapCache (model_t *mod, int *alloc, int allocsize);
 
 #endif	// __MODEL__
@@ -0,0 +1,346 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// gl_occlusion.c -- hardware occlusion queries for entities and world leafs
+
+#include "quakedef.h"
+
+// Once the world is in the depth buffer, the bounding boxes of the leafs
+// the world walk went through and of the entities about to be drawn are
+// drawn invisibly inside occlusion queries.  Waiting for the answers would
+// stall, so they are read the next frame: a leaf or entity whose box had
+// no samples pass last frame is skipped this frame, and queried again.
+//
+// Anything that wasn't queried last frame, whose answer isn't back yet,
+// or that the view is inside is drawn.  So is everything after the view
+// jumps, and the boxes are grown to cover a frame of movement.
+
+#define	MAX_OCCLUSION_QUERIES	2048	// a frame
+#define	OCCLUSION_PAD			16		// grows the boxes for movement and lerping
+#define	OCCLUSION_MAXMOVE		64		// the view moving further makes last frame's answers stale
+#define	OCCLUSION_NEAR			8		// the view this close to a box is taken to be inside it
+
+cvar_t	r_occlusion = {"r_occlusion", "0", true};
+
+int		c_occlusion_queries, c_occluded_entities, c_occluded_leafs;
+
+static GLuint	occlqueries[2][MAX_OCCLUSION_QUERIES];	// this frame's and last frame's, by r_framecount & 1
+static int		numocclqueries;
+static qboolean	occlsupported;
+
+static qboolean	occlactive;		// this frame's world and entities are being queried
+static qboolean	occlwalking;	// the world walk is recording leafs
+static qboolean	occlstale;		// last frame's answers can't be used
+static int		occlframe;
+static vec3_t	occlvieworg;
+
+static mleaf_t	*occlleafs[MAX_OCCLUSION_QUERIES];
+static int		numoccleafs;
+
+/*
+================
+R_InitOcclusion
+================
+*/
+void R_InitOcclusion (void)
+{
+	occlsupported = false;
+
+	if (!GLEW_VERSION_1_5)
+	{
+		Con_Printf ("OpenGL 1.5 is required for occlusion queries\n");
+		return;
+	}
+
+	glGenQueries (MAX_OCCLUSION_QUERIES, occlqueries[0]);
+	glGenQueries (MAX_OCCLUSION_QUERIES, occlqueries[1]);
+	occlsupported = true;
+}
+
+/*
+================
+R_OcclusionBeginFrame
+
+Called before the world is walked
+================
+*/
+void R_OcclusionBeginFrame (void)
+{
+	vec3_t	delta;
+
+	c_occlusion_queries = c_occluded_entities = c_occluded_leafs = 0;
+	numocclqueries = 0;
+	numoccleafs = 0;
+
+	occlactive = occlwalking = r_occlusion.value && occlsupported && !mirror;
+	if (!occlactive)
+		return;
+
+	VectorSubtract (r_origin, occlvieworg, delta);
+	occlstale = occlframe != r_framecount - 1 || Length (delta) > OCCLUSION_MAXMOVE;
+
+	occlframe = r_framecount;
+	VectorCopy (r_origin, occlvieworg);
+}
+
+/*
+================
+R_OcclusionAnswer
+
+True if the query made in frame had no samples pass.  Anything unsure is
+taken as seen.
+================
+*/
+static qboolean R_OcclusionAnswer (int frame, int query)
+{
+	GLuint	q, available, samples;
+
+	if (occlstale || frame != r_framecount - 1 || query < 0)
+		return false;
+
+	q = occlqueries[frame & 1][query];
+	glGetQueryObjectuiv (q, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return false;		// the card is behind, don't wait for it
+
+	glGetQueryObjectuiv (q, GL_QUERY_RESULT, &samples);
+	return !samples;
+}
+
+/*
+================
+R_ViewInBox
+================
+*/
+static qboolean R_ViewInBox (vec3_t mins, vec3_t maxs)
+{
+	int		i;
+
+	for (i=0 ; i<3 ; i++)
+	{
+		if (r_origin[i] < mins[i] - OCCLUSION_NEAR || r_origin[i] > maxs[i] + OCCLUSION_NEAR)
+			return false;
+	}
+	return true;
+}
+
+/*
+================
+R_BeginOcclusionQueries
+================
+*/
+static void R_BeginOcclusionQueries (void)
+{
+	// straight to GL, glPopAttrib puts back what the state cache has
+	glPushAttrib (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_ENABLE_BIT);
+	glColorMask (GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask (GL_FALSE);
+	glDisable (GL_TEXTURE_2D);
+	glDisable (GL_CULL_FACE);
+	glDisable (GL_BLEND);
+	glDisable (GL_ALPHA_TEST);
+}
+
+/*
+================
+R_EndOcclusionQueries
+================
+*/
+static void R_EndOcclusionQueries (void)
+{
+	glPopAttrib ();
+}
+
+/*
+================
+R_QueryBox
+
+Draws the box in this frame's next query.  Returns the query, or -1 when
+they have run out.
+================
+*/
+static int R_QueryBox (vec3_t mins, vec3_t maxs)
+{
+	vec3_t	v[8];
+	int		i;
+	static int	faces[6][4] =
+	{
+		{0, 1, 3, 2}, {4, 6, 7, 5},		// -x, +x
+		{0, 4, 5, 1}, {2, 3, 7, 6},		// -y, +y
+		{0, 2, 6, 4}, {1, 5, 7, 3}		// -z, +z
+	};
+
+	if (numocclqueries == MAX_OCCLUSION_QUERIES)
+		return -1;
+
+	for (i=0 ; i<8 ; i++)
+	{
+		v[i][0] = (i & 4) ? maxs[0] : mins[0];
+		v[i][1] = (i & 2) ? maxs[1] : mins[1];
+		v[i][2] = (i & 1) ? maxs[2] : mins[2];
+	}
+
+	glBeginQuery (GL_SAMPLES_PASSED, occlqueries[r_framecount & 1][numocclqueries]);
+	glBegin (GL_QUADS);
+	for (i=0 ; i<6 ; i++)
+	{
+		glVertex3fv (v[faces[i][0]]);
+		glVertex3fv (v[faces[i][1]]);
+		glVertex3fv (v[faces[i][2]]);
+		glVertex3fv (v[faces[i][3]]);
+	}
+	glEnd ();
+	glEndQuery (GL_SAMPLES_PASSED);
+
+	c_occlusion_queries++;
+	return numocclqueries++;
+}
+
+/*
+================
+R_LeafOccluded
+
+Called by the world walk for every leaf it reaches.  The leaf is queried
+again once the world is drawn.
+================
+*/
+qboolean R_LeafOccluded (mleaf_t *leaf)
+{
+	if (!occlwalking)
+		return false;
+	if (!leaf->nummarksurfaces && !leaf->efrags)
+		return false;		// nothing to skip
+	if (numoccleafs == MAX_OCCLUSION_QUERIES)
+		return false;
+
+	occlleafs[numoccleafs++] = leaf;
+
+	if (!R_OcclusionAnswer (leaf->occlframe, leaf->occlquery))
+		return false;
+
+	c_occluded_leafs++;
+	return true;
+}
+
+/*
+================
+R_OcclusionQueryLeafs
+
+Called once the world is in the depth buffer
+================
+*/
+void R_OcclusionQueryLeafs (void)
+{
+	mleaf_t	*leaf;
+	vec3_t	mins, maxs;
+	int		i, j;
+
+	if (!occlwalking)
+		return;
+	occlwalking = false;
+
+	R_BeginOcclusionQueries ();
+
+	for (i=0 ; i<numoccleafs ; i++)
+	{
+		leaf = occlleafs[i];
+		leaf->occlframe = 0;
+
+		// just outside the leaf's walls, so they don't hide it
+		for (j=0 ; j<3 ; j++)
+		{
+			mins[j] = leaf->minmaxs[j] - 1;
+			maxs[j] = leaf->minmaxs[3+j] + 1;
+		}
+		if (R_ViewInBox (mins, maxs))
+			continue;
+
+		leaf->occlquery = R_QueryBox (mins, maxs);
+		leaf->occlframe = r_framecount;
+	}
+
+	R_EndOcclusionQueries ();
+}
+
+/*
+================
+R_OcclusionTestEntities
+
+Sets occluded on every entity of the list from last frame's queries and
+queries them again against the world
+================
+*/
+void R_OcclusionTestEntities (entity_t **list, int count)
+{
+	entity_t	*e;
+	model_t		*clmodel;
+	vec3_t		mins, maxs;
+	float		radius;
+	int			i, j;
+
+	for (i=0 ; i<count ; i++)
+		list[i]->occluded = false;
+
+	if (!occlactive)
+		return;
+
+	R_BeginOcclusionQueries ();
+
+	for (i=0 ; i<count ; i++)
+	{
+		e = list[i];
+		clmodel = e->model;
+		if (clmodel->type != mod_alias && clmodel->type != mod_brush)
+			continue;
+
+		// alias bounds are for the model unturned, so take the sphere
+		if (clmodel->type == mod_alias || e->angles[0] || e->angles[1] || e->angles[2])
+		{
+			radius = clmodel->type == mod_alias ? RadiusFromBounds (clmodel->mins, clmodel->maxs) : clmodel->radius;
+			for (j=0 ; j<3 ; j++)
+			{
+				mins[j] = e->origin[j] - radius - OCCLUSION_PAD;
+				maxs[j] = e->origin[j] + radius + OCCLUSION_PAD;
+			}
+		}
+		else
+		{
+			for (j=0 ; j<3 ; j++)
+			{
+				mins[j] = e->origin[j] + clmodel->mins[j] - OCCLUSION_PAD;
+				maxs[j] = e->origin[j] + clmodel->maxs[j] + OCCLUSION_PAD;
+			}
+		}
+
+		if (R_ViewInBox (mins, maxs))
+		{
+			e->occlframe = 0;
+			continue;
+		}
+
+		e->occluded = R_OcclusionAnswer (e->occlframe, e->occlquery);
+		if (e->occluded)
+			c_occluded_entities++;
+
+		e->occlquery = R_QueryBox (mins, maxs);
+		e->occlframe = r_framecount;
+	}
+
+	R_EndOcclusionQueries ();
+}
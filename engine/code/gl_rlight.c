@@ -54,277 +54,262 @@ void R_AnimateLight (void)
 /*
 =============================================================================
 
-DYNAMIC LIGHTS BLEND RENDERING
+DYNAMIC LIGHTS
 
 =============================================================================
 */
 
-// jkrige - flashblend removal
-/*void AddLightBlend (float r, float g, float b, float a2)
-{
-	float	a;
-
-	v_blend[3] = a = v_blend[3] + a2*(1-v_blend[3]);
+cvar_t	r_maxdlights = {"r_maxdlights", "64", true};
 
-	a2 = a2/a;
+dlight_t		*r_dlights[MAX_DLIGHTS];	// this frame's lights, most on screen first
+int				r_numdlights;
 
-	v_blend[0] = v_blend[1]*(1-a2) + r*a2;
-	v_blend[1] = v_blend[1]*(1-a2) + g*a2;
-	v_blend[2] = v_blend[2]*(1-a2) + b*a2;
-}*/
-// jkrige - flashblend removal
+surfdlight_t	r_surfdlights[MAX_SURFDLIGHTS];
+int				r_numsurfdlights;
 
+static byte		r_dlightlist[MAX_DLIGHTS];	// 0 .. r_numdlights-1, for the marking
 
-// jkrige - flashblend removal
-/*void R_RenderDlight (dlight_t *light)
+typedef struct
 {
-	int		i, j;
-	float	a;
-	vec3_t	v;
-	float	rad;
-
-	rad = light->radius * 0.35;
-
-	VectorSubtract (light->origin, r_origin, v);
-	if (Length (v) < rad)
-	{	// view is inside the dlight
-		AddLightBlend (1, 0.5, 0, light->radius * 0.0003);
-		return;
-	}
-
-	glBegin (GL_TRIANGLE_FAN);
-	glColor3f (0.2,0.1,0.0);
-	for (i=0 ; i<3 ; i++)
-		v[i] = light->origin[i] - vpn[i]*rad;
-	glVertex3fv (v);
-	glColor3f (0,0,0);
-	for (i=16 ; i>=0 ; i--)
-	{
-		a = i/16.0 * M_PI*2;
-		for (j=0 ; j<3 ; j++)
-			v[j] = light->origin[j] + vright[j]*cos(a)*rad
-				+ vup[j]*sin(a)*rad;
-		glVertex3fv (v);
-	}
-	glEnd ();
-}*/
-// jkrige - flashblend removal
-
+	dlight_t	*light;
+	float		contribution;
+} dlightsort_t;
 
-// jkrige - flashblend removal
 /*
 =============
-R_RenderDlights
+R_LightSurface
+
+Puts light lnum on surf's list for the frame if it reaches the lightmap,
+dist is the light's distance from the surface's plane
 =============
 */
-/*void R_RenderDlights (void)
+static void R_LightSurface (msurface_t *surf, int lnum, float dist)
 {
-	int		i;
-	dlight_t	*l;
-
-	if (!gl_flashblend.value)
-		return;
+	dlight_t	*light;
+	float		l;
+	int			i, s, t, link;
+	vec3_t		impact;
 
-	r_dlightframecount = r_framecount + 1;	// because the count hasn't
-											//  advanced yet for this frame
-	glDepthMask (0);
-	glDisable (GL_TEXTURE_2D);
-	glShadeModel (GL_SMOOTH);
-	glEnable (GL_BLEND);
-	glBlendFunc (GL_ONE, GL_ONE);
+	light = r_dlights[lnum];
 
-	l = cl_dlights;
-	for (i=0 ; i<MAX_DLIGHTS ; i++, l++)
+	// jkrige - fix dynamic light shine through
+	if (r_dynamic_sidemark.value)
 	{
-		if (l->die < cl.time || !l->radius)
-			continue;
-		R_RenderDlight (l);
+		if ((surf->flags & SURF_PLANEBACK) != (dist >= 0 ? 0 : SURF_PLANEBACK))
+			return;
 	}
+	// jkrige - fix dynamic light shine through
 
-	glColor3f (1,1,1);
-	glDisable (GL_BLEND);
-	glEnable (GL_TEXTURE_2D);
-	glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glDepthMask (1);
-}*/
-// jkrige - flashblend removal
+	// jkrige - speed increase
+	for (i=0 ; i<3 ; i++)
+		impact[i] = light->origin[i] - surf->plane->normal[i] * dist;
+
+	// clamp center of light to corner and check brightness
+	l = DotProduct (impact, surf->texinfo->vecs[0]) + surf->texinfo->vecs[0][3] - surf->texturemins[0];
+	s = l + 0.5;
+	if (s < 0)
+		s = 0;
+	else if (s > surf->extents[0])
+		s = surf->extents[0];
+	s = l - s;
+	l = DotProduct (impact, surf->texinfo->vecs[1]) + surf->texinfo->vecs[1][3] - surf->texturemins[1];
+	t = l + 0.5;
+	if (t < 0)
+		t = 0;
+	else if (t > surf->extents[1])
+		t = surf->extents[1];
+	t = l - t;
+
+	if (s*s + t*t + dist*dist >= light->radius*light->radius)
+		return;
+	// jkrige - speed increase
 
-/*
-=============================================================================
+	if (surf->dlightframe != r_dlightframecount)
+	{
+		surf->dlightframe = r_dlightframecount;
+		surf->dlights = -1;
+	}
+	else
+	{
+		// a brush model drawn twice in the frame marks its surfaces twice
+		for (link = surf->dlights ; link != -1 ; link = r_surfdlights[link].next)
+			if (r_surfdlights[link].light == lnum)
+				return;
+	}
 
-DYNAMIC LIGHTS
+	if (r_numsurfdlights == MAX_SURFDLIGHTS)
+		return;		// the rest of the frame goes without
 
-=============================================================================
-*/
+	r_surfdlights[r_numsurfdlights].light = lnum;
+	r_surfdlights[r_numsurfdlights].next = surf->dlights;
+	surf->dlights = r_numsurfdlights++;
+}
 
 /*
 =============
-R_MarkLights
+R_MarkLightList
+
+Takes the lights down the tree together.  Each node sorts the list into
+the lights in front of and behind its plane, and only the ones crossing
+it are tried against its surfaces.  The front side is walked in place,
+reusing the front list, so the lists passed in are never written.
 =============
 */
-void R_MarkLights (dlight_t *light, int lnum, mnode_t *node)
+static void R_MarkLightList (mnode_t *node, byte *lights, int numlights)
 {
 	mplane_t	*splitplane;
-	float		dist;
 	msurface_t	*surf;
-	int			i;
-
-	// jkrige - fix dynamic light shine through
-	int			sidebit;
-	// jkrige - fix dynamic light shine through
+	dlight_t	*light;
+	float		dist;
+	int			i, j, lnum;
+	int			numfront, numback;
+	byte		front[MAX_DLIGHTS], back[MAX_DLIGHTS];
 
-	// jkrige - speed increase
-	float		l, maxdist;
-	int			j, s, t;
-	vec3_t		impact;
 loc0:
-	// jkrige - speed increase
-	
-	if (node->contents < 0)
+	if (node->contents < 0 || !numlights)
 		return;
 
 	splitplane = node->plane;
+	numfront = numback = 0;
 
-	// jkrige - speed increase
-	if (splitplane->type < 3)
-		dist = light->origin[splitplane->type] - splitplane->dist;
-	else
-		dist = DotProduct (light->origin, splitplane->normal) - splitplane->dist;
-	//dist = DotProduct (light->origin, splitplane->normal) - splitplane->dist;
-	// jkrige - speed increase
-
-	if (dist > light->radius)
+	for (i=0 ; i<numlights ; i++)
 	{
+		lnum = lights[i];
+		light = r_dlights[lnum];
+
 		// jkrige - speed increase
-		node = node->children[0];
-		goto loc0;
-		//R_MarkLights (light, lnum, node->children[0]);
-		//return;
-		// jkrige - speed increase
-	}
-	if (dist < -light->radius)
-	{
+		if (splitplane->type < 3)
+			dist = light->origin[splitplane->type] - splitplane->dist;
+		else
+			dist = DotProduct (light->origin, splitplane->normal) - splitplane->dist;
 		// jkrige - speed increase
-		node = node->children[1];
-		goto loc0;
-		//R_MarkLights (light, lnum, node->children[1]);
-		//return;
-		// jkrige - speed increase
-	}
 
-	// jkrige - speed increase
-	maxdist = light->radius*light->radius;
-	// jkrige - speed increase
-		
-// mark the polygons
-	surf = cl.worldmodel->surfaces + node->firstsurface;
-	for (i=0 ; i<node->numsurfaces ; i++, surf++)
-	{
-		// jkrige - fix dynamic light shine through
-		if (r_dynamic_sidemark.value)
+		if (dist > light->radius)
 		{
-			if (dist >= 0)
-				sidebit = 0;
-			else
-				sidebit = SURF_PLANEBACK;
-
-			if ( (surf->flags & SURF_PLANEBACK) != sidebit )
-				continue;
+			front[numfront++] = lnum;
+			continue;
+		}
+		if (dist < -light->radius)
+		{
+			back[numback++] = lnum;
+			continue;
 		}
-		// jkrige - fix dynamic light shine through
-
 
-		// jkrige - speed increase
-		for (j=0 ; j<3 ; j++)
-			impact[j] = light->origin[j] - surf->plane->normal[j] * dist;
-
-		// clamp center of light to corner and check brightness
-		l = DotProduct (impact, surf->texinfo->vecs[0]) + surf->texinfo->vecs[0][3] - surf->texturemins[0];
-		s = l + 0.5;
-		if (s < 0)
-			s = 0;
-		else if (s > surf->extents[0])
-			s = surf->extents[0];
-		s = l - s;
-		l = DotProduct (impact, surf->texinfo->vecs[1]) + surf->texinfo->vecs[1][3] - surf->texturemins[1];
-		t = l + 0.5;
-		if (t < 0)
-			t = 0;
-		else if (t > surf->extents[1])
-			t = surf->extents[1];
-		t = l - t;
-		// jkrige - speed increase
+		front[numfront++] = lnum;
+		back[numback++] = lnum;
 
+	// mark the polygons
+		surf = cl.worldmodel->surfaces + node->firstsurface;
+		for (j=0 ; j<node->numsurfaces ; j++, surf++)
+			R_LightSurface (surf, lnum, dist);
+	}
 
-		// jkrige - increase dlights
-		//if (surf->dlightframe != r_dlightframecount)
-		//{
-		//	surf->dlightbits = 0;
-		//	surf->dlightframe = r_dlightframecount;
-		//}
-		//surf->dlightbits |= lnum; // jkrige - was bit
+	if (numback)
+		R_MarkLightList (node->children[1], back, numback);
 
+	// front can be walked on in place, entry i is read before anything
+	// is written over it
+	node = node->children[0];
+	lights = front;
+	numlights = numfront;
+	goto loc0;
+}
 
-		if ((s*s+t*t+dist*dist) < maxdist) // jkrige - speed increase
-		{
-			if (surf->dlightframe != r_dlightframecount) 
-			{ 
-				// init a new dlight on the surf 
-				int j; 
+/*
+=============
+R_MarkLights
 
-				for (j = 0; j < MAX_DLIGHTS; j += 8) 
-					surf->dlightbits[(j >> 3)] = 0;
+Gives the surfaces under node this frame's lights, the whole world from
+R_PushDlights and the brush models as they are drawn
+=============
+*/
+void R_MarkLights (mnode_t *node)
+{
+	R_MarkLightList (node, r_dlightlist, r_numdlights);
+}
 
-				surf->dlightframe = r_dlightframecount; 
-			}
-		
+/*
+=============
+R_DlightSortCmp
+=============
+*/
+static int R_DlightSortCmp (const void *a, const void *b)
+{
+	float	ca, cb;
 
-			// mark it 
-			surf->dlightbits[(lnum >> 3)] |= (1 << (lnum & 7));
-		}
-		// jkrige - increase dlights
-	}
+	ca = ((dlightsort_t *)a)->contribution;
+	cb = ((dlightsort_t *)b)->contribution;
 
-	// jkrige - speed increase
-	if (node->children[0]->contents >= 0)
-		R_MarkLights (light, lnum, node->children[0]);
-	if (node->children[1]->contents >= 0)
-		R_MarkLights (light, lnum, node->children[1]);
-	//R_MarkLights (light, lnum, node->children[0]);
-	//R_MarkLights (light, lnum, node->children[1]);
-	// jkrige - speed increase
+	return (ca < cb) - (ca > cb);
 }
 
-
 /*
 =============
 R_PushDlights
+
+Picks the frame's lights and hands them out to the world's surfaces.
+Lights wholly behind the view are dropped, the rest are ranked by how big
+they are on screen and only the first r_maxdlights are used.
 =============
 */
 void R_PushDlights (void)
 {
-	int		i;
+	static dlightsort_t	sort[MAX_DLIGHTS];
+	int			i, count, max;
 	dlight_t	*l;
+	vec3_t		forward, right, up, delta;
+	float		d, r;
 
 	// jkrige - flashblend removal
 	//if (gl_flashblend.value)
 	//	return;
 	// jkrige - flashblend removal
 
+	if (r_dlightframecount == r_framecount + 1)
+		return;		// already done for this frame, the second lcd_x view
+
 	r_dlightframecount = r_framecount + 1;	// because the count hasn't
 											//  advanced yet for this frame
-	l = cl_dlights;
+	r_numsurfdlights = 0;
 
+	AngleVectors (r_refdef.viewangles, forward, right, up);
+
+	count = 0;
+	l = cl_dlights;
 	for (i=0 ; i<MAX_DLIGHTS ; i++, l++)
 	{
 		if (l->die < cl.time || !l->radius)
 			continue;
 
-		// jkrige - increase dlights
-		//R_MarkLights ( l, 1<<i, cl.worldmodel->nodes );
-		R_MarkLights ( l, i, cl.worldmodel->nodes );
-		// jkrige - increase dlights
+		VectorSubtract (l->origin, r_refdef.vieworg, delta);
+		if (DotProduct (delta, forward) < -l->radius)
+			continue;
+
+		// the solid angle of the sphere, all of it when inside
+		d = DotProduct (delta, delta);
+		r = l->radius * l->radius;
+		sort[count].light = l;
+		sort[count].contribution = r / (d > r ? d : r);
+		count++;
 	}
+
+	qsort (sort, count, sizeof(sort[0]), R_DlightSortCmp);
+
+	max = (int)r_maxdlights.value;
+	if (max > MAX_DLIGHTS)
+		max = MAX_DLIGHTS;
+	if (count > max)
+		count = max > 0 ? max : 0;
+
+	for (i=0 ; i<count ; i++)
+	{
+		r_dlights[i] = sort[i].light;
+		r_dlightlist[i] = i;
+	}
+	r_numdlights = count;
+
+	if (r_numdlights)
+		R_MarkLights (cl.worldmodel->nodes);
 }
 
 
@@ -336,18 +321,27 @@ LIGHT SAMPLING
 =============================================================================
 */
 
-mplane_t		*lightplane;
+mplane_t		*lightplane;	// only for the removed alias shadows, not kept up
 vec3_t			lightspot;
 
 // jkrige - .lit colored lights
-int RecursiveLightPoint (vec3_t color, mnode_t *node, vec3_t start, vec3_t end)
+/*
+=============
+RecursiveLightTrace
+
+Finds the lit surface the line from start to end hits first, with the
+point on it in lightmap units from texturemins
+=============
+*/
+msurface_t *RecursiveLightTrace (mnode_t *node, vec3_t start, vec3_t end, int *hit_ds, int *hit_dt)
 {
 	float		front, back, frac;
 	vec3_t		mid;
+	msurface_t	*hit;
 
 loc0:
 	if (node->contents < 0)
-		return false;		// didn't hit anything
+		return NULL;		// didn't hit anything
 	
 // calculate mid point
 	if (node->plane->type < 3)
@@ -375,16 +369,14 @@ loc0:
 	mid[2] = start[2] + (end[2] - start[2])*frac;
 	
 // go down front side
-	if (RecursiveLightPoint (color, node->children[front < 0], start, mid))
-		return true;	// hit something
+	hit = RecursiveLightTrace (node->children[front < 0], start, mid, hit_ds, hit_dt);
+	if (hit)
+		return hit;	// hit something
 	else
 	{
 		int i, ds, dt;
 		msurface_t *surf;
 	// check for impact on this node
-		VectorCopy (mid, lightspot);
-		lightplane = node->plane;
-
 		surf = cl.worldmodel->surfaces + node->firstsurface;
 		for (i = 0;i < node->numsurfaces;i++, surf++)
 		{
@@ -403,36 +395,74 @@ loc0:
 			if (ds > surf->extents[0] || dt > surf->extents[1])
 				continue;
 
-			if (surf->samples)
-			{
-				// LordHavoc: enhanced to interpolate lighting
-				byte *lightmap;
-				int maps, line3, dsfrac = ds & 15, dtfrac = dt & 15, r00 = 0, g00 = 0, b00 = 0, r01 = 0, g01 = 0, b01 = 0, r10 = 0, g10 = 0, b10 = 0, r11 = 0, g11 = 0, b11 = 0;
-				float scale;
-				line3 = ((surf->extents[0]>>4)+1)*3;
-
-				lightmap = surf->samples + ((dt>>4) * ((surf->extents[0]>>4)+1) + (ds>>4))*3; // LordHavoc: *3 for color
-
-				for (maps = 0;maps < MAXLIGHTMAPS && surf->styles[maps] != 255;maps++)
-				{
-					scale = (float) d_lightstylevalue[surf->styles[maps]] * 1.0 / 256.0;
-					r00 += (float) lightmap[      0] * scale;g00 += (float) lightmap[      1] * scale;b00 += (float) lightmap[2] * scale;
-					r01 += (float) lightmap[      3] * scale;g01 += (float) lightmap[      4] * scale;b01 += (float) lightmap[5] * scale;
-					r10 += (float) lightmap[line3+0] * scale;g10 += (float) lightmap[line3+1] * scale;b10 += (float) lightmap[line3+2] * scale;
-					r11 += (float) lightmap[line3+3] * scale;g11 += (float) lightmap[line3+4] * scale;b11 += (float) lightmap[line3+5] * scale;
-					lightmap += ((surf->extents[0]>>4)+1) * ((surf->extents[1]>>4)+1)*3; // LordHavoc: *3 for colored lighting
-				}
-
-				color[0] += (float) ((int) ((((((((r11-r10) * dsfrac) >> 4) + r10)-((((r01-r00) * dsfrac) >> 4) + r00)) * dtfrac) >> 4) + ((((r01-r00) * dsfrac) >> 4) + r00)));
-				color[1] += (float) ((int) ((((((((g11-g10) * dsfrac) >> 4) + g10)-((((g01-g00) * dsfrac) >> 4) + g00)) * dtfrac) >> 4) + ((((g01-g00) * dsfrac) >> 4) + g00)));
-				color[2] += (float) ((int) ((((((((b11-b10) * dsfrac) >> 4) + b10)-((((b01-b00) * dsfrac) >> 4) + b00)) * dtfrac) >> 4) + ((((b01-b00) * dsfrac) >> 4) + b00)));
-			}
-			return true; // success
+			*hit_ds = ds;
+			*hit_dt = dt;
+			return surf; // success
 		}
 
 	// go down back side
-		return RecursiveLightPoint (color, node->children[front >= 0], mid, end);
+		return RecursiveLightTrace (node->children[front >= 0], mid, end, hit_ds, hit_dt);
+	}
+}
+
+/*
+=============
+R_SampleLightStyles
+
+The lightmap of surf at ds, dt for each of its styles on their own, at full
+brightness.  Returns the number of styles.
+=============
+*/
+int R_SampleLightStyles (msurface_t *surf, int ds, int dt, byte *styles, int rgb[MAXLIGHTMAPS][3])
+{
+	// LordHavoc: enhanced to interpolate lighting
+	byte *lightmap;
+	int maps, c, line3, dsfrac = ds & 15, dtfrac = dt & 15, c00, c01, c10, c11;
+
+	if (!surf->samples)
+		return 0;
+
+	line3 = ((surf->extents[0]>>4)+1)*3;
+	lightmap = surf->samples + ((dt>>4) * ((surf->extents[0]>>4)+1) + (ds>>4))*3; // LordHavoc: *3 for color
+
+	for (maps = 0;maps < MAXLIGHTMAPS && surf->styles[maps] != 255;maps++)
+	{
+		styles[maps] = surf->styles[maps];
+		for (c = 0;c < 3;c++)
+		{
+			c00 = lightmap[c];
+			c01 = lightmap[3+c];
+			c10 = lightmap[line3+c];
+			c11 = lightmap[line3+3+c];
+			rgb[maps][c] = ((((((c11-c10) * dsfrac) >> 4) + c10)-((((c01-c00) * dsfrac) >> 4) + c00)) * dtfrac >> 4) + ((((c01-c00) * dsfrac) >> 4) + c00);
+		}
+		lightmap += ((surf->extents[0]>>4)+1) * ((surf->extents[1]>>4)+1)*3; // LordHavoc: *3 for colored lighting
 	}
+
+	return maps;
+}
+
+int RecursiveLightPoint (vec3_t color, mnode_t *node, vec3_t start, vec3_t end)
+{
+	msurface_t	*surf;
+	byte		styles[MAXLIGHTMAPS];
+	int			rgb[MAXLIGHTMAPS][3];
+	int			i, maps, ds, dt;
+	float		scale;
+
+	surf = RecursiveLightTrace (node, start, end, &ds, &dt);
+	if (!surf)
+		return false;		// didn't hit anything
+
+	maps = R_SampleLightStyles (surf, ds, dt, styles, rgb);
+	for (i = 0;i < maps;i++)
+	{
+		scale = (float) d_lightstylevalue[styles[i]] * 1.0 / 256.0;
+		color[0] += rgb[i][0] * scale;
+		color[1] += rgb[i][1] * scale;
+		color[2] += rgb[i][2] * scale;
+	}
+	return true;
 }
 
 /*int RecursiveLightPoint (mnode_t *node, vec3_t start, vec3_t end)
@@ -539,22 +569,53 @@ loc0:
 // jkrige - .lit colored lights
 vec3_t lightcolor; // jkrige - used by model rendering
 int R_LightPoint (vec3_t p)
+{
+	return R_LightPointDir (p, lightcolor, NULL);
+}
+
+/*
+=============
+R_LightPointColor
+
+R_LightPoint into color instead of lightcolor, safe to call from jobs
+=============
+*/
+int R_LightPointColor (vec3_t p, vec3_t color)
+{
+	return R_LightPointDir (p, color, NULL);
+}
+
+/*
+=============
+R_LightPointDir
+
+R_LightPointColor that also gives the way to the light from the light grid,
+dir is cleared when the grid can't say
+=============
+*/
+int R_LightPointDir (vec3_t p, vec3_t color, vec3_t dir)
 {
 	vec3_t		end;
 	
+	if (dir)
+		VectorClear (dir);
+
 	if (r_fullbright.value || !cl.worldmodel->lightdata)
 	{
-		lightcolor[0] = lightcolor[1] = lightcolor[2] = 255;
+		color[0] = color[1] = color[2] = 255;
 		return 255;
 	}
+
+	if (R_LightGridSample (p, color, dir))
+		return ((color[0] + color[1] + color[2]) * (1.0f / 3.0f));
 	
 	end[0] = p[0];
 	end[1] = p[1];
 	end[2] = p[2] - 2048;
 
-	lightcolor[0] = lightcolor[1] = lightcolor[2] = 0;
-	RecursiveLightPoint (lightcolor, cl.worldmodel->nodes, p, end);
-	return ((lightcolor[0] + lightcolor[1] + lightcolor[2]) * (1.0f / 3.0f));
+	color[0] = color[1] = color[2] = 0;
+	RecursiveLightPoint (color, cl.worldmodel->nodes, p, end);
+	return ((color[0] + color[1] + color[2]) * (1.0f / 3.0f));
 }
 
 /*int R_LightPoint (vec3_t p)
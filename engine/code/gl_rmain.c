@@ -138,6 +138,9 @@ cvar_t	gl_texturemode = {"gl_texturemode", "2", true};
 cvar_t	gl_coloredlight = {"gl_coloredlight", "0", true};
 // jkrige - .lit colored lights
 
+cvar_t	r_lerpmodels = {"r_lerpmodels", "1", true};
+cvar_t	gl_aliasbuffers = {"gl_aliasbuffers", "1", true};
+
 extern	cvar_t	gl_ztrick;
 
 /*
@@ -240,6 +243,8 @@ void R_DrawSpriteModel (entity_t *e)
 	float		*up, *right;
 	vec3_t		v_forward, v_right, v_up;
 	msprite_t		*psprite;
+	batchvert_t	*v;
+	int			i;
 
 	// don't even bother culling, because it's just a single
 	// polygon without a surface cache
@@ -258,40 +263,35 @@ void R_DrawSpriteModel (entity_t *e)
 		right = vright;
 	}
 
-	glColor3f (1,1,1);
-
 	// jkrige - remove multitexture
 	//GL_DisableMultitexture();
 	// jkrige - remove multitexture
 
-    GL_Bind(frame->gl_texturenum);
-
-	glEnable (GL_ALPHA_TEST);
-	glBegin (GL_QUADS);
+	// batched with the other sprites, R_DrawEntitiesOnList flushes them
+	v = GL_BatchQuad (frame->gl_texturenum, 0);
 
-	glTexCoord2f (0, 1);
 	VectorMA (e->origin, frame->down, up, point);
-	VectorMA (point, frame->left, right, point);
-	glVertex3fv (point);
+	VectorMA (point, frame->left, right, v[0].xyz);
+	v[0].st[0] = 0;
+	v[0].st[1] = 1;
 
-	glTexCoord2f (0, 0);
 	VectorMA (e->origin, frame->up, up, point);
-	VectorMA (point, frame->left, right, point);
-	glVertex3fv (point);
+	VectorMA (point, frame->left, right, v[1].xyz);
+	v[1].st[0] = 0;
+	v[1].st[1] = 0;
 
-	glTexCoord2f (1, 0);
 	VectorMA (e->origin, frame->up, up, point);
-	VectorMA (point, frame->right, right, point);
-	glVertex3fv (point);
+	VectorMA (point, frame->right, right, v[2].xyz);
+	v[2].st[0] = 1;
+	v[2].st[1] = 0;
 
-	glTexCoord2f (1, 1);
 	VectorMA (e->origin, frame->down, up, point);
-	VectorMA (point, frame->right, right, point);
-	glVertex3fv (point);
-	
-	glEnd ();
+	VectorMA (point, frame->right, right, v[3].xyz);
+	v[3].st[0] = 1;
+	v[3].st[1] = 1;
 
-	glDisable (GL_ALPHA_TEST);
+	for (i=0 ; i<4 ; i++)
+		v[i].color[0] = v[i].color[1] = v[i].color[2] = v[i].color[3] = 255;
 }
 
 /*
@@ -303,8 +303,6 @@ void R_DrawSpriteModel (entity_t *e)
 */
 
 
-#define NUMVERTEXNORMALS	162
-
 float	r_avertexnormals[NUMVERTEXNORMALS][3] = {
 #include "anorms.h"
 };
@@ -315,7 +313,6 @@ float	r_avertexnormals[NUMVERTEXNORMALS][3] = {
 
 // jkrige - .lit colored lights
 //float	shadelight, ambientlight;
-float	shadelight;
 // jkrige - .lit colored lights
 
 
@@ -326,41 +323,167 @@ float	r_avertexnormal_dots[SHADEDOT_QUANT][256] =
 #include "anorm_dots.h"
 ;
 
-float	*shadedots = r_avertexnormal_dots[0];
+#define STRINGIFY(A)  #A
 
-// jkrige - static light vector
-float cm_pitch;
-float lightvec[3] = {0.0f, 0.0f, 0.0f};
-// jkrige - static light vector
+#include "../shaders/aliasv.glsl"
+#include "../shaders/aliasf.glsl"
 
+// attribute slots of the alias shader
+enum
+{
+	ALIAS_ATTR_POSE1VERT,
+	ALIAS_ATTR_POSE1NORMAL,
+	ALIAS_ATTR_POSE2VERT,
+	ALIAS_ATTR_POSE2NORMAL,
+	ALIAS_ATTR_TEXCOORD,
+	ALIAS_NUMATTRS
+};
 
-// jkrige - light lerping
-float *shadedots2 = r_avertexnormal_dots[0];
-float lightlerpoffset;
-// jkrige - light lerping
+GLuint	r_aliasprogram;
 
+static GLint	alias_blend, alias_shadevector, alias_shadelight;
+static GLint	alias_lightvec, alias_lightcolor, alias_fullbright;
 
+/*
+=============
+R_CompileAliasShader
 
-int	lastposenum;
+Like phCompile, but says why on the console and returns 0 instead of
+stopping, the immediate mode path is still there
+=============
+*/
+static GLuint R_CompileAliasShader (GLenum type, const char *source)
+{
+	GLchar	buf[256];
+	GLuint	shader;
+	GLint	success;
+
+	shader = glCreateShader (type);
+	glShaderSource (shader, 1, (const GLchar **)&source, 0);
+	glCompileShader (shader);
+	glGetShaderiv (shader, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog (shader, sizeof(buf), 0, buf);
+		Con_Printf ("Alias shader didn't compile:\n%s\n", buf);
+		glDeleteShader (shader);
+		return 0;
+	}
 
-// jkrige - .lit colored lights
-extern vec3_t lightcolor;
-// jkrige - .lit colored lights
+	return shader;
+}
 
+/*
+=============
+R_InitAliasShader
 
-// jkrige - fullbright pixels
-void GL_DrawAliasFrame2 (aliashdr_t *paliashdr, int posenum, int anim, qboolean fullbrights)
+Builds the program that blends two poses and shades alias models
+=============
+*/
+void R_InitAliasShader (void)
 {
-	float	s, t;
-	float 	l;
-	int		i, j;
-	int		index;
-	trivertx_t	*v, *verts;
-	int		list;
-	int		*order;
-	vec3_t	point;
-	float	*normal;
-	int		count;
+	GLchar	buf[256];
+	GLuint	vert, frag, program;
+	GLint	success;
+
+	r_aliasprogram = 0;
+
+	if (!GLEW_VERSION_2_0)
+	{
+		Con_Printf ("OpenGL 2.0 is required for alias vertex buffers\n");
+		return;
+	}
+
+	vert = R_CompileAliasShader (GL_VERTEX_SHADER, aliasv);
+	frag = R_CompileAliasShader (GL_FRAGMENT_SHADER, aliasf);
+	if (!vert || !frag)
+	{
+		if (vert)
+			glDeleteShader (vert);
+		if (frag)
+			glDeleteShader (frag);
+		return;
+	}
+
+	program = glCreateProgram ();
+	glAttachShader (program, vert);
+	glAttachShader (program, frag);
+	glBindAttribLocation (program, ALIAS_ATTR_POSE1VERT, "Pose1Vert");
+	glBindAttribLocation (program, ALIAS_ATTR_POSE1NORMAL, "Pose1Normal");
+	glBindAttribLocation (program, ALIAS_ATTR_POSE2VERT, "Pose2Vert");
+	glBindAttribLocation (program, ALIAS_ATTR_POSE2NORMAL, "Pose2Normal");
+	glBindAttribLocation (program, ALIAS_ATTR_TEXCOORD, "TexCoord");
+	glLinkProgram (program);
+
+	// the program keeps them
+	glDeleteShader (vert);
+	glDeleteShader (frag);
+
+	glGetProgramiv (program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glGetProgramInfoLog (program, sizeof(buf), 0, buf);
+		Con_Printf ("Alias shader didn't link:\n%s\n", buf);
+		glDeleteProgram (program);
+		return;
+	}
+
+	alias_blend = glGetUniformLocation (program, "Blend");
+	alias_shadevector = glGetUniformLocation (program, "ShadeVector");
+	alias_shadelight = glGetUniformLocation (program, "ShadeLight");
+	alias_lightvec = glGetUniformLocation (program, "LightVec");
+	alias_lightcolor = glGetUniformLocation (program, "LightColor");
+	alias_fullbright = glGetUniformLocation (program, "Fullbright");
+
+	GL_UseProgram (program);
+	glUniform1i (glGetUniformLocation (program, "skin"), 0);
+	GL_UseProgram (0);
+
+	r_aliasprogram = program;
+}
+
+// what the job pass works out for an alias entity before anything is drawn
+typedef struct
+{
+	entity_t	*entity;
+	aliashdr_t	*paliashdr;
+	qboolean	culled;
+	qboolean	buffers;		// drawn by the alias shader from the model's buffers
+
+	float		shadelight;
+	vec3_t		lightcolor;
+	vec3_t		lightvec;		// jkrige - static light vector
+	float		*shadedots;		// jkrige - light lerping
+	float		*shadedots2;
+	float		lightlerpoffset;
+
+	int			pose1, pose2;
+	float		blend;
+
+	float		*verts;			// lerped xyz in draw order, for the vertex arrays
+	byte		*colors;		// lit rgba for them
+} aliasprep_t;
+
+#define	ALIASPREP_VERTSIZE	(3*sizeof(float) + 4)
+
+static aliasprep_t	aliaspreps[MAX_VISEDICTS];
+static int			numaliaspreps, nextaliasprep;
+static qboolean		aliaspass;		// between R_BeginAliasModels and R_EndAliasModels
+
+static byte			*aliasscratch;
+static int			aliasscratchsize;
+
+int	lastposenum;
+
+
+/*
+=============
+R_AliasVertexLight
+=============
+*/
+static float R_AliasVertexLight (aliasprep_t *prep, int normalindex)
+{
+	float	l;
 
 	// jkrige - static light vector
 	float dir_light;
@@ -369,143 +492,256 @@ void GL_DrawAliasFrame2 (aliashdr_t *paliashdr, int posenum, int anim, qboolean
 	// jkrige - light lerping
 	float l1, l2, diff;
 	// jkrige - light lerping
-	
-	lastposenum = posenum;
 
-	verts = (trivertx_t *)((byte *)paliashdr + paliashdr->posedata);
-	verts += posenum * paliashdr->poseverts;
-	order = (int *)((byte *)paliashdr + paliashdr->commands);
+	// jkrige - static light vector
+	dir_light = DotProduct(r_avertexnormals[normalindex], prep->lightvec);
+	if (dir_light > 0.0f)
+	{
+		// jkrige - light lerping
+		l1 = (prep->shadedots[normalindex] * prep->shadelight) + dir_light;
+		l2 = (prep->shadedots2[normalindex] * prep->shadelight) + dir_light;
+		//l = ambientlight + dir_light;
+		// jkrige - light lerping
+	}
+	else
+	{
+		// jkrige - light lerping
+		l1 = prep->shadedots[normalindex] * prep->shadelight;
+		l2 = prep->shadedots2[normalindex] * prep->shadelight;
+		//l = ambientlight;
+		// jkrige - light lerping
+	}
+	// jkrige - static light vector
+
 
-	if (fullbrights == true)
+	// jkrige - light lerping
+	if (l1 != l2)
+	{
+		if (l1 > l2)
+		{
+			diff = l1 - l2;
+			diff *= prep->lightlerpoffset;
+			l = l1 - diff;
+		}
+		else
+		{
+			diff = l2 - l1;
+			diff *= prep->lightlerpoffset;
+			l = l1 + diff;
+		}
+	}
+	else
 	{
-		if (r_fullbright.value)
-			return;
+		l = l1;
+	}
+	// jkrige - light lerping
 
-		if(gl_lumatex_render.value != 1)
-			return;
+	return l;
+}
 
-		GL_Bind (JK_LUMA_TEX + paliashdr->gl_texturenum[currententity->skinnum][anim]);
+/*
+=============
+R_AliasLerpVerts
 
-		glDepthMask (GL_FALSE);
-		glEnable(GL_BLEND);
+Blends the two poses into the entity's vertex array and lights every
+vertex, all the per vertex work of the fixed function path
+=============
+*/
+static void R_AliasLerpVerts (aliasprep_t *prep)
+{
+	aliashdr_t	*paliashdr;
+	trivertx_t	*verts1, *verts2;
+	float		*out, blend, l, c;
+	byte		*color;
+	int			i, j;
 
-		glBlendFunc (GL_ONE, GL_ONE);
-	}
+	paliashdr = prep->paliashdr;
+	verts1 = (trivertx_t *)((byte *)paliashdr + paliashdr->posedata);
+	verts2 = verts1 + prep->pose2 * paliashdr->poseverts;
+	verts1 += prep->pose1 * paliashdr->poseverts;
+	blend = prep->blend;
 
-	while (1)
+	out = prep->verts;
+	color = prep->colors;
+	for (i=0 ; i<paliashdr->poseverts ; i++, verts1++, verts2++, out += 3, color += 4)
 	{
-		// get the vertex count and primitive type
-		count = *order++;
-		if (!count)
-			break;		// done
-		if (count < 0)
+		out[0] = verts1->v[0] + (verts2->v[0] - verts1->v[0]) * blend;
+		out[1] = verts1->v[1] + (verts2->v[1] - verts1->v[1]) * blend;
+		out[2] = verts1->v[2] + (verts2->v[2] - verts1->v[2]) * blend;
+
+		l = R_AliasVertexLight (prep, verts1->lightnormalindex);
+		if (verts1 != verts2)
+			l += (R_AliasVertexLight (prep, verts2->lightnormalindex) - l) * blend;
+
+		// jkrige - .lit colored lights
+		for (j=0 ; j<3 ; j++)
 		{
-			count = -count;
-			glBegin (GL_TRIANGLE_FAN);
+			c = l * prep->lightcolor[j] * 255.0f;
+			color[j] = c <= 0 ? 0 : (c >= 255 ? 255 : (byte)c);
 		}
-		else
-			glBegin (GL_TRIANGLE_STRIP);
+		color[3] = 255;
+		// jkrige - .lit colored lights
+	}
+}
 
-		do
-		{
-			// texture coordinates come from the draw list
-			glTexCoord2f (((float *)order)[0], ((float *)order)[1]);
-			order += 2;
+/*
+=============
+GL_DrawAliasArrays
 
-			// normals and vertexes come from the frame list
+Submits the vertex arrays the job pass filled in
+=============
+*/
+void GL_DrawAliasArrays (aliasprep_t *prep, int anim)
+{
+	aliashdr_t		*paliashdr;
+	unsigned short	*indexes;
 
-			if (fullbrights == false)
-			{
-				// jkrige - static light vector
-				dir_light = DotProduct(r_avertexnormals[verts->lightnormalindex], lightvec);
-				if (dir_light > 0.0f)
-				{
-					// jkrige - light lerping
-					l1 = (shadedots[verts->lightnormalindex] * shadelight) + dir_light;
-					l2 = (shadedots2[verts->lightnormalindex] * shadelight) + dir_light;
-					//l = ambientlight + dir_light;
-					// jkrige - light lerping
-				}
-				else
-				{
-					// jkrige - light lerping
-					l1 = shadedots[verts->lightnormalindex] * shadelight;
-					l2 = shadedots2[verts->lightnormalindex] * shadelight;
-					//l = ambientlight;
-					// jkrige - light lerping
-				}
-				// jkrige - static light vector
-
-
-				// jkrige - light lerping
-				if (l1 != l2)
-				{
-					if (l1 > l2)
-					{
-						diff = l1 - l2;
-						diff *= lightlerpoffset;
-						l = l1 - diff;
-					}
-					else
-					{
-						diff = l2 - l1;
-						diff *= lightlerpoffset;
-						l = l1 + diff;
-					}
-				}
-				else
-				{
-					l = l1;
-				}
-				// jkrige - light lerping
-
-
-				// jkrige - .lit colored lights
-				//l = shadedots[verts->lightnormalindex];
-				glColor3f (l * lightcolor[0], l * lightcolor[1], l * lightcolor[2]);
-				//l = shadedots[verts->lightnormalindex] * shadelight;
-				//glColor3f (l, l, l);
-				// jkrige - .lit colored lights
-			}
-			else
-			{
-				glColor3f (1.0f, 1.0f, 1.0f);
-			}
-
-			
-			glVertex3f (verts->v[0], verts->v[1], verts->v[2]);
-			verts++;
-		} while (--count);
+	paliashdr = prep->paliashdr;
+	indexes = (unsigned short *)((byte *)paliashdr + paliashdr->indexes);
 
-		glEnd ();
-	}
+	// a model before this one may have been drawn from buffers
+	GL_UseProgram (0);
+	GL_BindBuffer (GL_ARRAY_BUFFER, 0);
+	GL_BindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	glEnableClientState (GL_VERTEX_ARRAY);
+	glEnableClientState (GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState (GL_COLOR_ARRAY);
+	glVertexPointer (3, GL_FLOAT, 0, prep->verts);
+	glTexCoordPointer (2, GL_FLOAT, 0, (byte *)paliashdr + paliashdr->texcoords);
+	glColorPointer (4, GL_UNSIGNED_BYTE, 0, prep->colors);
+
+	glDrawElements (GL_TRIANGLES, paliashdr->numindexes, GL_UNSIGNED_SHORT, indexes);
 
-	if (fullbrights == true)
+	glDisableClientState (GL_COLOR_ARRAY);
+
+	// jkrige - fullbright pixels
+	if (paliashdr->tex_luma == true && !r_fullbright.value && gl_lumatex_render.value == 1)
 	{
-		glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		GL_Bind (JK_LUMA_TEX + paliashdr->gl_texturenum[currententity->skinnum][anim]);
+
+		GL_DepthMask (GL_FALSE);
+		GL_Enable(GL_BLEND);
+		GL_BlendFunc (GL_ONE, GL_ONE);
+		glColor3f (1.0f, 1.0f, 1.0f);
 
-		glDisable(GL_BLEND);
-		glDepthMask (GL_TRUE);
+		glDrawElements (GL_TRIANGLES, paliashdr->numindexes, GL_UNSIGNED_SHORT, indexes);
+		if (paliashdr->tex_luma8bit == false)
+			glDrawElements (GL_TRIANGLES, paliashdr->numindexes, GL_UNSIGNED_SHORT, indexes);
+
+		GL_BlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		GL_Disable(GL_BLEND);
+		GL_DepthMask (GL_TRUE);
 	}
+	// jkrige - fullbright pixels
+
+	glDisableClientState (GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState (GL_VERTEX_ARRAY);
+
+	// the color array leaves the current color undefined
+	glColor3f (1.0f, 1.0f, 1.0f);
 }
-// jkrige - fullbright pixels
 
 /*
 =============
-GL_DrawAliasFrame
+GL_DrawAliasBuffers
+
+Draws from the model's vertex buffers, the alias shader blends the two
+poses and does the per vertex shading from the entity's uniforms
 =============
 */
-void GL_DrawAliasFrame (aliashdr_t *paliashdr, int posenum, int anim)
+void GL_DrawAliasBuffers (aliasprep_t *prep, int anim)
 {
-	GL_DrawAliasFrame2(paliashdr, posenum, anim, false);
-
-	if (paliashdr->tex_luma == true)
+	aliashdr_t	*paliashdr;
+	model_t		*m;
+	int			posebase, posesize, pass, passes;
+	float		an;
+	vec3_t		shadevector;
+
+	paliashdr = prep->paliashdr;
+	m = currententity->model;
+	posebase = paliashdr->poseverts * 2*sizeof(float);
+	posesize = paliashdr->poseverts * sizeof(aliasvert_t);
+
+	an = currententity->angles[YAW] / 180 * M_PI;
+	shadevector[0] = cos(-an);
+	shadevector[1] = sin(-an);
+	shadevector[2] = 1;
+	VectorNormalize (shadevector);
+
+	GL_UseProgram (r_aliasprogram);
+	glUniform1f (alias_blend, prep->blend);
+	glUniform3fv (alias_shadevector, 1, shadevector);
+	glUniform1f (alias_shadelight, prep->shadelight);
+	glUniform3fv (alias_lightvec, 1, prep->lightvec);
+	glUniform3fv (alias_lightcolor, 1, prep->lightcolor);
+	glUniform1f (alias_fullbright, 0);
+
+	GL_BindBuffer (GL_ARRAY_BUFFER, m->aliasvbo);
+	GL_BindBuffer (GL_ELEMENT_ARRAY_BUFFER, m->aliasibo);
+
+	glEnableVertexAttribArray (ALIAS_ATTR_POSE1VERT);
+	glEnableVertexAttribArray (ALIAS_ATTR_POSE1NORMAL);
+	glEnableVertexAttribArray (ALIAS_ATTR_POSE2VERT);
+	glEnableVertexAttribArray (ALIAS_ATTR_POSE2NORMAL);
+	glEnableVertexAttribArray (ALIAS_ATTR_TEXCOORD);
+
+	glVertexAttribPointer (ALIAS_ATTR_POSE1VERT, 4, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(aliasvert_t),
+		(void *)(size_t)(posebase + prep->pose1 * posesize));
+	glVertexAttribPointer (ALIAS_ATTR_POSE1NORMAL, 3, GL_BYTE, GL_TRUE, sizeof(aliasvert_t),
+		(void *)(size_t)(posebase + prep->pose1 * posesize + 4));
+	glVertexAttribPointer (ALIAS_ATTR_POSE2VERT, 4, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(aliasvert_t),
+		(void *)(size_t)(posebase + prep->pose2 * posesize));
+	glVertexAttribPointer (ALIAS_ATTR_POSE2NORMAL, 3, GL_BYTE, GL_TRUE, sizeof(aliasvert_t),
+		(void *)(size_t)(posebase + prep->pose2 * posesize + 4));
+	glVertexAttribPointer (ALIAS_ATTR_TEXCOORD, 2, GL_FLOAT, GL_FALSE, 0, (void *)0);
+
+	glDrawElements (GL_TRIANGLES, m->aliasnumindexes, GL_UNSIGNED_SHORT, (void *)0);
+
+	// jkrige - fullbright pixels
+	if (paliashdr->tex_luma == true && !r_fullbright.value && gl_lumatex_render.value == 1)
 	{
-		GL_DrawAliasFrame2(paliashdr, posenum, anim, true);
+		GL_Bind (JK_LUMA_TEX + paliashdr->gl_texturenum[currententity->skinnum][anim]);
 
-		if (paliashdr->tex_luma8bit == false)
-			GL_DrawAliasFrame2(paliashdr, posenum, anim, true);
+		GL_DepthMask (GL_FALSE);
+		GL_Enable(GL_BLEND);
+		GL_BlendFunc (GL_ONE, GL_ONE);
+
+		glUniform1f (alias_fullbright, 1);
+
+		passes = (paliashdr->tex_luma8bit == false) ? 2 : 1;
+		for (pass=0 ; pass<passes ; pass++)
+			glDrawElements (GL_TRIANGLES, m->aliasnumindexes, GL_UNSIGNED_SHORT, (void *)0);
+
+		GL_BlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		GL_Disable(GL_BLEND);
+		GL_DepthMask (GL_TRUE);
 	}
+	// jkrige - fullbright pixels
+
+	glDisableVertexAttribArray (ALIAS_ATTR_POSE1VERT);
+	glDisableVertexAttribArray (ALIAS_ATTR_POSE1NORMAL);
+	glDisableVertexAttribArray (ALIAS_ATTR_POSE2VERT);
+	glDisableVertexAttribArray (ALIAS_ATTR_POSE2NORMAL);
+	glDisableVertexAttribArray (ALIAS_ATTR_TEXCOORD);
+
+	// the program and buffers are left for the next model, R_EndAliasModels
+	// puts them back
+}
+
+/*
+=============
+GL_DrawAliasFrame
+=============
+*/
+void GL_DrawAliasFrame (aliasprep_t *prep, int anim)
+{
+	lastposenum = prep->pose2;
+
+	if (prep->buffers)
+		GL_DrawAliasBuffers (prep, anim);
+	else
+		GL_DrawAliasArrays (prep, anim);
 }
 
 
@@ -578,79 +814,112 @@ GL_DrawAliasShadow
 // jkrige - removed alias shadows
 
 
+/*
+=================
+R_AliasLerpPoses
+
+Keeps the two poses the entity blends between, moving on when the frame
+gives a new pose.  Returns how far it is from the first to the second.
+=================
+*/
+float R_AliasLerpPoses (entity_t *e, int pose, float interval)
+{
+	float	blend;
+
+	if (e->lerpmodel != e->model || !r_lerpmodels.value || e->lerpstart > cl.time)
+	{
+		// new model or level, nothing to blend from
+		e->lerpmodel = e->model;
+		e->lerppose1 = e->lerppose2 = pose;
+		e->lerpstart = cl.time;
+		e->lerpinterval = interval;
+		return 1;
+	}
+
+	if (pose != e->lerppose2)
+	{
+		e->lerppose1 = e->lerppose2;
+		e->lerppose2 = pose;
+		e->lerpstart = cl.time;
+		e->lerpinterval = interval;
+	}
+
+	if (e->lerpinterval <= 0)
+		return 1;
+
+	blend = (cl.time - e->lerpstart) / e->lerpinterval;
+	return bound (0, blend, 1);
+}
+
 /*
 =================
 R_SetupAliasFrame
 
 =================
 */
-void R_SetupAliasFrame (int frame, aliashdr_t *paliashdr, int anim)
+void R_SetupAliasFrame (aliasprep_t *prep)
 {
-	int				pose, numposes;
+	aliashdr_t		*paliashdr;
+	int				frame, pose, numposes;
 	float			interval;
 
+	paliashdr = prep->paliashdr;
+	frame = prep->entity->frame;
 	if ((frame >= paliashdr->numframes) || (frame < 0))
 	{
-		Con_DPrintf ("R_AliasSetupFrame: no such frame %d\n", frame);
+		// can't print from a job
+		//Con_DPrintf ("R_AliasSetupFrame: no such frame %d\n", frame);
 		frame = 0;
 	}
 
 	pose = paliashdr->frames[frame].firstpose;
 	numposes = paliashdr->frames[frame].numposes;
 
+	interval = 0.1;		// the server animates at 10 frames a second
 	if (numposes > 1)
 	{
 		interval = paliashdr->frames[frame].interval;
 		pose += (int)(cl.time / interval) % numposes;
 	}
 
-	GL_DrawAliasFrame (paliashdr, pose, anim);
+	prep->blend = R_AliasLerpPoses (prep->entity, pose, interval);
+	prep->pose1 = prep->entity->lerppose1;
+	prep->pose2 = prep->entity->lerppose2;
 }
 
-
-
 /*
 =================
-R_DrawAliasModel
+R_SetupAliasLighting
 
 =================
 */
-void R_DrawAliasModel (entity_t *e)
+void R_SetupAliasLighting (aliasprep_t *prep)
 {
-	int			i, j;
-	int			lnum;
+	entity_t	*e;
+	model_t		*clmodel;
+	int			i, lnum;
+	dlight_t	*dl;
 	vec3_t		dist;
 	float		add;
-	model_t		*clmodel;
-	vec3_t		mins, maxs;
-	aliashdr_t	*paliashdr;
-	trivertx_t	*verts, *v;
-	int			index;
-	float		s, t, an;
-	int			anim;
+	vec3_t		lightdir, angles, forward, right, up;
+
+	// jkrige - static light vector
+	float cm_pitch;
+	// jkrige - static light vector
 
 	// jkrige - light lerping
 	float ang_ceil, ang_floor;
 	// jkrige - light lerping
 
-	clmodel = currententity->model;
-
-	VectorAdd (currententity->origin, clmodel->mins, mins);
-	VectorAdd (currententity->origin, clmodel->maxs, maxs);
-
-	if (R_CullBox (mins, maxs))
-		return;
-
-
-	VectorCopy (currententity->origin, r_entorigin);
-	VectorSubtract (r_origin, r_entorigin, modelorg);
+	e = prep->entity;
+	clmodel = e->model;
 
 	//
 	// get lighting information
 	//
 
 	// jkrige - .lit colored lights
-	shadelight = R_LightPoint(currententity->origin);
+	prep->shadelight = R_LightPointDir (e->origin, prep->lightcolor, lightdir);
 	//ambientlight = shadelight = R_LightPoint (currententity->origin);
 	// jkrige - .lit colored lights
 
@@ -662,15 +931,15 @@ void R_DrawAliasModel (entity_t *e)
 	// jkrige - .lit colored lights
 	if (e == &cl.viewent)
 	{
-		if (lightcolor[0] < 10)
-			lightcolor[0] = 10;
-		if (lightcolor[1] < 10)
-			lightcolor[1] = 10;
-		if (lightcolor[2] < 10)
-			lightcolor[2] = 10;
-
-		if(shadelight < 8)
-			shadelight = 8;
+		if (prep->lightcolor[0] < 10)
+			prep->lightcolor[0] = 10;
+		if (prep->lightcolor[1] < 10)
+			prep->lightcolor[1] = 10;
+		if (prep->lightcolor[2] < 10)
+			prep->lightcolor[2] = 10;
+
+		if(prep->shadelight < 8)
+			prep->shadelight = 8;
 	}
 	//if (e == &cl.viewent && ambientlight < 10)
 	//	ambientlight = shadelight = 10;
@@ -680,44 +949,57 @@ void R_DrawAliasModel (entity_t *e)
 
 
 	// jkrige - glowing rotating items
-	if (currententity->model->flags & EF_ROTATE)
+	if (clmodel->flags & EF_ROTATE)
 	{
-		float shadelightdelta = (255.0f - shadelight) / 2.0f;
-		lightcolor[0] = lightcolor[1] = lightcolor[2] = shadelight + ((shadelightdelta * sin(cl.time * 3.5f)) + shadelightdelta) / 2.0f;
+		float shadelightdelta = (255.0f - prep->shadelight) / 2.0f;
+		prep->lightcolor[0] = prep->lightcolor[1] = prep->lightcolor[2] = prep->shadelight + ((shadelightdelta * sin(cl.time * 3.5f)) + shadelightdelta) / 2.0f;
 	}
 	// jkrige - glowing rotating items
 
 
-	for (lnum=0 ; lnum<MAX_DLIGHTS ; lnum++)
+	// the frame's lights from R_PushDlights, so models and walls agree
+	for (lnum=0 ; lnum<r_numdlights ; lnum++)
 	{
-		if (cl_dlights[lnum].die >= cl.time)
+		dl = r_dlights[lnum];
+		VectorSubtract (e->origin, dl->origin, dist);
+		add = dl->radius - Length(dist);
+
+		// jkrige - .lit colored lights
+		if (add > 0)
 		{
-			VectorSubtract (currententity->origin, cl_dlights[lnum].origin,	dist);
-			add = cl_dlights[lnum].radius - Length(dist);
-
-			// jkrige - .lit colored lights
-			if (add > 0)
-			{
-				lightcolor[0] += add * cl_dlights[lnum].color[0];
-				lightcolor[1] += add * cl_dlights[lnum].color[1];
-				lightcolor[2] += add * cl_dlights[lnum].color[2];
-
-				//ambientlight += add;
-				//ZOID models should be affected by dlights as well
-				//shadelight += add;
-			}
-			// jkrige - .lit colored lights
+			prep->lightcolor[0] += add * dl->color[0];
+			prep->lightcolor[1] += add * dl->color[1];
+			prep->lightcolor[2] += add * dl->color[2];
+
+			//ambientlight += add;
+			//ZOID models should be affected by dlights as well
+			//shadelight += add;
 		}
+		// jkrige - .lit colored lights
 	}
 
 
 	// jkrige - static light vector
 	// Set up light direction (from above)
-    cm_pitch = currententity->angles[PITCH] * ((float)M_PI / 180.0f);
-	lightvec[0] = sin(cm_pitch);
-    lightvec[2] = cos(cm_pitch);
+    cm_pitch = e->angles[PITCH] * ((float)M_PI / 180.0f);
+	prep->lightvec[0] = sin(cm_pitch);
+	prep->lightvec[1] = 0.0f;
+    prep->lightvec[2] = cos(cm_pitch);
 	// jkrige - static light vector
 
+	// the light grid knows where the light comes from, put that in the
+	// model's frame (alias models pitch the other way)
+	if (lightdir[0] || lightdir[1] || lightdir[2])
+	{
+		angles[PITCH] = -e->angles[PITCH];
+		angles[YAW] = e->angles[YAW];
+		angles[ROLL] = e->angles[ROLL];
+		AngleVectors (angles, forward, right, up);
+		prep->lightvec[0] = DotProduct (lightdir, forward);
+		prep->lightvec[1] = -DotProduct (lightdir, right);
+		prep->lightvec[2] = DotProduct (lightdir, up);
+	}
+
 
 	// clamp lighting so it doesn't overbright as much
 	// jkrige - static light vector
@@ -728,19 +1010,19 @@ void R_DrawAliasModel (entity_t *e)
 	// jkrige - static light vector
 
 	// ZOID: never allow players to go totally black
-	i = currententity - cl_entities;
+	i = e - cl_entities;
 	if (i >= 1 && i<=cl.maxclients /* && !strcmp (currententity->model->name, "progs/player.mdl") */)
 	{
 		// jkrige - .lit colored lights
-		if (lightcolor[0] < 10)
-			lightcolor[0] = 10;
-		if (lightcolor[1] < 10)
-			lightcolor[1] = 10;
-		if (lightcolor[2] < 10)
-			lightcolor[2] = 10;
-
-		if(shadelight < 8)
-			shadelight = 8;
+		if (prep->lightcolor[0] < 10)
+			prep->lightcolor[0] = 10;
+		if (prep->lightcolor[1] < 10)
+			prep->lightcolor[1] = 10;
+		if (prep->lightcolor[2] < 10)
+			prep->lightcolor[2] = 10;
+
+		if(prep->shadelight < 8)
+			prep->shadelight = 8;
 		//if (ambientlight < 8)
 		//	ambientlight = shadelight = 8;
 		// jkrige - .lit colored lights
@@ -773,30 +1055,210 @@ void R_DrawAliasModel (entity_t *e)
 		| !strcmp (clmodel->name, "progs/end4.mdl") // jkrige - end1 fullbright
 		)
 	{
-		lightcolor[0] = lightcolor[1] = lightcolor[2] = 256;
-		shadelight = 256;
+		prep->lightcolor[0] = prep->lightcolor[1] = prep->lightcolor[2] = 256;
+		prep->shadelight = 256;
 		//ambientlight = shadelight = 256;
 	}
 	
 
 	// jkrige - light lerping
-	lightlerpoffset = e->angles[YAW] * (SHADEDOT_QUANT / 360.0);
-	ang_ceil = ceil(lightlerpoffset);
-	ang_floor = floor(lightlerpoffset);
+	prep->lightlerpoffset = e->angles[YAW] * (SHADEDOT_QUANT / 360.0);
+	ang_ceil = ceil(prep->lightlerpoffset);
+	ang_floor = floor(prep->lightlerpoffset);
 	
-	lightlerpoffset = ang_ceil - lightlerpoffset;
+	prep->lightlerpoffset = ang_ceil - prep->lightlerpoffset;
 	//shadedots = r_avertexnormal_dots[((int)(e->angles[1] * (SHADEDOT_QUANT / 360.0))) & (SHADEDOT_QUANT - 1)];
-	shadedots = r_avertexnormal_dots[(int)ang_ceil & (SHADEDOT_QUANT - 1)];
-	shadedots2 = r_avertexnormal_dots[(int)ang_floor & (SHADEDOT_QUANT - 1)];
+	prep->shadedots = r_avertexnormal_dots[(int)ang_ceil & (SHADEDOT_QUANT - 1)];
+	prep->shadedots2 = r_avertexnormal_dots[(int)ang_floor & (SHADEDOT_QUANT - 1)];
 	// jkrige - light lerping
 
 
 	// jkrige - .lit colored lights
-	VectorScale(lightcolor, 1.0f / 192.0f, lightcolor);
-	shadelight = shadelight / 192.0;
+	VectorScale(prep->lightcolor, 1.0f / 192.0f, prep->lightcolor);
+	prep->shadelight = prep->shadelight / 192.0;
 	// jkrige - .lit colored lights
 
 	
+}
+
+/*
+=================
+R_PrepareAliasModel
+
+Job for one entity of the pass: lighting, poses, and the vertex arrays
+when it isn't drawn from buffers
+=================
+*/
+void R_PrepareAliasModel (void *parm, int index)
+{
+	aliasprep_t	*prep;
+
+	prep = (aliasprep_t *)parm + index;
+	if (prep->culled)
+		return;
+
+	R_SetupAliasLighting (prep);
+	R_SetupAliasFrame (prep);
+
+	if (!prep->buffers)
+		R_AliasLerpVerts (prep);
+}
+
+/*
+=================
+R_PrepareAliasModels
+
+Does all the per entity and per vertex work for the alias models in the
+list on the job threads, so drawing them is only GL calls.  Anything that
+can load or print is done here first.
+=================
+*/
+void R_PrepareAliasModels (entity_t **list, int count)
+{
+	aliasprep_t	*prep;
+	entity_t	*e;
+	vec3_t		mins, maxs;
+	int			i, size;
+	byte		*scratch;
+
+	numaliaspreps = nextaliasprep = 0;
+	for (i=0 ; i<count ; i++)
+	{
+		e = list[i];
+		if (e->model->type != mod_alias)
+			continue;
+
+		prep = &aliaspreps[numaliaspreps++];
+		prep->entity = e;
+
+		VectorAdd (e->origin, e->model->mins, mins);
+		VectorAdd (e->origin, e->model->maxs, maxs);
+		prep->culled = e->occluded || R_CullBox (mins, maxs);
+		if (!prep->culled)
+			Mod_Extradata (e->model);
+	}
+
+// bringing a model back into the cache can move or flush the ones before it,
+// so only take the pointers once they are all in
+	size = 0;
+	for (i=0, prep=aliaspreps ; i<numaliaspreps ; i++, prep++)
+	{
+		if (prep->culled)
+			continue;
+
+		prep->paliashdr = (aliashdr_t *)Cache_Check (&prep->entity->model->cache);
+		if (!prep->paliashdr)
+		{
+			prep->culled = true;	// thrashing, back next frame
+			continue;
+		}
+
+		prep->buffers = gl_aliasbuffers.value && prep->entity->model->aliasnumindexes;
+		if (!prep->buffers)
+			size += prep->paliashdr->poseverts * ALIASPREP_VERTSIZE;
+	}
+
+	if (size > aliasscratchsize)
+	{
+		aliasscratch = realloc (aliasscratch, size);
+		if (!aliasscratch)
+			Sys_Error ("R_PrepareAliasModels: couldn't allocate %i bytes", size);
+		aliasscratchsize = size;
+	}
+
+	scratch = aliasscratch;
+	for (i=0, prep=aliaspreps ; i<numaliaspreps ; i++, prep++)
+	{
+		if (prep->culled || prep->buffers)
+			continue;
+
+		prep->verts = (float *)scratch;
+		scratch += prep->paliashdr->poseverts * 3*sizeof(float);
+		prep->colors = scratch;
+		scratch += prep->paliashdr->poseverts * 4;
+	}
+
+	PROF_BEGIN ("R_PrepareAliasModels");
+	Job_Run (R_PrepareAliasModel, aliaspreps, numaliaspreps);
+	PROF_END ();
+}
+
+/*
+=================
+R_BeginAliasModels
+
+Sets the state every alias model is drawn with
+=================
+*/
+void R_BeginAliasModels (void)
+{
+	if (gl_smoothmodels.value)
+		GL_ShadeModel (GL_SMOOTH);
+	GL_TexEnvMode (GL_MODULATE);
+
+	if (gl_affinemodels.value)
+		glHint (GL_PERSPECTIVE_CORRECTION_HINT, GL_FASTEST);
+
+	aliaspass = true;
+}
+
+/*
+=================
+R_EndAliasModels
+=================
+*/
+void R_EndAliasModels (void)
+{
+	GL_UseProgram (0);
+	GL_BindBuffer (GL_ARRAY_BUFFER, 0);
+	GL_BindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	GL_TexEnvMode (GL_REPLACE);
+	GL_ShadeModel (GL_FLAT);
+	if (gl_affinemodels.value)
+		glHint (GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST);
+
+	aliaspass = false;
+}
+
+/*
+=================
+R_DrawAliasModel
+
+Draws e from the last R_PrepareAliasModels, preparing it on its own if it
+wasn't part of that.  Sets up the alias model state itself when it isn't
+drawn between R_BeginAliasModels and R_EndAliasModels.
+=================
+*/
+void R_DrawAliasModel (entity_t *e)
+{
+	aliasprep_t	*prep;
+	aliashdr_t	*paliashdr;
+	model_t		*clmodel;
+	int			i;
+	int			anim;
+
+	if (!aliaspass)
+	{
+		R_BeginAliasModels ();
+		R_DrawAliasModel (e);
+		R_EndAliasModels ();
+		return;
+	}
+
+	if (nextaliasprep == numaliaspreps || aliaspreps[nextaliasprep].entity != e)
+		R_PrepareAliasModels (&e, 1);
+	prep = &aliaspreps[nextaliasprep++];
+
+	if (prep->culled)
+		return;
+
+	clmodel = e->model;
+	paliashdr = prep->paliashdr;
+
+	VectorCopy (e->origin, r_entorigin);
+	VectorSubtract (r_origin, r_entorigin, modelorg);
+
 	// jkrige - removed alias shadows
 	//an = e->angles[1]/180*M_PI;
 	//shadevector[0] = cos(-an);
@@ -805,11 +1267,6 @@ void R_DrawAliasModel (entity_t *e)
 	//VectorNormalize (shadevector);
 	// jkrige - removed alias shadows
 
-	//
-	// locate the proper data
-	//
-	paliashdr = (aliashdr_t *)Mod_Extradata (currententity->model);
-
 	c_alias_polys += paliashdr->numtris;
 
 	//
@@ -828,7 +1285,7 @@ void R_DrawAliasModel (entity_t *e)
 	if (!strcmp (clmodel->name, "progs/eyes.mdl") && gl_doubleeyes.value)
 	{
 		glTranslatef (paliashdr->scale_origin[0], paliashdr->scale_origin[1], paliashdr->scale_origin[2] - (22 + 8));
-		
+
 		// double size of eyes, since they are really hard to see in gl
 		glScalef (paliashdr->scale[0]*2, paliashdr->scale[1]*2, paliashdr->scale[2]*2);
 	}
@@ -839,34 +1296,18 @@ void R_DrawAliasModel (entity_t *e)
 	}
 
 	anim = (int)(cl.time*10) & 3;
-    GL_Bind(paliashdr->gl_texturenum[currententity->skinnum][anim]);
+    GL_Bind(paliashdr->gl_texturenum[e->skinnum][anim]);
 
 	// we can't dynamically colormap textures, so they are cached
 	// seperately for the players.  Heads are just uncolored.
-	if (currententity->colormap != vid.colormap && !gl_nocolors.value)
+	if (e->colormap != vid.colormap && !gl_nocolors.value)
 	{
-		i = currententity - cl_entities;
+		i = e - cl_entities;
 		if (i >= 1 && i<=cl.maxclients /* && !strcmp (currententity->model->name, "progs/player.mdl") */)
 		    GL_Bind(playertextures - 1 + i);
 	}
 
-	if (gl_smoothmodels.value)
-		glShadeModel (GL_SMOOTH);
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-
-	if (gl_affinemodels.value)
-		glHint (GL_PERSPECTIVE_CORRECTION_HINT, GL_FASTEST);
-
-
-	R_SetupAliasFrame (currententity->frame, paliashdr, anim);
-
-
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-
-	glShadeModel (GL_FLAT);
-	if (gl_affinemodels.value)
-		glHint (GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST);
-
+	GL_DrawAliasFrame (prep, anim);
 
 	glPopMatrix ();
 
@@ -890,6 +1331,33 @@ void R_DrawAliasModel (entity_t *e)
 
 //==================================================================================
 
+static entity_t	*r_sortedents[MAX_VISEDICTS];
+
+/*
+=============
+R_EntitySortCmp
+
+Brush models, then alias models, then sprites, and within each the same
+model and skin together so they share textures and state
+=============
+*/
+static int R_EntitySortCmp (const void *a, const void *b)
+{
+	static int	typeorder[] = {0, 2, 1};	// mod_brush, mod_sprite, mod_alias
+	entity_t	*e1, *e2;
+
+	e1 = *(entity_t **)a;
+	e2 = *(entity_t **)b;
+
+	if (e1->model->type != e2->model->type)
+		return typeorder[e1->model->type] - typeorder[e2->model->type];
+	if (e1->model != e2->model)
+		return e1->model < e2->model ? -1 : 1;
+	if (e1->skinnum != e2->skinnum)
+		return e1->skinnum - e2->skinnum;
+	return e1 < e2 ? -1 : e1 > e2;		// keeps the order the same frame to frame
+}
+
 /*
 =============
 R_DrawEntitiesOnList
@@ -897,42 +1365,43 @@ R_DrawEntitiesOnList
 */
 void R_DrawEntitiesOnList (void)
 {
-	int		i;
+	int		i, count;
 
 	if (!r_drawentities.value)
 		return;
 
-	// draw sprites seperately, because of alpha blending
-	for (i=0 ; i<cl_numvisedicts ; i++)
-	{
-		currententity = cl_visedicts[i];
+	count = cl_numvisedicts;
+	memcpy (r_sortedents, cl_visedicts, count * sizeof(*r_sortedents));
+	qsort (r_sortedents, count, sizeof(*r_sortedents), R_EntitySortCmp);
 
-		switch (currententity->model->type)
-		{
-		case mod_alias:
-			R_DrawAliasModel (currententity);
-			break;
+	// alias models are prepared in the order they are drawn
+	R_OcclusionTestEntities (r_sortedents, count);
+	R_PrepareAliasModels (r_sortedents, count);
 
-		case mod_brush:
+	for (i=0 ; i<count && r_sortedents[i]->model->type == mod_brush ; i++)
+	{
+		currententity = r_sortedents[i];
+		if (!currententity->occluded)
 			R_DrawBrushModel (currententity);
-			break;
-
-		default:
-			break;
-		}
 	}
 
-	for (i=0 ; i<cl_numvisedicts ; i++)
+	R_BeginAliasModels ();
+	for ( ; i<count && r_sortedents[i]->model->type == mod_alias ; i++)
 	{
-		currententity = cl_visedicts[i];
+		currententity = r_sortedents[i];
+		R_DrawAliasModel (currententity);
+	}
+	R_EndAliasModels ();
 
-		switch (currententity->model->type)
-		{
-		case mod_sprite:
-			R_DrawSpriteModel (currententity);
-			break;
-		}
+	// draw sprites seperately, because of alpha blending
+	GL_Enable (GL_ALPHA_TEST);
+	for ( ; i<count ; i++)
+	{
+		currententity = r_sortedents[i];
+		R_DrawSpriteModel (currententity);
 	}
+	GL_FlushBatch ();
+	GL_Disable (GL_ALPHA_TEST);
 }
 
 /*
@@ -1038,12 +1507,12 @@ void R_PolyBlend (void)
 	if (!v_blend[3])
 		return;
 
-	glAlphaFunc(GL_ALWAYS, 0);
+	GL_AlphaFunc(GL_ALWAYS, 0);
 
 	glLoadIdentity ();
 
-	glEnable (GL_BLEND);
-	glDisable (GL_TEXTURE_2D);
+	GL_Enable (GL_BLEND);
+	GL_Disable (GL_TEXTURE_2D);
 
 	glColor4fv (v_blend);
 
@@ -1056,10 +1525,10 @@ void R_PolyBlend (void)
 
 	glColor4f (1,1,1,1);
 
-	glEnable (GL_TEXTURE_2D);
-	glDisable (GL_BLEND);
+	GL_Enable (GL_TEXTURE_2D);
+	GL_Disable (GL_BLEND);
 
-	glAlphaFunc(GL_GREATER, 0.632);
+	GL_AlphaFunc(GL_GREATER, 0.632);
 }
 /*void R_PolyBlend (void)
 {
@@ -1304,10 +1773,10 @@ void R_SetupGL (void)
 			glScalef (1, -1, 1);
 		else
 			glScalef (-1, 1, 1);
-		glCullFace(GL_BACK);
+		GL_CullFace(GL_BACK);
 	}
 	else
-		glCullFace(GL_FRONT);
+		GL_CullFace(GL_FRONT);
 
 	glMatrixMode(GL_MODELVIEW);
     glLoadIdentity ();
@@ -1325,13 +1794,13 @@ void R_SetupGL (void)
 	// set drawing parms
 	//
 	if (gl_cull.value)
-		glEnable(GL_CULL_FACE);
+		GL_Enable(GL_CULL_FACE);
 	else
-		glDisable(GL_CULL_FACE);
+		GL_Disable(GL_CULL_FACE);
 
-	glDisable(GL_BLEND);
-	glDisable(GL_ALPHA_TEST);
-	glEnable(GL_DEPTH_TEST);
+	GL_Disable(GL_BLEND);
+	GL_Disable(GL_ALPHA_TEST);
+	GL_Enable(GL_DEPTH_TEST);
 }
 
 /*
@@ -1343,6 +1812,10 @@ r_refdef must be set before the first call
 */
 void R_RenderScene (void)
 {
+	double	stagestart;
+
+	stagestart = Host_StageStart ();
+
 	R_SetupFrame ();
 
 	R_SetFrustum ();
@@ -1351,12 +1824,21 @@ void R_RenderScene (void)
 
 	R_MarkLeaves ();	// done here so we know if we're in water
 
+	Host_StageEnd (fs_rsetup, stagestart);
+	stagestart = Host_StageStart ();
+
 	R_DrawWorld ();		// adds static entities to the list
 
+	Host_StageEnd (fs_world, stagestart);
+
 	S_ExtraUpdate ();	// don't let sound get messed up if going slow
 
+	stagestart = Host_StageStart ();
+
 	R_DrawEntitiesOnList ();
 
+	Host_StageEnd (fs_entities, stagestart);
+
 	// jkrige - remove multitexture
 	//GL_DisableMultitexture();
 	// jkrige - remove multitexture
@@ -1365,7 +1847,9 @@ void R_RenderScene (void)
 	//R_RenderDlights ();
 	// jkrige - flashblend removal
 
+	stagestart = Host_StageStart ();
 	R_DrawParticles ();
+	Host_StageEnd (fs_particles, stagestart);
 
 #ifdef GLTEST
 	Test_Draw ();
@@ -1389,7 +1873,7 @@ void R_Clear (void)
 			glClear (GL_DEPTH_BUFFER_BIT);
 		gldepthmin = 0;
 		gldepthmax = 0.5;
-		glDepthFunc (GL_LEQUAL);
+		GL_DepthFunc (GL_LEQUAL);
 	}
 	else if (gl_ztrick.value)
 	{
@@ -1403,13 +1887,13 @@ void R_Clear (void)
 		{
 			gldepthmin = 0;
 			gldepthmax = 0.49999;
-			glDepthFunc (GL_LEQUAL);
+			GL_DepthFunc (GL_LEQUAL);
 		}
 		else
 		{
 			gldepthmin = 1;
 			gldepthmax = 0.5;
-			glDepthFunc (GL_GEQUAL);
+			GL_DepthFunc (GL_GEQUAL);
 		}
 	}
 	else
@@ -1420,7 +1904,7 @@ void R_Clear (void)
 			glClear (GL_DEPTH_BUFFER_BIT);
 		gldepthmin = 0;
 		gldepthmax = 1;
-		glDepthFunc (GL_LEQUAL);
+		GL_DepthFunc (GL_LEQUAL);
 	}
 
 	glDepthRange (gldepthmin, gldepthmax);
@@ -1462,7 +1946,7 @@ void R_Mirror (void)
 	gldepthmin = 0.5;
 	gldepthmax = 1;
 	glDepthRange (gldepthmin, gldepthmax);
-	glDepthFunc (GL_LEQUAL);
+	GL_DepthFunc (GL_LEQUAL);
 
 	R_RenderScene ();
 	R_DrawWaterSurfaces ();
@@ -1470,16 +1954,16 @@ void R_Mirror (void)
 	gldepthmin = 0;
 	gldepthmax = 0.5;
 	glDepthRange (gldepthmin, gldepthmax);
-	glDepthFunc (GL_LEQUAL);
+	GL_DepthFunc (GL_LEQUAL);
 
 	// blend on top
-	glEnable (GL_BLEND);
+	GL_Enable (GL_BLEND);
 	glMatrixMode(GL_PROJECTION);
 	if (mirror_plane->normal[2])
 		glScalef (1,-1,1);
 	else
 		glScalef (-1,1,1);
-	glCullFace(GL_FRONT);
+	GL_CullFace(GL_FRONT);
 	glMatrixMode(GL_MODELVIEW);
 
 	glLoadMatrixf (r_base_world_matrix);
@@ -1489,7 +1973,7 @@ void R_Mirror (void)
 	for ( ; s ; s=s->texturechain)
 		R_RenderBrushPoly (s);
 	cl.worldmodel->textures[mirrortexturenum]->texturechain = NULL;
-	glDisable (GL_BLEND);
+	GL_Disable (GL_BLEND);
 	glColor4f (1,1,1,1);
 }
 
@@ -1511,12 +1995,16 @@ void R_RenderView (void)
 	if (!r_worldentity.model || !cl.worldmodel)
 		Sys_Error ("R_RenderView: NULL worldmodel");
 
+	PROF_BEGIN ("R_RenderView");
+
 	if (r_speeds.value)
 	{
 		glFinish ();
 		time1 = Sys_FloatTime ();
 		c_brush_polys = 0;
 		c_alias_polys = 0;
+		c_gl_statecalls = c_gl_statedropped = 0;
+		c_gl_binds = c_gl_bindsdropped = 0;
 	}
 
 	mirror = false;
@@ -1570,5 +2058,10 @@ void R_RenderView (void)
 //		glFinish ();
 		time2 = Sys_FloatTime ();
 		Con_Printf ("%3i ms  %4i wpoly %4i epoly\n", (int)((time2-time1)*1000), c_brush_polys, c_alias_polys); 
+		if (r_occlusion.value)
+			Con_Printf ("%4i queries %3i ents %4i leafs occluded\n", c_occlusion_queries, c_occluded_entities, c_occluded_leafs);
+		Con_Printf ("%4i gl state calls (%4i dropped) %4i binds (%4i dropped)\n", c_gl_statecalls, c_gl_statedropped, c_gl_binds, c_gl_bindsdropped);
 	}
+
+	PROF_END ();
 }
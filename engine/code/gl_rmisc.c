@@ -104,7 +104,7 @@ void R_InitParticleTexture_Linear (void)
 	}
 	glTexImage2D (GL_TEXTURE_2D, 0, gl_alpha_format, 8, 8, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
 
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	GL_TexEnvMode (GL_MODULATE);
 
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -133,7 +133,7 @@ void R_InitParticleTexture_Point (void)
 	}
 	glTexImage2D (GL_TEXTURE_2D, 0, gl_alpha_format, 8, 8, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
 
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	GL_TexEnvMode (GL_MODULATE);
 
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -229,6 +229,8 @@ void R_Init (void)
 	Cmd_AddCommand ("timerefresh", R_TimeRefresh_f);	
 	Cmd_AddCommand ("envmap", R_Envmap_f);	
 	Cmd_AddCommand ("pointfile", R_ReadPointFile_f);	
+	Cmd_AddCommand ("campath", R_CamPath_f);
+	Cmd_AddCommand ("worldbench", R_WorldBench_f);
 
 	Cvar_RegisterVariable (&r_norefresh);
 	Cvar_RegisterVariable (&r_lightmap);
@@ -244,6 +246,9 @@ void R_Init (void)
 
 	// jkrige - fix dynamic light shine through
 	Cvar_RegisterVariable (&r_dynamic_sidemark);
+	Cvar_RegisterVariable (&r_maxdlights);
+	Cvar_RegisterVariable (&r_worldwalk);
+	Cvar_RegisterVariable (&r_occlusion);
 	// jkrige - fix dynamic light shine through
 
 	// jkrige - remove gl_finish
@@ -289,6 +294,13 @@ void R_Init (void)
 	Cvar_RegisterVariable (&gl_coloredlight);
 	// jkrige - .lit colored lights
 
+	Cvar_RegisterVariable (&r_lightgrid);
+	Cvar_RegisterVariable (&r_lerpmodels);
+	Cvar_RegisterVariable (&gl_aliasbuffers);
+	Cvar_RegisterVariable (&gl_statecache);
+	R_InitAliasShader ();
+	R_InitOcclusion ();
+
 	R_InitParticles ();
 	R_InitParticleTexture ();
 
@@ -447,7 +459,7 @@ void R_TranslatePlayerSkin (int playernum)
 	}
 	glTexImage2D (GL_TEXTURE_2D, 0, gl_solid_format, scaled_width, scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	GL_TexEnvMode (GL_MODULATE);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 #endif
@@ -479,6 +491,8 @@ void R_NewMap (void)
 	R_ClearParticles ();
 
 	GL_BuildLightmaps ();
+	R_BuildLightGrid ();
+	R_BuildSurfaceBuckets ();
 
 	// identify sky texture
 	skytexturenum = -1;
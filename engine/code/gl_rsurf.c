@@ -21,8 +21,15 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define	WORLD_SSE
+#include <xmmintrin.h>
+#endif
+
 int			skytexturenum;
 
+cvar_t		r_worldwalk = {"r_worldwalk", "1"};	// 0 is the old recursive walk, for worldbench
+
 #ifndef GL_RGBA4
 #define	GL_RGBA4	0
 #endif
@@ -73,17 +80,22 @@ void R_RenderDynamicLightmaps (msurface_t *fa);
 /*
 ===============
 R_AddDynamicLights
+
+Adds the lights R_MarkLights put on the surface's list, each only over
+the texels inside the square its radius can reach
 ===============
 */
 void R_AddDynamicLights (msurface_t *surf)
 {
-	int			lnum;
+	int			link;
+	dlight_t	*light;
 	int			sd, td;
 	float		dist, rad, minlight;
 	vec3_t		impact, local;
 	int			s, t;
 	int			i;
 	int			smax, tmax;
+	int			s0, s1, t0, t1;
 	mtexinfo_t	*tex;
 
 	// jkrige - .lit colored lights
@@ -95,33 +107,22 @@ void R_AddDynamicLights (msurface_t *surf)
 	tmax = (surf->extents[1]>>4)+1;
 	tex = surf->texinfo;
 
-	for (lnum=0 ; lnum<MAX_DLIGHTS ; lnum++)
+	for (link = surf->dlights ; link != -1 ; link = r_surfdlights[link].next)
 	{
-		// jkrige - increase dlights
-		//if ( !(surf->dlightbits & (1<<lnum) ) )
-		//	continue;		// not lit by this light
+		light = r_dlights[r_surfdlights[link].light];
 
-		// dead light .. id forgot this...!!! 
-		if (cl_dlights[lnum].die < cl.time)
-			continue;
-
-		// not marked for checking by this light 
-		if (!(surf->dlightbits[(lnum >> 3)] & (1 << (lnum & 7))))
-			continue;
-		// jkrige - increase dlights
-
-		rad = cl_dlights[lnum].radius;
-		dist = DotProduct (cl_dlights[lnum].origin, surf->plane->normal) -
+		rad = light->radius;
+		dist = DotProduct (light->origin, surf->plane->normal) -
 				surf->plane->dist;
 		rad -= fabs(dist);
-		minlight = cl_dlights[lnum].minlight;
+		minlight = light->minlight;
 		if (rad < minlight)
 			continue;
 		minlight = rad - minlight;
 
 		for (i=0 ; i<3 ; i++)
 		{
-			impact[i] = cl_dlights[lnum].origin[i] -
+			impact[i] = light->origin[i] -
 					surf->plane->normal[i]*dist;
 		}
 
@@ -131,19 +132,33 @@ void R_AddDynamicLights (msurface_t *surf)
 		local[0] -= surf->texturemins[0];
 		local[1] -= surf->texturemins[1];
 
-		
+		// texels further than minlight along s or t are never lit, the
+		// extra unit covers the distances being truncated
+		s0 = (int)floor ((local[0] - minlight - 1) / 16);
+		s1 = (int)ceil ((local[0] + minlight + 1) / 16);
+		t0 = (int)floor ((local[1] - minlight - 1) / 16);
+		t1 = (int)ceil ((local[1] + minlight + 1) / 16);
+		if (s0 < 0)
+			s0 = 0;
+		if (s1 > smax - 1)
+			s1 = smax - 1;
+		if (t0 < 0)
+			t0 = 0;
+		if (t1 > tmax - 1)
+			t1 = tmax - 1;
+
 		// jkrige - .lit colored lights
-		bl = blocklightscolor;
-		cred = cl_dlights[lnum].color[0] * 256.0f;
-		cgreen = cl_dlights[lnum].color[1] * 256.0f;
-		cblue = cl_dlights[lnum].color[2] * 256.0f;
+		cred = light->color[0] * 256.0f;
+		cgreen = light->color[1] * 256.0f;
+		cblue = light->color[2] * 256.0f;
 
-		for (t = 0; t < tmax; t++)
+		for (t = t0; t <= t1; t++)
 		{
 			td = local[1] - t*16;
 			if (td < 0)
 				td = -td;
-			for (s = 0; s < smax; s++)
+			bl = blocklightscolor + (t*smax + s0)*3;
+			for (s = s0; s <= s1; s++)
 			{
 				sd = local[0] - s*16;
 				if (sd < 0)
@@ -302,6 +317,7 @@ void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
 		lightshift = 7;
 	// jkrige - overbrights
 
+	PROF_BEGIN ("R_BuildLightMap");
 
 	surf->cached_dlight = (surf->dlightframe == r_framecount);
 
@@ -482,6 +498,8 @@ store:
 	default:
 		Sys_Error ("Bad lightmap format");
 	}
+
+	PROF_END ();
 }
 
 
@@ -600,7 +618,7 @@ void R_DrawSequentialPoly (msurface_t *s)
 		glEnd ();
 
 		GL_Bind (lightmap_textures + s->lightmaptexturenum);
-		glEnable (GL_BLEND);
+		GL_Enable (GL_BLEND);
 		glBegin (GL_POLYGON);
 		v = p->verts[0];
 		for (i=0 ; i<p->numverts ; i++, v+= VERTEXSIZE)
@@ -610,7 +628,7 @@ void R_DrawSequentialPoly (msurface_t *s)
 		}
 		glEnd ();
 
-		glDisable (GL_BLEND);
+		GL_Disable (GL_BLEND);
 
 		return;
 	}
@@ -636,16 +654,16 @@ void R_DrawSequentialPoly (msurface_t *s)
 
 		EmitSkyPolys (s);
 
-		glEnable (GL_BLEND);
-		glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		GL_Enable (GL_BLEND);
+		GL_BlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 		GL_Bind (alphaskytexture);
 		speedscale = realtime*16;
 		speedscale -= (int)speedscale;
 		EmitSkyPolys (s);
 		if (gl_lightmap_format == GL_LUMINANCE)
-			glBlendFunc (GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+			GL_BlendFunc (GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
 
-		glDisable (GL_BLEND);
+		GL_Disable (GL_BLEND);
 	}
 
 	//
@@ -658,9 +676,9 @@ void R_DrawSequentialPoly (msurface_t *s)
 	DrawGLWaterPoly (p);
 
 	GL_Bind (lightmap_textures + s->lightmaptexturenum);
-	glEnable (GL_BLEND);
+	GL_Enable (GL_BLEND);
 	DrawGLWaterPolyLightmap (p);
-	glDisable (GL_BLEND);
+	GL_Disable (GL_BLEND);
 }
 #else
 /*
@@ -739,24 +757,24 @@ void R_DrawSequentialPoly (msurface_t *s)
 			glEnd ();
 
 			GL_Bind (lightmap_textures + s->lightmaptexturenum);
-			glEnable (GL_BLEND);
+			GL_Enable (GL_BLEND);
 
 			// jkrige - .lit colored lights
 			if (gl_lightmap_format == GL_LUMINANCE)
 			{
-				glBlendFunc (GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+				GL_BlendFunc (GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
 			}
 			else if (gl_lightmap_format == GL_INTENSITY)
 			{
-				glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+				GL_TexEnvMode (GL_MODULATE);
 				glColor4f (0.0f,0.0f,0.0f,1.0f);
-				glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+				GL_BlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 			}
 			else if (gl_lightmap_format == GL_RGBA)
 			{
-				glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+				GL_TexEnvMode (GL_MODULATE);
 				glColor4f (1.0f,1.0f,1.0f, 1.0f);
-				glBlendFunc(GL_ZERO, GL_SRC_COLOR);
+				GL_BlendFunc(GL_ZERO, GL_SRC_COLOR);
 			}
 			// jkrige - .lit colored lights
 
@@ -769,7 +787,7 @@ void R_DrawSequentialPoly (msurface_t *s)
 			}
 			glEnd ();
 
-			glDisable (GL_BLEND);
+			GL_Disable (GL_BLEND);
 		//} // jkrige - remove multitexture
 
 		return;
@@ -804,13 +822,13 @@ void R_DrawSequentialPoly (msurface_t *s)
 		speedscale -= (int)speedscale & ~127;
 		EmitSkyPolys (s);
 
-		glEnable (GL_BLEND);
+		GL_Enable (GL_BLEND);
 		GL_Bind (alphaskytexture);
 		speedscale = realtime*16;
 		speedscale -= (int)speedscale & ~127;
 		EmitSkyPolys (s);
 
-		glDisable (GL_BLEND);
+		GL_Disable (GL_BLEND);
 		return;
 	}
 
@@ -864,32 +882,32 @@ void R_DrawSequentialPoly (msurface_t *s)
 		DrawGLWaterPoly (p);
 
 		GL_Bind (lightmap_textures + s->lightmaptexturenum);
-		glEnable (GL_BLEND);
+		GL_Enable (GL_BLEND);
 
 		// jkrige - .lit colored lights
 		if (gl_lightmap_format == GL_LUMINANCE)
 		{
-			glBlendFunc (GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+			GL_BlendFunc (GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
 		}
 		else if (gl_lightmap_format == GL_INTENSITY)
 		{
-			glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+			GL_TexEnvMode (GL_MODULATE);
 			glColor4f (0.0f,0.0f,0.0f,1.0f);
-			glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			GL_BlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 		}
 		else if (gl_lightmap_format == GL_RGBA)
 		{
-			glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+			GL_TexEnvMode (GL_MODULATE);
 			glColor4f (1.0f,1.0f,1.0f, 1.0f);
-			glBlendFunc(GL_ZERO, GL_SRC_COLOR);
+			GL_BlendFunc(GL_ZERO, GL_SRC_COLOR);
 		}
 		// jkrige - .lit colored lights
 
 		DrawGLWaterPolyLightmap (p);
-		glDisable (GL_BLEND);
+		GL_Disable (GL_BLEND);
 
 		// jkrige - .lit colored lights
-		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+		GL_TexEnvMode (GL_REPLACE);
 		// jkrige - .lit colored lights
 
 		// jkrige - luma textures
@@ -1003,37 +1021,37 @@ void R_BlendLightmaps (void)
 	if (!gl_texsort.value)
 		return;
 
-	glDepthMask (0);		// don't bother writing Z
+	GL_DepthMask (0);		// don't bother writing Z
 
 	if (gl_lightmap_format == GL_LUMINANCE)
 	{
-		glBlendFunc (GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+		GL_BlendFunc (GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
 	}
 	else if (gl_lightmap_format == GL_INTENSITY)
 	{
-		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+		GL_TexEnvMode (GL_MODULATE);
 		glColor4f (0,0,0,1);
-		glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		GL_BlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	}
 	// jkrige - .lit colored lights
 	else if (gl_lightmap_format == GL_RGBA)
 	{
-		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+		GL_TexEnvMode (GL_MODULATE);
         glColor4f (1.0f,1.0f,1.0f, 1.0f);
 		//glBlendFunc(GL_DST_COLOR, GL_SRC_COLOR);
-        glBlendFunc(GL_ZERO, GL_SRC_COLOR);
+        GL_BlendFunc(GL_ZERO, GL_SRC_COLOR);
 	}
 	// jkrige - .lit colored lights
 
 
 	// jkrige - overbrights
 	if (gl_overbright.value)
-		glBlendFunc(GL_DST_COLOR, GL_SRC_COLOR);
+		GL_BlendFunc(GL_DST_COLOR, GL_SRC_COLOR);
 	// jkrige - overbrights
 
 	if (!r_lightmap.value)
 	{
-		glEnable (GL_BLEND);
+		GL_Enable (GL_BLEND);
 	}
 
 	for (i=0 ; i<MAX_LIGHTMAPS ; i++)
@@ -1078,7 +1096,7 @@ void R_BlendLightmaps (void)
 		}
 	}
 
-	glDisable (GL_BLEND);
+	GL_Disable (GL_BLEND);
 	/*
 	if (gl_lightmap_format == GL_LUMINANCE)
 	{
@@ -1098,21 +1116,34 @@ void R_BlendLightmaps (void)
 	*/
 
 	// jkrige - .lit colored lights
-	glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	GL_BlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	GL_TexEnvMode (GL_REPLACE);
 	glColor4f (1,1,1,1);
 	// jkrige - .lit colored lights
 
-	glDepthMask (1);		// back to normal Z buffering
+	GL_DepthMask (1);		// back to normal Z buffering
 }
 
 // jkrige - luma textures
+typedef struct
+{
+	msurface_t	*surf;
+	texture_t	*texture;
+} lumasurf_t;
+
+static lumasurf_t	*lumasurfs;
+static int			maxlumasurfs;
+
+static int R_LumaSurfCmp (const void *a, const void *b)
+{
+	return ((lumasurf_t *)a)->texture->gl_texturenum - ((lumasurf_t *)b)->texture->gl_texturenum;
+}
+
 void R_DrawLumaSurfaces (msurface_t *s, int num_surfaces)
 {
-	int i;
+	int i, num_lumas;
     msurface_t *fa;
     texture_t *t;
-	qboolean luma_found = false;
 
 	if (r_fullbright.value)
         return;
@@ -1120,42 +1151,60 @@ void R_DrawLumaSurfaces (msurface_t *s, int num_surfaces)
 	if(gl_lumatex_render.value != 1)
 		return;
 
+	if (num_surfaces > maxlumasurfs)
+	{
+		lumasurfs = realloc (lumasurfs, num_surfaces * sizeof(*lumasurfs));
+		if (!lumasurfs)
+			Sys_Error ("R_DrawLumaSurfaces: couldn't allocate %i surfaces", num_surfaces);
+		maxlumasurfs = num_surfaces;
+	}
+
+	// gather the marked surfaces, and draw them a texture at a time
+	num_lumas = 0;
 	for (fa = s, i = 0; i < num_surfaces; fa++, i++)
     {
+		if (fa->luma_mark == false)
+			continue;
+		fa->luma_mark = false;
+
         // find the correct texture
         t = R_TextureAnimation (fa->texinfo->texture);
+		if (t->tex_luma == false)
+			continue;
 
-		if(fa->luma_mark == true && t->tex_luma == true)
-        {
-			if(luma_found == false)
-			{
-				glDepthMask (GL_FALSE);
-				glEnable (GL_BLEND);
+		lumasurfs[num_lumas].surf = fa;
+		lumasurfs[num_lumas].texture = t;
+		num_lumas++;
+    }
 
-				//glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-				glBlendFunc (GL_ONE, GL_ONE);
+	if (!num_lumas)
+		return;
 
-				luma_found = true;
-			}
+	qsort (lumasurfs, num_lumas, sizeof(*lumasurfs), R_LumaSurfCmp);
 
-            GL_Bind (JK_LUMA_TEX + t->gl_texturenum);
-            DrawGLPoly (fa->polys);
+	GL_DepthMask (GL_FALSE);
+	GL_Enable (GL_BLEND);
 
-			// draw luma textures more than once to add more brightness to external textures (hacky?)
-			if (t->tex_luma8bit == false)
-				DrawGLPoly (fa->polys);
+	//glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	GL_BlendFunc (GL_ONE, GL_ONE);
 
-			fa->luma_mark = false;
-        }
-    }
-
-	if(luma_found == true)
+	for (i = 0; i < num_lumas; i++)
 	{
-		glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		fa = lumasurfs[i].surf;
+		t = lumasurfs[i].texture;
+
+        GL_Bind (JK_LUMA_TEX + t->gl_texturenum);
+        DrawGLPoly (fa->polys);
 
-		glDisable (GL_BLEND);
-		glDepthMask (GL_TRUE);
+		// draw luma textures more than once to add more brightness to external textures (hacky?)
+		if (t->tex_luma8bit == false)
+			DrawGLPoly (fa->polys);
 	}
+
+	GL_BlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	GL_Disable (GL_BLEND);
+	GL_DepthMask (GL_TRUE);
 }
 // jkrige - luma textures
 
@@ -1209,12 +1258,12 @@ void R_RenderBrushPoly (msurface_t *fa)
 
 		//glColor4f (shadelight, shadelight, shadelight, 1.0f);
 		glColor4f (lightcolor[0], lightcolor[1], lightcolor[2], 1.0f);
-		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+		GL_TexEnvMode (GL_MODULATE);
 	}
 	else
 	{
 		glColor4f (1.0f, 1.0f, 1.0f, 1.0f);
-		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+		GL_TexEnvMode (GL_REPLACE);
 	}
 	// jkrige - external brushmodel lighting
 
@@ -1228,29 +1277,29 @@ void R_RenderBrushPoly (msurface_t *fa)
 	// jkrige - normal mapping
 	if (gl_normalmap_render.value == 1 && t->tex_norm == true && !(fa->flags & SURF_DRAWTURB) && !(fa->flags & SURF_DRAWSKY) && !(fa->flags & SURF_UNDERWATER))
 	{
-		glDepthMask (GL_FALSE);
-		glEnable (GL_BLEND);
+		GL_DepthMask (GL_FALSE);
+		GL_Enable (GL_BLEND);
 
 		// set the correct blending mode for normal maps 
-		glBlendFunc (GL_ZERO, GL_SRC_COLOR);
+		GL_BlendFunc (GL_ZERO, GL_SRC_COLOR);
 
 		// and the texenv 
-		glTexEnvi (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE);
+		GL_TexEnvMode (GL_COMBINE);
 		glTexEnvi (GL_TEXTURE_ENV, GL_COMBINE_RGB, GL_DOT3_RGB);
 
 		GL_Bind (JK_NORM_TEX + t->gl_texturenum);
 		DrawGLPoly (fa->polys);
 
 		// back to replace mode 
-		glTexEnvi (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE); 
+		GL_TexEnvMode (GL_REPLACE); 
 		//glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 
 		// restore the original blend mode 
-		glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); 
+		GL_BlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); 
 
 		// switch off blending 
-		glDisable (GL_BLEND);
-		glDepthMask (GL_TRUE);
+		GL_Disable (GL_BLEND);
+		GL_DepthMask (GL_TRUE);
 	}
 	// jkrige - normal mapping
 
@@ -1414,9 +1463,9 @@ void R_DrawWaterSurfaces (void)
 	//
     glLoadMatrixf (r_world_matrix);
 
-	glEnable (GL_BLEND);
+	GL_Enable (GL_BLEND);
 	glColor4f (1,1,1,r_wateralpha.value);
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	GL_TexEnvMode (GL_MODULATE);
 
 	for (i=0 ; i<cl.worldmodel->numtextures ; i++)
 	{
@@ -1438,10 +1487,10 @@ void R_DrawWaterSurfaces (void)
 		t->texturechain = NULL;
 	}
 
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	GL_TexEnvMode (GL_REPLACE);
 
 	glColor4f (1,1,1,1);
-	glDisable (GL_BLEND);
+	GL_Disable (GL_BLEND);
 }
 #else
 /*
@@ -1465,9 +1514,9 @@ void R_DrawWaterSurfaces (void)
     glLoadMatrixf (r_world_matrix);
 
 	if (r_wateralpha.value < 1.0) {
-		glEnable (GL_BLEND);
+		GL_Enable (GL_BLEND);
 		glColor4f (1,1,1,r_wateralpha.value);
-		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+		GL_TexEnvMode (GL_MODULATE);
 	}
 
 	if (!gl_texsort.value) {
@@ -1506,10 +1555,10 @@ void R_DrawWaterSurfaces (void)
 	}
 
 	if (r_wateralpha.value < 1.0) {
-		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+		GL_TexEnvMode (GL_REPLACE);
 
 		glColor4f (1,1,1,1);
-		glDisable (GL_BLEND);
+		GL_Disable (GL_BLEND);
 	}
 
 }
@@ -1574,7 +1623,7 @@ R_DrawBrushModel
 */
 void R_DrawBrushModel (entity_t *e)
 {
-	int			j, k;
+	int			j;
 	vec3_t		mins, maxs;
 	int			i, numsurfaces;
 	msurface_t	*psurf;
@@ -1629,21 +1678,14 @@ void R_DrawBrushModel (entity_t *e)
 // instanced model
 	if (clmodel->firstmodelsurface != 0 /*&& !gl_flashblend.value*/) // jkrige - flashblend removal
 	{
-		for (k=0 ; k<MAX_DLIGHTS ; k++)
-		{
-			if ((cl_dlights[k].die < cl.time) ||
-				(!cl_dlights[k].radius))
-				continue;
-
-			// jkrige - increase dlights
-			//R_MarkLights (&cl_dlights[k], 1<<k, clmodel->nodes + clmodel->hulls[0].firstclipnode);
-			R_MarkLights (&cl_dlights[k], k, clmodel->nodes + clmodel->hulls[0].firstclipnode);
-			// jkrige - increase dlights
-		}
+		// jkrige - increase dlights
+		//R_MarkLights (&cl_dlights[k], 1<<k, clmodel->nodes + clmodel->hulls[0].firstclipnode);
+		R_MarkLights (clmodel->nodes + clmodel->hulls[0].firstclipnode);
+		// jkrige - increase dlights
 	}
 
 	// jkrige - brush z-fighting
-	glEnable(GL_POLYGON_OFFSET_FILL);
+	GL_Enable(GL_POLYGON_OFFSET_FILL);
 	// jkrige - brush z-fighting
 
     glPushMatrix ();
@@ -1683,7 +1725,7 @@ void R_DrawBrushModel (entity_t *e)
 	glPopMatrix ();
 
 	// jkrige - brush z-fighting
-	glDisable(GL_POLYGON_OFFSET_FILL);
+	GL_Disable(GL_POLYGON_OFFSET_FILL);
 	// jkrige - brush z-fighting
 }
 
@@ -1830,6 +1872,652 @@ void R_RecursiveWorldNode (mnode_t *node)
 }
 
 
+/*
+=============================================================================
+
+  ITERATIVE WORLD WALK
+
+=============================================================================
+*/
+
+#define	MAX_WALKSTACK	1024
+
+typedef struct
+{
+	mnode_t		*node;
+	int			clipflags;		// frustum planes the node isn't wholly inside
+	float		dot;			// view distance from the node's plane
+} walkstack_t;
+
+static walkstack_t	walkstack[MAX_WALKSTACK];
+
+#ifdef WORLD_SSE
+// the frustum a plane per lane, and which normals have a positive x, y, z
+static __m128	frustum_nx, frustum_ny, frustum_nz, frustum_dist;
+static __m128	frustum_px, frustum_py, frustum_pz;
+static int		world_sse = -1;		// -1 until the cpu has been asked
+#endif
+
+/*
+================
+R_SetupWorldFrustum
+================
+*/
+static void R_SetupWorldFrustum (void)
+{
+#ifdef WORLD_SSE
+	__m128	zero;
+
+	if (world_sse == -1)
+	{
+#ifdef _WIN32
+		world_sse = IsProcessorFeaturePresent (PF_XMMI_INSTRUCTIONS_AVAILABLE);
+#else
+		world_sse = true;
+#endif
+	}
+	if (!world_sse)
+		return;		// R_ClipNodeBox uses the planes
+
+	frustum_nx = _mm_setr_ps (frustum[0].normal[0], frustum[1].normal[0], frustum[2].normal[0], frustum[3].normal[0]);
+	frustum_ny = _mm_setr_ps (frustum[0].normal[1], frustum[1].normal[1], frustum[2].normal[1], frustum[3].normal[1]);
+	frustum_nz = _mm_setr_ps (frustum[0].normal[2], frustum[1].normal[2], frustum[2].normal[2], frustum[3].normal[2]);
+	frustum_dist = _mm_setr_ps (frustum[0].dist, frustum[1].dist, frustum[2].dist, frustum[3].dist);
+
+	zero = _mm_setzero_ps ();
+	frustum_px = _mm_cmpge_ps (frustum_nx, zero);
+	frustum_py = _mm_cmpge_ps (frustum_ny, zero);
+	frustum_pz = _mm_cmpge_ps (frustum_nz, zero);
+#endif
+}
+
+/*
+================
+R_ClipNodeBox
+
+Tests a node's box against the frustum planes left in clipflags.  Returns
+-1 if it is behind one of them, otherwise the planes its children still
+have to be tested against.
+================
+*/
+static int R_ClipNodeBox (float *minmaxs, int clipflags)
+{
+	int		i, sides;
+
+#ifdef WORLD_SSE
+	if (world_sse > 0)
+	{
+		__m128	minx, miny, minz, maxx, maxy, maxz;
+		__m128	far_, near_;
+		int		outside, inside;
+
+		minx = _mm_set1_ps (minmaxs[0]);
+		miny = _mm_set1_ps (minmaxs[1]);
+		minz = _mm_set1_ps (minmaxs[2]);
+		maxx = _mm_set1_ps (minmaxs[3]);
+		maxy = _mm_set1_ps (minmaxs[4]);
+		maxz = _mm_set1_ps (minmaxs[5]);
+
+		// the corner furthest along each plane's normal, then the nearest
+		far_ = _mm_mul_ps (frustum_nx, _mm_or_ps (_mm_and_ps (frustum_px, maxx), _mm_andnot_ps (frustum_px, minx)));
+		far_ = _mm_add_ps (far_, _mm_mul_ps (frustum_ny, _mm_or_ps (_mm_and_ps (frustum_py, maxy), _mm_andnot_ps (frustum_py, miny))));
+		far_ = _mm_add_ps (far_, _mm_mul_ps (frustum_nz, _mm_or_ps (_mm_and_ps (frustum_pz, maxz), _mm_andnot_ps (frustum_pz, minz))));
+
+		near_ = _mm_mul_ps (frustum_nx, _mm_or_ps (_mm_and_ps (frustum_px, minx), _mm_andnot_ps (frustum_px, maxx)));
+		near_ = _mm_add_ps (near_, _mm_mul_ps (frustum_ny, _mm_or_ps (_mm_and_ps (frustum_py, miny), _mm_andnot_ps (frustum_py, maxy))));
+		near_ = _mm_add_ps (near_, _mm_mul_ps (frustum_nz, _mm_or_ps (_mm_and_ps (frustum_pz, minz), _mm_andnot_ps (frustum_pz, maxz))));
+
+		outside = _mm_movemask_ps (_mm_cmplt_ps (far_, frustum_dist));
+		inside = _mm_movemask_ps (_mm_cmpge_ps (near_, frustum_dist));
+
+		if (outside & clipflags)
+			return -1;
+		return clipflags & ~inside;
+	}
+#endif
+
+	for (i=0 ; i<4 ; i++)
+	{
+		if (!(clipflags & (1<<i)))
+			continue;
+
+		sides = BoxOnPlaneSide (minmaxs, minmaxs+3, &frustum[i]);
+		if (sides == 2)
+			return -1;
+		if (sides == 1)
+			clipflags &= ~(1<<i);
+	}
+	return clipflags;
+}
+
+/*
+================
+R_DrawNodeBuckets
+
+The node's surfaces a bucket at a time: the wrong side and the mirror
+are dropped a bucket at once, and the visible surfaces of a bucket are
+linked up and put on their chain together
+================
+*/
+static void R_DrawNodeBuckets (mnode_t *node, float dot)
+{
+	surfbucket_t	*bucket;
+	msurface_t		**mark, *surf, *first, *last, **chain;
+	texture_t		*mirrortexture;
+	int				i, j, backside;
+
+	backside = dot < 0 ? SURF_PLANEBACK : 0;
+	mirrortexture = mirror ? cl.worldmodel->textures[mirrortexturenum] : NULL;
+
+	bucket = cl.worldmodel->surfbuckets + node->firstbucket;
+	for (i=0 ; i<node->numbuckets ; i++, bucket++)
+	{
+		// don't backface underwater surfaces, because they warp
+		if (!(bucket->flags & SURF_UNDERWATER) && (bucket->flags & SURF_PLANEBACK) != backside)
+			continue;		// wrong side
+
+		// if sorting by texture, just store it out
+		if (gl_texsort.value)
+		{
+			if (bucket->texture == mirrortexture)
+				continue;
+			chain = &bucket->texture->texturechain;
+		}
+		else if (bucket->flags & SURF_DRAWSKY)
+			chain = &skychain;
+		else if (bucket->flags & SURF_DRAWTURB)
+			chain = &waterchain;
+		else
+			chain = NULL;
+
+		first = last = NULL;
+		mark = cl.worldmodel->bucketsurfs + bucket->firstsurf;
+		for (j=0 ; j<bucket->numsurfs ; j++)
+		{
+			surf = mark[j];
+			if (surf->visframe != r_framecount)
+				continue;
+
+			if (!chain)
+			{
+				// jkrige - luma textures
+				surf->luma_mark = true;
+				// jkrige - luma textures
+
+				R_DrawSequentialPoly (surf);
+				continue;
+			}
+
+			if (last)
+				last->texturechain = surf;
+			else
+				first = surf;
+			last = surf;
+		}
+
+		if (last)
+		{
+			last->texturechain = *chain;
+			*chain = first;
+		}
+	}
+}
+
+/*
+================
+R_WalkWorld
+
+R_RecursiveWorldNode without the recursion.  The back sides wait on a
+stack with the frustum planes their parent wasn't wholly inside, so a
+node only tests the planes that can still cut it, all of them in one go.
+================
+*/
+void R_WalkWorld (void)
+{
+	mnode_t		*node;
+	mleaf_t		*pleaf;
+	mplane_t	*plane;
+	msurface_t	**mark;
+	walkstack_t	*sp;
+	int			c, clipflags;
+	float		dot;
+
+	R_SetupWorldFrustum ();
+
+	sp = walkstack;
+	node = cl.worldmodel->nodes;
+	clipflags = 15;
+
+	for ( ; ; )
+	{
+		// go down the front sides, leaving the nodes for the way back
+		while (node->contents != CONTENTS_SOLID && node->visframe == r_visframecount)
+		{
+			if (clipflags)
+			{
+				clipflags = R_ClipNodeBox (node->minmaxs, clipflags);
+				if (clipflags < 0)
+					break;
+			}
+
+			if (node->contents < 0)
+			{
+				// if a leaf node, draw stuff
+				pleaf = (mleaf_t *)node;
+				if (R_LeafOccluded (pleaf))
+					break;		// hidden last frame
+
+				mark = pleaf->firstmarksurface;
+				for (c = pleaf->nummarksurfaces ; c ; c--, mark++)
+					(*mark)->visframe = r_framecount;
+
+			// deal with model fragments in this leaf
+				if (pleaf->efrags)
+					R_StoreEfrags (&pleaf->efrags);
+				break;
+			}
+
+			plane = node->plane;
+			if (plane->type < 3)
+				dot = modelorg[plane->type] - plane->dist;
+			else
+				dot = DotProduct (modelorg, plane->normal) - plane->dist;
+
+			if (sp == walkstack + MAX_WALKSTACK)
+				Sys_Error ("R_WalkWorld: MAX_WALKSTACK");
+			sp->node = node;
+			sp->clipflags = clipflags;
+			sp->dot = dot;
+			sp++;
+
+			node = node->children[dot >= 0 ? 0 : 1];
+		}
+
+		if (sp == walkstack)
+			break;
+
+		// the front side is done, draw the node and go down the back
+		sp--;
+		R_DrawNodeBuckets (sp->node, sp->dot);
+
+		node = sp->node->children[sp->dot >= 0 ? 1 : 0];
+		clipflags = sp->clipflags;
+	}
+}
+
+/*
+================
+R_SurfaceBucketCmp
+================
+*/
+static int R_SurfaceBucketCmp (const void *a, const void *b)
+{
+	msurface_t	*sa, *sb;
+	int			fa, fb;
+
+	sa = *(msurface_t **)a;
+	sb = *(msurface_t **)b;
+
+	if (sa->texinfo->texture != sb->texinfo->texture)
+		return sa->texinfo->texture < sb->texinfo->texture ? -1 : 1;
+
+	fa = sa->flags & SURFBUCKET_FLAGS;
+	fb = sb->flags & SURFBUCKET_FLAGS;
+	if (fa != fb)
+		return fa - fb;
+
+	return (sa > sb) - (sa < sb);	// keep the map's order within a bucket
+}
+
+/*
+================
+R_SameBucket
+================
+*/
+static qboolean R_SameBucket (msurface_t *a, msurface_t *b)
+{
+	return a->texinfo->texture == b->texinfo->texture
+		&& (a->flags & SURFBUCKET_FLAGS) == (b->flags & SURFBUCKET_FLAGS);
+}
+
+/*
+================
+R_BuildSurfaceBuckets
+
+Sorts the surfaces of every world node into buckets by texture and side
+for R_WalkWorld, once per map from R_NewMap
+================
+*/
+void R_BuildSurfaceBuckets (void)
+{
+	model_t			*world;
+	mnode_t			*node;
+	surfbucket_t	*bucket;
+	msurface_t		**mark;
+	int				i, j, count, numbuckets;
+
+	world = cl.worldmodel;
+	world->surfbuckets = NULL;
+	world->bucketsurfs = NULL;
+
+	count = 0;
+	for (i=0, node=world->nodes ; i<world->numnodes ; i++, node++)
+		count += node->numsurfaces;
+	if (!count)
+		return;
+
+	world->bucketsurfs = Hunk_AllocName (count * sizeof(msurface_t *), "surfbuckets");
+
+	// the worst case is a bucket a surface, the hunk has no realloc so
+	// count them first
+	numbuckets = 0;
+	mark = world->bucketsurfs;
+	for (i=0, node=world->nodes ; i<world->numnodes ; i++, node++)
+	{
+		for (j=0 ; j<node->numsurfaces ; j++)
+			mark[j] = world->surfaces + node->firstsurface + j;
+		qsort (mark, node->numsurfaces, sizeof(*mark), R_SurfaceBucketCmp);
+
+		for (j=0 ; j<node->numsurfaces ; j++)
+			if (!j || !R_SameBucket (mark[j-1], mark[j]))
+				numbuckets++;
+		mark += node->numsurfaces;
+	}
+
+	world->surfbuckets = Hunk_AllocName (numbuckets * sizeof(surfbucket_t), "surfbuckets");
+
+	bucket = world->surfbuckets;
+	mark = world->bucketsurfs;
+	for (i=0, node=world->nodes ; i<world->numnodes ; i++, node++)
+	{
+		node->firstbucket = bucket - world->surfbuckets;
+		node->numbuckets = 0;
+
+		for (j=0 ; j<node->numsurfaces ; j++)
+		{
+			if (!j || !R_SameBucket (mark[j-1], mark[j]))
+			{
+				bucket->texture = mark[j]->texinfo->texture;
+				bucket->flags = mark[j]->flags & SURFBUCKET_FLAGS;
+				bucket->firstsurf = mark + j - world->bucketsurfs;
+				bucket->numsurfs = 0;
+				bucket++;
+				node->numbuckets++;
+			}
+			bucket[-1].numsurfs++;
+		}
+		mark += node->numsurfaces;
+	}
+}
+
+
+/*
+=============================================================================
+
+  WORLD WALK BENCHMARK
+
+=============================================================================
+*/
+
+typedef struct
+{
+	vec3_t	origin;
+	vec3_t	angles;
+	float	fov_x, fov_y;
+} campoint_t;
+
+static campoint_t	*campath;
+static int			campathsize, campathcount;
+static qboolean		campathrecording;
+static char			campathname[MAX_OSPATH];
+
+/*
+================
+R_RecordCamPath
+
+Called for every view of the world while campath is recording
+================
+*/
+static void R_RecordCamPath (void)
+{
+	campoint_t	*p;
+
+	if (!campathrecording || mirror)
+		return;
+
+	if (campathcount == campathsize)
+	{
+		campathsize = campathsize ? campathsize * 2 : 1024;
+		campath = realloc (campath, campathsize * sizeof(campoint_t));
+		if (!campath)
+			Sys_Error ("R_RecordCamPath: couldn't allocate %i points", campathsize);
+	}
+
+	p = &campath[campathcount++];
+	VectorCopy (r_refdef.vieworg, p->origin);
+	VectorCopy (r_refdef.viewangles, p->angles);
+	p->fov_x = r_refdef.fov_x;
+	p->fov_y = r_refdef.fov_y;
+}
+
+/*
+================
+R_CamPath_f
+
+campath <name> records the view every frame until campath is given again,
+then writes the path for worldbench
+================
+*/
+void R_CamPath_f (void)
+{
+	char		name[MAX_OSPATH];
+	FILE		*f;
+	campoint_t	*p;
+	int			i;
+
+	if (campathrecording)
+	{
+		campathrecording = false;
+
+		sprintf (name, "%s/%s", com_gamedir, campathname);
+		f = fopen (name, "w");
+		if (!f)
+		{
+			Con_Printf ("ERROR: couldn't open %s.\n", campathname);
+			return;
+		}
+		for (i=0, p=campath ; i<campathcount ; i++, p++)
+			fprintf (f, "%f %f %f %f %f %f %f %f\n", p->origin[0], p->origin[1], p->origin[2],
+				p->angles[0], p->angles[1], p->angles[2], p->fov_x, p->fov_y);
+		fclose (f);
+
+		Con_Printf ("Wrote %i views to %s.\n", campathcount, campathname);
+		return;
+	}
+
+	if (Cmd_Argc () != 2)
+	{
+		Con_Printf ("campath <name> : record the view until campath is given again\n");
+		return;
+	}
+
+	strcpy (campathname, Cmd_Argv(1));
+	COM_DefaultExtension (campathname, ".path");
+	campathcount = 0;
+	campathrecording = true;
+	Con_Printf ("Recording view path to %s.\n", campathname);
+}
+
+/*
+================
+R_LoadCamPath
+================
+*/
+static qboolean R_LoadCamPath (char *pathname)
+{
+	char		name[MAX_OSPATH];
+	FILE		*f;
+	campoint_t	p;
+
+	strcpy (name, pathname);
+	COM_DefaultExtension (name, ".path");
+	sprintf (campathname, "%s/%s", com_gamedir, name);
+	f = fopen (campathname, "r");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't open %s.\n", name);
+		return false;
+	}
+
+	campathcount = 0;
+	while (fscanf (f, "%f %f %f %f %f %f %f %f", &p.origin[0], &p.origin[1], &p.origin[2],
+		&p.angles[0], &p.angles[1], &p.angles[2], &p.fov_x, &p.fov_y) == 8)
+	{
+		if (campathcount == campathsize)
+		{
+			campathsize = campathsize ? campathsize * 2 : 1024;
+			campath = realloc (campath, campathsize * sizeof(campoint_t));
+			if (!campath)
+				Sys_Error ("R_LoadCamPath: couldn't allocate %i points", campathsize);
+		}
+		campath[campathcount++] = p;
+	}
+	fclose (f);
+
+	if (!campathcount)
+	{
+		Con_Printf ("%s has no views.\n", name);
+		return false;
+	}
+	return true;
+}
+
+/*
+================
+R_ClearTextureChains
+================
+*/
+static void R_ClearTextureChains (void)
+{
+	int		i;
+
+	for (i=0 ; i<cl.worldmodel->numtextures ; i++)
+		if (cl.worldmodel->textures[i])
+			cl.worldmodel->textures[i]->texturechain = NULL;
+	skychain = NULL;
+	waterchain = NULL;
+}
+
+/*
+================
+R_BenchView
+
+Sets up the frustum and visible leafs of a path point the way
+R_RenderScene would, without drawing anything
+================
+*/
+static void R_BenchView (campoint_t *p)
+{
+	VectorCopy (p->origin, r_refdef.vieworg);
+	VectorCopy (p->angles, r_refdef.viewangles);
+	r_refdef.fov_x = p->fov_x;
+	r_refdef.fov_y = p->fov_y;
+
+	r_framecount++;
+	VectorCopy (r_refdef.vieworg, r_origin);
+	VectorCopy (r_refdef.vieworg, modelorg);
+	AngleVectors (r_refdef.viewangles, vpn, vright, vup);
+	R_SetFrustum ();
+
+	r_viewleaf = Mod_PointInLeaf (r_origin, cl.worldmodel);
+	R_MarkLeaves ();
+}
+
+/*
+================
+R_WorldBench_f
+
+worldbench <name> [loops] runs both world walks over a recorded path,
+building the texture chains but drawing nothing, and times them
+================
+*/
+void R_WorldBench_f (void)
+{
+	refdef_t	savedrefdef;
+	campoint_t	*p;
+	int			i, loop, loops, walk, numvisedicts, views;
+	float		texsort;
+	qboolean	savedmirror;
+	double		start, time[2];
+
+	if (Cmd_Argc () < 2)
+	{
+		Con_Printf ("worldbench <name> [loops] : time the world walks over a campath\n");
+		return;
+	}
+	if (cls.state != ca_connected || !cl.worldmodel)
+	{
+		Con_Printf ("worldbench: no map running\n");
+		return;
+	}
+	if (campathrecording)
+	{
+		Con_Printf ("worldbench: stop campath first\n");
+		return;
+	}
+	if (!cl.worldmodel->surfbuckets)
+	{
+		Con_Printf ("worldbench: the map has no surface buckets\n");
+		return;
+	}
+	if (!R_LoadCamPath (Cmd_Argv(1)))
+		return;
+
+	loops = Cmd_Argc () > 2 ? Q_atoi (Cmd_Argv(2)) : 10;
+	if (loops < 1)
+		loops = 1;
+
+	savedrefdef = r_refdef;
+	savedmirror = mirror;
+	numvisedicts = cl_numvisedicts;
+	texsort = gl_texsort.value;
+
+	mirror = false;
+	gl_texsort.value = 1;	// chain everything so nothing gets drawn
+
+	for (walk=0 ; walk<2 ; walk++)
+	{
+		time[walk] = 0;
+		for (loop=0 ; loop<loops ; loop++)
+		{
+			for (i=0, p=campath ; i<campathcount ; i++, p++)
+			{
+				R_BenchView (p);
+
+				start = Sys_PreciseTime ();
+				if (walk)
+					R_WalkWorld ();
+				else
+					R_RecursiveWorldNode (cl.worldmodel->nodes);
+				time[walk] += Sys_PreciseTime () - start;
+
+				R_ClearTextureChains ();
+				cl_numvisedicts = numvisedicts;
+			}
+		}
+	}
+
+	r_refdef = savedrefdef;
+	mirror = savedmirror;
+	gl_texsort.value = texsort;
+	r_viewleaf = NULL;	// mark the leafs again for the next frame
+
+	views = loops * campathcount;
+	Con_Printf ("%i views: recursive %.1f usec, iterative %.1f usec a view (%.2fx)\n", views,
+		time[0] * 1000000 / views, time[1] * 1000000 / views, time[1] > 0 ? time[0] / time[1] : 0);
+}
+
+
 
 /*
 =============
@@ -1860,7 +2548,13 @@ void R_DrawWorld (void)
 	R_DrawSkyBox ();
 	// jkrige - skybox (moved upwards, disabled depth checking)
 
-	R_RecursiveWorldNode (cl.worldmodel->nodes);
+	R_RecordCamPath ();
+	R_OcclusionBeginFrame ();
+
+	if (r_worldwalk.value && cl.worldmodel->surfbuckets)
+		R_WalkWorld ();
+	else
+		R_RecursiveWorldNode (cl.worldmodel->nodes);
 
 	DrawTextureChains ();
 
@@ -1870,12 +2564,16 @@ void R_DrawWorld (void)
 	R_DrawLumaSurfaces (&cl.worldmodel->surfaces[cl.worldmodel->firstmodelsurface], cl.worldmodel->nummodelsurfaces);
 	// jkrige - luma textures
 
+	R_OcclusionQueryLeafs ();
+
 //#ifdef QUAKE2 // jkrige - skybox
 //	R_DrawSkyBox ();
 //#endif
 }
 
 
+static byte	r_pvs[MAX_MAP_LEAFS/8];	// the server thread decompresses its own
+
 /*
 ===============
 R_MarkLeaves
@@ -1903,7 +2601,7 @@ void R_MarkLeaves (void)
 		memset (solid, 0xff, (cl.worldmodel->numleafs+7)>>3);
 	}
 	else
-		vis = Mod_LeafPVS (r_viewleaf, cl.worldmodel);
+		vis = Mod_LeafPVS (r_viewleaf, cl.worldmodel, r_pvs);
 		
 	for (i=0 ; i<cl.worldmodel->numleafs ; i++)
 	{
@@ -2107,7 +2805,7 @@ void BuildSurfaceDisplayList (msurface_t *fa)
 GL_CreateSurfaceLightmap
 ========================
 */
-void GL_CreateSurfaceLightmap (msurface_t *surf)
+void GL_CreateSurfaceLightmap (msurface_t *surf, qboolean placed)
 {
 	int		smax, tmax, s, t, l, i;
 	byte	*base;
@@ -2118,13 +2816,44 @@ void GL_CreateSurfaceLightmap (msurface_t *surf)
 	smax = (surf->extents[0]>>4)+1;
 	tmax = (surf->extents[1]>>4)+1;
 
-	surf->lightmaptexturenum = AllocBlock (smax, tmax, &surf->light_s, &surf->light_t);
+	if (!placed)	// the map cache has it in place already
+		surf->lightmaptexturenum = AllocBlock (smax, tmax, &surf->light_s, &surf->light_t);
 	base = lightmaps + surf->lightmaptexturenum*lightmap_bytes*BLOCK_WIDTH*BLOCK_HEIGHT;
 	base += (surf->light_t * BLOCK_WIDTH + surf->light_s) * lightmap_bytes;
 	R_BuildLightMap (surf, base, BLOCK_WIDTH*lightmap_bytes);
 }
 
 
+/*
+================
+GL_LightmapPlaceOk
+
+True if a surface's place in the lightmaps, as the map cache has it, is
+inside the blocks and its lightmap fits blocklights
+================
+*/
+qboolean GL_LightmapPlaceOk (msurface_t *surf)
+{
+	int		smax, tmax;
+
+	if (surf->flags & (SURF_DRAWSKY|SURF_DRAWTURB))
+		return true;		// no lightmap
+
+	if (surf->extents[0] < 0 || surf->extents[0] > 256 || surf->extents[1] < 0 || surf->extents[1] > 256)
+		return false;
+	if (surf->lightmaptexturenum < 0 || surf->lightmaptexturenum >= MAX_LIGHTMAPS)
+		return false;
+
+	smax = (surf->extents[0]>>4)+1;
+	tmax = (surf->extents[1]>>4)+1;
+	if (surf->light_s < 0 || surf->light_s + smax > BLOCK_WIDTH)
+		return false;
+	if (surf->light_t < 0 || surf->light_t + tmax > BLOCK_HEIGHT)
+		return false;
+
+	return true;
+}
+
 /*
 ==================
 GL_BuildLightmaps
@@ -2137,6 +2866,8 @@ void GL_BuildLightmaps (void)
 {
 	int		i, j;
 	model_t	*m;
+	msurface_t	*surf;
+	qboolean	cached;
 	extern qboolean isPermedia;
 
 	memset (allocated, 0, sizeof(allocated));
@@ -2194,9 +2925,32 @@ void GL_BuildLightmaps (void)
 			continue;
 		r_pcurrentvertbase = m->vertexes;
 		currentmodel = m;
+
+	// the map cache placed the world's lightmaps as if it were packed
+	// first, so anything else takes its display lists off and repacks
+		cached = (m->mapcachealloc != NULL);
+		if (cached && (j != 1 || m->mapcacheallocsize != sizeof(allocated)))
+		{
+			for (i=0, surf=m->surfaces ; i<m->numsurfaces ; i++, surf++)
+			{
+				if (surf->flags & SURF_DRAWTURB)
+					continue;
+#ifndef QUAKE2
+				if (surf->flags & SURF_DRAWSKY)
+					continue;
+#endif
+				surf->polys = NULL;
+			}
+			cached = false;
+		}
+		if (cached)
+			memcpy (allocated, m->mapcachealloc, sizeof(allocated));
+
 		for (i=0 ; i<m->numsurfaces ; i++)
 		{
-			GL_CreateSurfaceLightmap (m->surfaces + i);
+			GL_CreateSurfaceLightmap (m->surfaces + i, cached);
+			if (cached)
+				continue;
 			if ( m->surfaces[i].flags & SURF_DRAWTURB )
 				continue;
 #ifndef QUAKE2
@@ -2205,6 +2959,9 @@ void GL_BuildLightmaps (void)
 #endif
 			BuildSurfaceDisplayList (m->surfaces + i);
 		}
+
+		if (j == 1 && !cached)
+			Mod_WriteMapCache (m, allocated[0], sizeof(allocated));
 	}
 
 	// jkrige - remove multitexture
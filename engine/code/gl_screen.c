@@ -633,6 +633,65 @@ void SCR_DrawFPS (void)
 }
 // jkrige - fps counter
 
+/*
+==============
+SCR_DrawTimeline
+
+One bar per stage of the last frame, placed where it ran within the frame.
+With host_pipeline the server's bar lies beside the render and sound ones.
+==============
+*/
+#define	TIMELINE_WIDTH	256
+
+void SCR_DrawTimeline (void)
+{
+	static char	*names[NUM_FRAMESTAGES] =
+	{
+		"frame", "server", "parse", "rsetup", "world",
+		"entities", "particles", "render", "sound"
+	};
+	frametimeline_t	*t;
+	char	st[80];
+	float	scale;
+	int		i, x, y, x0, x1;
+
+	if (!host_timeline.value)
+		return;
+
+	t = &host_lasttimeline;
+	if (t->time[fs_total] <= 0)
+		return;
+
+	scale = TIMELINE_WIDTH / t->time[fs_total];
+
+	x = 8;
+	y = vid.height - 48 - (NUM_FRAMESTAGES + 1) * 8;
+	sprintf (st, "%.2f ms%s", t->time[fs_total] * 1000, t->pipelined ? ", pipelined" : "");
+	Draw_String (x, y, st);
+	y += 8;
+
+	for (i=0 ; i<NUM_FRAMESTAGES ; i++, y += 8)
+	{
+		Draw_String (x, y, names[i]);
+		Draw_Fill (x + 80, y, TIMELINE_WIDTH, 7, 8);
+		if (t->time[i] <= 0)
+			continue;
+
+		x0 = t->begin[i] * scale;
+		x1 = (t->begin[i] + t->time[i]) * scale;
+		if (x1 > TIMELINE_WIDTH)
+			x1 = TIMELINE_WIDTH;
+		if (x1 <= x0)
+			x1 = x0 + 1;
+
+		// the server's own thread stands out
+		Draw_Fill (x + 80 + x0, y, x1 - x0, 7, (i == fs_server && t->pipelined) ? 251 : 15);
+
+		sprintf (st, "%6.2f", t->time[i] * 1000);
+		Draw_String (x + 88 + TIMELINE_WIDTH, y, st);
+	}
+}
+
 /*
 ==============
 DrawPause
@@ -1057,6 +1116,7 @@ void SCR_UpdateScreen (void)
 
 
 	GL_BeginRendering (&glx, &gly, &glwidth, &glheight);
+	c_batch_quads = c_batch_draws = 0;
 	
 	//
 	// determine size of refresh window
@@ -1137,6 +1197,8 @@ void SCR_UpdateScreen (void)
 		SCR_DrawNet ();
 		SCR_DrawTurtle ();
 		SCR_DrawFPS (); // jkrige - fps counter
+		Prof_Draw ();
+		SCR_DrawTimeline ();
 		SCR_DrawPause ();
 		SCR_CheckDrawCenterString ();
 		Sbar_Draw ();
@@ -1146,8 +1208,12 @@ void SCR_UpdateScreen (void)
 
 	V_UpdatePalette ();
 
+	GL_FlushBatch ();
 	GL_EndRendering ();
 
+	if (r_speeds.value)		// the whole frame's batches, sprites and 2d
+		Con_Printf ("%4i 2d and sprite quads in %3i draws\n", c_batch_quads, c_batch_draws);
+
 	// jkrige - texture mode
 	Draw_TextureMode_f();
 	// jkrige - texture mode
@@ -0,0 +1,335 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// gl_state.c -- shadow copy of the GL state the renderer changes
+
+#include "quakedef.h"
+
+// Every enable, blend function, texture environment and so on the renderer
+// sets goes through here, and a call that wouldn't change anything never
+// reaches the driver.  Anything else that changes the state behind the
+// cache's back (mode changes, glPopAttrib) has to GL_InvalidateState, after
+// which the next call of each kind is always made.
+
+#define	STATE_UNKNOWN	-1
+#define	MAX_STATE_UNITS	8		// texture units the cache follows
+
+cvar_t	gl_statecache = {"gl_statecache", "1"};
+
+int		c_gl_statecalls, c_gl_statedropped;
+int		c_gl_binds, c_gl_bindsdropped;
+
+static GLenum	statecaps[] = {GL_BLEND, GL_ALPHA_TEST, GL_DEPTH_TEST, GL_CULL_FACE, GL_POLYGON_OFFSET_FILL, GL_FOG};
+#define	NUM_STATECAPS	(sizeof(statecaps)/sizeof(statecaps[0]))
+
+static int		capstate[NUM_STATECAPS];
+static int		texture2d[MAX_STATE_UNITS];
+static int		texenvmode[MAX_STATE_UNITS];
+static int		unittextures[MAX_STATE_UNITS];
+static int		activeunit;
+
+static int		depthmask;
+static int		blendsrc, blenddst;
+static int		shademodel;
+static int		depthfunc;
+static int		cullface;
+static int		alphafunc;
+static float	alpharef;
+static int		program;
+static int		arraybuffer, elementbuffer;
+
+/*
+================
+GL_InvalidateState
+
+Forgets everything, so the next call of each kind goes to the driver
+================
+*/
+void GL_InvalidateState (void)
+{
+	int		i;
+
+	for (i=0 ; i<NUM_STATECAPS ; i++)
+		capstate[i] = STATE_UNKNOWN;
+	for (i=0 ; i<MAX_STATE_UNITS ; i++)
+	{
+		texture2d[i] = STATE_UNKNOWN;
+		texenvmode[i] = STATE_UNKNOWN;
+		unittextures[i] = -1;
+	}
+
+	depthmask = STATE_UNKNOWN;
+	blendsrc = blenddst = STATE_UNKNOWN;
+	shademodel = STATE_UNKNOWN;
+	depthfunc = STATE_UNKNOWN;
+	cullface = STATE_UNKNOWN;
+	alphafunc = STATE_UNKNOWN;
+	program = STATE_UNKNOWN;
+	arraybuffer = elementbuffer = STATE_UNKNOWN;
+
+	currenttexture = -1;
+}
+
+/*
+================
+GL_StateSame
+
+Counts the call, and returns true if it can be dropped
+================
+*/
+static qboolean GL_StateSame (qboolean same)
+{
+	if (same && gl_statecache.value)
+	{
+		c_gl_statedropped++;
+		return true;
+	}
+
+	c_gl_statecalls++;
+	return false;
+}
+
+/*
+================
+GL_CapState
+
+Returns where the state of cap is kept, or NULL if it isn't
+================
+*/
+static int *GL_CapState (GLenum cap)
+{
+	int		i;
+
+	if (cap == GL_TEXTURE_2D)
+		return &texture2d[activeunit];
+
+	for (i=0 ; i<NUM_STATECAPS ; i++)
+	{
+		if (statecaps[i] == cap)
+			return &capstate[i];
+	}
+	return NULL;
+}
+
+/*
+================
+GL_Enable
+================
+*/
+void GL_Enable (GLenum cap)
+{
+	int		*state;
+
+	state = GL_CapState (cap);
+	if (!state)
+	{
+		c_gl_statecalls++;
+		glEnable (cap);
+		return;
+	}
+
+	if (GL_StateSame (*state == GL_TRUE))
+		return;
+	*state = GL_TRUE;
+	glEnable (cap);
+}
+
+/*
+================
+GL_Disable
+================
+*/
+void GL_Disable (GLenum cap)
+{
+	int		*state;
+
+	state = GL_CapState (cap);
+	if (!state)
+	{
+		c_gl_statecalls++;
+		glDisable (cap);
+		return;
+	}
+
+	if (GL_StateSame (*state == GL_FALSE))
+		return;
+	*state = GL_FALSE;
+	glDisable (cap);
+}
+
+/*
+================
+GL_ActiveTexture
+
+Texture units keep their own binding, enables and environment
+================
+*/
+void GL_ActiveTexture (GLenum unit)
+{
+	int		i;
+
+	i = unit - GL_TEXTURE0;
+	if (i < 0 || i >= MAX_STATE_UNITS)
+		Sys_Error ("GL_ActiveTexture: bad unit %i", i);
+
+	if (GL_StateSame (activeunit == i))
+		return;
+
+	unittextures[activeunit] = currenttexture;
+	currenttexture = unittextures[i];
+	activeunit = i;
+
+	glActiveTexture (unit);
+}
+
+/*
+================
+GL_DepthMask
+================
+*/
+void GL_DepthMask (GLboolean flag)
+{
+	if (GL_StateSame (depthmask == flag))
+		return;
+	depthmask = flag;
+	glDepthMask (flag);
+}
+
+/*
+================
+GL_BlendFunc
+================
+*/
+void GL_BlendFunc (GLenum sfactor, GLenum dfactor)
+{
+	if (GL_StateSame (blendsrc == sfactor && blenddst == dfactor))
+		return;
+	blendsrc = sfactor;
+	blenddst = dfactor;
+	glBlendFunc (sfactor, dfactor);
+}
+
+/*
+================
+GL_TexEnvMode
+
+GL_TEXTURE_ENV_MODE of the active unit
+================
+*/
+void GL_TexEnvMode (GLint mode)
+{
+	if (GL_StateSame (texenvmode[activeunit] == mode))
+		return;
+	texenvmode[activeunit] = mode;
+	glTexEnvi (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, mode);
+}
+
+/*
+================
+GL_ShadeModel
+================
+*/
+void GL_ShadeModel (GLenum mode)
+{
+	if (GL_StateSame (shademodel == mode))
+		return;
+	shademodel = mode;
+	glShadeModel (mode);
+}
+
+/*
+================
+GL_DepthFunc
+================
+*/
+void GL_DepthFunc (GLenum func)
+{
+	if (GL_StateSame (depthfunc == func))
+		return;
+	depthfunc = func;
+	glDepthFunc (func);
+}
+
+/*
+================
+GL_CullFace
+================
+*/
+void GL_CullFace (GLenum mode)
+{
+	if (GL_StateSame (cullface == mode))
+		return;
+	cullface = mode;
+	glCullFace (mode);
+}
+
+/*
+================
+GL_AlphaFunc
+================
+*/
+void GL_AlphaFunc (GLenum func, GLclampf ref)
+{
+	if (GL_StateSame (alphafunc == func && alpharef == ref))
+		return;
+	alphafunc = func;
+	alpharef = ref;
+	glAlphaFunc (func, ref);
+}
+
+/*
+================
+GL_UseProgram
+================
+*/
+void GL_UseProgram (GLuint prog)
+{
+	if (GL_StateSame (program == prog))
+		return;
+	program = prog;
+	glUseProgram (prog);
+}
+
+/*
+================
+GL_BindBuffer
+================
+*/
+void GL_BindBuffer (GLenum target, GLuint buffer)
+{
+	int		*state;
+
+	if (target == GL_ARRAY_BUFFER)
+		state = &arraybuffer;
+	else if (target == GL_ELEMENT_ARRAY_BUFFER)
+		state = &elementbuffer;
+	else
+		state = NULL;
+
+	if (state)
+	{
+		if (GL_StateSame (*state == buffer))
+			return;
+		*state = buffer;
+	}
+	else
+		c_gl_statecalls++;
+
+	glBindBuffer (target, buffer);
+}
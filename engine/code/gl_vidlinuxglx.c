@@ -604,6 +604,8 @@ void GL_Init (void)
 
 //	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+	GL_InvalidateState ();	// new context, the cache knows nothing of it
 }
 
 /*
@@ -860,7 +862,8 @@ void VID_Init(unsigned char *palette)
 	win = XCreateWindow(dpy, root, 0, 0, width, height,
 						0, visinfo->depth, InputOutput,
 						visinfo->visual, mask, &attr);
-	XMapWindow(dpy, win);
+	if (!host_headless)		// glXMakeCurrent doesn't need it mapped
+		XMapWindow(dpy, win);
 
 	if (vidmode_active) {
 		XMoveWindow(dpy, win, 0, 0);
@@ -243,7 +243,7 @@ void CenterWindow(HWND hWndCenter, int width, int height, BOOL lefttopjustify)
 	CenterX = (CenterX < 0) ? 0: CenterX;
 	CenterY = (CenterY < 0) ? 0: CenterY;
 	SetWindowPos (hWndCenter, NULL, CenterX, CenterY, 0, 0,
-			SWP_NOSIZE | SWP_NOZORDER | SWP_SHOWWINDOW | SWP_DRAWFRAME);
+			SWP_NOSIZE | SWP_NOZORDER | (host_headless ? 0 : SWP_SHOWWINDOW) | SWP_DRAWFRAME);
 }
 
 qboolean VID_SetWindowedMode (int modenum)
@@ -293,8 +293,11 @@ qboolean VID_SetWindowedMode (int modenum)
 	CenterWindow(dibwindow, WindowRect.right - WindowRect.left,
 				 WindowRect.bottom - WindowRect.top, false);
 
-	ShowWindow (dibwindow, SW_SHOWDEFAULT);
-	UpdateWindow (dibwindow);
+	if (!host_headless)		// the context works on a window nobody sees
+	{
+		ShowWindow (dibwindow, SW_SHOWDEFAULT);
+		UpdateWindow (dibwindow);
+	}
 
 	modestate = MS_WINDOWED;
 
@@ -520,7 +523,8 @@ int VID_SetMode (int modenum, unsigned char *palette)
 // to let messages finish bouncing around the system, then we put
 // ourselves at the top of the z order, then grab the foreground again,
 // Who knows if it helps, but it probably doesn't hurt
-	SetForegroundWindow (mainwindow);
+	if (!host_headless)
+		SetForegroundWindow (mainwindow);
 	VID_SetPalette (palette);
 	vid_modenum = modenum;
 	Cvar_SetValue ("vid_mode", (float)vid_modenum);
@@ -533,11 +537,14 @@ int VID_SetMode (int modenum, unsigned char *palette)
 
 	Sleep (100);
 
-	SetWindowPos (mainwindow, HWND_TOP, 0, 0, 0, 0,
-				  SWP_DRAWFRAME | SWP_NOMOVE | SWP_NOSIZE | SWP_SHOWWINDOW |
-				  SWP_NOCOPYBITS);
+	if (!host_headless)
+	{
+		SetWindowPos (mainwindow, HWND_TOP, 0, 0, 0, 0,
+					  SWP_DRAWFRAME | SWP_NOMOVE | SWP_NOSIZE | SWP_SHOWWINDOW |
+					  SWP_NOCOPYBITS);
 
-	SetForegroundWindow (mainwindow);
+		SetForegroundWindow (mainwindow);
+	}
 
 // fix the leftover Alt from any Alt-Tab or the like that switched us away
 	ClearAllStates ();
@@ -918,6 +925,8 @@ void GL_Init (void)
 //	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
 
+	GL_InvalidateState ();	// new context, the cache knows nothing of it
+
 #if 0
 	CheckArrayExtensions ();
 
@@ -1933,7 +1942,7 @@ void	VID_Init (unsigned char *palette)
 
 	VID_InitFullDIB (global_hInstance);
 
-	if (COM_CheckParm("-window"))
+	if (COM_CheckParm("-window") || host_headless)
 	{
 		hdc = GetDC (NULL);
 
@@ -29,8 +29,6 @@ int		solidskytexture;
 int		alphaskytexture;
 float	speedscale;		// for top sky and bottom sky
 
-msurface_t	*warpface;
-
 // jkrige - quake2 warps
 //extern cvar_t gl_subdivide_size;
 #define	SUBDIVIDE_SIZE	64
@@ -55,7 +53,7 @@ void BoundPoly (int numverts, float *verts, vec3_t mins, vec3_t maxs)
 }
 
 // jkrige - quake2 warps
-void SubdividePolygon (int numverts, float *verts)
+void SubdividePolygon (msurface_t *warpface, int numverts, float *verts)
 {
 	int		i, j, k;
 	vec3_t	mins, maxs;
@@ -124,8 +122,8 @@ void SubdividePolygon (int numverts, float *verts)
 			}
 		}
 
-		SubdividePolygon (f, front[0]);
-		SubdividePolygon (b, back[0]);
+		SubdividePolygon (warpface, f, front[0]);
+		SubdividePolygon (warpface, b, back[0]);
 		return;
 	}
 
@@ -261,8 +259,6 @@ void GL_SubdivideSurface (msurface_t *fa)
 	float		*vec;
 	//texture_t	*t;
 
-	warpface = fa;
-
 	//
 	// convert edges back to a normal polygon
 	//
@@ -279,7 +275,7 @@ void GL_SubdivideSurface (msurface_t *fa)
 		numverts++;
 	}
 
-	SubdividePolygon (numverts, verts[0]);
+	SubdividePolygon (fa, numverts, verts[0]);
 }
 
 //=========================================================
@@ -432,14 +428,14 @@ void EmitBothSkyLayers (msurface_t *fa)
 
 	EmitSkyPolys (fa);
 
-	glEnable (GL_BLEND);
+	GL_Enable (GL_BLEND);
 	GL_Bind (alphaskytexture);
 	speedscale = realtime*16;
 	speedscale -= (int)speedscale & ~127 ;
 
 	EmitSkyPolys (fa);
 
-	glDisable (GL_BLEND);
+	GL_Disable (GL_BLEND);
 }
 
 #ifndef QUAKE2
@@ -813,7 +809,7 @@ void R_DrawSkyChain (msurface_t *s)
 		for (fa=s ; fa ; fa=fa->texturechain)
 			EmitSkyPolys (fa);
 
-		glEnable (GL_BLEND);
+		GL_Enable (GL_BLEND);
 		GL_Bind (alphaskytexture);
 		speedscale = realtime*16;
 		speedscale -= (int)speedscale & ~127;
@@ -821,7 +817,7 @@ void R_DrawSkyChain (msurface_t *s)
 		for (fa=s ; fa ; fa=fa->texturechain)
 			EmitSkyPolys (fa);
 
-		glDisable (GL_BLEND);
+		GL_Disable (GL_BLEND);
 	}
 }
 
@@ -906,7 +902,7 @@ void R_DrawSkyBox (void)
 //glEnable (GL_BLEND);
 //glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 //glColor4f (1,1,1,0.5);
-glDisable (GL_DEPTH_TEST); // jkrige - skybox (disabled depth ckecking)
+GL_Disable (GL_DEPTH_TEST); // jkrige - skybox (disabled depth ckecking)
 //#endif
 
 	//glGetIntegerv(GL_DEPTH_FUNC, &gld);
@@ -942,7 +938,7 @@ glDisable (GL_DEPTH_TEST); // jkrige - skybox (disabled depth ckecking)
 //glDisable (GL_BLEND);
 //glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
 //glColor4f (1,1,1,0.5);
-glEnable (GL_DEPTH_TEST); // jkrige - skybox (disabled depth ckecking)
+GL_Enable (GL_DEPTH_TEST); // jkrige - skybox (disabled depth ckecking)
 //#endif
 //glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
 //glEnable (GL_DEPTH_TEST);
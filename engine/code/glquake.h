@@ -189,6 +189,47 @@ extern	int glx, gly, glwidth, glheight;
 
 void R_TimeRefresh_f (void);
 void R_ReadPointFile_f (void);
+
+int R_LightPoint (vec3_t p);
+int R_LightPointColor (vec3_t p, vec3_t color);
+int R_LightPointDir (vec3_t p, vec3_t color, vec3_t dir);
+msurface_t *RecursiveLightTrace (mnode_t *node, vec3_t start, vec3_t end, int *hit_ds, int *hit_dt);
+int R_SampleLightStyles (msurface_t *surf, int ds, int dt, byte *styles, int rgb[MAXLIGHTMAPS][3]);
+
+// the lights reaching a surface this frame, linked through r_surfdlights
+typedef struct
+{
+	int		light;		// into r_dlights
+	int		next;		// -1 ends the surface's list
+} surfdlight_t;
+
+#define	MAX_SURFDLIGHTS		32768
+
+extern	cvar_t	r_maxdlights;
+extern	dlight_t		*r_dlights[MAX_DLIGHTS];
+extern	int				r_numdlights;
+extern	surfdlight_t	r_surfdlights[MAX_SURFDLIGHTS];
+void R_MarkLights (mnode_t *node);
+
+extern	cvar_t	r_worldwalk;
+void R_SetFrustum (void);
+void R_MarkLeaves (void);
+void R_BuildSurfaceBuckets (void);
+void R_WalkWorld (void);
+void R_CamPath_f (void);
+void R_WorldBench_f (void);
+
+extern	cvar_t	r_occlusion;
+extern	int		c_occlusion_queries, c_occluded_entities, c_occluded_leafs;
+void R_InitOcclusion (void);
+void R_OcclusionBeginFrame (void);
+qboolean R_LeafOccluded (mleaf_t *leaf);
+void R_OcclusionQueryLeafs (void);
+void R_OcclusionTestEntities (entity_t **list, int count);
+
+extern	cvar_t	r_lightgrid;
+void R_BuildLightGrid (void);
+qboolean R_LightGridSample (vec3_t p, vec3_t color, vec3_t dir);
 texture_t *R_TextureAnimation (texture_t *base);
 
 typedef struct surfcache_s
@@ -231,7 +272,6 @@ typedef struct particle_s
 	vec3_t		org;
 	float		color;
 // drivers never touch the following fields
-	struct particle_s	*next;
 	vec3_t		vel;
 	float		ramp;
 	float		die;
@@ -319,6 +359,8 @@ extern	cvar_t	gl_polyblend;
 extern	cvar_t	gl_nocolors;
 extern	cvar_t	gl_skytype; // jkrige - skybox
 extern	cvar_t	gl_doubleeyes;
+extern	cvar_t	r_lerpmodels;
+extern	cvar_t	gl_aliasbuffers;
 
 // jkrige - .lit colored lights
 extern	int		gl_coloredstatic;
@@ -364,6 +406,43 @@ extern	const char *gl_extensions;
 void R_TranslatePlayerSkin (int playernum);
 void GL_Bind (int texnum);
 
+// gl_state.c
+extern	cvar_t	gl_statecache;
+extern	int		c_gl_statecalls, c_gl_statedropped;
+extern	int		c_gl_binds, c_gl_bindsdropped;
+void GL_InvalidateState (void);
+void GL_Enable (GLenum cap);
+void GL_Disable (GLenum cap);
+void GL_ActiveTexture (GLenum unit);
+void GL_DepthMask (GLboolean flag);
+void GL_BlendFunc (GLenum sfactor, GLenum dfactor);
+void GL_TexEnvMode (GLint mode);
+void GL_ShadeModel (GLenum mode);
+void GL_DepthFunc (GLenum func);
+void GL_CullFace (GLenum mode);
+void GL_AlphaFunc (GLenum func, GLclampf ref);
+void GL_UseProgram (GLuint prog);
+void GL_BindBuffer (GLenum target, GLuint buffer);
+
+// gl_batch.c
+typedef struct
+{
+	float	xyz[3];
+	float	st[2];
+	byte	color[4];
+} batchvert_t;
+
+#define	BATCH_BLEND		1		// blended instead of alpha tested
+#define	BATCH_NOTEXTURE	2		// flat colored
+
+extern	int		c_batch_quads, c_batch_draws;
+void GL_InitBatch (void);
+batchvert_t *GL_BatchQuad (int texnum, int flags);
+void GL_FlushBatch (void);
+
+extern	GLuint	r_aliasprogram;		// 0 if the alias shader didn't compile
+void R_InitAliasShader (void);
+
 // Multitexture
 // jkrige - remove multitexture
 //#define    TEXTURE0_SGIS				0x835E
@@ -22,6 +22,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 #include "r_local.h"
 
+#ifdef _MSC_VER
+#define THREADLOCAL	__declspec(thread)
+#else
+#define THREADLOCAL	__thread
+#endif
+
 /*
 
 A server can allways be started, even if the system started out as a client
@@ -42,6 +48,8 @@ double		host_time;
 double		realtime;				// without any filtering or bounding
 double		oldrealtime;			// last frame run
 int			host_framecount;
+int			host_exitcode;			// handed to exit () by Sys_Quit
+qboolean	host_headless;			// -headless: the window is never shown, no sound or mouse
 
 int			host_hunklevel;
 
@@ -60,6 +68,8 @@ extern cvar_t   sv_fps;
 
 cvar_t	host_framerate = {"host_framerate","0"};	// set for slow motion
 cvar_t	host_speeds = {"host_speeds","0"};			// set for running times
+cvar_t	host_pipeline = {"host_pipeline","0",true};	// run the local server beside the drawing
+cvar_t	host_timeline = {"host_timeline","0"};		// draw where the frame stages fell
 
 // jkrige - configurable fps caps
 //		defaults to 0 since sv_fps takes care of framerate
@@ -97,6 +107,195 @@ int		fps_count;
 // jkrige - fps counter
 
 
+/*
+==============================================================================
+
+PIPELINED SERVER FRAME
+
+With host_pipeline set, the local server's frame runs on a thread of its own
+while the main thread draws the frame and mixes the sound.  It is started
+once the client has read what the server sent last frame, and waited for
+after the sound.  Nothing writes the client state in between, so the frame
+is drawn from the state as the read left it, and the server's answer to
+this frame's move is seen one frame later than when run in line.
+
+The server thread doesn't print or abort on its own: its Con_Printfs,
+Cvar_Sets and Cbuf_AddTexts are held until it is waited for, and a
+Host_Error or Host_EndGame is raised again on the main thread.
+==============================================================================
+*/
+
+static sys_thread_t	host_simthread;
+static sys_event_t	host_simwake, host_simdone;
+static qboolean		host_simfailed;		// no thread to be had, run in line
+static qboolean		host_simquit;
+static qboolean		host_simrunning;	// started and not waited for yet
+
+static jmp_buf		host_simabort;
+static char			host_simerror[1024];
+static qboolean		host_simerrored, host_simendgame;
+
+static THREADLOCAL qboolean	host_onsimthread;
+
+/*
+================
+Host_OnServerThread
+================
+*/
+qboolean Host_OnServerThread (void)
+{
+	return host_onsimthread;
+}
+
+/*
+================
+Host_AbortServerThread
+
+Leaves the server frame, for the main thread to raise the error
+================
+*/
+static void Host_AbortServerThread (char *string, qboolean endgame)
+{
+	Q_strncpy (host_simerror, string, sizeof(host_simerror) - 1);
+	host_simendgame = endgame;
+	host_simerrored = true;
+
+	longjmp (host_simabort, 1);
+}
+
+/*
+================
+Host_ServerThread
+================
+*/
+static void Host_ServerThread (void *parm)
+{
+	double	stagestart;
+
+	host_onsimthread = true;
+
+	while (1)
+	{
+		Sys_WaitEvent (host_simwake, -1);
+		if (host_simquit)
+			return;
+
+		if (!setjmp (host_simabort))
+		{
+			stagestart = Host_StageStart ();
+			Host_ServerFrame ();
+			Host_StageEnd (fs_server, stagestart);
+		}
+
+		Sys_SignalEvent (host_simdone);
+	}
+}
+
+/*
+================
+Host_CanPipeline
+
+True if this frame's server frame can run beside the drawing
+================
+*/
+static qboolean Host_CanPipeline (void)
+{
+	if (!host_pipeline.value || !sv.active)
+		return false;
+
+	// the menus poll the network for server lists
+	if (key_dest == key_menu)
+		return false;
+
+	if (!host_simthread && !host_simfailed)
+	{
+		host_simwake = Sys_CreateEvent ();
+		host_simdone = Sys_CreateEvent ();
+		host_simthread = Sys_CreateThread (Host_ServerThread, NULL);
+		if (!host_simthread)
+		{
+			host_simfailed = true;
+			Con_Printf ("Couldn't start the server thread, host_pipeline ignored\n");
+		}
+	}
+
+	return host_simthread != NULL;
+}
+
+/*
+================
+Host_StartServerFrame
+================
+*/
+static void Host_StartServerFrame (void)
+{
+	host_simerrored = false;
+	host_simrunning = true;
+	Sys_SignalEvent (host_simwake);
+}
+
+/*
+================
+Host_WaitServerFrame
+
+Called before anything the server frame could be using is changed
+================
+*/
+void Host_WaitServerFrame (void)
+{
+	if (!host_simrunning || host_onsimthread)
+		return;
+
+	Sys_WaitEvent (host_simdone, -1);
+	host_simrunning = false;
+
+	Con_FlushDeferred ();
+	Cvar_FlushDeferred ();
+	Cbuf_FlushDeferred ();
+}
+
+/*
+================
+Host_FinishServerFrame
+
+Waits for the server frame and raises its error, if it had one
+================
+*/
+static void Host_FinishServerFrame (void)
+{
+	Host_WaitServerFrame ();
+
+	if (!host_simerrored)
+		return;
+	host_simerrored = false;
+
+	if (host_simendgame)
+		Host_EndGame ("%s", host_simerror);
+	Host_Error ("%s", host_simerror);
+}
+
+/*
+================
+Host_StopServerThread
+================
+*/
+static void Host_StopServerThread (void)
+{
+	if (!host_simthread || host_onsimthread)
+		return;		// a Sys_Error on the server thread can't wait for itself
+
+	Host_WaitServerFrame ();
+
+	host_simquit = true;
+	Sys_SignalEvent (host_simwake);
+	Sys_WaitThread (host_simthread);
+	host_simthread = NULL;
+
+	Sys_DestroyEvent (host_simwake);
+	Sys_DestroyEvent (host_simdone);
+}
+
+
 /*
 ================
 Host_EndGame
@@ -110,6 +309,11 @@ void Host_EndGame (char *message, ...)
 	va_start (argptr,message);
 	vsprintf (string,message,argptr);
 	va_end (argptr);
+
+	if (Host_OnServerThread ())
+		Host_AbortServerThread (string, true);
+	Host_WaitServerFrame ();
+
 	Con_DPrintf ("Host_EndGame: %s\n",string);
 	
 	if (sv.active)
@@ -138,6 +342,15 @@ void Host_Error (char *error, ...)
 	va_list		argptr;
 	char		string[1024];
 	static	qboolean inerror = false;
+
+	if (Host_OnServerThread ())
+	{
+		va_start (argptr,error);
+		vsprintf (string,error,argptr);
+		va_end (argptr);
+		Host_AbortServerThread (string, false);
+	}
+	Host_WaitServerFrame ();
 	
 	if (inerror)
 		Sys_Error ("Host_Error: recursively entered");
@@ -159,6 +372,8 @@ void Host_Error (char *error, ...)
 	CL_Disconnect ();
 	cls.demonum = -1;
 
+	CL_BenchmarkDone (false);
+
 	inerror = false;
 
 	longjmp (host_abortserver, 1);
@@ -227,6 +442,8 @@ void Host_InitLocal (void)
 	
 	Cvar_RegisterVariable (&host_framerate);
 	Cvar_RegisterVariable (&host_speeds);
+	Cvar_RegisterVariable (&host_pipeline);
+	Cvar_RegisterVariable (&host_timeline);
 
 	Cvar_RegisterVariable (&sys_ticrate);
 	Cvar_RegisterVariable (&serverprofile);
@@ -682,6 +899,41 @@ void Host_ServerFrame (void)
 #endif
 
 
+/*
+==================
+Host_StageStart / Host_StageEnd
+
+Bracket a stage of the frame; cost nothing but the test when neither a
+benchmark nor host_timeline is asking for the numbers
+==================
+*/
+qboolean	host_stagetiming;
+double		host_stagetime[NUM_FRAMESTAGES];
+double		host_stagebegin[NUM_FRAMESTAGES];
+
+frametimeline_t	host_lasttimeline;
+
+static qboolean	host_stagesactive;
+static double	host_framestart;
+
+double Host_StageStart (void)
+{
+	if (!host_stagesactive)
+		return 0;
+
+	return Sys_FloatTime ();
+}
+
+void Host_StageEnd (framestage_t stage, double start)
+{
+	if (!host_stagesactive)
+		return;
+
+	if (!host_stagetime[stage])
+		host_stagebegin[stage] = start - host_framestart;
+	host_stagetime[stage] += Sys_FloatTime () - start;
+}
+
 /*
 ==================
 Host_Frame
@@ -695,6 +947,8 @@ void _Host_Frame (float time)
 	static double		time2 = 0;
 	static double		time3 = 0;
 	int			pass1, pass2, pass3;
+	double		framestart, stagestart;
+	qboolean	pipelined;
 
 	if (setjmp (host_abortserver) )
 		return;			// something bad happened, or the server disconnected
@@ -705,6 +959,16 @@ void _Host_Frame (float time)
 // decide the simulation time
 	if (!Host_FilterTime (time))
 		return;			// don't run too fast, or packets will flood out
+
+	Prof_FrameBoundary ();
+	PROF_BEGIN ("Host_Frame");
+
+// nothing holds cache data between frames, so blocks can move
+	Cache_Compact ();
+
+	host_stagesactive = host_stagetiming || host_timeline.value;
+	memset (host_stagetime, 0, sizeof(host_stagetime));
+	framestart = host_framestart = Host_StageStart ();
 		
 // get new key events
 	Sys_SendKeyEvents ();
@@ -729,9 +993,15 @@ void _Host_Frame (float time)
 
 // check for commands typed to the host
 	Host_GetConsoleCommands ();
+
+	pipelined = Host_CanPipeline ();
 	
-	if (sv.active)
+	if (sv.active && !pipelined)
+	{
+		stagestart = Host_StageStart ();
 		Host_ServerFrame ();
+		Host_StageEnd (fs_server, stagestart);
+	}
 
 //-------------------
 //
@@ -749,19 +1019,28 @@ void _Host_Frame (float time)
 // fetch results from server
 	if (cls.state == ca_connected)
 	{
+		stagestart = Host_StageStart ();
 		CL_ReadFromServer ();
+		Host_StageEnd (fs_clientparse, stagestart);
 	}
 
+// the server takes this frame's move while the frame is drawn
+	if (pipelined)
+		Host_StartServerFrame ();
+
 // update video
 	if (host_speeds.value)
 		time1 = Sys_FloatTime ();
 		
+	stagestart = Host_StageStart ();
 	SCR_UpdateScreen ();
+	Host_StageEnd (fs_render, stagestart);
 
 	if (host_speeds.value)
 		time2 = Sys_FloatTime ();
 		
 // update audio
+	stagestart = Host_StageStart ();
 	if (cls.signon == SIGNONS)
 	{
 		S_Update (r_origin, vpn, vright, vup);
@@ -774,6 +1053,10 @@ void _Host_Frame (float time)
 	//CDAudio_Update();
 	FMOD_MusicUpdate();
 	// jkrige - fmod sound system (music)
+	Host_StageEnd (fs_sound, stagestart);
+
+	if (pipelined)
+		Host_FinishServerFrame ();
 
 	if (host_speeds.value)
 	{
@@ -784,9 +1067,23 @@ void _Host_Frame (float time)
 		Con_Printf ("%3i tot %3i server %3i gfx %3i snd\n",	pass1+pass2+pass3, pass1, pass2, pass3);
 	}
 	
+	if (host_stagesactive)
+	{
+		Host_StageEnd (fs_total, framestart);
+
+		memcpy (host_lasttimeline.begin, host_stagebegin, sizeof(host_stagebegin));
+		memcpy (host_lasttimeline.time, host_stagetime, sizeof(host_stagetime));
+		host_lasttimeline.pipelined = pipelined;
+	}
+
+	if (host_stagetiming)
+		CL_TimeDemoFrame ();
+
 	host_framecount++;
 
 	fps_count++; // jkrige - fps counter
+
+	PROF_END ();
 }
 
 void Host_Frame (float time)
@@ -897,6 +1194,9 @@ Host_Init
 */
 void Host_Init (quakeparms_t *parms)
 {
+	int		i;
+
+	host_headless = COM_CheckParm ("-headless") != 0;
 
 	if (standard_quake)
 		minimum_memory = MINIMUM_MEMORY;
@@ -917,6 +1217,7 @@ void Host_Init (quakeparms_t *parms)
 	Memory_Init (parms->membase, parms->memsize);
 	Cbuf_Init ();
 	Cmd_Init ();	
+	Prof_Init ();
 	V_Init ();
 
 	// jkrige - removed chase
@@ -934,6 +1235,7 @@ void Host_Init (quakeparms_t *parms)
 	Mod_Init ();
 	NET_Init ();
 	SV_Init ();
+	Job_Init ();
 
 	Con_Printf ("Exe: "__TIME__" "__DATE__"\n");
 	Con_Printf ("%4.1f megabyte heap\n",parms->memsize/ (1024*1024.0));
@@ -991,6 +1293,21 @@ void Host_Init (quakeparms_t *parms)
 
 	Cbuf_InsertText ("exec quake.rc\n");
 
+// -benchmark <demo> [-benchout <file>] runs a timedemo, writes the frame
+// statistics and quits; with -headless it needs nobody's desktop
+	i = COM_CheckParm ("-benchmark");
+	if (i && i < com_argc - 1 && cls.state != ca_dedicated)
+	{
+		char	*out;
+
+		out = "benchmark.json";
+		if (COM_CheckParm ("-benchout") && COM_CheckParm ("-benchout") < com_argc - 1)
+			out = com_argv[COM_CheckParm ("-benchout") + 1];
+		Cbuf_AddText (va("timedemo %s %s\n", com_argv[i+1], out));
+	}
+	else if (i)
+		CL_BenchmarkDone (false);
+
 	Hunk_AllocName (0, "-HOST_HUNKLEVEL-");
 	host_hunklevel = Hunk_LowMark ();
 
@@ -1022,8 +1339,14 @@ void Host_Shutdown(void)
 // keep Con_Printf from trying to update the screen
 	scr_disabled_for_loading = true;
 
+	Host_StopServerThread ();
+
 	Host_WriteConfiguration (); 
 
+// the demo writer holds buffered blocks that must still reach the disk
+	if (cls.demorecording)
+		CL_CloseDemoFile ();
+
 	// jkrige - fmod sound system (music)
 	//CDAudio_Shutdown ();
 	// jkrige - fmod sound system (music)
@@ -1036,6 +1359,7 @@ void Host_Shutdown(void)
 
 	S_Shutdown();
 	IN_Shutdown ();
+	Job_Shutdown ();
 
 	if (cls.state != ca_dedicated)
 	{
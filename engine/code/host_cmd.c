@@ -29,6 +29,8 @@ void Mod_Print (void);
 /*
 ==================
 Host_Quit_f
+
+quit [exitcode]; with an exit code there is nobody to ask for confirmation
 ==================
 */
 
@@ -36,7 +38,9 @@ extern void M_Menu_Quit_f (void);
 
 void Host_Quit_f (void)
 {
-	if (key_dest != key_console && cls.state != ca_dedicated)
+	if (Cmd_Argc () > 1)
+		host_exitcode = Q_atoi (Cmd_Argv (1));
+	else if (key_dest != key_console && cls.state != ca_dedicated)
 	{
 		M_Menu_Quit_f ();
 		return;
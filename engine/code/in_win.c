@@ -428,7 +428,7 @@ void IN_StartupMouse (void)
 {
 	HDC			hdc;
 
-	if ( COM_CheckParm ("-nomouse") ) 
+	if ( COM_CheckParm ("-nomouse") || host_headless ) 
 		return; 
 
 	mouseinitialized = true;
@@ -0,0 +1,270 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// job.c -- worker threads for parallel loops
+
+#include "quakedef.h"
+
+#ifdef _MSC_VER
+#define THREADLOCAL	__declspec(thread)
+#else
+#define THREADLOCAL	__thread
+#endif
+
+#define	MAX_JOBTHREADS	16
+
+typedef struct
+{
+	sys_thread_t	thread;
+	sys_event_t		wake;
+	int				num;
+} jobthread_t;
+
+static jobthread_t	job_threads[MAX_JOBTHREADS];
+static int			job_numthreads;
+static qboolean		job_quit;
+
+static sys_mutex_t	job_mutex;
+static sys_event_t	job_done;
+
+// the job in flight
+static jobfunc_t	job_func;
+static void			*job_parm;
+static int			job_count;
+static int			job_next;			// next index to hand out
+static int			job_pending;		// indexes not finished yet
+static qboolean		job_active;
+
+static THREADLOCAL int	job_threadnum;
+
+/*
+================
+Job_Work
+
+Takes indexes until there are none left
+================
+*/
+static void Job_Work (void)
+{
+	jobfunc_t	func;
+	void		*parm;
+	int			index;
+
+	while (1)
+	{
+		Sys_LockMutex (job_mutex);
+		if (!job_active || job_next >= job_count)
+		{
+			Sys_UnlockMutex (job_mutex);
+			return;
+		}
+		index = job_next++;
+		func = job_func;
+		parm = job_parm;
+		Sys_UnlockMutex (job_mutex);
+
+		func (parm, index);
+
+		Sys_LockMutex (job_mutex);
+		if (!--job_pending)
+			Sys_SignalEvent (job_done);
+		Sys_UnlockMutex (job_mutex);
+	}
+}
+
+/*
+================
+Job_Thread
+================
+*/
+static void Job_Thread (void *parm)
+{
+	jobthread_t	*t;
+
+	t = (jobthread_t *)parm;
+	job_threadnum = t->num;
+
+	while (1)
+	{
+		Sys_WaitEvent (t->wake, -1);
+		if (job_quit)
+			return;
+		Job_Work ();
+	}
+}
+
+/*
+================
+Job_Begin
+================
+*/
+void Job_Begin (jobfunc_t func, void *parm, int count)
+{
+	int		i, wake;
+
+	if (count <= 0)
+		return;
+
+	Sys_LockMutex (job_mutex);
+	if (job_active || job_threadnum || !job_numthreads)
+	{	// no one to hand it to, do it now
+		Sys_UnlockMutex (job_mutex);
+		for (i=0 ; i<count ; i++)
+			func (parm, i);
+		return;
+	}
+
+	job_func = func;
+	job_parm = parm;
+	job_count = count;
+	job_next = 0;
+	job_pending = count;
+	job_active = true;
+	Sys_UnlockMutex (job_mutex);
+
+	wake = count < job_numthreads ? count : job_numthreads;
+	for (i=0 ; i<wake ; i++)
+		Sys_SignalEvent (job_threads[i].wake);
+}
+
+/*
+================
+Job_Finish
+================
+*/
+void Job_Finish (void)
+{
+	if (job_threadnum || !job_active)
+		return;
+
+	Job_Work ();
+
+	while (1)
+	{
+		Sys_LockMutex (job_mutex);
+		if (!job_pending)
+		{
+			job_active = false;
+			Sys_UnlockMutex (job_mutex);
+			return;
+		}
+		Sys_UnlockMutex (job_mutex);
+
+		Sys_WaitEvent (job_done, 10);
+	}
+}
+
+/*
+================
+Job_Run
+================
+*/
+void Job_Run (jobfunc_t func, void *parm, int count)
+{
+	if (job_active)
+	{	// Job_Begin would run it inline, but must not finish the other job
+		int		i;
+
+		for (i=0 ; i<count ; i++)
+			func (parm, i);
+		return;
+	}
+
+	Job_Begin (func, parm, count);
+	Job_Finish ();
+}
+
+/*
+================
+Job_NumThreads / Job_ThreadNum
+================
+*/
+int Job_NumThreads (void)
+{
+	return job_numthreads;
+}
+
+int Job_ThreadNum (void)
+{
+	return job_threadnum;
+}
+
+/*
+================
+Job_Init
+
+One worker per extra processor, or -jobthreads <n>
+================
+*/
+void Job_Init (void)
+{
+	jobthread_t	*t;
+	int			i, want;
+
+	job_mutex = Sys_CreateMutex ();
+	job_done = Sys_CreateEvent ();
+
+	want = Sys_NumProcessors () - 1;
+	i = COM_CheckParm ("-jobthreads");
+	if (i && i < com_argc-1)
+		want = Q_atoi (com_argv[i+1]);
+	if (want > MAX_JOBTHREADS)
+		want = MAX_JOBTHREADS;
+
+	if (!job_mutex || !job_done)
+		want = 0;
+
+	for (i=0 ; i<want ; i++)
+	{
+		t = &job_threads[job_numthreads];
+		t->num = job_numthreads + 1;
+		t->wake = Sys_CreateEvent ();
+		if (!t->wake)
+			break;
+		t->thread = Sys_CreateThread (Job_Thread, t);
+		if (!t->thread)
+		{
+			Sys_DestroyEvent (t->wake);
+			break;
+		}
+		job_numthreads++;
+	}
+
+	Con_Printf ("%i job threads\n", job_numthreads);
+}
+
+/*
+================
+Job_Shutdown
+================
+*/
+void Job_Shutdown (void)
+{
+	int		i;
+
+	job_quit = true;
+	for (i=0 ; i<job_numthreads ; i++)
+		Sys_SignalEvent (job_threads[i].wake);
+	for (i=0 ; i<job_numthreads ; i++)
+	{
+		Sys_WaitThread (job_threads[i].thread);
+		Sys_DestroyEvent (job_threads[i].wake);
+	}
+	job_numthreads = 0;
+}
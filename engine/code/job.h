@@ -0,0 +1,41 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// job.h -- worker threads for parallel loops
+
+// A job is func (parm, index) for every index below count, in any order and
+// on any thread.  Job_Begin hands it to the workers and returns; Job_Finish
+// has the caller help with what is left and returns when all of it is done.
+// Only one job is in flight at a time: a job started while another one
+// is, including from inside a job, simply runs inline.
+//
+// Job functions must not print, touch the video or sound state, or open
+// files.  Hunk_Alloc is safe to call from them.
+
+typedef void (*jobfunc_t) (void *parm, int index);
+
+void Job_Init (void);
+void Job_Shutdown (void);
+
+void Job_Begin (jobfunc_t func, void *parm, int count);
+void Job_Finish (void);
+void Job_Run (jobfunc_t func, void *parm, int count);	// Job_Begin + Job_Finish
+
+int Job_NumThreads (void);		// workers, not counting the caller
+int Job_ThreadNum (void);		// 0 on the caller, 1.. on the workers
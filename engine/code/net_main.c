@@ -473,6 +473,8 @@ qsocket_t *NET_CheckNewConnections (void)
 {
 	qsocket_t	*ret;
 
+	PROF_BEGIN ("NET_CheckNewConnections");
+
 	SetNetTime();
 
 	for (net_driverlevel=0 ; net_driverlevel<net_numdrivers; net_driverlevel++)
@@ -492,6 +494,7 @@ qsocket_t *NET_CheckNewConnections (void)
 				Sys_FileWrite (vcrFile, &vcrConnect, sizeof(vcrConnect));
 				Sys_FileWrite (vcrFile, ret->address, NET_NAMELEN);
 			}
+			PROF_END ();
 			return ret;
 		}
 	}
@@ -504,6 +507,7 @@ qsocket_t *NET_CheckNewConnections (void)
 		Sys_FileWrite (vcrFile, &vcrConnect, sizeof(vcrConnect));
 	}
 
+	PROF_END ();
 	return NULL;
 }
 
@@ -958,6 +962,8 @@ void NET_Poll(void)
 		configRestored = true;
 	}
 
+	PROF_BEGIN ("NET_Poll");
+
 	SetNetTime();
 
 	for (pp = pollProcedureList; pp; pp = pp->next)
@@ -967,6 +973,8 @@ void NET_Poll(void)
 		pollProcedureList = pp->next;
 		pp->procedure(pp->arg);
 	}
+
+	PROF_END ();
 }
 
 
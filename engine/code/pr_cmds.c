@@ -727,8 +727,9 @@ int PF_newcheckclient (int check)
 // get the PVS for the entity
 	VectorAdd (ent->v.origin, ent->v.view_ofs, org);
 	leaf = Mod_PointInLeaf (org, sv.worldmodel);
-	pvs = Mod_LeafPVS (leaf, sv.worldmodel);
-	memcpy (checkpvs, pvs, (sv.worldmodel->numleafs+7)>>3 );
+	pvs = Mod_LeafPVS (leaf, sv.worldmodel, checkpvs);
+	if (pvs != checkpvs)
+		memcpy (checkpvs, pvs, (sv.worldmodel->numleafs+7)>>3 );
 
 	return i;
 }
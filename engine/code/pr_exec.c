@@ -218,10 +218,404 @@ void PR_StackTrace (void)
 }
 
 
+/*
+==============================================================================
+
+TIMING PROFILE
+
+While "profile start" is in effect every QuakeC function and builtin call
+is timed.  Calls are kept as a tree of call paths so self time, inclusive
+time and the call graph all fall out of it, and the tree can be written as
+folded stacks for flamegraph tools.
+==============================================================================
+*/
+
+typedef struct
+{
+	int		calls;
+	int		active;			// recursion depth, so inclusive time counts once
+	double	self;
+	double	total;			// inclusive
+	double	builtin;		// in builtins called directly from this function
+} prprofile_t;
+
+typedef struct
+{
+	int		func;
+	int		parent, child, sibling;		// -1 terminated
+	int		calls;
+	double	self;
+	double	total;
+} prnode_t;
+
+typedef struct
+{
+	int		node;
+	int		func;
+	double	start;
+	double	child;			// time spent in callees
+} prframe_t;
+
+#define	MAX_PROFILE_NODES	0x40000
+#define	MAX_PROFILE_STACK	256
+
+qboolean		pr_timing;
+
+static prprofile_t	*prof_funcs;
+static int			prof_numfuncs;
+static unsigned short	prof_crc;
+
+static prnode_t		*prof_nodes;
+static int			prof_numnodes, prof_maxnodes;
+static int			prof_roots = -1;
+
+static prframe_t	prof_stack[MAX_PROFILE_STACK];
+static int			prof_sp;
+static int			prof_overflow;		// calls too deep to record
+
+/*
+============
+PR_ClearProfile
+============
+*/
+static void PR_ClearProfile (void)
+{
+	free (prof_funcs);
+	free (prof_nodes);
+	prof_funcs = NULL;
+	prof_nodes = NULL;
+	prof_numfuncs = 0;
+	prof_numnodes = prof_maxnodes = 0;
+	prof_roots = -1;
+	prof_sp = 0;
+	prof_overflow = 0;
+}
+
+/*
+============
+PR_CheckProfile
+
+Called after progs are loaded; a different progs invalidates the numbers
+============
+*/
+void PR_CheckProfile (void)
+{
+	if (!prof_funcs)
+		return;
+
+	if (prof_crc == pr_crc && prof_numfuncs == progs->numfunctions)
+		return;
+
+	Con_Printf ("progs changed, QuakeC profile cleared\n");
+	PR_ClearProfile ();
+	pr_timing = false;
+}
+
+/*
+============
+PR_ProfileNode
+
+Finds or adds the call path node for func under parent
+============
+*/
+static int PR_ProfileNode (int parent, int func)
+{
+	prnode_t	*n;
+	int			*link;
+	int			i;
+
+	link = (parent < 0) ? &prof_roots : &prof_nodes[parent].child;
+	for (i = *link ; i >= 0 ; i = prof_nodes[i].sibling)
+	{
+		if (prof_nodes[i].func == func)
+			return i;
+	}
+
+	if (prof_numnodes == prof_maxnodes)
+	{
+		if (prof_maxnodes == MAX_PROFILE_NODES)
+			return -1;
+		n = realloc (prof_nodes, (prof_maxnodes + 4096) * sizeof(prnode_t));
+		if (!n)
+			return -1;
+		prof_nodes = n;
+		prof_maxnodes += 4096;
+		link = (parent < 0) ? &prof_roots : &prof_nodes[parent].child;
+	}
+
+	i = prof_numnodes++;
+	n = &prof_nodes[i];
+	n->func = func;
+	n->parent = parent;
+	n->child = -1;
+	n->sibling = *link;
+	n->calls = 0;
+	n->self = n->total = 0;
+	*link = i;
+
+	return i;
+}
+
+/*
+============
+PR_ProfileEnter
+============
+*/
+static void PR_ProfileEnter (dfunction_t *f)
+{
+	prframe_t	*fr;
+	int			parent;
+
+	if (prof_sp == MAX_PROFILE_STACK)
+	{
+		prof_overflow++;
+		return;
+	}
+
+	fr = &prof_stack[prof_sp];
+	fr->func = f - pr_functions;
+
+	parent = prof_sp ? prof_stack[prof_sp-1].node : -1;
+	fr->node = (prof_sp && parent < 0) ? -1 : PR_ProfileNode (parent, fr->func);
+
+	prof_funcs[fr->func].active++;
+	fr->child = 0;
+	prof_sp++;
+
+	fr->start = Sys_PreciseTime ();
+}
+
+/*
+============
+PR_ProfileLeave
+============
+*/
+static void PR_ProfileLeave (void)
+{
+	prframe_t	*fr;
+	prprofile_t	*p;
+	prnode_t	*n;
+	double		total, self;
+
+	if (prof_overflow)
+	{
+		prof_overflow--;
+		return;
+	}
+	if (!prof_sp)
+		return;
+
+	fr = &prof_stack[--prof_sp];
+	total = Sys_PreciseTime () - fr->start;
+	self = total - fr->child;
+
+	p = &prof_funcs[fr->func];
+	p->calls++;
+	p->self += self;
+	if (!--p->active)
+		p->total += total;
+
+	if (fr->node >= 0)
+	{
+		n = &prof_nodes[fr->node];
+		n->calls++;
+		n->self += self;
+		n->total += total;
+	}
+
+	if (prof_sp)
+	{
+		prof_stack[prof_sp-1].child += total;
+		if (pr_functions[fr->func].first_statement < 0)
+			prof_funcs[prof_stack[prof_sp-1].func].builtin += total;
+	}
+}
+
+/*
+============
+PR_ProfileUnwind
+
+An error dumped the progs stack without leaving the functions on it
+============
+*/
+static void PR_ProfileUnwind (void)
+{
+	while (prof_sp)
+	{
+		prof_sp--;
+		if (prof_funcs)
+			prof_funcs[prof_stack[prof_sp].func].active--;
+	}
+	prof_overflow = 0;
+}
+
+static int PR_CompareSelfTime (const void *a, const void *b)
+{
+	double	ta, tb;
+
+	ta = prof_funcs[*(const int *)a].self;
+	tb = prof_funcs[*(const int *)b].self;
+
+	if (ta > tb)
+		return -1;
+	if (ta < tb)
+		return 1;
+	return 0;
+}
+
+/*
+============
+PR_PrintTimes
+============
+*/
+static void PR_PrintTimes (void)
+{
+	prprofile_t	*p;
+	int			*order;
+	int			i;
+
+	order = malloc (prof_numfuncs * sizeof(int));
+	if (!order)
+		return;
+	for (i=0 ; i<prof_numfuncs ; i++)
+		order[i] = i;
+	qsort (order, prof_numfuncs, sizeof(int), PR_CompareSelfTime);
+
+	Con_Printf ("  calls  self ms  incl ms builtin  function\n");
+	for (i=0 ; i<prof_numfuncs && i<20 ; i++)
+	{
+		p = &prof_funcs[order[i]];
+		if (!p->calls)
+			break;
+		Con_Printf ("%7i %8.2f %8.2f %7.2f  %s%s\n", p->calls, p->self*1000, p->total*1000, p->builtin*1000,
+			pr_strings + pr_functions[order[i]].s_name, (pr_functions[order[i]].first_statement < 0) ? " (builtin)" : "");
+	}
+
+	free (order);
+}
+
+/*
+============
+PR_PrintCallGraph
+
+Callers and callees of one function, summed over every path it appears on
+============
+*/
+static void PR_PrintCallGraph (char *name)
+{
+	prnode_t	*n, *c;
+	int			*calls;
+	double		*times;
+	int			func, i, j;
+
+	for (func=0 ; func<prof_numfuncs ; func++)
+	{
+		if (!strcmp (pr_strings + pr_functions[func].s_name, name))
+			break;
+	}
+	if (func == prof_numfuncs)
+	{
+		Con_Printf ("No function %s\n", name);
+		return;
+	}
+
+	calls = malloc (prof_numfuncs * 2 * sizeof(int));
+	times = malloc (prof_numfuncs * 2 * sizeof(double));
+	if (!calls || !times)
+	{
+		free (calls);
+		free (times);
+		return;
+	}
+	memset (calls, 0, prof_numfuncs * 2 * sizeof(int));
+	memset (times, 0, prof_numfuncs * 2 * sizeof(double));
+
+// callers in the first half, callees in the second
+	for (i=0, n=prof_nodes ; i<prof_numnodes ; i++, n++)
+	{
+		if (n->func != func)
+			continue;
+
+		if (n->parent >= 0)
+		{
+			calls[prof_nodes[n->parent].func] += n->calls;
+			times[prof_nodes[n->parent].func] += n->total;
+		}
+
+		for (j = n->child ; j >= 0 ; j = c->sibling)
+		{
+			c = &prof_nodes[j];
+			calls[prof_numfuncs + c->func] += c->calls;
+			times[prof_numfuncs + c->func] += c->total;
+		}
+	}
+
+	Con_Printf ("called by:\n");
+	for (i=0 ; i<prof_numfuncs ; i++)
+		if (calls[i])
+			Con_Printf ("%7i %8.2f ms  %s\n", calls[i], times[i]*1000, pr_strings + pr_functions[i].s_name);
+
+	Con_Printf ("calls:\n");
+	for (i=0 ; i<prof_numfuncs ; i++)
+		if (calls[prof_numfuncs + i])
+			Con_Printf ("%7i %8.2f ms  %s\n", calls[prof_numfuncs + i], times[prof_numfuncs + i]*1000, pr_strings + pr_functions[i].s_name);
+
+	free (calls);
+	free (times);
+}
+
+/*
+============
+PR_WriteFlameGraph
+
+One line per call path: "outer;inner;innermost <self microseconds>", the
+folded format flamegraph.pl and speedscope read
+============
+*/
+static void PR_WriteFlameGraph (char *filename)
+{
+	char		name[MAX_OSPATH];
+	FILE		*f;
+	prnode_t	*n;
+	int			path[MAX_PROFILE_STACK];
+	int			i, j, depth, count;
+
+	sprintf (name, "%s/%s", com_gamedir, filename);
+	f = fopen (name, "w");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't open %s.\n", name);
+		return;
+	}
+
+	count = 0;
+	for (i=0, n=prof_nodes ; i<prof_numnodes ; i++, n++)
+	{
+		if ((int)(n->self * 1000000) <= 0)
+			continue;
+
+		depth = 0;
+		for (j=i ; j >= 0 && depth < MAX_PROFILE_STACK ; j = prof_nodes[j].parent)
+			path[depth++] = prof_nodes[j].func;
+
+		while (depth--)
+			fprintf (f, "%s%c", pr_strings + pr_functions[path[depth]].s_name, depth ? ';' : ' ');
+		fprintf (f, "%i\n", (int)(n->self * 1000000));
+		count++;
+	}
+
+	fclose (f);
+	Con_Printf ("Wrote %i call paths to %s\n", count, name);
+}
+
 /*
 ============
 PR_Profile_f
 
+profile					statement counts, and times if any were taken
+profile start|stop|clear
+profile graph <function>
+profile flame [file]
 ============
 */
 void PR_Profile_f (void)
@@ -230,6 +624,79 @@ void PR_Profile_f (void)
 	int			max;
 	int			num;
 	int			i;
+	char		*cmd;
+
+	if (!progs)
+	{
+		Con_Printf ("No progs loaded.\n");
+		return;
+	}
+
+	cmd = (Cmd_Argc() > 1) ? Cmd_Argv(1) : "";
+
+	if (!strcmp (cmd, "start"))
+	{
+		if (!prof_funcs)
+		{
+			prof_funcs = malloc (progs->numfunctions * sizeof(prprofile_t));
+			if (!prof_funcs)
+				return;
+			memset (prof_funcs, 0, progs->numfunctions * sizeof(prprofile_t));
+			prof_numfuncs = progs->numfunctions;
+			prof_crc = pr_crc;
+		}
+		pr_timing = true;
+		Con_Printf ("QuakeC timing on\n");
+		return;
+	}
+
+	if (!strcmp (cmd, "stop"))
+	{
+		pr_timing = false;
+		Con_Printf ("QuakeC timing off\n");
+		return;
+	}
+
+	if (!strcmp (cmd, "clear"))
+	{
+		PR_ClearProfile ();
+		pr_timing = false;
+		return;
+	}
+
+	if (!strcmp (cmd, "graph") || !strcmp (cmd, "flame"))
+	{
+		if (!prof_funcs)
+		{
+			Con_Printf ("No QuakeC timings, use \"profile start\"\n");
+			return;
+		}
+
+		if (cmd[0] == 'g')
+		{
+			if (Cmd_Argc() != 3)
+				Con_Printf ("profile graph <function>\n");
+			else
+				PR_PrintCallGraph (Cmd_Argv(2));
+		}
+		else
+		{
+			if (Cmd_Argc() == 3 && strstr(Cmd_Argv(2), ".."))
+				Con_Printf ("Relative pathnames are not allowed.\n");
+			else
+				PR_WriteFlameGraph ((Cmd_Argc() == 3) ? Cmd_Argv(2) : "qcprofile.folded");
+		}
+		return;
+	}
+
+	if (cmd[0])
+	{
+		Con_Printf ("profile [start|stop|clear|graph <function>|flame [file]]\n");
+		return;
+	}
+
+	if (prof_funcs)
+		PR_PrintTimes ();
 	
 	num = 0;	
 	do
@@ -327,6 +794,10 @@ int PR_EnterFunction (dfunction_t *f)
 	}
 
 	pr_xfunction = f;
+
+	if (pr_timing)
+		PR_ProfileEnter (f);
+
 	return f->first_statement - 1;	// offset the s++
 }
 
@@ -342,6 +813,9 @@ int PR_LeaveFunction (void)
 	if (pr_depth <= 0)
 		Sys_Error ("prog stack underflow");
 
+	if (pr_timing)
+		PR_ProfileLeave ();
+
 // restore locals from the stack
 	c = pr_xfunction->locals;
 	localstack_used -= c;
@@ -384,6 +858,11 @@ void PR_ExecuteProgram (func_t fnum)
 	
 	f = &pr_functions[fnum];
 
+	PROF_BEGIN ("PR_ExecuteProgram");
+
+	if (!pr_depth && prof_sp)
+		PR_ProfileUnwind ();
+
 	runaway = 100000;
 	pr_trace = false;
 
@@ -633,7 +1112,14 @@ while (1)
 			i = -newf->first_statement;
 			if (i >= pr_numbuiltins)
 				PR_RunError ("Bad builtin call number");
-			pr_builtins[i] ();
+			if (pr_timing)
+			{
+				PR_ProfileEnter (newf);
+				pr_builtins[i] ();
+				PR_ProfileLeave ();
+			}
+			else
+				pr_builtins[i] ();
 			break;
 		}
 
@@ -648,7 +1134,10 @@ while (1)
 	
 		s = PR_LeaveFunction ();
 		if (pr_depth == exitdepth)
+		{
+			PROF_END ();
 			return;		// all done
+		}
 		break;
 		
 	case OP_STATE:
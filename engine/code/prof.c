@@ -0,0 +1,483 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// prof.c -- scoped zone profiler
+
+#include "quakedef.h"
+
+#ifdef PROFILER
+
+// Each thread that enters a zone gets its own ring of finished zones, so
+// recording never takes a lock.  Zones are only timed while something is
+// looking at them: the overlay or a pending capture.
+
+#ifdef _MSC_VER
+#define THREADLOCAL	__declspec(thread)
+#else
+#define THREADLOCAL	__thread
+#endif
+
+#define	MAX_PROFTHREADS		8
+#define	MAX_PROFDEPTH		32
+#define	PROF_RINGSIZE		65536		// zones per thread, power of two
+#define	MAX_PROFDISPLAY		32
+
+typedef struct
+{
+	const char	*name;
+	double		start, end;
+	int			depth;
+} profzone_t;
+
+typedef struct
+{
+	int			id;
+	profzone_t	*ring;
+	unsigned	head;					// zones ever written
+
+	profzone_t	stack[MAX_PROFDEPTH];	// open zones
+	int			depth;
+} profthread_t;
+
+typedef struct
+{
+	const char	*name;
+	int			depth;
+	double		first;					// start of the first call, for ordering
+	double		time;
+	int			calls;
+} profline_t;
+
+static profthread_t		prof_threads[MAX_PROFTHREADS];
+static int				prof_numthreads;
+static sys_mutex_t		prof_mutex;
+static THREADLOCAL profthread_t	*prof_thread;
+
+static qboolean			prof_initialized;
+static volatile qboolean	prof_active;
+
+// overlay: main thread zones summed over half a second
+static unsigned			prof_framehead;		// main ring head at the last boundary
+static double			prof_windowstart;
+static int				prof_windowframes;
+static profline_t		prof_window[MAX_PROFDISPLAY];
+static int				prof_numwindow;
+static profline_t		prof_display[MAX_PROFDISPLAY];
+static int				prof_numdisplay;
+static int				prof_displayframes;
+
+// capture
+static int				prof_captureframes;	// frames still to record
+static qboolean			prof_capturing;
+static double			prof_capturestart;
+static char				prof_capturefile[MAX_OSPATH];
+
+cvar_t	prof_overlay = {"prof_overlay", "0"};
+
+/*
+================
+Prof_GetThread
+
+Registers the calling thread the first time it enters a zone
+================
+*/
+static profthread_t *Prof_GetThread (void)
+{
+	profthread_t	*t;
+
+	if (prof_thread)
+		return prof_thread;
+
+	Sys_LockMutex (prof_mutex);
+	if (prof_numthreads == MAX_PROFTHREADS)
+	{
+		Sys_UnlockMutex (prof_mutex);
+		return NULL;
+	}
+
+	t = &prof_threads[prof_numthreads];
+	t->ring = malloc (PROF_RINGSIZE * sizeof(profzone_t));
+	if (!t->ring)
+	{
+		Sys_UnlockMutex (prof_mutex);
+		return NULL;
+	}
+	t->id = prof_numthreads;
+	t->head = 0;
+	t->depth = 0;
+	prof_numthreads++;
+	Sys_UnlockMutex (prof_mutex);
+
+	prof_thread = t;
+	return t;
+}
+
+/*
+================
+Prof_Begin
+================
+*/
+void Prof_Begin (const char *name)
+{
+	profthread_t	*t;
+	profzone_t		*z;
+
+	if (!prof_active)
+		return;
+
+	t = Prof_GetThread ();
+	if (!t)
+		return;
+
+	if (t->depth < MAX_PROFDEPTH)
+	{
+		z = &t->stack[t->depth];
+		z->name = name;
+		z->depth = t->depth;
+		z->start = Sys_PreciseTime ();
+	}
+	t->depth++;
+}
+
+/*
+================
+Prof_End
+================
+*/
+void Prof_End (void)
+{
+	profthread_t	*t;
+	profzone_t		*z;
+
+	t = prof_thread;
+	if (!t || !t->depth)
+		return;		// zone was entered before profiling switched on
+
+	t->depth--;
+	if (t->depth >= MAX_PROFDEPTH || !prof_active)
+		return;
+
+	z = &t->stack[t->depth];
+	z->end = Sys_PreciseTime ();
+	t->ring[t->head & (PROF_RINGSIZE-1)] = *z;
+	t->head++;
+}
+
+/*
+================
+Prof_AddLine
+================
+*/
+static void Prof_AddLine (profline_t *lines, int *numlines, profzone_t *z, double time, int calls)
+{
+	profline_t	*l;
+	int			i;
+
+	for (i=0, l=lines ; i<*numlines ; i++, l++)
+	{
+		if (l->name == z->name && l->depth == z->depth)
+			break;
+	}
+
+	if (i == *numlines)
+	{
+		if (*numlines == MAX_PROFDISPLAY)
+			return;
+		(*numlines)++;
+		l->name = z->name;
+		l->depth = z->depth;
+		l->first = z->start;
+		l->time = 0;
+		l->calls = 0;
+	}
+
+	if (z->start < l->first)
+		l->first = z->start;
+	l->time += time;
+	l->calls += calls;
+}
+
+static int Prof_CompareLines (const void *a, const void *b)
+{
+	const profline_t	*la, *lb;
+
+	la = (const profline_t *)a;
+	lb = (const profline_t *)b;
+
+	if (la->first < lb->first)
+		return -1;
+	if (la->first > lb->first)
+		return 1;
+	return 0;
+}
+
+/*
+================
+Prof_UpdateOverlay
+
+Folds the zones the main thread finished last frame into the window
+================
+*/
+static void Prof_UpdateOverlay (double now)
+{
+	profthread_t	*t;
+	profzone_t		*z;
+	unsigned		i;
+
+	t = prof_thread;
+	if (!t)
+		return;
+
+	i = prof_framehead;
+	if (t->head - i > PROF_RINGSIZE)
+		i = t->head - PROF_RINGSIZE;
+
+	for ( ; i != t->head ; i++)
+	{
+		z = &t->ring[i & (PROF_RINGSIZE-1)];
+		Prof_AddLine (prof_window, &prof_numwindow, z, z->end - z->start, 1);
+	}
+	prof_windowframes++;
+
+	if (now - prof_windowstart < 0.5)
+		return;
+
+// publish the window, ordered as the zones were entered
+	memcpy (prof_display, prof_window, prof_numwindow * sizeof(profline_t));
+	prof_numdisplay = prof_numwindow;
+	prof_displayframes = prof_windowframes;
+	qsort (prof_display, prof_numdisplay, sizeof(profline_t), Prof_CompareLines);
+
+	prof_numwindow = 0;
+	prof_windowframes = 0;
+	prof_windowstart = now;
+}
+
+/*
+================
+Prof_WriteCapture
+
+Writes every zone finished since the capture started in the Chrome trace
+event format (chrome://tracing, Perfetto)
+================
+*/
+static void Prof_WriteCapture (double end)
+{
+	char			name[MAX_OSPATH];
+	FILE			*f;
+	profthread_t	*t;
+	profzone_t		*z;
+	unsigned		i;
+	int				n, count;
+	qboolean		first, lost;
+
+	sprintf (name, "%s/%s", com_gamedir, prof_capturefile);
+	f = fopen (name, "w");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't open %s.\n", name);
+		return;
+	}
+
+	fprintf (f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	first = true;
+	lost = false;
+	count = 0;
+	for (n=0 ; n<prof_numthreads ; n++)
+	{
+		t = &prof_threads[n];
+
+		fprintf (f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"%s\"}}",
+			first ? "" : ",\n", t->id, t->id ? va("thread %i", t->id) : "main");
+		first = false;
+
+		i = 0;
+		if (t->head > PROF_RINGSIZE)
+		{
+			i = t->head - PROF_RINGSIZE;
+			if (t->ring[i & (PROF_RINGSIZE-1)].start > prof_capturestart)
+				lost = true;
+		}
+
+		for ( ; i != t->head ; i++)
+		{
+			z = &t->ring[i & (PROF_RINGSIZE-1)];
+			if (z->start < prof_capturestart || z->end > end)
+				continue;
+
+			fprintf (f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%i,\"ts\":%.3f,\"dur\":%.3f}",
+				z->name, t->id, (z->start - prof_capturestart) * 1000000, (z->end - z->start) * 1000000);
+			count++;
+		}
+	}
+
+	fprintf (f, "\n]}\n");
+	fclose (f);
+
+	Con_Printf ("Wrote %i zones to %s\n", count, name);
+	if (lost)
+		Con_Printf ("WARNING: zone ring overflowed, capture fewer frames\n");
+}
+
+/*
+================
+Prof_FrameBoundary
+================
+*/
+void Prof_FrameBoundary (void)
+{
+	profthread_t	*t;
+	double			now;
+
+	if (!prof_initialized)
+		return;
+
+	now = Sys_PreciseTime ();
+	t = prof_thread;
+
+// a Host_Error can longjmp out of open zones
+	if (t)
+		t->depth = 0;
+
+	if (prof_active)
+	{
+		if (prof_overlay.value)
+			Prof_UpdateOverlay (now);
+
+		if (prof_capturing && !--prof_captureframes)
+		{
+			prof_capturing = false;
+			Prof_WriteCapture (now);
+		}
+	}
+
+	if (prof_captureframes && !prof_capturing)
+	{
+		prof_capturing = true;
+		prof_capturestart = now;
+	}
+
+	prof_active = prof_overlay.value || prof_capturing;
+
+	if (!prof_overlay.value)
+	{
+		prof_numwindow = prof_numdisplay = 0;
+		prof_windowframes = 0;
+		prof_windowstart = now;
+	}
+
+	if (t)
+		prof_framehead = t->head;
+}
+
+/*
+================
+Prof_Draw
+================
+*/
+void Prof_Draw (void)
+{
+	profline_t	*l;
+	char		st[80];
+	int			i, x, y;
+
+	if (!prof_overlay.value || !prof_displayframes)
+		return;
+
+	x = 8;
+	y = 32;
+	Draw_String (x, y, "zone                     ms/frame calls");
+	y += 8;
+
+	for (i=0, l=prof_display ; i<prof_numdisplay ; i++, l++)
+	{
+		sprintf (st, "%*s%-*.*s %8.3f %5i", l->depth, "", 24 - l->depth, 24 - l->depth, l->name,
+			l->time * 1000 / prof_displayframes, l->calls / prof_displayframes);
+		Draw_String (x, y, st);
+		y += 8;
+		if (y > vid.height - 16)
+			break;
+	}
+}
+
+/*
+================
+Prof_Capture_f
+
+prof_capture <frames> [file]
+================
+*/
+static void Prof_Capture_f (void)
+{
+	int		frames;
+
+	if (Cmd_Argc() < 2 || Cmd_Argc() > 3)
+	{
+		Con_Printf ("prof_capture <frames> [file] : writes a trace of the next frames\n");
+		return;
+	}
+
+	if (prof_captureframes)
+	{
+		Con_Printf ("A capture is already running.\n");
+		return;
+	}
+
+	frames = Q_atoi (Cmd_Argv(1));
+	if (frames < 1)
+	{
+		Con_Printf ("Need at least one frame.\n");
+		return;
+	}
+
+	if (Cmd_Argc() == 3)
+	{
+		if (strstr(Cmd_Argv(2), ".."))
+		{
+			Con_Printf ("Relative pathnames are not allowed.\n");
+			return;
+		}
+		Q_strncpy (prof_capturefile, Cmd_Argv(2), sizeof(prof_capturefile) - 1);
+		prof_capturefile[sizeof(prof_capturefile) - 1] = 0;
+	}
+	else
+		strcpy (prof_capturefile, "profile.json");
+
+	prof_captureframes = frames;
+	Con_Printf ("Capturing %i frames...\n", frames);
+}
+
+/*
+================
+Prof_Init
+================
+*/
+void Prof_Init (void)
+{
+	Cvar_RegisterVariable (&prof_overlay);
+	Cmd_AddCommand ("prof_capture", Prof_Capture_f);
+
+	prof_mutex = Sys_CreateMutex ();
+	Prof_GetThread ();		// the main thread is always thread 0
+
+	prof_initialized = true;
+}
+
+#endif // PROFILER
@@ -0,0 +1,48 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// prof.h -- scoped zone profiler
+
+// Zones are bracketed with PROF_BEGIN / PROF_END and must nest.  The name
+// has to be a string literal, only the pointer is kept.  Every return
+// inside a zone needs its own PROF_END.
+//
+// Without PROFILER defined in quakedef.h all of this compiles away.
+
+#ifdef PROFILER
+
+void Prof_Init (void);
+void Prof_Begin (const char *name);
+void Prof_End (void);
+void Prof_FrameBoundary (void);		// top of every host frame, main thread
+void Prof_Draw (void);				// on-screen zone breakdown
+
+#define PROF_BEGIN(name)	Prof_Begin (name)
+#define PROF_END()			Prof_End ()
+
+#else
+
+#define Prof_Init()
+#define Prof_FrameBoundary()
+#define Prof_Draw()
+
+#define PROF_BEGIN(name)
+#define PROF_END()
+
+#endif
@@ -69,6 +69,7 @@ void PR_ExecuteProgram (func_t fnum);
 void PR_LoadProgs (void);
 
 void PR_Profile_f (void);
+void PR_CheckProfile (void);
 
 edict_t *ED_Alloc (void);
 void ED_Free (edict_t *ed);
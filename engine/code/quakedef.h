@@ -33,6 +33,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 //define	PARANOID			// speed sapping error checking
 
+#define	PROFILER			// scoped zone profiler, see prof.h
+
 #ifdef QUAKE2
 #define	GAMENAME	"id1"		// directory to look in by default
 #else
@@ -280,6 +282,8 @@ typedef struct
 #include "view.h"
 #include "menu.h"
 #include "crc.h"
+#include "prof.h"
+#include "job.h"
 #include "cdaudio.h"
 
 #ifdef GLQUAKE
@@ -339,6 +343,8 @@ void Host_Frame (float time);
 void Host_Quit_f (void);
 void Host_ClientCommands (char *fmt, ...);
 void Host_ShutdownServer (qboolean crash);
+qboolean Host_OnServerThread (void);
+void Host_WaitServerFrame (void);
 
 extern qboolean		msg_suppress_1;		// suppresses resolution and cache size console output
 										//  an fullscreen DIB focus gain/loss
@@ -350,6 +356,43 @@ extern qboolean		isDedicated;
 
 extern int			minimum_memory;
 
+extern int			host_exitcode;
+extern qboolean		host_headless;
+
+//
+// frame stage timing, switched on by the timedemo benchmark
+//
+typedef enum
+{
+	fs_total,
+	fs_server,
+	fs_clientparse,
+	fs_rsetup,
+	fs_world,
+	fs_entities,
+	fs_particles,
+	fs_render,
+	fs_sound,
+	NUM_FRAMESTAGES
+} framestage_t;
+
+typedef struct
+{
+	double		begin[NUM_FRAMESTAGES];		// seconds from the frame start
+	double		time[NUM_FRAMESTAGES];
+	qboolean	pipelined;					// the server ran beside the drawing
+} frametimeline_t;
+
+extern qboolean		host_stagetiming;
+extern double		host_stagetime[NUM_FRAMESTAGES];	// seconds, this frame
+extern double		host_stagebegin[NUM_FRAMESTAGES];	// first start, from the frame start
+
+extern cvar_t		host_timeline;
+extern frametimeline_t	host_lasttimeline;		// the last finished frame
+
+double Host_StageStart (void);
+void Host_StageEnd (framestage_t stage, double start);
+
 //
 // chase
 //
@@ -315,6 +315,6 @@ void R_cshift_f (void);
 void R_EmitEdge (mvertex_t *pv0, mvertex_t *pv1);
 void R_ClipEdge (mvertex_t *pv0, mvertex_t *pv1, clipplane_t *clip);
 void R_SplitEntityOnNode2 (mnode_t *node);
-void R_MarkLights (dlight_t *light, int lnum, mnode_t *node);
+void R_MarkLights (mnode_t *node);
 
 #endif
\ No newline at end of file
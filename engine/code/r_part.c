@@ -21,22 +21,70 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 #include "r_local.h"
 
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define	PART_SSE
+#include <xmmintrin.h>
+#endif
+
 #define MAX_PARTICLES			2048	// default max # of particles at one
 										//  time
 #define ABSOLUTE_MIN_PARTICLES	512		// no fewer than this no matter what's
 										//  on the command line
 
+#define	PART_JOBSIZE			4096	// particles per job, a multiple of 4
+
 int		ramp1[8] = {0x6f, 0x6d, 0x6b, 0x69, 0x67, 0x65, 0x63, 0x61};
 int		ramp2[8] = {0x6f, 0x6e, 0x6d, 0x6c, 0x6b, 0x6a, 0x68, 0x66};
 int		ramp3[8] = {0x6d, 0x6b, 6, 5, 4, 3};
 
-particle_t	*active_particles, *free_particles;
-
-particle_t	*particles;
 int			r_numparticles;
 
 vec3_t			r_pright, r_pup, r_ppn;
 
+// Live particles are kept as a structure of arrays so the update can run
+// four at a time, dead ones are swapped out with the last.  The spawn
+// functions fill in particle_t records, which are moved into the arrays
+// at the start of the next draw.
+static float	*part_org[3], *part_vel[3];
+static float	*part_ramp, *part_die;
+static byte		*part_color, *part_type;
+static int		part_numactive;
+
+static particle_t	*part_new;
+static int			part_numnew;
+
+// what each type does this frame: vel[xy] *= xyscale,
+// vel[z] = vel[z]*zscale + gravity, ramp += rampspeed
+static float	part_xyscale[8], part_zscale[8], part_gravity[8], part_rampspeed[8];
+static int		*part_ramps[8] = {NULL, NULL, NULL, ramp3, ramp1, ramp2, NULL, NULL};
+static float	part_rampend[8] = {0, 0, 0, 6, 8, 8, 0, 0};
+
+static float	part_frametime;
+
+#ifdef GLQUAKE
+typedef struct
+{
+	float		xyz[3];
+	float		st[2];
+	unsigned	color;
+} partvert_t;
+
+static partvert_t	*part_verts;
+static GLuint		part_vbo;
+static vec3_t		part_up, part_right;
+#endif
+
+// r_partstress
+static int		part_stresscount;
+static int		part_statframes, part_statcount;
+static double	part_updatetime, part_buildtime, part_submittime;
+static int		part_statparticles;
+
+#ifdef PART_SSE
+static qboolean	part_sse;
+#endif
+
+void R_ParticleStress_f (void);
 
 /*
 ===============
@@ -45,7 +93,7 @@ R_InitParticles
 */
 void R_InitParticles (void)
 {
-	int		i;
+	int		i, n;
 
 	i = COM_CheckParm ("-particles");
 
@@ -60,8 +108,53 @@ void R_InitParticles (void)
 		r_numparticles = MAX_PARTICLES;
 	}
 
-	particles = (particle_t *)
-			Hunk_AllocName (r_numparticles * sizeof(particle_t), "particles");
+// hunk blocks are 16 byte aligned, keep every array that way
+	n = (r_numparticles + 3) & ~3;
+	for (i=0 ; i<3 ; i++)
+	{
+		part_org[i] = Hunk_AllocName (n * sizeof(float), "particles");
+		part_vel[i] = Hunk_AllocName (n * sizeof(float), "particles");
+	}
+	part_ramp = Hunk_AllocName (n * sizeof(float), "particles");
+	part_die = Hunk_AllocName (n * sizeof(float), "particles");
+	part_color = Hunk_AllocName (n, "particles");
+	part_type = Hunk_AllocName (n, "particles");
+	part_new = Hunk_AllocName (r_numparticles * sizeof(particle_t), "particles");
+
+#ifdef GLQUAKE
+	part_verts = Hunk_AllocName (r_numparticles * 3 * sizeof(partvert_t), "particles");
+	if (GLEW_VERSION_1_5)
+		glGenBuffers (1, &part_vbo);
+#endif
+
+#ifdef PART_SSE
+#ifdef _WIN32
+	part_sse = IsProcessorFeaturePresent (PF_XMMI_INSTRUCTIONS_AVAILABLE);
+#else
+	part_sse = true;
+#endif
+#endif
+
+	Cmd_AddCommand ("r_partstress", R_ParticleStress_f);
+}
+
+/*
+===============
+R_NewParticle
+
+A cleared particle to fill in, NULL when the pool is full
+===============
+*/
+static particle_t *R_NewParticle (void)
+{
+	particle_t	*p;
+
+	if (part_numactive + part_numnew >= r_numparticles)
+		return NULL;
+
+	p = &part_new[part_numnew++];
+	memset (p, 0, sizeof(*p));
+	return p;
 }
 
 #ifdef QUAKE2
@@ -80,12 +173,9 @@ void R_DarkFieldParticles (entity_t *ent)
 		for (j=-16 ; j<16 ; j+=8)
 			for (k=0 ; k<32 ; k+=8)
 			{
-				if (!free_particles)
+				p = R_NewParticle ();
+				if (!p)
 					return;
-				p = free_particles;
-				free_particles = p->next;
-				p->next = active_particles;
-				active_particles = p;
 		
 				p->die = cl.time + 0.2 + (rand()&7) * 0.02;
 				p->color = 150 + rand()%6;
@@ -157,12 +247,9 @@ avelocities[0][i] = (rand()&255) * 0.01;
 		forward[1] = cp*sy;
 		forward[2] = -sp;
 
-		if (!free_particles)
+		p = R_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->die = cl.time + 0.01;
 		p->color = 0x6f;
@@ -182,14 +269,8 @@ R_ClearParticles
 */
 void R_ClearParticles (void)
 {
-	int		i;
-	
-	free_particles = &particles[0];
-	active_particles = NULL;
-
-	for (i=0 ;i<r_numparticles ; i++)
-		particles[i].next = &particles[i+1];
-	particles[r_numparticles-1].next = NULL;
+	part_numactive = 0;
+	part_numnew = 0;
 }
 
 
@@ -220,15 +301,12 @@ void R_ReadPointFile_f (void)
 			break;
 		c++;
 		
-		if (!free_particles)
+		p = R_NewParticle ();
+		if (!p)
 		{
 			Con_Printf ("Not enough free particles\n");
 			break;
 		}
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		
 		p->die = 99999;
 		p->color = (-c)&15;
@@ -281,12 +359,9 @@ void R_ParticleExplosion (vec3_t org)
 	
 	for (i=0 ; i<1024 ; i++)
 	{
-		if (!free_particles)
+		p = R_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->die = cl.time + 5;
 		p->color = ramp1[0];
@@ -326,12 +401,9 @@ void R_ParticleExplosion2 (vec3_t org, int colorStart, int colorLength)
 
 	for (i=0; i<512; i++)
 	{
-		if (!free_particles)
+		p = R_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->die = cl.time + 0.3;
 		p->color = colorStart + (colorMod % colorLength);
@@ -359,12 +431,9 @@ void R_BlobExplosion (vec3_t org)
 	
 	for (i=0 ; i<1024 ; i++)
 	{
-		if (!free_particles)
+		p = R_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->die = cl.time + 1 + (rand()&8)*0.05;
 
@@ -404,12 +473,9 @@ void R_RunParticleEffect (vec3_t org, vec3_t dir, int color, int count)
 	
 	for (i=0 ; i<count ; i++)
 	{
-		if (!free_particles)
+		p = R_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		if (count == 1024)
 		{	// rocket explosion
@@ -467,12 +533,9 @@ void R_LavaSplash (vec3_t org)
 		for (j=-16 ; j<16 ; j++)
 			for (k=0 ; k<1 ; k++)
 			{
-				if (!free_particles)
+				p = R_NewParticle ();
+				if (!p)
 					return;
-				p = free_particles;
-				free_particles = p->next;
-				p->next = active_particles;
-				active_particles = p;
 		
 				p->die = cl.time + 2 + (rand()&31) * 0.02;
 				p->color = 224 + (rand()&7);
@@ -509,12 +572,9 @@ void R_TeleportSplash (vec3_t org)
 		for (j=-16 ; j<16 ; j+=4)
 			for (k=-24 ; k<32 ; k+=4)
 			{
-				if (!free_particles)
+				p = R_NewParticle ();
+				if (!p)
 					return;
-				p = free_particles;
-				free_particles = p->next;
-				p->next = active_particles;
-				active_particles = p;
 		
 				p->die = cl.time + 0.2 + (rand()&7) * 0.02;
 				p->color = 7 + (rand()&7);
@@ -557,12 +617,9 @@ void R_RocketTrail (vec3_t start, vec3_t end, int type)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		p = R_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		
 		VectorCopy (vec3_origin, p->vel);
 		p->die = cl.time + 2;
@@ -641,167 +698,440 @@ void R_RocketTrail (vec3_t start, vec3_t end, int type)
 
 /*
 ===============
-R_DrawParticles
+R_ParticleStress_f
+
+r_partstress [count] : keeps count particles alive for a hundred frames
+and reports what they cost
 ===============
 */
-extern	cvar_t	sv_gravity;
+void R_ParticleStress_f (void)
+{
+	int		count;
 
-void R_DrawParticles (void)
+	count = 100000;
+	if (Cmd_Argc() > 1)
+		count = Q_atoi (Cmd_Argv(1));
+
+	if (count > r_numparticles)
+	{
+		Con_Printf ("Only room for %i particles, start with -particles %i\n", r_numparticles, count);
+		count = r_numparticles;
+	}
+
+	part_stresscount = count;
+	part_statframes = 100;
+	part_statcount = 0;
+	part_updatetime = part_buildtime = part_submittime = 0;
+	part_statparticles = 0;
+}
+
+/*
+===============
+R_StressParticles
+
+Tops the particles up with explosions and rocket trails in front of the view
+===============
+*/
+static void R_StressParticles (void)
 {
-	particle_t		*p, *kill;
-	float			grav;
-	int				i;
-	float			time2, time3;
-	float			time1;
-	float			dvel;
-	float			frametime;
-	
-#ifdef GLQUAKE
-	vec3_t			up, right;
-	float			scale;
+	vec3_t	org, start, end;
+	int		i, last;
 
-	// jkrige - texture mode
-	//GL_Bind(particletexture);
-	if(gl_texturemode.value == 0.0f)
-		GL_Bind(particletexture_point);
-	else
-		GL_Bind(particletexture_linear);
-	// jkrige - texture mode
+	VectorMA (r_origin, 256, vpn, org);
 
-	glEnable (GL_BLEND);
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-	glBegin (GL_TRIANGLES);
+	for (i=0 ; part_numactive + part_numnew < part_stresscount ; i++)
+	{
+		last = part_numnew;
+		if (i & 1)
+		{
+			VectorMA (org, (rand()&127) - 64, vright, start);
+			VectorMA (start, 300, vup, end);
+			R_RocketTrail (start, end, 0);
+		}
+		else
+		{
+			VectorMA (org, (rand()&255) - 128, vright, start);
+			R_ParticleExplosion (start);
+		}
+		if (part_numnew == last)
+			break;		// full
+	}
+}
 
-	VectorScale (vup, 1.5, up);
-	VectorScale (vright, 1.5, right);
-#else
-	D_StartParticles ();
+/*
+===============
+R_AddNewParticles
 
-	VectorScale (vright, xscaleshrink, r_pright);
-	VectorScale (vup, yscaleshrink, r_pup);
-	VectorCopy (vpn, r_ppn);
-#endif
-	frametime = cl.time - cl.oldtime;
-	time3 = frametime * 15;
-	time2 = frametime * 10; // 15;
-	time1 = frametime * 5;
+Moves the particles spawned since the last frame into the arrays
+===============
+*/
+static void R_AddNewParticles (void)
+{
+	particle_t	*p;
+	int			i, n;
+
+	for (i=0, p=part_new ; i<part_numnew ; i++, p++)
+	{
+		n = part_numactive++;
+		part_org[0][n] = p->org[0];
+		part_org[1][n] = p->org[1];
+		part_org[2][n] = p->org[2];
+		part_vel[0][n] = p->vel[0];
+		part_vel[1][n] = p->vel[1];
+		part_vel[2][n] = p->vel[2];
+		part_ramp[n] = p->ramp;
+		part_die[n] = p->die;
+		part_color[n] = (int)p->color;
+		part_type[n] = p->type;
+	}
+	part_numnew = 0;
+}
+
+/*
+===============
+R_SetupParticleFrame
+===============
+*/
+extern	cvar_t	sv_gravity;
+
+static void R_SetupParticleFrame (float frametime)
+{
+	float	grav, dvel;
+	int		i;
+
+	part_frametime = frametime;
 	grav = frametime * sv_gravity.value * 0.05;
 	dvel = 4*frametime;
-	
-	for ( ;; ) 
+
+	for (i=0 ; i<8 ; i++)
+	{
+		part_xyscale[i] = 1;
+		part_zscale[i] = 1;
+		part_gravity[i] = -grav;
+		part_rampspeed[i] = 0;
+	}
+
+	part_gravity[pt_static] = 0;
+
+	part_gravity[pt_fire] = grav;
+	part_rampspeed[pt_fire] = frametime * 5;
+
+	part_xyscale[pt_explode] = part_zscale[pt_explode] = 1 + dvel;
+	part_rampspeed[pt_explode] = frametime * 10;
+
+	part_xyscale[pt_explode2] = part_zscale[pt_explode2] = 1 - frametime;
+	part_rampspeed[pt_explode2] = frametime * 15;
+
+	part_xyscale[pt_blob] = part_zscale[pt_blob] = 1 + dvel;
+
+	part_xyscale[pt_blob2] = 1 - dvel;
+
+#ifdef QUAKE2
+	part_gravity[pt_grav] = -grav * 20;
+#endif
+}
+
+/*
+===============
+R_UpdateParticles
+
+Moves a job's worth of particles, ramps their colors and marks the ones
+that burned out
+===============
+*/
+static void R_UpdateParticles (void *parm, int job)
+{
+	int		i, first, end, t;
+	float	frametime;
+
+	first = job * PART_JOBSIZE;
+	end = first + PART_JOBSIZE;
+	if (end > part_numactive)
+		end = part_numactive;
+	frametime = part_frametime;
+
+	i = first;
+
+#ifdef PART_SSE
+	if (part_sse)
 	{
-		kill = active_particles;
-		if (kill && kill->die < cl.time)
+		__m128	dt, xy, z, g, r, vx, vy, vz;
+
+		dt = _mm_set1_ps (frametime);
+		for ( ; i+4 <= end ; i += 4)
 		{
-			active_particles = kill->next;
-			kill->next = free_particles;
-			free_particles = kill;
-			continue;
+			xy = _mm_set_ps (part_xyscale[part_type[i+3]], part_xyscale[part_type[i+2]], part_xyscale[part_type[i+1]], part_xyscale[part_type[i]]);
+			z = _mm_set_ps (part_zscale[part_type[i+3]], part_zscale[part_type[i+2]], part_zscale[part_type[i+1]], part_zscale[part_type[i]]);
+			g = _mm_set_ps (part_gravity[part_type[i+3]], part_gravity[part_type[i+2]], part_gravity[part_type[i+1]], part_gravity[part_type[i]]);
+			r = _mm_set_ps (part_rampspeed[part_type[i+3]], part_rampspeed[part_type[i+2]], part_rampspeed[part_type[i+1]], part_rampspeed[part_type[i]]);
+
+			vx = _mm_load_ps (part_vel[0] + i);
+			vy = _mm_load_ps (part_vel[1] + i);
+			vz = _mm_load_ps (part_vel[2] + i);
+
+			_mm_store_ps (part_org[0] + i, _mm_add_ps (_mm_load_ps (part_org[0] + i), _mm_mul_ps (vx, dt)));
+			_mm_store_ps (part_org[1] + i, _mm_add_ps (_mm_load_ps (part_org[1] + i), _mm_mul_ps (vy, dt)));
+			_mm_store_ps (part_org[2] + i, _mm_add_ps (_mm_load_ps (part_org[2] + i), _mm_mul_ps (vz, dt)));
+
+			_mm_store_ps (part_vel[0] + i, _mm_mul_ps (vx, xy));
+			_mm_store_ps (part_vel[1] + i, _mm_mul_ps (vy, xy));
+			_mm_store_ps (part_vel[2] + i, _mm_add_ps (_mm_mul_ps (vz, z), g));
+
+			_mm_store_ps (part_ramp + i, _mm_add_ps (_mm_load_ps (part_ramp + i), r));
 		}
-		break;
 	}
+#endif
+
+	for ( ; i<end ; i++)
+	{
+		t = part_type[i];
+		part_org[0][i] += part_vel[0][i]*frametime;
+		part_org[1][i] += part_vel[1][i]*frametime;
+		part_org[2][i] += part_vel[2][i]*frametime;
+		part_vel[0][i] *= part_xyscale[t];
+		part_vel[1][i] *= part_xyscale[t];
+		part_vel[2][i] = part_vel[2][i]*part_zscale[t] + part_gravity[t];
+		part_ramp[i] += part_rampspeed[t];
+	}
+
+// color ramps are table lookups
+	for (i=first ; i<end ; i++)
+	{
+		t = part_type[i];
+		if (!part_ramps[t])
+			continue;
+		if (part_ramp[i] >= part_rampend[t])
+			part_die[i] = -1;
+		else
+			part_color[i] = part_ramps[t][(int)part_ramp[i]];
+	}
+}
+
+/*
+===============
+R_KillParticles
+
+Swaps the dead particles out with the last live ones
+===============
+*/
+static void R_KillParticles (void)
+{
+	float	time;
+	int		i, last;
 
-	for (p=active_particles ; p ; p=p->next)
+	time = cl.time;
+	for (i=0 ; i<part_numactive ; )
 	{
-		for ( ;; )
+		if (part_die[i] >= time)
 		{
-			kill = p->next;
-			if (kill && kill->die < cl.time)
-			{
-				p->next = kill->next;
-				kill->next = free_particles;
-				free_particles = kill;
-				continue;
-			}
-			break;
+			i++;
+			continue;
 		}
 
+		last = --part_numactive;
+		part_org[0][i] = part_org[0][last];
+		part_org[1][i] = part_org[1][last];
+		part_org[2][i] = part_org[2][last];
+		part_vel[0][i] = part_vel[0][last];
+		part_vel[1][i] = part_vel[1][last];
+		part_vel[2][i] = part_vel[2][last];
+		part_ramp[i] = part_ramp[last];
+		part_die[i] = part_die[last];
+		part_color[i] = part_color[last];
+		part_type[i] = part_type[last];
+	}
+}
+
 #ifdef GLQUAKE
+/*
+===============
+R_BuildParticleVerts
+
+One triangle per particle for a job's worth of particles
+===============
+*/
+static void R_BuildParticleVerts (void *parm, int job)
+{
+	partvert_t	*v;
+	int			i, end;
+	float		scale, x, y, z;
+	unsigned	color;
+
+	i = job * PART_JOBSIZE;
+	end = i + PART_JOBSIZE;
+	if (end > part_numactive)
+		end = part_numactive;
+
+	for (v=(partvert_t *)parm + i*3 ; i<end ; i++, v+=3)
+	{
+		x = part_org[0][i];
+		y = part_org[1][i];
+		z = part_org[2][i];
+
 		// hack a scale up to keep particles from disapearing
-		scale = (p->org[0] - r_origin[0])*vpn[0] + (p->org[1] - r_origin[1])*vpn[1]
-			+ (p->org[2] - r_origin[2])*vpn[2];
+		scale = (x - r_origin[0])*vpn[0] + (y - r_origin[1])*vpn[1] + (z - r_origin[2])*vpn[2];
 		if (scale < 20)
 			scale = 1;
 		else
 			scale = 1 + scale * 0.004;
-		glColor3ubv ((byte *)&d_8to24table[(int)p->color]);
-		glTexCoord2f (0,0);
-		glVertex3fv (p->org);
-		glTexCoord2f (1,0);
-		glVertex3f (p->org[0] + up[0]*scale, p->org[1] + up[1]*scale, p->org[2] + up[2]*scale);
-		glTexCoord2f (0,1);
-		glVertex3f (p->org[0] + right[0]*scale, p->org[1] + right[1]*scale, p->org[2] + right[2]*scale);
+
+		color = d_8to24table[part_color[i]] | LittleLong (0xff000000);
+
+		v[0].xyz[0] = x;
+		v[0].xyz[1] = y;
+		v[0].xyz[2] = z;
+		v[0].st[0] = 0;
+		v[0].st[1] = 0;
+		v[0].color = color;
+
+		v[1].xyz[0] = x + part_up[0]*scale;
+		v[1].xyz[1] = y + part_up[1]*scale;
+		v[1].xyz[2] = z + part_up[2]*scale;
+		v[1].st[0] = 1;
+		v[1].st[1] = 0;
+		v[1].color = color;
+
+		v[2].xyz[0] = x + part_right[0]*scale;
+		v[2].xyz[1] = y + part_right[1]*scale;
+		v[2].xyz[2] = z + part_right[2]*scale;
+		v[2].st[0] = 0;
+		v[2].st[1] = 1;
+		v[2].color = color;
+	}
+}
+#endif
+
+/*
+===============
+R_DrawParticles
+===============
+*/
+void R_DrawParticles (void)
+{
+	int			jobs;
+	double		start, updated, built, submitted;
+#ifdef GLQUAKE
+	partvert_t	*base;
 #else
-		D_DrawParticle (p);
+	particle_t	p;
+	int			i;
 #endif
-		p->org[0] += p->vel[0]*frametime;
-		p->org[1] += p->vel[1]*frametime;
-		p->org[2] += p->vel[2]*frametime;
-		
-		switch (p->type)
-		{
-		case pt_static:
-			break;
-		case pt_fire:
-			p->ramp += time1;
-			if (p->ramp >= 6)
-				p->die = -1;
-			else
-				p->color = ramp3[(int)p->ramp];
-			p->vel[2] += grav;
-			break;
 
-		case pt_explode:
-			p->ramp += time2;
-			if (p->ramp >=8)
-				p->die = -1;
-			else
-				p->color = ramp1[(int)p->ramp];
-			for (i=0 ; i<3 ; i++)
-				p->vel[i] += p->vel[i]*dvel;
-			p->vel[2] -= grav;
-			break;
+	start = Sys_PreciseTime ();
 
-		case pt_explode2:
-			p->ramp += time3;
-			if (p->ramp >=8)
-				p->die = -1;
-			else
-				p->color = ramp2[(int)p->ramp];
-			for (i=0 ; i<3 ; i++)
-				p->vel[i] -= p->vel[i]*frametime;
-			p->vel[2] -= grav;
-			break;
+	if (part_stresscount)
+		R_StressParticles ();
 
-		case pt_blob:
-			for (i=0 ; i<3 ; i++)
-				p->vel[i] += p->vel[i]*dvel;
-			p->vel[2] -= grav;
-			break;
+	PROF_BEGIN("particle update");
+	R_KillParticles ();		// ones that ran out of time since the last frame
+	R_AddNewParticles ();
+	R_SetupParticleFrame (cl.time - cl.oldtime);
+	jobs = (part_numactive + PART_JOBSIZE - 1) / PART_JOBSIZE;
+	PROF_END();
+	updated = Sys_PreciseTime ();
 
-		case pt_blob2:
-			for (i=0 ; i<2 ; i++)
-				p->vel[i] -= p->vel[i]*dvel;
-			p->vel[2] -= grav;
-			break;
+#ifdef GLQUAKE
+	VectorScale (vup, 1.5, part_up);
+	VectorScale (vright, 1.5, part_right);
 
-		case pt_grav:
-#ifdef QUAKE2
-			p->vel[2] -= grav * 20;
-			break;
-#endif
-		case pt_slowgrav:
-			p->vel[2] -= grav;
-			break;
+	PROF_BEGIN("particle build");
+	Job_Run (R_BuildParticleVerts, part_verts, jobs);
+	PROF_END();
+	built = Sys_PreciseTime ();
+
+	if (part_numactive)
+	{
+		PROF_BEGIN("particle submit");
+
+		// jkrige - texture mode
+		//GL_Bind(particletexture);
+		if(gl_texturemode.value == 0.0f)
+			GL_Bind(particletexture_point);
+		else
+			GL_Bind(particletexture_linear);
+		// jkrige - texture mode
+
+		GL_Enable (GL_BLEND);
+		GL_TexEnvMode (GL_MODULATE);
+
+	// one streaming buffer, orphaned and refilled every frame
+		base = part_verts;
+		if (part_vbo)
+		{
+			GL_BindBuffer (GL_ARRAY_BUFFER, part_vbo);
+			glBufferData (GL_ARRAY_BUFFER, part_numactive * 3 * sizeof(partvert_t), part_verts, GL_STREAM_DRAW);
+			base = NULL;
 		}
-	}
 
-#ifdef GLQUAKE
-	glEnd ();
-	glDisable (GL_BLEND);
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+		glEnableClientState (GL_VERTEX_ARRAY);
+		glEnableClientState (GL_TEXTURE_COORD_ARRAY);
+		glEnableClientState (GL_COLOR_ARRAY);
+		glVertexPointer (3, GL_FLOAT, sizeof(partvert_t), base->xyz);
+		glTexCoordPointer (2, GL_FLOAT, sizeof(partvert_t), base->st);
+		glColorPointer (4, GL_UNSIGNED_BYTE, sizeof(partvert_t), &base->color);
+
+		glDrawArrays (GL_TRIANGLES, 0, part_numactive * 3);
+
+		glDisableClientState (GL_VERTEX_ARRAY);
+		glDisableClientState (GL_TEXTURE_COORD_ARRAY);
+		glDisableClientState (GL_COLOR_ARRAY);
+		if (part_vbo)
+			GL_BindBuffer (GL_ARRAY_BUFFER, 0);
+
+		glColor3f (1, 1, 1);
+		GL_Disable (GL_BLEND);
+		GL_TexEnvMode (GL_REPLACE);
+
+		PROF_END();
+	}
 #else
+	built = updated;
+
+	D_StartParticles ();
+
+	VectorScale (vright, xscaleshrink, r_pright);
+	VectorScale (vup, yscaleshrink, r_pup);
+	VectorCopy (vpn, r_ppn);
+
+	for (i=0 ; i<part_numactive ; i++)
+	{
+		p.org[0] = part_org[0][i];
+		p.org[1] = part_org[1][i];
+		p.org[2] = part_org[2][i];
+		p.color = part_color[i];
+		D_DrawParticle (&p);
+	}
+
 	D_EndParticles ();
 #endif
-}
 
+	submitted = Sys_PreciseTime ();
+
+// move everything for the next frame, the ones that burn out are
+// taken away before that frame draws
+	PROF_BEGIN("particle update");
+	Job_Run (R_UpdateParticles, NULL, jobs);
+	PROF_END();
+
+	if (part_statframes)
+	{
+		double	now;
+
+		now = Sys_PreciseTime ();
+		part_updatetime += (updated - start) + (now - submitted);
+		part_buildtime += built - updated;
+		part_submittime += submitted - built;
+		part_statparticles += part_numactive;
+		part_statcount++;
+
+		if (!--part_statframes)
+		{
+			Con_Printf ("%i particles: update %.3f ms, build %.3f ms, submit %.3f ms per frame\n",
+				part_statparticles / part_statcount,
+				part_updatetime * 1000 / part_statcount,
+				part_buildtime * 1000 / part_statcount,
+				part_submittime * 1000 / part_statcount);
+			part_stresscount = 0;
+		}
+	}
+}
@@ -61,6 +61,18 @@ typedef struct entity_s
 											
 	int						dlightframe;	// dynamic lighting
 	int						dlightbits;
+
+// alias pose interpolation, kept by R_SetupAliasFrame
+	struct model_s			*lerpmodel;		// model the poses belong to
+	int						lerppose1;		// pose blending from
+	int						lerppose2;		// pose blending to
+	double					lerpstart;		// cl.time lerppose2 was set
+	float					lerpinterval;	// seconds to blend over
+
+// occlusion queries, see gl_occlusion.c
+	int						occlframe;		// r_framecount of the last query
+	int						occlquery;
+	qboolean				occluded;		// hidden by the world this frame
 	
 // FIXME: could turn these into a union
 	int						trivial_accept;
@@ -131,6 +143,7 @@ void R_RemoveEfrags (entity_t *ent);
 void R_NewMap (void);
 
 
+void R_ClearParticles (void);
 void R_ParseParticleEffect (void);
 void R_RunParticleEffect (vec3_t org, vec3_t dir, int color, int count);
 void R_RocketTrail (vec3_t start, vec3_t end, int type);
@@ -32,6 +32,9 @@ void S_Update_();
 void S_StopAllSounds(qboolean clear);
 void S_StopAllSoundsC(void);
 
+static void S_StartMixer (void);
+static void S_StopMixer (void);
+
 // =======================================================================
 // Internal sound data & structures
 // =======================================================================
@@ -80,6 +83,7 @@ cvar_t ambient_level = {"ambient_level", "0.3"};
 cvar_t ambient_fade = {"ambient_fade", "100"};
 cvar_t snd_noextraupdate = {"snd_noextraupdate", "0"};
 cvar_t snd_show = {"snd_show", "0"};
+cvar_t snd_voices = {"snd_voices", "32", true};
 cvar_t _snd_mixahead = {"_snd_mixahead", "0.1", true};
 
 
@@ -96,6 +100,262 @@ cvar_t _snd_mixahead = {"_snd_mixahead", "0.1", true};
 
 qboolean fakedma = false;
 int fakedma_updates = 15;
+static double	fakedma_start;
+
+// mixer statistics
+static int		snd_underruns;
+static int		snd_minfill = -1;	// least buffered sample pairs since the last soundinfo
+static int		snd_audible;		// voices heard in the last update
+static int		snd_mixedvoices;	// voices mixed in the last update
+static int		snd_culled;			// audible voices left virtual since the last soundinfo
+
+
+/*
+===============================================================================
+
+MIXER THREAD
+
+Unless -nosndthread is given, mixing runs on its own thread and the
+channels belong to it.  The main thread only queues commands: a single
+producer / single consumer ring where each side writes one index.  The
+indices are volatile, which with the x86 store order keeps a command's
+contents visible before its slot is published.
+
+Sound data lives in the cache, so the mixer holds the cache lock while it
+paints and the main thread does all the loading.  A sound thrown out of
+the cache while playing goes quiet instead of being reloaded; statics and
+ambients are touched every frame so they stay resident.
+===============================================================================
+*/
+
+typedef enum
+{
+	sc_start,
+	sc_stop,
+	sc_static,
+	sc_stopall,
+	sc_stopdynamic,
+	sc_clearbuffer,
+	sc_listener
+} sndcmdtype_t;
+
+typedef struct
+{
+	sndcmdtype_t	type;
+	int				entnum, entchannel;
+	sfx_t			*sfx;
+	vec3_t			origin;
+	float			vol, attenuation;
+
+// sc_listener
+	vec3_t			forward, right, up;
+	qboolean		ambients;				// false leaves the ambient channels alone
+	float			ambient[NUM_AMBIENTS];	// target levels, -1 = silent
+	float			frametime;
+} sndcmd_t;
+
+#define	SND_QUEUESIZE	1024			// power of two
+
+static sndcmd_t			snd_queue[SND_QUEUESIZE];
+static volatile int		snd_queuehead;	// written by the main thread
+static volatile int		snd_queuetail;	// written by the mixer
+
+static qboolean			snd_threaded;
+static sys_thread_t		snd_thread;
+static sys_event_t		snd_wake;
+static volatile qboolean	snd_quit;
+
+static volatile qboolean	snd_devicelost;
+static char				*snd_lostreason;
+
+#define	MAX_STATICSFX	(MAX_CHANNELS - MAX_DYNAMIC_CHANNELS - NUM_AMBIENTS)
+static sfx_t			*snd_staticsfx[MAX_STATICSFX];	// main thread copy, to keep cached
+static int				snd_numstaticsfx;
+
+static void S_DoStartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float fvol, float attenuation);
+static void S_DoStopSound (int entnum, int entchannel);
+static void S_DoStaticSound (sfx_t *sfx, vec3_t origin, float vol, float attenuation);
+static void S_DoStopAllSounds (qboolean clear);
+static void S_DoStopDynamicSounds (void);
+static void S_DoClearBuffer (void);
+static void S_SpatializeChannels (void);
+static void S_ScheduleVoices (void);
+static void S_UpdateAmbientSounds (float *levels, float frametime);
+
+/*
+================
+S_QueueCommand
+
+Returns the next free slot; it isn't seen by the mixer until S_SubmitCommand
+================
+*/
+static sndcmd_t *S_QueueCommand (sndcmdtype_t type)
+{
+	sndcmd_t	*cmd;
+
+// a full queue only happens if the mixer is stalled, wait for it
+	while (((snd_queuehead + 1) & (SND_QUEUESIZE-1)) == snd_queuetail)
+	{
+		Sys_SignalEvent (snd_wake);
+		Sys_Sleep ();
+	}
+
+	cmd = &snd_queue[snd_queuehead];
+	cmd->type = type;
+	return cmd;
+}
+
+static void S_SubmitCommand (void)
+{
+	snd_queuehead = (snd_queuehead + 1) & (SND_QUEUESIZE-1);
+}
+
+/*
+================
+S_RunCommands
+
+Mixer side of the queue
+================
+*/
+static void S_RunCommands (void)
+{
+	sndcmd_t	*cmd;
+
+	while (snd_queuetail != snd_queuehead)
+	{
+		cmd = &snd_queue[snd_queuetail];
+
+		switch (cmd->type)
+		{
+		case sc_start:
+			S_DoStartSound (cmd->entnum, cmd->entchannel, cmd->sfx, cmd->origin, cmd->vol, cmd->attenuation);
+			break;
+		case sc_stop:
+			S_DoStopSound (cmd->entnum, cmd->entchannel);
+			break;
+		case sc_static:
+			S_DoStaticSound (cmd->sfx, cmd->origin, cmd->vol, cmd->attenuation);
+			break;
+		case sc_stopall:
+			S_DoStopAllSounds (cmd->entnum);
+			break;
+		case sc_stopdynamic:
+			S_DoStopDynamicSounds ();
+			break;
+		case sc_clearbuffer:
+			S_DoClearBuffer ();
+			break;
+		case sc_listener:
+			VectorCopy (cmd->origin, listener_origin);
+			VectorCopy (cmd->forward, listener_forward);
+			VectorCopy (cmd->right, listener_right);
+			VectorCopy (cmd->up, listener_up);
+			S_UpdateAmbientSounds (cmd->ambients ? cmd->ambient : NULL, cmd->frametime);
+			S_SpatializeChannels ();
+			break;
+		}
+
+		snd_queuetail = (snd_queuetail + 1) & (SND_QUEUESIZE-1);
+	}
+}
+
+/*
+================
+S_MixerThread
+================
+*/
+static void S_MixerThread (void *parm)
+{
+	while (!snd_quit)
+	{
+		S_RunCommands ();
+		if (!snd_devicelost)
+			S_Update_ ();
+
+	// a few wakeups per mixahead keeps the fill level steady
+		Sys_WaitEvent (snd_wake, 5);
+	}
+}
+
+/*
+================
+S_StartMixer
+================
+*/
+static void S_StartMixer (void)
+{
+	if (snd_threaded || !sound_started || COM_CheckParm ("-nosndthread"))
+		return;
+
+	if (!snd_wake)
+		snd_wake = Sys_CreateEvent ();
+
+	snd_quit = false;
+	snd_queuehead = snd_queuetail = 0;
+	snd_threaded = true;		// before the thread can look at it
+	snd_thread = Sys_CreateThread (S_MixerThread, NULL);
+	if (!snd_thread)
+		snd_threaded = false;	// mix from the main loop as before
+}
+
+/*
+================
+S_StopMixer
+
+Waits for the mixer to drain the queue and exit
+================
+*/
+static void S_StopMixer (void)
+{
+	if (!snd_threaded)
+		return;
+
+	snd_quit = true;
+	Sys_SignalEvent (snd_wake);
+	Sys_WaitThread (snd_thread);
+	snd_thread = NULL;
+	snd_threaded = false;
+
+	S_RunCommands ();
+}
+
+/*
+================
+S_DeviceLost
+
+The output buffer couldn't be locked; restart the device.  On the mixer
+thread this is left to the main thread.
+================
+*/
+void S_DeviceLost (char *reason)
+{
+	if (snd_threaded)
+	{
+		snd_lostreason = reason;
+		snd_devicelost = true;
+		return;
+	}
+
+	Con_Printf ("%s", reason);
+	S_Shutdown ();
+	S_Startup ();
+}
+
+/*
+================
+S_MixerSound
+
+The mixer can't load from disk on its own thread; the main thread loads
+every sound before handing it over
+================
+*/
+sfxcache_t *S_MixerSound (sfx_t *sfx)
+{
+	if (snd_threaded)
+		return Cache_Check (&sfx->cache);
+
+	return S_LoadSound (sfx);
+}
 
 
 void S_AmbientOff (void)
@@ -126,6 +386,14 @@ void S_SoundInfo_f(void)
     Con_Printf("%5d speed\n", shm->speed);
     Con_Printf("0x%x dma buffer\n", shm->buffer);
 	Con_Printf("%5d total_channels\n", total_channels);
+	Con_Printf("%5d voices mixed of %d audible\n", snd_mixedvoices, snd_audible);
+	Con_Printf("%5d voice updates culled\n", snd_culled);
+	snd_culled = 0;
+	Con_Printf("mixer %s\n", snd_threaded ? "thread" : "main loop");
+	Con_Printf("%5d underruns\n", snd_underruns);
+	if (snd_minfill >= 0)
+		Con_Printf("%5.1f ms least buffered\n", snd_minfill * 1000.0 / shm->speed);
+	snd_minfill = -1;
 }
 
 
@@ -157,6 +425,8 @@ void S_Startup (void)
 	}
 
 	sound_started = 1;
+
+	S_StartStreams ();
 }
 
 
@@ -167,11 +437,12 @@ S_Init
 */
 void S_Init (void)
 {
+	int		oldbudget;
 
 	//Con_Printf("\nSound Initialization\n");
 	Con_Printf("\n------- Sound Initialization -------\n");
 
-	if (COM_CheckParm("-nosound"))
+	if (COM_CheckParm("-nosound") || host_headless)
 		return;
 
 	if (COM_CheckParm("-simsound"))
@@ -182,11 +453,13 @@ void S_Init (void)
 	Cmd_AddCommand("stopsound", S_StopAllSoundsC);
 	Cmd_AddCommand("soundlist", S_SoundList);
 	Cmd_AddCommand("soundinfo", S_SoundInfo_f);
+	Cmd_AddCommand("snd_mixbench", SND_MixBench_f);
 
 	Cvar_RegisterVariable(&nosound);
 	Cvar_RegisterVariable(&volume);
 	Cvar_RegisterVariable(&precache);
 	Cvar_RegisterVariable(&loadas8bit);
+	Cvar_RegisterVariable(&snd_mixsimd);
 	Cvar_RegisterVariable(&bgmvolume);
 	Cvar_RegisterVariable(&bgmtype); // jkrige - fmod sound system
 	Cvar_RegisterVariable(&bgmbuffer);
@@ -194,6 +467,8 @@ void S_Init (void)
 	Cvar_RegisterVariable(&ambient_fade);
 	Cvar_RegisterVariable(&snd_noextraupdate);
 	Cvar_RegisterVariable(&snd_show);
+	Cvar_RegisterVariable(&snd_voices);
+	Cvar_RegisterVariable(&snd_streamsize);
 	Cvar_RegisterVariable(&_snd_mixahead);
 
 	if (host_parms.memsize < 0x800000)
@@ -210,6 +485,7 @@ void S_Init (void)
 
 	SND_InitScaletable ();
 
+	oldbudget = Hunk_SetBudget (hb_sound);
 	known_sfx = Hunk_AllocName (MAX_SFX*sizeof(sfx_t), "sfx_t");
 	num_sfx = 0;
 
@@ -217,6 +493,8 @@ void S_Init (void)
 
 	if (fakedma)
 	{
+	// a null device, played back at real time speed
+		fakedma_start = Sys_PreciseTime ();
 		shm = (void *) Hunk_AllocName(sizeof(*shm), "shm");
 		shm->splitbuffer = 0;
 		shm->samplebits = 16;
@@ -229,6 +507,7 @@ void S_Init (void)
 		shm->submission_chunk = 1;
 		shm->buffer = Hunk_AllocName(1<<16, "shmbuf");
 	}
+	Hunk_SetBudget (oldbudget);
 
 	Con_Printf ("Sound sampling rate: %i\n", shm->speed);
 
@@ -241,6 +520,8 @@ void S_Init (void)
 	ambient_sfx[AMBIENT_SKY] = S_PrecacheSound ("ambience/wind2.wav");
 
 	S_StopAllSounds (true);
+
+	S_StartMixer ();
 }
 
 
@@ -254,6 +535,9 @@ void S_Shutdown(void)
 	if (!sound_started)
 		return;
 
+	S_StopMixer ();
+	S_StopStreams ();
+
 	if (shm)
 		shm->gamealive = 0;
 
@@ -349,37 +633,63 @@ sfx_t *S_PrecacheSound (char *name)
 
 //=============================================================================
 
+/*
+=================
+SND_VoiceScore
+
+How much a voice is worth keeping: its loudest side, weighted by priority
+=================
+*/
+static int SND_VoiceScore (channel_t *ch)
+{
+	int		vol;
+
+	vol = ch->leftvol > ch->rightvol ? ch->leftvol : ch->rightvol;
+	return vol << ch->priority;
+}
+
 /*
 =================
 SND_PickChannel
+
+A free voice is used when there is one, otherwise the lowest scored voice
+is replaced, the one nearest its end on a tie
 =================
 */
 channel_t *SND_PickChannel(int entnum, int entchannel)
 {
     int ch_idx;
     int first_to_die;
-    int life_left;
+    int score, best;
+	channel_t	*ch;
 
 // Check for replacement sound, or find the best one to replace
     first_to_die = -1;
-    life_left = 0x7fffffff;
-    for (ch_idx=NUM_AMBIENTS ; ch_idx < NUM_AMBIENTS + MAX_DYNAMIC_CHANNELS ; ch_idx++)
+    best = 0x7fffffff;
+	ch = channels + NUM_AMBIENTS;
+    for (ch_idx=NUM_AMBIENTS ; ch_idx < NUM_AMBIENTS + MAX_DYNAMIC_CHANNELS ; ch_idx++, ch++)
     {
 		if (entchannel != 0		// channel 0 never overrides
-		&& channels[ch_idx].entnum == entnum
-		&& (channels[ch_idx].entchannel == entchannel || entchannel == -1) )
+		&& ch->entnum == entnum
+		&& (ch->entchannel == entchannel || entchannel == -1) )
 		{	// allways override sound from same entity
 			first_to_die = ch_idx;
 			break;
 		}
 
+		if (!ch->sfx)
+			score = -1;
+		else
+		{
 		// don't let monster sounds override player sounds
-		if (channels[ch_idx].entnum == cl.viewentity && entnum != cl.viewentity && channels[ch_idx].sfx)
-			continue;
+			if (ch->entnum == cl.viewentity && entnum != cl.viewentity)
+				continue;
+			score = SND_VoiceScore (ch);
+		}
 
-		if (channels[ch_idx].end - paintedtime < life_left)
+		if (score < best || (score == best && ch->end < channels[first_to_die].end))
 		{
-			life_left = channels[ch_idx].end - paintedtime;
+			best = score;
 			first_to_die = ch_idx;
 		}
    }
@@ -418,6 +728,14 @@ void SND_Spatialize(channel_t *ch)
 
 	snd = ch->sfx;
 	VectorSubtract(ch->origin, listener_origin, source_vec);
+
+// past the clip distance a voice is silent, don't bother normalizing
+	if (DotProduct(source_vec, source_vec) * ch->dist_mult * ch->dist_mult >= 1.0)
+	{
+		ch->leftvol = 0;
+		ch->rightvol = 0;
+		return;
+	}
 	
 	dist = VectorNormalize(source_vec) * ch->dist_mult;
 	
@@ -453,11 +771,7 @@ void SND_Spatialize(channel_t *ch)
 
 void S_StartSound(int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float fvol, float attenuation)
 {
-	channel_t *target_chan, *check;
-	sfxcache_t	*sc;
-	int		vol;
-	int		ch_idx;
-	int		skip;
+	sndcmd_t	*cmd;
 
 	if (!sound_started)
 		return;
@@ -468,6 +782,33 @@ void S_StartSound(int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float f
 	if (nosound.value)
 		return;
 
+	if (!snd_threaded)
+	{
+		S_DoStartSound (entnum, entchannel, sfx, origin, fvol, attenuation);
+		return;
+	}
+
+	if (!S_LoadSound (sfx))
+		return;		// couldn't load the sound's data
+
+	cmd = S_QueueCommand (sc_start);
+	cmd->entnum = entnum;
+	cmd->entchannel = entchannel;
+	cmd->sfx = sfx;
+	VectorCopy (origin, cmd->origin);
+	cmd->vol = fvol;
+	cmd->attenuation = attenuation;
+	S_SubmitCommand ();
+}
+
+static void S_DoStartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float fvol, float attenuation)
+{
+	channel_t *target_chan, *check;
+	sfxcache_t	*sc;
+	int		vol;
+	int		ch_idx;
+	int		skip;
+
 	vol = fvol*255;
 
 // pick a channel to play on
@@ -482,22 +823,33 @@ void S_StartSound(int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float f
 	target_chan->master_vol = vol;
 	target_chan->entnum = entnum;
 	target_chan->entchannel = entchannel;
+	target_chan->priority = entnum == cl.viewentity ? VOICE_VIEW : VOICE_ENTITY;
+	target_chan->mixed = true;		// heard at once, ranked on the next update
 	SND_Spatialize(target_chan);
 
-	if (!target_chan->leftvol && !target_chan->rightvol)
-		return;		// not audible at all
-
-// new channel
-	sc = S_LoadSound (sfx);
+// a sound out of earshot still gets a voice, so it is at the right place
+// if the listener walks up to it
+	sc = S_MixerSound (sfx);
 	if (!sc)
 	{
 		target_chan->sfx = NULL;
 		return;		// couldn't load the sound's data
 	}
 
+// a streamed sound plays once at a time, starting it again restarts it
+	if (sfx->stream)
+	{
+		check = &channels[NUM_AMBIENTS];
+		for (ch_idx=NUM_AMBIENTS ; ch_idx < NUM_AMBIENTS + MAX_DYNAMIC_CHANNELS ; ch_idx++, check++)
+			if (check->sfx == sfx)
+				check->sfx = NULL;
+	}
+
 	target_chan->sfx = sfx;
 	target_chan->pos = 0.0;
     target_chan->end = paintedtime + sc->length;	
+	target_chan->looping = sc->loopstart;
+	target_chan->length = sc->length;
 
 // if an identical sound has also been started this frame, offset the pos
 // a bit to keep it from just making the first one louder
@@ -520,6 +872,22 @@ void S_StartSound(int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float f
 }
 
 void S_StopSound(int entnum, int entchannel)
+{
+	sndcmd_t	*cmd;
+
+	if (snd_threaded)
+	{
+		cmd = S_QueueCommand (sc_stop);
+		cmd->entnum = entnum;
+		cmd->entchannel = entchannel;
+		S_SubmitCommand ();
+		return;
+	}
+
+	S_DoStopSound (entnum, entchannel);
+}
+
+static void S_DoStopSound (int entnum, int entchannel)
 {
 	int i;
 
@@ -537,11 +905,28 @@ void S_StopSound(int entnum, int entchannel)
 
 void S_StopAllSounds(qboolean clear)
 {
-	int		i;
+	sndcmd_t	*cmd;
 
 	if (!sound_started)
 		return;
 
+	snd_numstaticsfx = 0;
+
+	if (snd_threaded)
+	{
+		cmd = S_QueueCommand (sc_stopall);
+		cmd->entnum = clear;
+		S_SubmitCommand ();
+		return;
+	}
+
+	S_DoStopAllSounds (clear);
+}
+
+static void S_DoStopAllSounds (qboolean clear)
+{
+	int		i;
+
 	total_channels = MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS;	// no statics
 
 	for (i=0 ; i<MAX_CHANNELS ; i++)
@@ -551,7 +936,32 @@ void S_StopAllSounds(qboolean clear)
 	Q_memset(channels, 0, MAX_CHANNELS * sizeof(channel_t));
 
 	if (clear)
-		S_ClearBuffer ();
+		S_DoClearBuffer ();
+}
+
+/*
+==================
+S_StopDynamicSounds
+==================
+*/
+void S_StopDynamicSounds (void)
+{
+	if (!sound_started)
+		return;
+
+	if (snd_threaded)
+	{
+		S_QueueCommand (sc_stopdynamic);
+		S_SubmitCommand ();
+		return;
+	}
+
+	S_DoStopDynamicSounds ();
+}
+
+static void S_DoStopDynamicSounds (void)
+{
+	Q_memset(&channels[NUM_AMBIENTS], 0, MAX_DYNAMIC_CHANNELS * sizeof(channel_t));
 }
 
 void S_StopAllSoundsC (void)
@@ -560,6 +970,18 @@ void S_StopAllSoundsC (void)
 }
 
 void S_ClearBuffer (void)
+{
+	if (snd_threaded)
+	{
+		S_QueueCommand (sc_clearbuffer);
+		S_SubmitCommand ();
+		return;
+	}
+
+	S_DoClearBuffer ();
+}
+
+static void S_DoClearBuffer (void)
 {
 	int		clear;
 		
@@ -589,15 +1011,13 @@ void S_ClearBuffer (void)
 		{
 			if (hresult != DSERR_BUFFERLOST)
 			{
-				Con_Printf ("S_ClearBuffer: DS::Lock Sound Buffer Failed\n");
-				S_Shutdown ();
+				S_DeviceLost ("S_ClearBuffer: DS::Lock Sound Buffer Failed\n");
 				return;
 			}
 
 			if (++reps > 10000)
 			{
-				Con_Printf ("S_ClearBuffer: DS: couldn't restore buffer\n");
-				S_Shutdown ();
+				S_DeviceLost ("S_ClearBuffer: DS: couldn't restore buffer\n");
 				return;
 			}
 		}
@@ -622,28 +1042,68 @@ S_StaticSound
 */
 void S_StaticSound (sfx_t *sfx, vec3_t origin, float vol, float attenuation)
 {
-	channel_t	*ss;
-	sfxcache_t		*sc;
+	sndcmd_t	*cmd;
+	sfxcache_t	*sc;
 
 	if (!sfx)
 		return;
 
-	if (total_channels == MAX_CHANNELS)
+	if (!snd_threaded)
+	{
+		S_DoStaticSound (sfx, origin, vol, attenuation);
+		return;
+	}
+
+// the checks that print are done here, off the mixer thread
+	if (snd_numstaticsfx == MAX_STATICSFX)
 	{
 		Con_Printf ("total_channels == MAX_CHANNELS\n");
 		return;
 	}
 
+	sc = S_LoadSound (sfx);
+	if (!sc)
+		return;
+
+	if (sc->loopstart == -1)
+	{
+		Con_Printf ("Sound %s not looped\n", sfx->name);
+		return;
+	}
+
+	snd_staticsfx[snd_numstaticsfx++] = sfx;
+
+	cmd = S_QueueCommand (sc_static);
+	cmd->sfx = sfx;
+	VectorCopy (origin, cmd->origin);
+	cmd->vol = vol;
+	cmd->attenuation = attenuation;
+	S_SubmitCommand ();
+}
+
+static void S_DoStaticSound (sfx_t *sfx, vec3_t origin, float vol, float attenuation)
+{
+	channel_t	*ss;
+	sfxcache_t		*sc;
+
+	if (total_channels == MAX_CHANNELS)
+	{
+		if (!snd_threaded)
+			Con_Printf ("total_channels == MAX_CHANNELS\n");
+		return;
+	}
+
 	ss = &channels[total_channels];
 	total_channels++;
 
-	sc = S_LoadSound (sfx);
+	sc = S_MixerSound (sfx);
 	if (!sc)
 		return;
 
 	if (sc->loopstart == -1)
 	{
-		Con_Printf ("Sound %s not looped\n", sfx->name);
+		if (!snd_threaded)
+			Con_Printf ("Sound %s not looped\n", sfx->name);
 		return;
 	}
 	
@@ -652,6 +1112,10 @@ void S_StaticSound (sfx_t *sfx, vec3_t origin, float vol, float attenuation)
 	ss->master_vol = vol;
 	ss->dist_mult = (attenuation/64) / sound_nominal_clip_dist;
     ss->end = paintedtime + sc->length;	
+	ss->looping = sc->loopstart;
+	ss->length = sc->length;
+	ss->priority = VOICE_STATIC;
+	ss->mixed = true;
 	
 	SND_Spatialize (ss);
 }
@@ -661,50 +1125,80 @@ void S_StaticSound (sfx_t *sfx, vec3_t origin, float vol, float attenuation)
 
 /*
 ===================
-S_UpdateAmbientSounds
+S_AmbientLevels
+
+Finds the ambient levels for the listener's leaf.  Returns false when the
+ambient channels should be left alone.
 ===================
 */
-void S_UpdateAmbientSounds (void)
+static qboolean S_AmbientLevels (vec3_t origin, float *levels)
 {
 	mleaf_t		*l;
-	float		vol;
 	int			ambient_channel;
-	channel_t	*chan;
+	float		vol;
 
 	if (!snd_ambient)
-		return;
+		return false;
 
 // calc ambient sound levels
 	if (!cl.worldmodel)
-		return;
+		return false;
 
-	l = Mod_PointInLeaf (listener_origin, cl.worldmodel);
-	if (!l || !ambient_level.value)
+	l = Mod_PointInLeaf (origin, cl.worldmodel);
+	for (ambient_channel = 0 ; ambient_channel< NUM_AMBIENTS ; ambient_channel++)
 	{
-		for (ambient_channel = 0 ; ambient_channel< NUM_AMBIENTS ; ambient_channel++)
-			channels[ambient_channel].sfx = NULL;
-		return;
+		if (!l || !ambient_level.value)
+		{
+			levels[ambient_channel] = -1;	// silence
+			continue;
+		}
+
+		vol = ambient_level.value * l->ambient_sound_level[ambient_channel];
+		if (vol < 8)
+			vol = 0;
+		levels[ambient_channel] = vol;
 	}
 
+	return true;
+}
+
+/*
+===================
+S_UpdateAmbientSounds
+
+levels is NULL to leave the ambient channels alone
+===================
+*/
+static void S_UpdateAmbientSounds (float *levels, float frametime)
+{
+	float		vol;
+	int			ambient_channel;
+	channel_t	*chan;
+
+	if (!levels)
+		return;
+
 	for (ambient_channel = 0 ; ambient_channel< NUM_AMBIENTS ; ambient_channel++)
 	{
 		chan = &channels[ambient_channel];	
+		vol = levels[ambient_channel];
+		if (vol < 0)
+		{
+			chan->sfx = NULL;
+			continue;
+		}
 		chan->sfx = ambient_sfx[ambient_channel];
-	
-		vol = ambient_level.value * l->ambient_sound_level[ambient_channel];
-		if (vol < 8)
-			vol = 0;
 
 	// don't adjust volume too fast
 		if (chan->master_vol < vol)
 		{
-			chan->master_vol += host_frametime * ambient_fade.value;
+			chan->master_vol += frametime * ambient_fade.value;
 			if (chan->master_vol > vol)
 				chan->master_vol = vol;
 		}
 		else if (chan->master_vol > vol)
 		{
-			chan->master_vol -= host_frametime * ambient_fade.value;
+			chan->master_vol -= frametime * ambient_fade.value;
 			if (chan->master_vol < vol)
 				chan->master_vol = vol;
 		}
@@ -723,21 +1217,84 @@ Called once each time through the main loop
 */
 void S_Update(vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 {
-	int			i, j;
-	int			total;
-	channel_t	*ch;
-	channel_t	*combine;
+	sndcmd_t	*cmd;
+	float		levels[NUM_AMBIENTS];
+	qboolean	ambients;
+	int			i;
+
+	if (snd_devicelost)
+	{
+		Con_Printf ("%s", snd_lostreason);
+		S_StopMixer ();
+		snd_devicelost = false;
+		S_Shutdown ();
+		S_Startup ();
+		S_StartMixer ();
+	}
 
 	if (!sound_started || (snd_blocked > 0))
 		return;
 
-	VectorCopy(origin, listener_origin);
-	VectorCopy(forward, listener_forward);
-	VectorCopy(right, listener_right);
-	VectorCopy(up, listener_up);
-	
-// update general area ambient sound sources
-	S_UpdateAmbientSounds ();
+	ambients = S_AmbientLevels (origin, levels);
+
+	if (snd_threaded)
+	{
+	// keep everything the mixer is playing loaded
+		for (i=0 ; i<NUM_AMBIENTS ; i++)
+			if (ambient_sfx[i])
+				S_LoadSound (ambient_sfx[i]);
+		for (i=0 ; i<snd_numstaticsfx ; i++)
+			S_LoadSound (snd_staticsfx[i]);
+
+		cmd = S_QueueCommand (sc_listener);
+		VectorCopy (origin, cmd->origin);
+		VectorCopy (forward, cmd->forward);
+		VectorCopy (right, cmd->right);
+		VectorCopy (up, cmd->up);
+		cmd->ambients = ambients;
+		if (ambients)
+			memcpy (cmd->ambient, levels, sizeof(levels));
+		cmd->frametime = host_frametime;
+		S_SubmitCommand ();
+		Sys_SignalEvent (snd_wake);
+	}
+	else
+	{
+		VectorCopy(origin, listener_origin);
+		VectorCopy(forward, listener_forward);
+		VectorCopy(right, listener_right);
+		VectorCopy(up, listener_up);
+
+	// update general area ambient sound sources
+		S_UpdateAmbientSounds (ambients ? levels : NULL, host_frametime);
+
+		S_SpatializeChannels ();
+	}
+
+//
+// debugging output
+//
+	if (snd_show.value)
+		Con_Printf ("----(%i audible, %i mixed)----\n", snd_audible, snd_mixedvoices);
+
+// decode streamed sounds if they have no thread of their own
+	S_PumpStreams ();
+
+// mix some sound
+	if (!snd_threaded)
+		S_Update_();
+}
+
+/*
+============
+S_SpatializeChannels
+============
+*/
+static void S_SpatializeChannels (void)
+{
+	int			i, j;
+	channel_t	*ch;
+	channel_t	*combine;
 
 	combine = NULL;
 
@@ -789,25 +1346,73 @@ void S_Update(vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 		
 	}
 
-//
-// debugging output
-//
-	if (snd_show.value)
+	S_ScheduleVoices ();
+}
+
+/*
+============
+S_CompareVoices
+============
+*/
+static int S_CompareVoices (const void *a, const void *b)
+{
+	channel_t	*ca, *cb;
+	int			sa, sb;
+
+	ca = *(channel_t **)a;
+	cb = *(channel_t **)b;
+	sa = SND_VoiceScore (ca);
+	sb = SND_VoiceScore (cb);
+
+	if (sa != sb)
+		return sb - sa;
+	return ca - cb;		// keep ties in the same order from update to update
+}
+
+/*
+============
+S_ScheduleVoices
+
+Every started sound keeps its channel as a voice, but only the snd_voices
+best scored audible ones are mixed.  The others are virtual: the mixer
+moves them along without reading their samples, so one that is ranked in
+again resumes where it would have been.  snd_voices 0 mixes everything.
+============
+*/
+static void S_ScheduleVoices (void)
+{
+	static channel_t	*ranked[MAX_CHANNELS];
+	int			i;
+	int			count, limit;
+	channel_t	*ch;
+
+// the ambients are only a few and always mixed
+	for (i=0 ; i<NUM_AMBIENTS ; i++)
+		channels[i].mixed = true;
+
+	count = 0;
+	ch = channels+NUM_AMBIENTS;
+	for (i=NUM_AMBIENTS ; i<total_channels; i++, ch++)
 	{
-		total = 0;
-		ch = channels;
-		for (i=0 ; i<total_channels; i++, ch++)
-			if (ch->sfx && (ch->leftvol || ch->rightvol) )
-			{
-				//Con_Printf ("%3i %3i %s\n", ch->leftvol, ch->rightvol, ch->sfx->name);
-				total++;
-			}
-		
-		Con_Printf ("----(%i)----\n", total);
+		ch->mixed = false;
+		if (ch->sfx && (ch->leftvol || ch->rightvol))
+			ranked[count++] = ch;
 	}
 
-// mix some sound
-	S_Update_();
+	limit = (int)snd_voices.value;
+	if (limit > 0 && count > limit)
+	{
+		qsort (ranked, count, sizeof(channel_t *), S_CompareVoices);
+		snd_culled += count - limit;
+	}
+	else
+		limit = count;
+
+	for (i=0 ; i<limit ; i++)
+		ranked[i]->mixed = true;
+
+	snd_audible = count;
+	snd_mixedvoices = limit;
 }
 
 void GetSoundtime(void)
@@ -824,7 +1429,10 @@ void GetSoundtime(void)
 #ifdef __sun__
 	soundtime = SNDDMA_GetSamples();
 #else
-	samplepos = SNDDMA_GetDMAPos();
+	if (fakedma)
+		samplepos = ((int)((Sys_PreciseTime () - fakedma_start) * shm->speed) * shm->channels) & (shm->samples - 1);
+	else
+		samplepos = SNDDMA_GetDMAPos();
 
 
 	if (samplepos < oldsamplepos)
@@ -835,7 +1443,7 @@ void GetSoundtime(void)
 		{	// time to chop things off to avoid 32 bit limits
 			buffers = 0;
 			paintedtime = fullsamples;
-			S_StopAllSounds (true);
+			S_DoStopAllSounds (true);
 		}
 	}
 	oldsamplepos = samplepos;
@@ -851,6 +1459,9 @@ void S_ExtraUpdate (void)
 	IN_Accumulate ();
 #endif
 
+	if (snd_threaded)
+		return;		// the mixer thread keeps itself fed
+
 	if (snd_noextraupdate.value)
 		return;		// don't pollute timings
 	S_Update_();
@@ -864,6 +1475,8 @@ void S_Update_(void)
 	if (!sound_started || (snd_blocked > 0))
 		return;
 
+	PROF_BEGIN ("S_Update_");
+
 // Updates DMA time
 	GetSoundtime();
 
@@ -871,9 +1484,14 @@ void S_Update_(void)
 	if (paintedtime < soundtime)
 	{
 		//Con_Printf ("S_Update_ : overflow\n");
+		if (paintedtime)
+			snd_underruns++;
 		paintedtime = soundtime;
 	}
 
+	if (snd_minfill < 0 || paintedtime - soundtime < snd_minfill)
+		snd_minfill = paintedtime - soundtime;
+
 // mix ahead of current position
 	endtime = soundtime + _snd_mixahead.value * shm->speed;
 	samps = shm->samples >> (shm->channels-1);
@@ -902,6 +1520,8 @@ void S_Update_(void)
 	S_PaintChannels (endtime);
 
 	SNDDMA_Submit ();
+
+	PROF_END ();
 }
 
 /*
@@ -966,6 +1586,7 @@ void S_SoundList(void)
 	sfx_t	*sfx;
 	sfxcache_t	*sc;
 	int		size, total;
+	int		streamed, starved;
 
 	total = 0;
 	for (sfx=known_sfx, i=0 ; i<num_sfx ; i++, sfx++)
@@ -974,14 +1595,26 @@ void S_SoundList(void)
 		if (!sc)
 			continue;
 		size = sc->length*sc->width*(sc->stereo+1);
+		if (sfx->stream)
+			size = 0;		// only the header is in the cache
 		total += size;
 		if (sc->loopstart >= 0)
 			Con_Printf ("L");
 		else
 			Con_Printf (" ");
-		Con_Printf("(%2db) %6i : %s\n",sc->width*8,  size, sfx->name);
+		Con_Printf("(%2db) %6i : %s%s\n",sc->width*8,  size, sfx->name, sfx->stream ? " (streamed)" : "");
 	}
 	Con_Printf ("Total resident: %i\n", total);
+
+	streamed = starved = 0;
+	for (i=0 ; i<snd_numstreams ; i++)
+	{
+		streamed += snd_streams[i]->info.samples * 2;
+		starved += snd_streams[i]->starved;
+	}
+	Con_Printf ("%i streamed: %iK kept out of the cache, %iK of rings, %i starved paints\n",
+		snd_numstreams, streamed / 1024, snd_numstreams * (STREAM_RING + STREAM_GUARD) * 2 / 1024, starved);
+	Con_Printf ("%i sounds loaded in %.1f ms\n", snd_loadcount, snd_loadtime * 1000);
 }
 
 
@@ -23,6 +23,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 int			cache_full_cycle;
 
+int			snd_loadcount;		// sounds read from disk
+double		snd_loadtime;		// seconds spent reading and converting them
+
 byte *S_Alloc (int size);
 
 /*
@@ -87,6 +90,37 @@ void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
 	}
 }
 
+/*
+================
+S_StoreSfx
+
+Keeps the samples at their own rate for the resampling mixer, with one
+extra sample on the end for the interpolation to read
+================
+*/
+void S_StoreSfx (sfxcache_t *sc, int inwidth, int samples, byte *data)
+{
+	int		i, sample;
+
+	sc->width = loadas8bit.value ? 1 : inwidth;
+	sc->stereo = 0;
+
+	for (i=0 ; i<=samples ; i++)
+	{
+		if (i == samples)
+			sample = i ? ((sc->width == 2) ? ((short *)sc->data)[i-1] : ((signed char *)sc->data)[i-1] << 8) : 0;
+		else if (inwidth == 2)
+			sample = LittleShort ( ((short *)data)[i] );
+		else
+			sample = (int)( (unsigned char)(data[i]) - 128) << 8;
+
+		if (sc->width == 2)
+			((short *)sc->data)[i] = sample;
+		else
+			((signed char *)sc->data)[i] = sample >> 8;
+	}
+}
+
 //=============================================================================
 
 /*
@@ -97,48 +131,129 @@ S_LoadSound
 sfxcache_t *S_LoadSound (sfx_t *s)
 {
     char	namebuffer[256];
-	byte	*data;
+	byte	*data, *src, *in, *end;
+	short	*pcm;
 	wavinfo_t	info;
-	int		len;
+	int		len, filelen;
+	int		i, n;
 	float	stepscale;
 	sfxcache_t	*sc;
-	byte	stackbuf[1*1024];		// avoid dirtying the cache heap
+	FILE	*f;
+	double	start;
+	qboolean	mapped;
 
 // see if still in memory
 	sc = Cache_Check (&s->cache);
 	if (sc)
+	{
+		if (s->stream)
+			s->stream->lastused = realtime;
 		return sc;
+	}
+
+// a streamed sound only needs its header again
+	if (s->stream)
+		return S_StreamCache (s);
+
+	start = Sys_PreciseTime ();
 
-//Con_Printf ("S_LoadSound: %x\n", (int)stackbuf);
 // load it in
     Q_strcpy(namebuffer, "sound/");
     Q_strcat(namebuffer, s->name);
 
 //	Con_Printf ("loading %s\n",namebuffer);
 
-	data = COM_LoadStackFile(namebuffer, stackbuf, sizeof(stackbuf));
+// short sounds in a mapped pak are parsed where they lie
+	data = COM_MapFile (namebuffer);
+	filelen = com_filesize;
+	if (data && snd_streamsize.value > 0 && filelen > snd_streamsize.value)
+		data = NULL;
+	mapped = (data != NULL);
 
-	if (!data)
+	if (!mapped)
 	{
-		Con_Printf ("Couldn't load %s\n", namebuffer);
-		return NULL;
+		filelen = COM_FOpenFile (namebuffer, &f);
+		if (!f)
+		{
+			Con_Printf ("Couldn't load %s\n", namebuffer);
+			return NULL;
+		}
+
+	// long sounds play from the file instead of the cache; the stream thread
+	// can't share a pk3's zip handle
+		if (!LoadFromPK3 && snd_streamsize.value > 0 && filelen > snd_streamsize.value)
+		{
+			sc = S_OpenStream (s, f, filelen);
+			if (sc)
+			{
+				snd_loadtime += Sys_PreciseTime () - start;
+				snd_loadcount++;
+				return sc;
+			}
+		}
+
+		data = COM_FReadFile (f, filelen);
+		if (!data)
+		{
+			Con_Printf ("Couldn't load %s\n", namebuffer);
+			return NULL;
+		}
 	}
 
-	info = GetWavinfo (s->name, data, com_filesize);
+	info = GetWavinfo (s->name, data, filelen);
 	if (info.channels != 1)
 	{
 		Con_Printf ("%s is a stereo sample\n",s->name);
+		if (!mapped)
+			free (data);
 		return NULL;
 	}
 
+// short compressed sounds are decoded once and kept as 16 bit
+	src = data + info.dataofs;
+	pcm = NULL;
+	if (info.format == WAV_IMAADPCM)
+	{
+		pcm = malloc ((info.samples + info.blocksamples) * sizeof(short));
+		if (!pcm)
+		{
+			if (!mapped)
+				free (data);
+			return NULL;
+		}
+
+		in = data + info.dataofs;
+		end = data + filelen;
+		for (i=0 ; i<info.samples && in + 4 < end ; i += n, in += info.blockalign)
+			n = S_DecodeADPCM (in, (end - in < info.blockalign) ? end - in : info.blockalign, pcm + i);
+		for ( ; i<info.samples ; i++)
+			pcm[i] = 0;
+		for (i=0 ; i<info.samples ; i++)
+			pcm[i] = LittleShort (pcm[i]);	// read back as file data
+		src = (byte *)pcm;
+	}
+
 	stepscale = (float)info.rate / shm->speed;	
 	len = info.samples / stepscale;
 
+	if (snd_mixsimd.value)
+		len = info.samples + 1;		// resampled while mixing
+
 	len = len * info.width * info.channels;
 
+// a mixer thread's Cache_Check sees the entry as soon as it is allocated,
+// so keep it out until the entry is filled in
+	Cache_Lock ();
+
 	sc = Cache_Alloc ( &s->cache, len + sizeof(sfxcache_t), s->name);
 	if (!sc)
+	{
+		Cache_Unlock ();
+		if (!mapped)
+			free (data);
+		free (pcm);
 		return NULL;
+	}
 	
 	sc->length = info.samples;
 	sc->loopstart = info.loopstart;
@@ -146,11 +261,104 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	sc->width = info.width;
 	sc->stereo = info.channels;
 
-	ResampleSfx (s, sc->speed, sc->width, data + info.dataofs);
+	if (snd_mixsimd.value)
+	{
+	// lengths stay in output samples, the data doesn't
+		sc->length = info.samples / stepscale;
+		if (sc->loopstart != -1)
+			sc->loopstart = sc->loopstart / stepscale;
+		S_StoreSfx (sc, info.width, info.samples, src);
+	}
+	else
+		ResampleSfx (s, sc->speed, sc->width, src);
+
+	Cache_Unlock ();
+
+	if (!mapped)
+		free (data);
+	free (pcm);
+
+	snd_loadtime += Sys_PreciseTime () - start;
+	snd_loadcount++;
 
 	return sc;
 }
 
+/*
+================
+S_DecodeADPCM
+
+Decodes one mono IMA ADPCM block and returns the samples written
+================
+*/
+static const int adpcm_index[16] =
+{
+	-1, -1, -1, -1, 2, 4, 6, 8,
+	-1, -1, -1, -1, 2, 4, 6, 8
+};
+
+static const int adpcm_step[89] =
+{
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31,
+	34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143,
+	157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658,
+	724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
+	3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+int S_DecodeADPCM (byte *in, int len, short *out)
+{
+	int		pred, index, step, diff, nibble;
+	int		i, n, shift;
+
+	if (len < 4)
+		return 0;
+
+	pred = (short)(in[0] | (in[1] << 8));
+	index = in[2];
+	if (index > 88)
+		index = 88;
+	out[0] = pred;
+	n = 1;
+
+	for (i=4 ; i<len ; i++)
+	{
+		for (shift=0 ; shift<8 ; shift+=4)
+		{
+			nibble = (in[i] >> shift) & 15;
+			step = adpcm_step[index];
+
+			diff = step >> 3;
+			if (nibble & 1)
+				diff += step >> 2;
+			if (nibble & 2)
+				diff += step >> 1;
+			if (nibble & 4)
+				diff += step;
+			if (nibble & 8)
+				pred -= diff;
+			else
+				pred += diff;
+
+			if (pred > 32767)
+				pred = 32767;
+			else if (pred < -32768)
+				pred = -32768;
+
+			index += adpcm_index[nibble];
+			if (index < 0)
+				index = 0;
+			else if (index > 88)
+				index = 88;
+
+			out[n++] = pred;
+		}
+	}
+
+	return n;
+}
+
 
 
 /*
@@ -280,17 +488,32 @@ wavinfo_t GetWavinfo (char *name, byte *wav, int wavlength)
 	}
 	data_p += 8;
 	format = GetLittleShort();
-	if (format != 1)
+	if (format != WAV_PCM && format != WAV_IMAADPCM)
 	{
-		Con_Printf("Microsoft PCM format only\n");
+		Con_Printf("Microsoft PCM or IMA ADPCM format only\n");
 		return info;
 	}
 
+	info.format = format;
 	info.channels = GetLittleShort();
 	info.rate = GetLittleLong();
-	data_p += 4+2;
+	data_p += 4;
+	info.blockalign = GetLittleShort();
 	info.width = GetLittleShort() / 8;
 
+	if (format == WAV_IMAADPCM)
+	{
+	// decoded to 16 bit, a block holds its header sample and two per byte
+		info.width = 2;
+		info.blocksamples = (info.blockalign - 4) * 2 + 1;
+		if (info.channels != 1 || info.blockalign <= 4)
+		{
+			Con_Printf("%s: bad ADPCM format\n", name);
+			info.channels = 0;
+			return info;
+		}
+	}
+
 // get cue chunk
 	FindChunk("cue ");
 	if (data_p)
@@ -324,7 +547,16 @@ wavinfo_t GetWavinfo (char *name, byte *wav, int wavlength)
 	}
 
 	data_p += 4;
-	samples = GetLittleLong () / info.width;
+	samples = GetLittleLong ();
+	if (format == WAV_IMAADPCM)
+	{
+		i = samples % info.blockalign;
+		samples = (samples / info.blockalign) * info.blocksamples;
+		if (i > 4)
+			samples += (i - 4) * 2 + 1;
+	}
+	else
+		samples /= info.width;
 
 	if (info.samples)
 	{
@@ -27,12 +27,19 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define DWORD	unsigned long
 #endif
 
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define	SND_SSE2
+#include <emmintrin.h>
+#endif
+
 #define	PAINTBUFFER_SIZE	512
 portable_samplepair_t paintbuffer[PAINTBUFFER_SIZE];
 int		snd_scaletable[32][256];
 int 	*snd_p, snd_linear_count, snd_vol;
 short	*snd_out;
 
+cvar_t	snd_mixsimd = {"snd_mixsimd", "1", true};
+
 void Snd_WriteLinearBlastStereo16 (void);
 
 #if	!id386
@@ -89,17 +96,13 @@ void S_TransferStereo16 (int endtime)
 		{
 			if (hresult != DSERR_BUFFERLOST)
 			{
-				Con_Printf ("S_TransferStereo16: DS::Lock Sound Buffer Failed\n");
-				S_Shutdown ();
-				S_Startup ();
+				S_DeviceLost ("S_TransferStereo16: DS::Lock Sound Buffer Failed\n");
 				return;
 			}
 
 			if (++reps > 10000)
 			{
-				Con_Printf ("S_TransferStereo16: DS: couldn't restore buffer\n");
-				S_Shutdown ();
-				S_Startup ();
+				S_DeviceLost ("S_TransferStereo16: DS: couldn't restore buffer\n");
 				return;
 			}
 		}
@@ -176,17 +179,13 @@ void S_TransferPaintBuffer(int endtime)
 		{
 			if (hresult != DSERR_BUFFERLOST)
 			{
-				Con_Printf ("S_TransferPaintBuffer: DS::Lock Sound Buffer Failed\n");
-				S_Shutdown ();
-				S_Startup ();
+				S_DeviceLost ("S_TransferPaintBuffer: DS::Lock Sound Buffer Failed\n");
 				return;
 			}
 
 			if (++reps > 10000)
 			{
-				Con_Printf ("S_TransferPaintBuffer: DS: couldn't restore buffer\n");
-				S_Shutdown ();
-				S_Startup ();
+				S_DeviceLost ("S_TransferPaintBuffer: DS: couldn't restore buffer\n");
 				return;
 			}
 		}
@@ -257,6 +256,51 @@ CHANNEL MIXING
 
 void SND_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int endtime);
 void SND_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int endtime);
+void SND_PaintChannel (channel_t *ch, sfxcache_t *sc, int offset, int count, int outrate);
+
+/*
+================
+SND_SkipChannel
+
+Moves a virtual or silent voice along to end from what the channel knows
+of its sound, without its data, which may not even be in the cache
+================
+*/
+static void SND_SkipChannel (channel_t *ch, int end)
+{
+	int		ltime, count;
+
+	ltime = paintedtime;
+	while (ltime < end)
+	{
+		if (ch->end < end)
+			count = ch->end - ltime;
+		else
+			count = end - ltime;
+
+		if (count > 0)
+		{
+			ch->pos += count;
+			ltime += count;
+		}
+
+		if (ltime >= ch->end)
+		{
+		// a silent ambient that was never mixed doesn't know its length
+			if (ch->looping < 0 || ch->length <= ch->looping)
+			{
+				ch->sfx = NULL;
+				return;
+			}
+
+			ch->pos = ch->looping;
+			ch->end = ltime + ch->length - ch->pos;
+
+			if (ch->sfx->stream && ch->sfx->stream->owner == ch)
+				ch->sfx->stream->chpos = ch->pos;
+		}
+	}
+}
 
 void S_PaintChannels(int endtime)
 {
@@ -273,6 +317,10 @@ void S_PaintChannels(int endtime)
 		if (endtime - paintedtime > PAINTBUFFER_SIZE)
 			end = paintedtime + PAINTBUFFER_SIZE;
 
+	// the cache must not move sound data underneath a mixer thread, and the
+	// lock also keeps snd_mixbench out of the paint buffer
+		Cache_Lock ();
+
 	// clear the paint buffer
 		Q_memset(paintbuffer, 0, (end - paintedtime) * sizeof(portable_samplepair_t));
 
@@ -282,11 +330,22 @@ void S_PaintChannels(int endtime)
 		{
 			if (!ch->sfx)
 				continue;
-			if (!ch->leftvol && !ch->rightvol)
+
+		// virtual and silent voices only keep their place
+			if (!ch->mixed || (!ch->leftvol && !ch->rightvol))
+			{
+				SND_SkipChannel (ch, end);
 				continue;
-			sc = S_LoadSound (ch->sfx);
+			}
+
+			sc = S_MixerSound (ch->sfx);
 			if (!sc)
+			{	// evicted under a mixer thread, keep it in time until reloaded
+				SND_SkipChannel (ch, end);
 				continue;
+			}
+			ch->looping = sc->loopstart;	// for when it is skipped
+			ch->length = sc->length;
 
 			ltime = paintedtime;
 
@@ -299,7 +358,13 @@ void S_PaintChannels(int endtime)
 
 				if (count > 0)
 				{	
-					if (sc->width == 1)
+					if (ch->sfx->stream)
+						SND_PaintStream (ch, sc, ltime - paintedtime, count, shm->speed);
+				// sounds kept at their own rate can only go through the
+				// resampling mixer
+					else if (sc->speed != shm->speed || snd_mixsimd.value)
+						SND_PaintChannel (ch, sc, ltime - paintedtime, count, shm->speed);
+					else if (sc->width == 1)
 						SND_PaintChannelFrom8(ch, sc, count);
 					else
 						SND_PaintChannelFrom16(ch, sc, count);
@@ -314,6 +379,10 @@ void S_PaintChannels(int endtime)
 					{
 						ch->pos = sc->loopstart;
 						ch->end = ltime + sc->length - ch->pos;
+
+					// the ring runs on over the loop by itself
+						if (ch->sfx->stream && ch->sfx->stream->owner == ch)
+							ch->sfx->stream->chpos = ch->pos;
 					}
 					else				
 					{	// channel just stopped
@@ -328,6 +397,8 @@ void S_PaintChannels(int endtime)
 	// transfer out according to DMA format
 		S_TransferPaintBuffer(end);
 		paintedtime = end;
+
+		Cache_Unlock ();
 	}
 }
 
@@ -396,3 +467,389 @@ void SND_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int count)
 	ch->pos += count;
 }
 
+
+/*
+===============================================================================
+
+VECTOR MIXING
+
+Sounds loaded with snd_mixsimd set stay at their own sample rate and are
+resampled with linear interpolation while mixing.  Everything is turned
+into 16 bit samples first and then scaled into the paint buffer four
+stereo pairs at a time.  Results match the scalar paths bit for bit when
+no resampling is needed.
+===============================================================================
+*/
+
+#ifdef SND_SSE2
+static int		snd_sse2 = -1;		// unknown until the first mix
+
+static qboolean SND_HaveSSE2 (void)
+{
+	if (snd_sse2 < 0)
+	{
+#ifdef _WIN32
+		snd_sse2 = IsProcessorFeaturePresent (PF_XMMI64_INSTRUCTIONS_AVAILABLE) ? 1 : 0;
+#else
+		snd_sse2 = 1;
+#endif
+	}
+	return snd_sse2;
+}
+#endif
+
+/*
+================
+SND_MixSamples
+
+pb[i] += (data[i] * vol) >> 8, which is what SND_PaintChannelFrom16 does
+================
+*/
+static void SND_MixSamples (portable_samplepair_t *pb, short *data, int count, int leftvol, int rightvol)
+{
+	int		i;
+
+	i = 0;
+
+#ifdef SND_SSE2
+	if (SND_HaveSSE2 ())
+	{
+		__m128i	lv, rv, d, lo, hi, l, r, *out;
+
+		lv = _mm_set1_epi16 ((short)leftvol);
+		rv = _mm_set1_epi16 ((short)rightvol);
+
+		for ( ; i+8 <= count ; i += 8)
+		{
+			d = _mm_loadu_si128 ((__m128i *)(data + i));
+			out = (__m128i *)(pb + i);
+
+		// full 32 bit products from the 16 bit halves
+			lo = _mm_mullo_epi16 (d, lv);
+			hi = _mm_mulhi_epi16 (d, lv);
+			l = _mm_srai_epi32 (_mm_unpacklo_epi16 (lo, hi), 8);
+			lo = _mm_mullo_epi16 (d, rv);
+			hi = _mm_mulhi_epi16 (d, rv);
+			r = _mm_srai_epi32 (_mm_unpacklo_epi16 (lo, hi), 8);
+
+			_mm_storeu_si128 (out, _mm_add_epi32 (_mm_loadu_si128 (out), _mm_unpacklo_epi32 (l, r)));
+			_mm_storeu_si128 (out+1, _mm_add_epi32 (_mm_loadu_si128 (out+1), _mm_unpackhi_epi32 (l, r)));
+
+			lo = _mm_mullo_epi16 (d, lv);
+			hi = _mm_mulhi_epi16 (d, lv);
+			l = _mm_srai_epi32 (_mm_unpackhi_epi16 (lo, hi), 8);
+			lo = _mm_mullo_epi16 (d, rv);
+			hi = _mm_mulhi_epi16 (d, rv);
+			r = _mm_srai_epi32 (_mm_unpackhi_epi16 (lo, hi), 8);
+
+			_mm_storeu_si128 (out+2, _mm_add_epi32 (_mm_loadu_si128 (out+2), _mm_unpacklo_epi32 (l, r)));
+			_mm_storeu_si128 (out+3, _mm_add_epi32 (_mm_loadu_si128 (out+3), _mm_unpackhi_epi32 (l, r)));
+		}
+	}
+#endif
+
+	for ( ; i<count ; i++)
+	{
+		pb[i].left += (data[i] * leftvol) >> 8;
+		pb[i].right += (data[i] * rightvol) >> 8;
+	}
+}
+
+/*
+================
+SND_ResampleData
+
+Produces count 16 bit samples from data, stepping 16.16 source samples
+per output sample from frac
+================
+*/
+static void SND_ResampleData (void *data, int width, int frac, int step, int count, short *out)
+{
+	int		i, j, a, b;
+
+	if (width == 2)
+	{
+		short	*in = (short *)data;
+
+		if (step == 0x10000 && !frac)
+		{
+			memcpy (out, in, count * sizeof(short));
+			return;
+		}
+
+		for (i=0 ; i<count ; i++, frac += step)
+		{
+			j = frac >> 16;
+			a = in[j];
+			b = in[j+1];
+			out[i] = a + (((b - a) * ((frac & 0xffff) >> 1)) >> 15);
+		}
+	}
+	else
+	{
+		signed char	*in = (signed char *)data;
+
+		if (step == 0x10000 && !frac)
+		{
+			for (i=0 ; i<count ; i++)
+				out[i] = in[i] << 8;
+			return;
+		}
+
+		for (i=0 ; i<count ; i++, frac += step)
+		{
+			j = frac >> 16;
+			a = in[j] << 8;
+			b = in[j+1] << 8;
+			out[i] = a + (((b - a) * ((frac & 0xffff) >> 1)) >> 15);
+		}
+	}
+}
+
+/*
+================
+SND_Resample
+
+Produces count 16 bit samples at outrate starting from output sample pos.
+Sounds resampled at load time come through here only for the 8 bit to
+16 bit conversion.
+================
+*/
+static void SND_Resample (sfxcache_t *sc, int pos, int count, short *out, int outrate)
+{
+	double	src;
+	int		base, frac, step;
+
+	src = (double)pos * sc->speed / outrate;
+	base = (int)src;
+	frac = (int)((src - base) * 65536);
+	step = (int)((double)sc->speed * 65536 / outrate);
+
+	SND_ResampleData (sc->data + base * sc->width, sc->width, frac, step, count, out);
+}
+
+/*
+================
+SND_PaintChannel
+
+Mixes count samples of the channel into the paint buffer at offset
+================
+*/
+void SND_PaintChannel (channel_t *ch, sfxcache_t *sc, int offset, int count, int outrate)
+{
+	short	samples[PAINTBUFFER_SIZE];
+	short	*data;
+	int		leftvol, rightvol;
+
+	if (ch->leftvol > 255)
+		ch->leftvol = 255;
+	if (ch->rightvol > 255)
+		ch->rightvol = 255;
+	leftvol = ch->leftvol;
+	rightvol = ch->rightvol;
+
+	if (sc->width == 2 && sc->speed == outrate)
+		data = (short *)sc->data + ch->pos;
+	else
+	{
+		SND_Resample (sc, ch->pos, count, samples, outrate);
+		data = samples;
+
+	// the 8 bit scale table drops the low volume bits
+		if (sc->width == 1)
+		{
+			leftvol &= ~7;
+			rightvol &= ~7;
+		}
+	}
+
+	SND_MixSamples (paintbuffer + offset, data, count, leftvol, rightvol);
+
+	ch->pos += count;
+}
+
+/*
+================
+SND_PaintStream
+
+Mixes count samples of a streamed sound out of its ring.  The ring follows
+one voice: a voice of the same sound that finds the ring already used this
+paint stays silent, and a voice that isn't where the ring is has the
+decoder seek to it and plays silence until the data arrives.
+================
+*/
+void SND_PaintStream (channel_t *ch, sfxcache_t *sc, int offset, int count, int outrate)
+{
+	sndstream_t	*st;
+	short	samples[PAINTBUFFER_SIZE];
+	double	src;
+	int		step, span;
+	int		leftvol, rightvol;
+
+	st = ch->sfx->stream;
+
+	if (st->owner != ch && st->owner && st->owner->sfx == ch->sfx && st->painted == paintedtime)
+	{
+		ch->pos += count;
+		return;
+	}
+
+	if (st->owner != ch || st->chpos != ch->pos)
+	{
+		src = (double)ch->pos * sc->speed / outrate;
+		st->owner = ch;
+		st->readpos = (int)src;
+		st->frac = (int)((src - (int)src) * 65536);
+		st->seekpos = st->readpos;
+		st->seekserial++;
+		S_WakeStreams ();
+	}
+	st->painted = paintedtime;
+
+	if (ch->leftvol > 255)
+		ch->leftvol = 255;
+	if (ch->rightvol > 255)
+		ch->rightvol = 255;
+	leftvol = ch->leftvol;
+	rightvol = ch->rightvol;
+
+	step = (int)((double)sc->speed * 65536 / outrate);
+	span = (st->frac + step * count) / 65536 + 2;		// with the sample interpolated to
+
+	if (st->ringserial == st->seekserial && st->readpos >= st->ringstart
+	&& st->readpos + span <= st->writepos && span <= STREAM_GUARD)
+	{
+		SND_ResampleData (st->ring + (st->readpos & (STREAM_RING-1)), 2, st->frac, step, count, samples);
+		SND_MixSamples (paintbuffer + offset, samples, count, leftvol, rightvol);
+	}
+	else
+		st->starved++;
+
+	st->frac += step * count;
+	st->readpos += st->frac >> 16;
+	st->frac &= 0xffff;
+
+	ch->pos += count;
+	st->chpos = ch->pos;
+}
+
+/*
+================
+SND_MixBench_f
+
+snd_mixbench [channels]
+
+Mixes one second of audio on many channels through the scalar and the
+vector paths and reports the cost of each
+================
+*/
+void SND_MixBench_f (void)
+{
+	sfxcache_t	*sc[4];
+	channel_t	*chans;
+	double		start, times[4];
+	int			outrate, numchans, samples, pass, test;
+	int			i, j, count, rates[4], widths[4];
+
+	numchans = 128;
+	if (Cmd_Argc() > 1)
+		numchans = Q_atoi (Cmd_Argv(1));
+	if (numchans < 1)
+		numchans = 1;
+
+	outrate = shm ? shm->speed : 22050;
+
+// 16 and 8 bit sounds at the output rate, as the load time resampler
+// leaves them, and at 11025, the rate most id1 sounds are stored at
+	rates[0] = rates[1] = outrate;
+	rates[2] = rates[3] = 11025;
+	widths[0] = widths[2] = 2;
+	widths[1] = widths[3] = 1;
+
+	for (i=0 ; i<4 ; i++)
+	{
+		samples = rates[i] + 1;		// a second plus the interpolation guard
+		sc[i] = malloc (sizeof(sfxcache_t) + samples * widths[i]);
+		if (!sc[i])
+		{
+			while (i--)
+				free (sc[i]);
+			return;
+		}
+		sc[i]->length = outrate;
+		sc[i]->loopstart = 0;
+		sc[i]->speed = rates[i];
+		sc[i]->width = widths[i];
+		sc[i]->stereo = 0;
+		for (j=0 ; j<samples ; j++)
+		{
+			if (widths[i] == 2)
+				((short *)sc[i]->data)[j] = (rand () & 0xffff) - 0x8000;
+			else
+				((signed char *)sc[i]->data)[j] = (rand () & 0xff) - 0x80;
+		}
+	}
+
+	chans = malloc (numchans * sizeof(channel_t));
+	if (!chans)
+	{
+		for (i=0 ; i<4 ; i++)
+			free (sc[i]);
+		return;
+	}
+
+	Cache_Lock ();		// keep a mixer thread out of the paint buffer
+
+// scalar at the output rate, vector at the output rate, vector resampling
+	for (test=0 ; test<3 ; test++)
+	{
+		memset (chans, 0, numchans * sizeof(channel_t));
+		for (i=0 ; i<numchans ; i++)
+		{
+			chans[i].leftvol = 64 + (i * 37) % 192;
+			chans[i].rightvol = 64 + (i * 91) % 192;
+			chans[i].pos = (i * 211) % outrate;
+		}
+
+		start = Sys_PreciseTime ();
+		for (pass=0 ; pass<outrate ; pass += PAINTBUFFER_SIZE)
+		{
+			count = outrate - pass;
+			if (count > PAINTBUFFER_SIZE)
+				count = PAINTBUFFER_SIZE;
+			memset (paintbuffer, 0, count * sizeof(portable_samplepair_t));
+
+			for (i=0 ; i<numchans ; i++)
+			{
+				j = (test == 2 ? 2 : 0) + (i & 1);
+				if (chans[i].pos + count > sc[j]->length)
+					chans[i].pos = 0;
+
+				if (test == 0)
+				{
+					if (sc[j]->width == 1)
+						SND_PaintChannelFrom8 (&chans[i], sc[j], count);
+					else
+						SND_PaintChannelFrom16 (&chans[i], sc[j], count);
+				}
+				else
+					SND_PaintChannel (&chans[i], sc[j], 0, count, outrate);
+			}
+		}
+		times[test] = Sys_PreciseTime () - start;
+	}
+
+	memset (paintbuffer, 0, sizeof(paintbuffer));
+	Cache_Unlock ();
+	free (chans);
+	for (i=0 ; i<4 ; i++)
+		free (sc[i]);
+
+	Con_Printf ("%i channels, one second at %i Hz:\n", numchans, outrate);
+	Con_Printf ("  scalar          %7.2f ms\n", times[0] * 1000);
+	Con_Printf ("  vector          %7.2f ms\n", times[1] * 1000);
+	Con_Printf ("  vector 11025 Hz %7.2f ms\n", times[2] * 1000);
+#ifdef SND_SSE2
+	Con_Printf ("SSE2 %s\n", SND_HaveSSE2 () ? "on" : "not supported");
+#endif
+}
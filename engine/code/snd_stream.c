@@ -0,0 +1,546 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// snd_stream.c -- long sounds decoded from their file as they play
+
+#include "quakedef.h"
+
+// A sound whose file is bigger than snd_streamsize keeps only its header in
+// the cache.  Its samples are read and decoded by the stream thread into a
+// ring the mixer reads from, so a long ambience or a music-like sound no
+// longer pushes everything else out of the cache.
+//
+// The mixer and the decoder share nothing but the volatile positions in
+// the stream: the mixer asks for a seek by bumping seekserial, the decoder
+// answers by setting ringserial once the ring starts at the new place.
+
+#define	MAX_STREAMS		16
+#define	STREAM_BLOCK	4096		// PCM samples read at a time
+#define	MAX_WAVHEADER	4096
+
+cvar_t	snd_streamsize = {"snd_streamsize", "262144", true};
+
+sndstream_t		*snd_streams[MAX_STREAMS];
+volatile int	snd_numstreams;
+
+static sys_thread_t	snd_streamthread;
+static sys_event_t	snd_streamwake;
+static volatile qboolean	snd_streamquit;
+
+/*
+================
+S_ReadWavHeader
+
+Builds a copy of the file's RIFF chunks for GetWavinfo without reading the
+samples: the small chunks are copied in order and the data chunk's header
+is moved to the end.  Returns the length, or 0 if it isn't a wav.
+================
+*/
+static int S_ReadWavHeader (FILE *f, int base, int filelen, byte *header, int *dataofs)
+{
+	byte	chunk[8];
+	int		pos, len, hlen;
+
+	fseek (f, base, SEEK_SET);
+	if (fread (header, 1, 12, f) != 12 || Q_strncmp ((char *)header, "RIFF", 4)
+	|| Q_strncmp ((char *)header + 8, "WAVE", 4))
+		return 0;
+
+	hlen = 12;
+	*dataofs = -1;
+	for (pos=12 ; pos + 8 <= filelen ; pos += 8 + ((len + 1) & ~1))
+	{
+		fseek (f, base + pos, SEEK_SET);
+		if (fread (chunk, 1, 8, f) != 8)
+			break;
+		len = chunk[4] | (chunk[5] << 8) | (chunk[6] << 16) | (chunk[7] << 24);
+		if (len < 0)
+			break;
+
+		if (!Q_strncmp ((char *)chunk, "data", 4))
+		{
+			*dataofs = pos + 8;
+			memcpy (header + MAX_WAVHEADER - 8, chunk, 8);
+			continue;
+		}
+
+	// anything too big to be a fmt, cue or LIST chunk is left out
+		if (hlen + 8 + ((len + 1) & ~1) > MAX_WAVHEADER - 8)
+			continue;
+
+		memcpy (header + hlen, chunk, 8);
+		memset (header + hlen + 8, 0, (len + 1) & ~1);
+		if (fread (header + hlen + 8, 1, len, f) != len)
+			break;
+		hlen += 8 + ((len + 1) & ~1);
+	}
+
+	if (*dataofs < 0)
+		return 0;
+
+	memmove (header + hlen, header + MAX_WAVHEADER - 8, 8);
+	return hlen + 8;
+}
+
+/*
+================
+S_RecycleStream
+
+Gives the slot of the stream no voice is playing and that was asked for
+the longest ago to a new long sound.  Its sound loses its cache entry and
+is opened again when next started.
+================
+*/
+static qboolean S_RecycleStream (void)
+{
+	sndstream_t	*st;
+	channel_t	*ch;
+	int			i, j, best;
+
+// the mixer thread changes the voices while it paints
+	Cache_Lock ();
+
+	best = -1;
+	for (i=0 ; i<snd_numstreams ; i++)
+	{
+		st = snd_streams[i];
+		if (realtime - st->lastused < 1)
+			continue;		// may be waiting in the mixer's command queue
+		if (best >= 0 && st->lastused >= snd_streams[best]->lastused)
+			continue;
+
+		for (j=0, ch=channels ; j<total_channels ; j++, ch++)
+			if (ch->sfx == st->sfx)
+				break;
+		if (j == total_channels)
+			best = i;
+	}
+
+	if (best < 0)
+	{
+		Cache_Unlock ();
+		return false;
+	}
+
+	st = snd_streams[best];
+	st->sfx->stream = NULL;
+	if (st->sfx->cache.data)
+		Cache_Free (&st->sfx->cache);
+	Cache_Unlock ();
+
+// the decoder walks the list on its own thread
+	S_StopStreams ();
+
+	fclose (st->file);
+	free (st);
+
+	snd_numstreams--;
+	snd_streams[best] = snd_streams[snd_numstreams];
+	snd_streams[snd_numstreams] = NULL;
+
+	return true;
+}
+
+/*
+================
+S_OpenStream
+
+Takes over the open file of a long sound.  Returns NULL with the file back
+where it was if the sound can't be streamed, so it can be loaded whole.
+================
+*/
+sfxcache_t *S_OpenStream (sfx_t *s, FILE *f, int filelen)
+{
+	byte		header[MAX_WAVHEADER];
+	sndstream_t	*st;
+	wavinfo_t	info;
+	int			base, hlen, dataofs;
+	int			rawsize, blocksize;
+
+	if (snd_numstreams == MAX_STREAMS && !S_RecycleStream ())
+		return NULL;
+
+	base = ftell (f);
+	hlen = S_ReadWavHeader (f, base, filelen, header, &dataofs);
+	if (!hlen)
+	{
+		fseek (f, base, SEEK_SET);
+		return NULL;
+	}
+
+	info = GetWavinfo (s->name, header, hlen);
+	if (info.channels != 1 || (info.width != 1 && info.width != 2))
+	{
+		fseek (f, base, SEEK_SET);
+		return NULL;		// the whole load prints why
+	}
+
+	if (info.format == WAV_IMAADPCM)
+	{
+		rawsize = info.blockalign;
+		blocksize = info.blocksamples;
+	}
+	else
+	{
+		rawsize = STREAM_BLOCK * info.width;
+		blocksize = STREAM_BLOCK;
+	}
+
+	st = malloc (sizeof(*st) + (STREAM_RING + STREAM_GUARD + blocksize) * sizeof(short) + rawsize);
+	if (!st)
+	{
+		fseek (f, base, SEEK_SET);
+		return NULL;
+	}
+	memset (st, 0, sizeof(*st));
+
+	st->sfx = s;
+	st->info = info;
+	st->file = f;
+	st->fileofs = base + dataofs;
+	st->ring = (short *)(st + 1);
+	st->block = st->ring + STREAM_RING + STREAM_GUARD;
+	st->raw = (byte *)(st->block + blocksize);
+
+// the decoder only looks at streams below snd_numstreams
+	s->stream = st;
+	snd_streams[snd_numstreams] = st;
+	snd_numstreams++;
+
+	S_StartStreams ();
+
+	return S_StreamCache (s);
+}
+
+/*
+================
+S_StreamCache
+
+A streamed sound's cache entry is only the header, lengths in output
+samples as usual
+================
+*/
+sfxcache_t *S_StreamCache (sfx_t *s)
+{
+	sndstream_t	*st;
+	sfxcache_t	*sc;
+	float		stepscale;
+
+	st = s->stream;
+	st->lastused = realtime;
+
+// filled in before a mixer thread's Cache_Check can see it
+	Cache_Lock ();
+
+	sc = Cache_Alloc (&s->cache, sizeof(sfxcache_t), s->name);
+	if (!sc)
+	{
+		Cache_Unlock ();
+		return NULL;
+	}
+
+	stepscale = (float)st->info.rate / shm->speed;
+	sc->length = st->info.samples / stepscale;
+	sc->loopstart = st->info.loopstart;
+	if (sc->loopstart != -1)
+		sc->loopstart = sc->loopstart / stepscale;
+	sc->speed = st->info.rate;
+	sc->width = 2;
+	sc->stereo = 0;
+
+	Cache_Unlock ();
+
+	return sc;
+}
+
+/*
+===============================================================================
+
+DECODER
+
+===============================================================================
+*/
+
+/*
+================
+S_StreamSeek
+
+Moves the file to a file sample
+================
+*/
+static void S_StreamSeek (sndstream_t *st, int filepos)
+{
+	st->blockpos = st->blocklen = 0;
+	st->skip = 0;
+	st->ended = false;
+
+	if (filepos >= st->info.samples)
+	{
+		st->filepos = st->info.samples;
+		return;
+	}
+
+	if (st->info.format == WAV_IMAADPCM)
+	{
+	// blocks can only be decoded from their start
+		st->skip = filepos % st->info.blocksamples;
+		filepos -= st->skip;
+		fseek (st->file, st->fileofs + (filepos / st->info.blocksamples) * st->info.blockalign, SEEK_SET);
+	}
+	else
+		fseek (st->file, st->fileofs + filepos * st->info.width, SEEK_SET);
+
+	st->filepos = filepos;
+}
+
+/*
+================
+S_StreamReadBlock
+
+Reads and decodes the next block of the file
+================
+*/
+static qboolean S_StreamReadBlock (sndstream_t *st)
+{
+	int		i, n, len;
+
+	if (st->filepos >= st->info.samples)
+		return false;
+
+	if (st->info.format == WAV_IMAADPCM)
+	{
+		len = fread (st->raw, 1, st->info.blockalign, st->file);
+		n = S_DecodeADPCM (st->raw, len, st->block);
+	}
+	else
+	{
+		n = st->info.samples - st->filepos;
+		if (n > STREAM_BLOCK)
+			n = STREAM_BLOCK;
+		n = fread (st->raw, st->info.width, n, st->file);
+
+		if (st->info.width == 2)
+		{
+			for (i=0 ; i<n ; i++)
+				st->block[i] = LittleShort (((short *)st->raw)[i]);
+		}
+		else
+		{
+			for (i=0 ; i<n ; i++)
+				st->block[i] = ((int)st->raw[i] - 128) << 8;
+		}
+	}
+
+	if (n > st->info.samples - st->filepos)
+		n = st->info.samples - st->filepos;
+	if (n <= 0)
+		return false;		// read error, treated as the end
+
+	st->filepos += n;
+	st->blocklen = n;
+	st->blockpos = st->skip < n ? st->skip : n;
+	st->skip = 0;
+
+	return true;
+}
+
+/*
+================
+S_StreamWrite
+
+Puts samples into the ring at a stream position, zeros if data is NULL.
+The start of the ring is mirrored past its end so a read never wraps.
+================
+*/
+static void S_StreamWrite (sndstream_t *st, int pos, short *data, int count)
+{
+	int		ofs;
+
+	ofs = pos & (STREAM_RING-1);
+	if (data)
+		memcpy (st->ring + ofs, data, count * sizeof(short));
+	else
+		memset (st->ring + ofs, 0, count * sizeof(short));
+
+	if (ofs < STREAM_GUARD)
+	{
+		if (count > STREAM_GUARD - ofs)
+			count = STREAM_GUARD - ofs;
+		memcpy (st->ring + STREAM_RING + ofs, st->ring + ofs, count * sizeof(short));
+	}
+}
+
+/*
+================
+S_StreamFilePos
+
+Where a stream position is in the file, going around the loop
+================
+*/
+static int S_StreamFilePos (sndstream_t *st, int pos)
+{
+	int		loop;
+
+	if (pos < st->info.samples || st->info.loopstart < 0)
+		return pos;
+
+	loop = st->info.samples - st->info.loopstart;
+	if (loop <= 0)
+		return st->info.samples;
+	return st->info.loopstart + (pos - st->info.loopstart) % loop;
+}
+
+/*
+================
+S_FillStream
+================
+*/
+static void S_FillStream (sndstream_t *st)
+{
+	int		serial, pos, limit, n;
+
+	serial = st->seekserial;
+	if (!serial)
+		return;		// never played
+
+	if (serial != st->ringserial)
+	{
+		pos = st->seekpos;
+		S_StreamSeek (st, S_StreamFilePos (st, pos));
+		st->ringstart = pos;
+		st->writepos = pos;
+		st->ringserial = serial;
+	}
+
+// stay far enough ahead of the mixer that it can always read a guard's worth
+	pos = st->writepos;
+	limit = st->readpos + STREAM_RING - STREAM_GUARD;
+	while (pos < limit && st->seekserial == serial)
+	{
+		if (st->blockpos == st->blocklen && !st->ended && !S_StreamReadBlock (st))
+		{
+			if (st->info.loopstart >= 0)
+			{
+				S_StreamSeek (st, st->info.loopstart);
+				if (S_StreamReadBlock (st))
+					continue;
+			}
+			st->ended = true;
+		}
+
+		n = STREAM_RING - (pos & (STREAM_RING-1));
+		if (n > limit - pos)
+			n = limit - pos;
+
+		if (st->ended)
+			S_StreamWrite (st, pos, NULL, n);	// silence past the end
+		else
+		{
+			if (n > st->blocklen - st->blockpos)
+				n = st->blocklen - st->blockpos;
+			S_StreamWrite (st, pos, st->block + st->blockpos, n);
+			st->blockpos += n;
+		}
+
+		pos += n;
+		st->writepos = pos;
+	}
+}
+
+/*
+================
+S_PumpStreams
+================
+*/
+void S_PumpStreams (void)
+{
+	int		i;
+
+	if (snd_streamthread)
+		return;
+
+	for (i=0 ; i<snd_numstreams ; i++)
+		S_FillStream (snd_streams[i]);
+}
+
+/*
+================
+S_StreamThread
+================
+*/
+static void S_StreamThread (void *parm)
+{
+	int		i;
+
+	while (!snd_streamquit)
+	{
+		for (i=0 ; i<snd_numstreams ; i++)
+			S_FillStream (snd_streams[i]);
+
+		Sys_WaitEvent (snd_streamwake, 10);
+	}
+}
+
+/*
+================
+S_WakeStreams
+
+Called by the mixer after it asks for a seek
+================
+*/
+void S_WakeStreams (void)
+{
+	if (snd_streamthread)
+		Sys_SignalEvent (snd_streamwake);
+}
+
+/*
+================
+S_StartStreams
+
+Without a thread the rings are filled from S_Update
+================
+*/
+void S_StartStreams (void)
+{
+	if (snd_streamthread || !snd_numstreams)
+		return;
+
+	if (!snd_streamwake)
+		snd_streamwake = Sys_CreateEvent ();
+
+	snd_streamquit = false;
+	snd_streamthread = Sys_CreateThread (S_StreamThread, NULL);
+}
+
+/*
+================
+S_StopStreams
+================
+*/
+void S_StopStreams (void)
+{
+	if (!snd_streamthread)
+		return;
+
+	snd_streamquit = true;
+	Sys_SignalEvent (snd_streamwake);
+	Sys_WaitThread (snd_streamthread);
+	snd_streamthread = NULL;
+}
@@ -36,6 +36,7 @@ typedef struct sfx_s
 {
 	char 	name[MAX_QPATH];
 	cache_user_t	cache;
+	struct sndstream_s	*stream;	// long sounds are decoded from the file as they play
 } sfx_t;
 
 // !!! if this is changed, it much be changed in asm_i386.h too !!!
@@ -77,18 +78,71 @@ typedef struct
 	vec3_t	origin;			// origin of sound effect
 	vec_t	dist_mult;		// distance multiplier (attenuation/clipK)
 	int		master_vol;		// 0-255 master volume
+	int		priority;		// VOICE_* weight when ranking voices
+	int		mixed;			// false for a virtual voice, only kept in time
+	int		length;			// sfx length, with looping lets a voice loop unread
 } channel_t;
 
+// voice priorities, each level doubles the weight of a voice's volume
+#define	VOICE_STATIC	0
+#define	VOICE_ENTITY	1
+#define	VOICE_VIEW		2
+
+#define	WAV_PCM			1
+#define	WAV_IMAADPCM	0x11
+
 typedef struct
 {
 	int		rate;
-	int		width;
+	int		width;			// once decoded
 	int		channels;
 	int		loopstart;
 	int		samples;
 	int		dataofs;		// chunk starts this many bytes from file start
+	int		format;			// WAV_PCM or WAV_IMAADPCM
+	int		blockalign;		// bytes in an ADPCM block
+	int		blocksamples;	// samples in an ADPCM block
 } wavinfo_t;
 
+// A streamed sound is decoded into a ring by the stream thread as it plays.
+// Positions are stream samples at the sound's own rate, counted as if a
+// looping sound were unrolled, so the ring runs straight over the loop.
+// The ring follows one voice at a time.
+#define	STREAM_RING		65536		// samples, power of two
+#define	STREAM_GUARD	4096		// copy of the ring start past its end, longest read
+
+typedef struct sndstream_s
+{
+	sfx_t		*sfx;
+	wavinfo_t	info;
+	FILE		*file;
+	int			fileofs;		// sample data starts here in the file
+	double		lastused;		// realtime the main thread last asked for the sound
+
+	short		*ring;			// STREAM_RING + STREAM_GUARD samples
+
+// written by the mixer
+	channel_t	*owner;			// voice the ring follows
+	int			chpos;			// owner's pos after its last paint
+	int			painted;		// paintedtime of that paint
+	int			frac;			// 16.16 past readpos
+	volatile int	readpos;	// next stream sample the mixer reads
+	volatile int	seekpos;
+	volatile int	seekserial;
+	int			starved;		// paints that found no data
+
+// written by the decoder
+	volatile int	ringserial;	// seekserial the ring was filled for
+	volatile int	ringstart;	// first stream sample in the ring
+	volatile int	writepos;	// next stream sample to decode
+	int			filepos;		// next file sample to read
+	int			skip;			// samples to drop from the next block after a seek
+	byte		*raw;			// block as read
+	short		*block;			// block decoded
+	int			blockpos, blocklen;
+	qboolean	ended;			// past the end of a sound that doesn't loop
+} sndstream_t;
+
 void S_Init (void);
 void S_Startup (void);
 void S_Shutdown (void);
@@ -96,6 +150,7 @@ void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float
 void S_StaticSound (sfx_t *sfx, vec3_t origin, float vol, float attenuation);
 void S_StopSound (int entnum, int entchannel);
 void S_StopAllSounds(qboolean clear);
+void S_StopDynamicSounds (void);	// leaves ambient and static sounds playing
 void S_ClearBuffer (void);
 void S_Update (vec3_t origin, vec3_t v_forward, vec3_t v_right, vec3_t v_up);
 void S_ExtraUpdate (void);
@@ -127,8 +182,8 @@ void SNDDMA_Shutdown(void);
 // User-setable variables
 // ====================================================================
 
-#define	MAX_CHANNELS			128
-#define	MAX_DYNAMIC_CHANNELS	8
+#define	MAX_CHANNELS			512		// voices, snd_voices of them are mixed
+#define	MAX_DYNAMIC_CHANNELS	128
 
 
 extern	channel_t   channels[MAX_CHANNELS];
@@ -156,6 +211,9 @@ extern volatile dma_t sn;
 extern vec_t sound_nominal_clip_dist;
 
 extern	cvar_t loadas8bit;
+extern	cvar_t snd_mixsimd;
+extern	cvar_t snd_voices;
+extern	cvar_t snd_streamsize;
 extern	cvar_t bgmvolume;
 extern	cvar_t bgmtype; // jkrige - fmod sound system (music)
 extern	cvar_t volume;
@@ -166,10 +224,28 @@ extern int		snd_blocked;
 
 void S_LocalSound (char *s);
 sfxcache_t *S_LoadSound (sfx_t *s);
+sfxcache_t *S_MixerSound (sfx_t *s);
+void S_DeviceLost (char *reason);
 
 wavinfo_t GetWavinfo (char *name, byte *wav, int wavlength);
+int S_DecodeADPCM (byte *in, int len, short *out);
+
+// snd_stream.c
+extern	volatile int	snd_numstreams;
+extern	sndstream_t	*snd_streams[];
+sfxcache_t *S_OpenStream (sfx_t *s, FILE *f, int filelen);
+sfxcache_t *S_StreamCache (sfx_t *s);
+void S_StartStreams (void);
+void S_StopStreams (void);
+void S_PumpStreams (void);		// fills the rings from the main loop without a stream thread
+void S_WakeStreams (void);
+void SND_PaintStream (channel_t *ch, sfxcache_t *sc, int offset, int count, int outrate);
+
+extern	int		snd_loadcount;
+extern	double	snd_loadtime;
 
 void SND_InitScaletable (void);
+void SND_MixBench_f (void);
 void SNDDMA_Submit(void);
 
 void S_AmbientOff (void);
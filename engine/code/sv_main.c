@@ -383,6 +383,7 @@ crosses a waterline.
 
 int		fatbytes;
 byte	fatpvs[MAX_MAP_LEAFS/8];
+static byte	fatleafpvs[MAX_MAP_LEAFS/8];	// the server thread's, not the render's
 
 void SV_AddToFatPVS (vec3_t org, mnode_t *node)
 {
@@ -398,7 +399,7 @@ void SV_AddToFatPVS (vec3_t org, mnode_t *node)
 		{
 			if (node->contents != CONTENTS_SOLID)
 			{
-				pvs = Mod_LeafPVS ( (mleaf_t *)node, sv.worldmodel);
+				pvs = Mod_LeafPVS ( (mleaf_t *)node, sv.worldmodel, fatleafpvs);
 				for (i=0 ; i<fatbytes ; i++)
 					fatpvs[i] |= pvs[i];
 			}
@@ -1069,6 +1070,7 @@ void SV_SpawnServer (char *server)
 {
 	edict_t		*ent;
 	int			i;
+	int			oldbudget;
 
 	// let's not have any servers with no name
 	if (hostname.string[0] == 0)
@@ -1076,6 +1078,7 @@ void SV_SpawnServer (char *server)
 	scr_centertime_off = 0;
 
 	Con_DPrintf ("SpawnServer: %s\n",server);
+	oldbudget = Hunk_SetBudget (hb_server);
 	svs.changelevel_issued = false;		// now safe to issue another
 
 //
@@ -1152,6 +1155,7 @@ void SV_SpawnServer (char *server)
 	{
 		Con_Printf ("Couldn't spawn server %s\n", sv.modelname);
 		sv.active = false;
+		Hunk_SetBudget (oldbudget);
 		return;
 	}
 
@@ -1160,6 +1164,7 @@ void SV_SpawnServer (char *server)
 	{
 		Con_Printf ("Couldn't spawn server %s\n", sv.modelname);
 		sv.active = false;
+		Hunk_SetBudget (oldbudget);
 		//total_loading_size = 0;
 		//loading_stage = 0;
 		return;
@@ -1227,6 +1232,7 @@ void SV_SpawnServer (char *server)
 		if (host_client->active)
 			SV_SendServerinfo (host_client);
 	
+	Hunk_SetBudget (oldbudget);
 	Con_DPrintf ("Server spawned.\n");
 }
 
@@ -1927,6 +1927,8 @@ void SV_Physics (void)
 	int		i;
 	edict_t	*ent;
 
+	PROF_BEGIN ("SV_Physics");
+
 // let the progs know that a new frame has started
 	pr_global_struct->self = EDICT_TO_PROG(sv.edicts);
 	pr_global_struct->other = EDICT_TO_PROG(sv.edicts);
@@ -1979,6 +1981,8 @@ void SV_Physics (void)
 		pr_global_struct->force_retouch--;	
 
 	sv.time += host_frametime;
+
+	PROF_END ();
 }
 
 
@@ -50,6 +50,9 @@ int Sys_FileWrite (int handle, void *data, int count);
 int	Sys_FileTime (char *path);
 void Sys_mkdir (char *path);
 
+// read only view of a whole file, kept until exit; NULL if it can't be mapped
+void *Sys_MapFile (char *path, int *length);
+
 //
 // memory protection
 //
@@ -70,6 +73,10 @@ void Sys_Quit (void);
 
 double Sys_FloatTime (void);
 
+double Sys_PreciseTime (void);
+// high resolution seconds from an arbitrary base, safe on any thread;
+// only for measuring intervals
+
 char *Sys_ConsoleInput (void);
 
 void Sys_Sleep (void);
@@ -82,6 +89,30 @@ void Sys_Sleep (void);
 void Sys_SendKeyEvents (void);
 // Perform Key_Event () callbacks until the input que is empty
 
+//
+// threads
+//
+// Sys_CreateThread returns NULL when the work can't be given its own thread;
+// callers must then do it inline.  The mutex and event calls accept NULL
+// handles so that fallback path needs no special casing.
+typedef void	*sys_thread_t;
+typedef void	*sys_mutex_t;
+typedef void	*sys_event_t;
+
+sys_thread_t Sys_CreateThread (void (*func) (void *parm), void *parm);
+void Sys_WaitThread (sys_thread_t thread);	// joins and releases the thread
+int Sys_NumProcessors (void);
+
+sys_mutex_t Sys_CreateMutex (void);		// recursive
+void Sys_DestroyMutex (sys_mutex_t mutex);
+void Sys_LockMutex (sys_mutex_t mutex);
+void Sys_UnlockMutex (sys_mutex_t mutex);
+
+sys_event_t Sys_CreateEvent (void);			// auto-reset, starts unsignaled
+void Sys_DestroyEvent (sys_event_t event);
+void Sys_SignalEvent (sys_event_t event);
+void Sys_WaitEvent (sys_event_t event, int msec);	// msec < 0 waits forever
+
 void Sys_LowFPPrecision (void);
 void Sys_HighFPPrecision (void);
 void Sys_SetFPCW (void);
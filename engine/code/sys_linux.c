@@ -126,7 +126,7 @@ void Sys_Quit (void)
 		printf("%s", end1);
 #endif
 	fflush(stdout);
-	exit(0);
+	exit(host_exitcode);
 }
 
 void Sys_Init(void)
@@ -135,6 +135,11 @@ void Sys_mkdir (char *path)
 {
 }
 
+void *Sys_MapFile (char *path, int *length)
+{
+	return NULL;
+}
+
 
 /*
 ===============================================================================
@@ -173,7 +178,7 @@ void Sys_Printf (char *fmt, ...)
 
 void Sys_Quit (void)
 {
-	exit (0);
+	exit (host_exitcode);
 }
 
 double Sys_FloatTime (void)
@@ -185,6 +190,11 @@ double Sys_FloatTime (void)
 	return t;
 }
 
+double Sys_PreciseTime (void)
+{
+	return Sys_FloatTime ();
+}
+
 char *Sys_ConsoleInput (void)
 {
 	return NULL;
@@ -198,6 +208,55 @@ void Sys_SendKeyEvents (void)
 {
 }
 
+// no threads on this platform, everything runs inline
+sys_thread_t Sys_CreateThread (void (*func) (void *parm), void *parm)
+{
+	return NULL;
+}
+
+void Sys_WaitThread (sys_thread_t thread)
+{
+}
+
+int Sys_NumProcessors (void)
+{
+	return 1;
+}
+
+sys_mutex_t Sys_CreateMutex (void)
+{
+	return NULL;
+}
+
+void Sys_DestroyMutex (sys_mutex_t mutex)
+{
+}
+
+void Sys_LockMutex (sys_mutex_t mutex)
+{
+}
+
+void Sys_UnlockMutex (sys_mutex_t mutex)
+{
+}
+
+sys_event_t Sys_CreateEvent (void)
+{
+	return NULL;
+}
+
+void Sys_DestroyEvent (sys_event_t event)
+{
+}
+
+void Sys_SignalEvent (sys_event_t event)
+{
+}
+
+void Sys_WaitEvent (sys_event_t event, int msec)
+{
+}
+
 void Sys_HighFPPrecision (void)
 {
 }
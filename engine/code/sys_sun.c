@@ -243,7 +243,7 @@ void Sys_Printf (char *fmt, ...)
 void Sys_Quit (void)
 {
     Host_Shutdown();
-    exit (0);
+    exit (host_exitcode);
 }
 
 double Sys_FloatTime (void)
@@ -42,6 +42,7 @@ qboolean	WinNT;
 static double		pfreq;
 static double		curtime = 0.0;
 static double		lastcurtime = 0.0;
+static sys_mutex_t	floattime_mutex;	// the server thread reads the clock too
 static int			lowshift;
 qboolean			isDedicated;
 static qboolean		sc_return_on_enter = false;
@@ -347,6 +348,36 @@ void Sys_mkdir (char *path)
 	_mkdir (path);
 }
 
+/*
+================
+Sys_MapFile
+================
+*/
+void *Sys_MapFile (char *path, int *length)
+{
+	HANDLE	file, mapping;
+	DWORD	size;
+	void	*base;
+
+	file = CreateFile (path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	size = GetFileSize (file, NULL);
+	mapping = CreateFileMapping (file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle (file);		// the mapping keeps the file open
+	if (!mapping)
+		return NULL;
+
+	base = MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle (mapping);	// and the view keeps the mapping
+	if (!base)
+		return NULL;
+
+	*length = size;
+	return base;
+}
+
 
 /*
 ===============================================================================
@@ -555,7 +586,7 @@ void Sys_Quit (void)
 // shut down QHOST hooks if necessary
 	DeinitConProc ();
 
-	exit (0);
+	exit (host_exitcode);
 }
 
 
@@ -571,8 +602,9 @@ double Sys_FloatTime (void)
 	static int			first = 1;
 	LARGE_INTEGER		PerformanceCount;
 	unsigned int		temp, t2;
-	double				time;
+	double				time, now;
 
+	Sys_LockMutex (floattime_mutex);	// the saved control word is shared too
 	Sys_PushFPCW_SetHigh ();
 
 	QueryPerformanceCounter (&PerformanceCount);
@@ -619,10 +651,34 @@ double Sys_FloatTime (void)
 			lastcurtime = curtime;
 		}
 	}
+	now = curtime;
 
 	Sys_PopFPCW ();
+	Sys_UnlockMutex (floattime_mutex);
+
+    return now;
+}
+
+
+/*
+================
+Sys_PreciseTime
+================
+*/
+double Sys_PreciseTime (void)
+{
+	static double		scale;
+	LARGE_INTEGER		count;
+
+	if (!scale)
+	{
+		QueryPerformanceFrequency (&count);
+		scale = 1.0 / (double)count.QuadPart;
+	}
 
-    return curtime;
+	QueryPerformanceCounter (&count);
+
+	return (double)count.QuadPart * scale;
 }
 
 
@@ -635,6 +691,7 @@ void Sys_InitFloatTime (void)
 {
 	int		j;
 
+	floattime_mutex = Sys_CreateMutex ();
 	Sys_FloatTime ();
 
 	j = COM_CheckParm("-starttime");
@@ -756,6 +813,144 @@ void Sys_SendKeyEvents (void)
 }
 
 
+/*
+===============================================================================
+
+THREADS
+
+===============================================================================
+*/
+
+typedef struct
+{
+	void	(*func) (void *parm);
+	void	*parm;
+} sys_threadstart_t;
+
+static DWORD WINAPI Sys_ThreadProc (LPVOID lpParameter)
+{
+	sys_threadstart_t	start;
+
+	start = *(sys_threadstart_t *)lpParameter;
+	free (lpParameter);
+
+	start.func (start.parm);
+
+	return 0;
+}
+
+/*
+================
+Sys_CreateThread
+================
+*/
+sys_thread_t Sys_CreateThread (void (*func) (void *parm), void *parm)
+{
+	sys_threadstart_t	*start;
+	HANDLE				thread;
+	DWORD				threadid;
+
+	start = malloc (sizeof(*start));
+	if (!start)
+		return NULL;
+	start->func = func;
+	start->parm = parm;
+
+	thread = CreateThread (NULL, 0, Sys_ThreadProc, start, 0, &threadid);
+	if (!thread)
+	{
+		free (start);
+		return NULL;
+	}
+
+	return (sys_thread_t)thread;
+}
+
+/*
+================
+Sys_WaitThread
+================
+*/
+void Sys_WaitThread (sys_thread_t thread)
+{
+	if (!thread)
+		return;
+
+	WaitForSingleObject ((HANDLE)thread, INFINITE);
+	CloseHandle ((HANDLE)thread);
+}
+
+/*
+================
+Sys_NumProcessors
+================
+*/
+int Sys_NumProcessors (void)
+{
+	SYSTEM_INFO	info;
+
+	GetSystemInfo (&info);
+	if (info.dwNumberOfProcessors < 1)
+		return 1;
+	return info.dwNumberOfProcessors;
+}
+
+sys_mutex_t Sys_CreateMutex (void)
+{
+	CRITICAL_SECTION	*cs;
+
+	cs = malloc (sizeof(*cs));
+	if (cs)
+		InitializeCriticalSection (cs);
+
+	return (sys_mutex_t)cs;
+}
+
+void Sys_DestroyMutex (sys_mutex_t mutex)
+{
+	if (!mutex)
+		return;
+
+	DeleteCriticalSection ((CRITICAL_SECTION *)mutex);
+	free (mutex);
+}
+
+void Sys_LockMutex (sys_mutex_t mutex)
+{
+	if (mutex)
+		EnterCriticalSection ((CRITICAL_SECTION *)mutex);
+}
+
+void Sys_UnlockMutex (sys_mutex_t mutex)
+{
+	if (mutex)
+		LeaveCriticalSection ((CRITICAL_SECTION *)mutex);
+}
+
+sys_event_t Sys_CreateEvent (void)
+{
+	return (sys_event_t)CreateEvent (NULL, FALSE, FALSE, NULL);
+}
+
+void Sys_DestroyEvent (sys_event_t event)
+{
+	if (event)
+		CloseHandle ((HANDLE)event);
+}
+
+void Sys_SignalEvent (sys_event_t event)
+{
+	if (event)
+		SetEvent ((HANDLE)event);
+}
+
+void Sys_WaitEvent (sys_event_t event, int msec)
+{
+	if (event)
+		WaitForSingleObject ((HANDLE)event, (msec < 0) ? INFINITE : msec);
+}
+
+
 /*
 ==============================================================================
 
@@ -852,7 +1047,7 @@ int WINAPI WinMain (HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLin
 
 	isDedicated = (COM_CheckParm ("-dedicated") != 0);
 
-	if (!isDedicated)
+	if (!isDedicated && !COM_CheckParm ("-headless"))
 	{
 		hwnd_dialog = CreateDialog(hInstance, MAKEINTRESOURCE(IDD_DIALOG1), NULL, NULL);
 
@@ -889,6 +1084,10 @@ int WINAPI WinMain (HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLin
 	if (parms.memsize > MAXIMUM_WIN_MEMORY)
 		parms.memsize = MAXIMUM_WIN_MEMORY;
 
+// the hunk grows as needed, so a dedicated server starts small
+	if (isDedicated)
+		parms.memsize = MINIMUM_MEMORY_LEVELPAK;
+
 	if (COM_CheckParm ("-heapsize"))
 	{
 		t = COM_CheckParm("-heapsize") + 1;
@@ -974,7 +1173,7 @@ int WINAPI WinMain (HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLin
 				SleepUntilInput (PAUSE_SLEEP);
 				scr_skipupdate = 1;		// no point in bothering to draw
 			}
-			else if (!ActiveApp && !DDActive)
+			else if (!ActiveApp && !DDActive && !host_headless)
 			{
 				SleepUntilInput (NOT_FOCUS_SLEEP);
 			}
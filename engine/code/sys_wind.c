@@ -183,7 +183,7 @@ void Sys_Printf (char *fmt, ...)
 
 void Sys_Quit (void)
 {
-	exit (0);
+	exit (host_exitcode);
 }
 
 double Sys_FloatTime (void)
@@ -4319,3 +4319,240 @@ void  zcfree (voidp opaque, voidp ptr)
 }
 
 
+
+
+/*
+=============================================================================
+
+BUFFER COMPRESSION
+
+Whole-buffer helpers for engine data that is stored zlib compressed
+(packed demos and the like).  Only the inflate half of zlib is carried
+here, so the compressor is a small LZ77 coder that emits a single block
+with the fixed huffman tables; any inflater can read its output.
+=============================================================================
+*/
+
+#define ZIP_WSIZE		0x8000			// deflate window
+#define ZIP_WMASK		(ZIP_WSIZE - 1)
+#define ZIP_HASHBITS	14
+#define ZIP_HASHSIZE	(1 << ZIP_HASHBITS)
+#define ZIP_MINMATCH	3
+#define ZIP_MAXMATCH	258
+#define ZIP_MAXCHAIN	48				// longest hash chain followed per position
+
+typedef struct
+{
+	byte	*out;
+	int		outsize;
+	int		outpos;
+	uLong	bitbuf;
+	int		bitcount;
+	int		overflowed;
+} zipbits_t;
+
+static const int zip_lengthbase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const int zip_lengthextra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const int zip_distbase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const int zip_distextra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+static void Zip_PutBits (zipbits_t *z, uLong value, int count)
+{
+	z->bitbuf |= value << z->bitcount;
+	z->bitcount += count;
+
+	while (z->bitcount >= 8)
+	{
+		if (z->outpos < z->outsize)
+			z->out[z->outpos++] = (byte)(z->bitbuf & 255);
+		else
+			z->overflowed = 1;
+		z->bitbuf >>= 8;
+		z->bitcount -= 8;
+	}
+}
+
+// huffman codes go out most significant bit first
+static void Zip_PutCode (zipbits_t *z, int code, int length)
+{
+	int		i, rev;
+
+	rev = 0;
+	for (i=0 ; i<length ; i++)
+	{
+		rev = (rev << 1) | (code & 1);
+		code >>= 1;
+	}
+	Zip_PutBits (z, rev, length);
+}
+
+static void Zip_PutLiteral (zipbits_t *z, int c)
+{
+	if (c < 144)
+		Zip_PutCode (z, 0x30 + c, 8);
+	else if (c < 256)
+		Zip_PutCode (z, 0x190 + c - 144, 9);
+	else if (c < 280)
+		Zip_PutCode (z, c - 256, 7);
+	else
+		Zip_PutCode (z, 0xc0 + c - 280, 8);
+}
+
+static void Zip_PutMatch (zipbits_t *z, int length, int dist)
+{
+	int		i;
+
+	for (i=28 ; zip_lengthbase[i] > length ; i--)
+		;
+	Zip_PutLiteral (z, 257 + i);
+	Zip_PutBits (z, length - zip_lengthbase[i], zip_lengthextra[i]);
+
+	for (i=29 ; zip_distbase[i] > dist ; i--)
+		;
+	Zip_PutCode (z, i, 5);
+	Zip_PutBits (z, dist - zip_distbase[i], zip_distextra[i]);
+}
+
+/*
+================
+Zip_Deflate
+
+Compresses inlen bytes into a zlib stream.  Returns the compressed length,
+or -1 if it would not fit in outsize (store the data raw instead).
+Safe to call from any thread.
+================
+*/
+int Zip_Deflate (byte *in, int inlen, byte *out, int outsize)
+{
+	zipbits_t	z;
+	int			*head, *prev;
+	int			pos, hash, cand, chain, len, bestlen, bestdist;
+	uLong		adler;
+
+	if (outsize < 6)
+		return -1;
+
+	head = malloc (ZIP_HASHSIZE * sizeof(int));
+	prev = malloc (ZIP_WSIZE * sizeof(int));
+	if (!head || !prev)
+	{
+		free (head);
+		free (prev);
+		return -1;
+	}
+	memset (head, -1, ZIP_HASHSIZE * sizeof(int));
+
+	memset (&z, 0, sizeof(z));
+	z.out = out;
+	z.outsize = outsize - 4;	// leave room for the adler32
+
+	Zip_PutBits (&z, 0x78, 8);	// 32k window, deflate
+	Zip_PutBits (&z, 0x01, 8);
+	Zip_PutBits (&z, 1, 1);		// final block
+	Zip_PutBits (&z, 1, 2);		// fixed huffman codes
+
+	pos = 0;
+	while (pos < inlen && !z.overflowed)
+	{
+		bestlen = 0;
+		bestdist = 0;
+
+		if (pos + ZIP_MINMATCH <= inlen)
+		{
+			hash = ((in[pos] << 8) ^ (in[pos+1] << 4) ^ in[pos+2]) & (ZIP_HASHSIZE - 1);
+			cand = head[hash];
+
+			for (chain = 0 ; cand >= 0 && pos - cand < ZIP_WSIZE && chain < ZIP_MAXCHAIN ; chain++)
+			{
+				for (len=0 ; len < ZIP_MAXMATCH && pos + len < inlen && in[cand+len] == in[pos+len] ; len++)
+					;
+				if (len > bestlen)
+				{
+					bestlen = len;
+					bestdist = pos - cand;
+					if (len == ZIP_MAXMATCH)
+						break;
+				}
+				cand = prev[cand & ZIP_WMASK];
+			}
+
+			prev[pos & ZIP_WMASK] = head[hash];
+			head[hash] = pos;
+		}
+
+		if (bestlen < ZIP_MINMATCH)
+		{
+			Zip_PutLiteral (&z, in[pos]);
+			pos++;
+			continue;
+		}
+
+		Zip_PutMatch (&z, bestlen, bestdist);
+
+	// hash the rest of the match so later strings can refer back into it
+		for (len=1, pos++ ; len < bestlen ; len++, pos++)
+		{
+			if (pos + ZIP_MINMATCH > inlen)
+				continue;
+			hash = ((in[pos] << 8) ^ (in[pos+1] << 4) ^ in[pos+2]) & (ZIP_HASHSIZE - 1);
+			prev[pos & ZIP_WMASK] = head[hash];
+			head[hash] = pos;
+		}
+	}
+
+	free (head);
+	free (prev);
+
+	Zip_PutLiteral (&z, 256);	// end of block
+	Zip_PutBits (&z, 0, 7);		// flush to a byte boundary
+
+	if (z.overflowed)
+		return -1;
+
+	adler = adler32 (adler32 (0, Z_NULL, 0), in, inlen);
+	out[z.outpos++] = (byte)(adler >> 24);
+	out[z.outpos++] = (byte)(adler >> 16);
+	out[z.outpos++] = (byte)(adler >> 8);
+	out[z.outpos++] = (byte)adler;
+
+	return z.outpos;
+}
+
+/*
+================
+Zip_Inflate
+
+Expands a zlib stream into out.  Returns the expanded length, or -1 if the
+data is corrupt or larger than outsize.  Safe to call from any thread.
+================
+*/
+int Zip_Inflate (byte *in, int inlen, byte *out, int outsize)
+{
+	z_stream	stream;
+	int			err;
+
+	memset (&stream, 0, sizeof(stream));
+	if (inflateInit2 (&stream, MAX_WBITS) != Z_OK)
+		return -1;
+
+	stream.next_in = in;
+	stream.avail_in = inlen;
+	stream.next_out = out;
+	stream.avail_out = outsize;
+
+	err = inflate (&stream, Z_FINISH);
+	inflateEnd (&stream);
+
+	if (err != Z_STREAM_END)
+		return -1;
+
+	return stream.total_out;
+}
@@ -334,3 +334,7 @@ extern int unzGetLocalExtrafield (unzFile file, void* buf, unsigned len);
   the return value is the number of unsigned chars copied in buf, or (if <0) 
 	the error code
 */
+
+// whole-buffer zlib streams, see the end of unzip.c
+int Zip_Deflate (byte *in, int inlen, byte *out, int outsize);
+int Zip_Inflate (byte *in, int inlen, byte *out, int outsize);
@@ -24,15 +24,17 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define	DYNAMIC_SIZE	0xc000
 
 #define	ZONEID	0x1d4a11
+#define	ZONEBIGID	0x1d4a12	// malloced when the zone was full
+#define	SLABID	0x1d4a13
 #define MINFRAGMENT	64
 
 typedef struct memblock_s
 {
 	int		size;           // including the header and possibly tiny fragments
 	int     tag;            // a tag of 0 is a free block
-	int     id;        		// should be ZONEID
 	struct memblock_s       *next, *prev;
 	int		pad;			// pad to 64 bit boundary
+	int     id;        		// should be ZONEID, right before the data
 } memblock_t;
 
 typedef struct
@@ -44,6 +46,7 @@ typedef struct
 
 void Cache_FreeLow (int new_low_hunk);
 void Cache_FreeHigh (int new_high_hunk);
+static void Cache_Stats (void);
 
 
 /*
@@ -51,6 +54,14 @@ void Cache_FreeHigh (int new_high_hunk);
 
 						ZONE MEMORY ALLOCATION
 
+Small allocations come out of slabs: pages cut into equal slots of a power
+of two size, one free list per page.  Allocating pops the first page with a
+free slot, freeing pushes the slot back, both without a search.  Anything
+bigger than the largest class goes to the zone proper below.
+
+Slab pages are themselves zone blocks.  When the zone is full, pages and
+big blocks are malloced instead of failing.
+
 There is never any space between memblocks, and there will never be two
 contiguous free memblocks.
 
@@ -61,8 +72,50 @@ all big things are allocated on the hunk.
 ==============================================================================
 */
 
+#define	SLAB_PAGESIZE	4096
+#define	SLAB_MINSHIFT	4			// 16 byte slots
+#define	NUM_SLABCLASSES	7			// up to 1024 byte slots
+#define	SLABTAG			0x51ab		// zone tag of a slab page
+
+typedef struct
+{
+	unsigned short	offset;		// bytes back to the slabpage_t
+	unsigned short	tag;		// 0 while free
+	int				id;			// SLABID, at the same place as memblock_t id
+} slabslot_t;
+
+typedef struct slabpage_s
+{
+	int			id;				// SLABID
+	int			sizeclass;
+	int			used;
+	int			count;			// slots in the page
+	slabslot_t	*freelist;		// next pointer is kept in the slot data
+	qboolean	malloced;
+	struct slabpage_s	*next, *prev;
+	int			pad[2];
+} slabpage_t;
+
+typedef struct
+{
+	int			size;			// slot size, including the slabslot_t
+	slabpage_t	*partial;		// pages with free slots
+	slabpage_t	*full;
+	slabpage_t	*spare;			// one empty page kept to stop thrashing
+
+	int			pages;
+	int			live, peak;		// slots in use
+	double		requested;		// bytes asked for by every alloc, for waste
+	int			allocs, frees;
+} slabclass_t;
+
 memzone_t	*mainzone;
 
+static slabclass_t	slab_classes[NUM_SLABCLASSES];
+static memblock_t	z_bigblocks;			// malloced fallback blocks
+static int			z_bigbytes;
+static int			z_mallocedpages;
+
 void Z_ClearZone (memzone_t *zone, int size);
 
 
@@ -74,7 +127,8 @@ Z_ClearZone
 void Z_ClearZone (memzone_t *zone, int size)
 {
 	memblock_t	*block;
-	
+	int			i;
+
 // set the entire zone to one free block
 
 	zone->blocklist.next = zone->blocklist.prev = block =
@@ -83,34 +137,47 @@ void Z_ClearZone (memzone_t *zone, int size)
 	zone->blocklist.id = 0;
 	zone->blocklist.size = 0;
 	zone->rover = block;
-	
+
 	block->prev = block->next = &zone->blocklist;
 	block->tag = 0;			// free block
 	block->id = ZONEID;
 	block->size = size - sizeof(memzone_t);
+	zone->size = size;
+
+	for (i=0 ; i<NUM_SLABCLASSES ; i++)
+	{
+		memset (&slab_classes[i], 0, sizeof(slab_classes[i]));
+		slab_classes[i].size = 1 << (SLAB_MINSHIFT + i);
+	}
+	z_bigblocks.next = z_bigblocks.prev = &z_bigblocks;
 }
 
 
 /*
 ========================
-Z_Free
+Z_FreeBlock
 ========================
 */
-void Z_Free (void *ptr)
+static void Z_FreeBlock (memblock_t *block)
 {
-	memblock_t	*block, *other;
-	
-	if (!ptr)
-		Sys_Error ("Z_Free: NULL pointer");
+	memblock_t	*other;
+
+	if (block->id == ZONEBIGID)
+	{
+		block->prev->next = block->next;
+		block->next->prev = block->prev;
+		z_bigbytes -= block->size;
+		free (block);
+		return;
+	}
 
-	block = (memblock_t *) ( (byte *)ptr - sizeof(memblock_t));
 	if (block->id != ZONEID)
 		Sys_Error ("Z_Free: freed a pointer without ZONEID");
 	if (block->tag == 0)
 		Sys_Error ("Z_Free: freed a freed pointer");
 
 	block->tag = 0;		// mark as free
-	
+
 	other = block->prev;
 	if (!other->tag)
 	{	// merge with previous free block
@@ -121,7 +188,7 @@ void Z_Free (void *ptr)
 			mainzone->rover = other;
 		block = other;
 	}
-	
+
 	other = block->next;
 	if (!other->tag)
 	{	// merge the next free block onto the end
@@ -133,33 +200,18 @@ void Z_Free (void *ptr)
 	}
 }
 
-
 /*
 ========================
-Z_Malloc
+Z_AllocBlock
+
+First fit in the zone, NULL if it is full
 ========================
 */
-void *Z_Malloc (int size)
-{
-	void	*buf;
-	
-Z_CheckHeap ();	// DEBUG
-	buf = Z_TagMalloc (size, 1);
-	if (!buf)
-		Sys_Error ("Z_Malloc: failed on allocation of %i bytes",size);
-	Q_memset (buf, 0, size);
-
-	return buf;
-}
-
-void *Z_TagMalloc (int size, int tag)
+static memblock_t *Z_AllocBlock (int size, int tag)
 {
 	int		extra;
 	memblock_t	*start, *rover, *new, *base;
 
-	if (!tag)
-		Sys_Error ("Z_TagMalloc: tried to use a 0 tag");
-
 //
 // scan through the block list looking for the first free block
 // of sufficient size
@@ -167,10 +219,10 @@ void *Z_TagMalloc (int size, int tag)
 	size += sizeof(memblock_t);	// account for size of block header
 	size += 4;					// space for memory trash tester
 	size = (size + 7) & ~7;		// align to 8-byte boundary
-	
+
 	base = rover = mainzone->rover;
 	start = base->prev;
-	
+
 	do
 	{
 		if (rover == start)	// scaned all the way around the list
@@ -180,7 +232,7 @@ void *Z_TagMalloc (int size, int tag)
 		else
 			rover = rover->next;
 	} while (base->tag || base->size < size);
-	
+
 //
 // found a block big enough
 //
@@ -197,17 +249,268 @@ void *Z_TagMalloc (int size, int tag)
 		base->next = new;
 		base->size = size;
 	}
-	
+
 	base->tag = tag;				// no longer a free block
-	
+
 	mainzone->rover = base->next;	// next allocation will start looking here
-	
+
 	base->id = ZONEID;
 
 // marker for memory trash testing
 	*(int *)((byte *)base + base->size - 4) = ZONEID;
 
-	return (void *) ((byte *)base + sizeof(memblock_t));
+	return base;
+}
+
+/*
+========================
+Z_BigAlloc
+
+A block from the zone, or from malloc when the zone is full
+========================
+*/
+static void *Z_BigAlloc (int size, int tag)
+{
+	memblock_t	*block;
+
+	block = Z_AllocBlock (size, tag);
+	if (block)
+		return (void *)(block + 1);
+
+	block = malloc (sizeof(memblock_t) + size);
+	if (!block)
+		return NULL;
+	block->size = sizeof(memblock_t) + size;
+	block->tag = tag;
+	block->id = ZONEBIGID;
+	block->next = z_bigblocks.next;
+	block->prev = &z_bigblocks;
+	block->next->prev = block;
+	z_bigblocks.next = block;
+	z_bigbytes += block->size;
+
+	return (void *)(block + 1);
+}
+
+/*
+========================
+Z_NewSlabPage
+========================
+*/
+static slabpage_t *Z_NewSlabPage (slabclass_t *sc, int sizeclass)
+{
+	slabpage_t	*page;
+	slabslot_t	*slot, **link;
+	int			i;
+
+	if (sc->spare)
+	{
+		page = sc->spare;
+		sc->spare = NULL;
+	}
+	else
+	{
+		page = Z_BigAlloc (SLAB_PAGESIZE, SLABTAG);
+		if (!page)
+			return NULL;
+		page->malloced = (((memblock_t *)page - 1)->id == ZONEBIGID);
+		if (page->malloced)
+			z_mallocedpages++;
+
+		page->id = SLABID;
+		page->sizeclass = sizeclass;
+		page->used = 0;
+		page->count = (SLAB_PAGESIZE - sizeof(slabpage_t)) / sc->size;
+
+	// thread every slot onto the free list
+		link = &page->freelist;
+		slot = (slabslot_t *)(page + 1);
+		for (i=0 ; i<page->count ; i++)
+		{
+			slot->offset = (byte *)slot - (byte *)page;
+			slot->tag = 0;
+			slot->id = SLABID;
+			*link = slot;
+			link = (slabslot_t **)(slot + 1);
+			slot = (slabslot_t *)((byte *)slot + sc->size);
+		}
+		*link = NULL;
+		sc->pages++;
+	}
+
+	page->prev = NULL;
+	page->next = sc->partial;
+	if (page->next)
+		page->next->prev = page;
+	sc->partial = page;
+
+	return page;
+}
+
+/*
+========================
+Z_UnlinkPage
+========================
+*/
+static void Z_UnlinkPage (slabpage_t **list, slabpage_t *page)
+{
+	if (page->prev)
+		page->prev->next = page->next;
+	else
+		*list = page->next;
+	if (page->next)
+		page->next->prev = page->prev;
+	page->next = page->prev = NULL;
+}
+
+/*
+========================
+Z_SlabAlloc
+========================
+*/
+static void *Z_SlabAlloc (int size, int tag)
+{
+	slabclass_t	*sc;
+	slabpage_t	*page;
+	slabslot_t	*slot;
+	int			i;
+
+	for (i=0, sc=slab_classes ; sc->size - (int)sizeof(slabslot_t) < size ; i++, sc++)
+		;
+
+	page = sc->partial;
+	if (!page)
+	{
+		page = Z_NewSlabPage (sc, i);
+		if (!page)
+			return NULL;
+	}
+
+	slot = page->freelist;
+	page->freelist = *(slabslot_t **)(slot + 1);
+	slot->tag = tag;
+
+	if (++page->used == page->count)
+	{	// move to the full list
+		Z_UnlinkPage (&sc->partial, page);
+		page->next = sc->full;
+		if (page->next)
+			page->next->prev = page;
+		sc->full = page;
+	}
+
+	sc->allocs++;
+	sc->live++;
+	if (sc->live > sc->peak)
+		sc->peak = sc->live;
+	sc->requested += size;
+
+	return (void *)(slot + 1);
+}
+
+/*
+========================
+Z_SlabFree
+========================
+*/
+static void Z_SlabFree (slabslot_t *slot)
+{
+	slabpage_t	*page;
+	slabclass_t	*sc;
+
+	page = (slabpage_t *)((byte *)slot - slot->offset);
+	if (page->id != SLABID || page->sizeclass < 0 || page->sizeclass >= NUM_SLABCLASSES)
+		Sys_Error ("Z_Free: freed a pointer without ZONEID");
+	if (slot->tag == 0)
+		Sys_Error ("Z_Free: freed a freed pointer");
+
+	sc = &slab_classes[page->sizeclass];
+	slot->tag = 0;
+	*(slabslot_t **)(slot + 1) = page->freelist;
+	page->freelist = slot;
+
+	if (page->used-- == page->count)
+	{	// back on the partial list
+		Z_UnlinkPage (&sc->full, page);
+		page->next = sc->partial;
+		if (page->next)
+			page->next->prev = page;
+		sc->partial = page;
+	}
+
+	if (!page->used)
+	{	// keep one empty page, give the rest back
+		Z_UnlinkPage (&sc->partial, page);
+		if (!sc->spare)
+			sc->spare = page;
+		else
+		{
+			if (page->malloced)
+				z_mallocedpages--;
+			page->id = 0;
+			sc->pages--;
+			Z_FreeBlock ((memblock_t *)page - 1);
+		}
+	}
+
+	sc->frees++;
+	sc->live--;
+}
+
+/*
+========================
+Z_Free
+========================
+*/
+void Z_Free (void *ptr)
+{
+	int		id;
+
+	if (!ptr)
+		Sys_Error ("Z_Free: NULL pointer");
+
+	id = ((int *)ptr)[-1];
+	if (id == SLABID)
+		Z_SlabFree ((slabslot_t *)ptr - 1);
+	else
+		Z_FreeBlock ((memblock_t *)ptr - 1);
+}
+
+/*
+========================
+Z_Malloc
+========================
+*/
+void *Z_Malloc (int size)
+{
+	void	*buf;
+
+#ifdef PARANOID
+	Z_CheckHeap ();
+#endif
+	buf = Z_TagMalloc (size, 1);
+	if (!buf)
+		Sys_Error ("Z_Malloc: failed on allocation of %i bytes",size);
+	Q_memset (buf, 0, size);
+
+	return buf;
+}
+
+void *Z_TagMalloc (int size, int tag)
+{
+	void	*buf;
+
+	if (!tag)
+		Sys_Error ("Z_TagMalloc: tried to use a 0 tag");
+
+	if (size <= (1 << (SLAB_MINSHIFT + NUM_SLABCLASSES - 1)) - (int)sizeof(slabslot_t) && tag <= 0xffff)
+	{
+		buf = Z_SlabAlloc (size, tag);
+		if (buf)
+			return buf;
+	}
+
+	return Z_BigAlloc (size, tag);
 }
 
 
@@ -219,16 +522,19 @@ Z_Print
 void Z_Print (memzone_t *zone)
 {
 	memblock_t	*block;
-	
+	slabclass_t	*sc;
+	slabpage_t	*page;
+	int			i;
+
 	Con_Printf ("zone size: %i  location: %p\n",mainzone->size,mainzone);
-	
+
 	for (block = zone->blocklist.next ; ; block = block->next)
 	{
 		Con_Printf ("block:%p    size:%7i    tag:%3i\n",
 			block, block->size, block->tag);
-		
+
 		if (block->next == &zone->blocklist)
-			break;			// all blocks have been hit	
+			break;			// all blocks have been hit
 		if ( (byte *)block + block->size != (byte *)block->next)
 			Con_Printf ("ERROR: block size does not touch the next block\n");
 		if ( block->next->prev != block)
@@ -236,9 +542,55 @@ void Z_Print (memzone_t *zone)
 		if (!block->tag && !block->next->tag)
 			Con_Printf ("ERROR: two consecutive free blocks\n");
 	}
+
+	for (block = z_bigblocks.next ; block != &z_bigblocks ; block = block->next)
+		Con_Printf ("malloced:%p size:%7i    tag:%3i\n",
+			block, block->size, block->tag);
+
+	for (i=0, sc=slab_classes ; i<NUM_SLABCLASSES ; i++, sc++)
+	{
+		for (page = sc->partial ; page ; page = page->next)
+			Con_Printf ("slab:%p     class:%5i   used:%3i/%i\n", page, sc->size, page->used, page->count);
+		for (page = sc->full ; page ; page = page->next)
+			Con_Printf ("slab:%p     class:%5i   used:%3i/%i\n", page, sc->size, page->used, page->count);
+		if (sc->spare)
+			Con_Printf ("slab:%p     class:%5i   spare\n", sc->spare, sc->size);
+	}
 }
 
 
+/*
+========================
+Z_CheckSlabs
+========================
+*/
+static void Z_CheckSlabs (slabclass_t *sc, slabpage_t *page, qboolean full)
+{
+	slabslot_t	*slot;
+	int			free;
+
+	for ( ; page ; page = page->next)
+	{
+		if (page->id != SLABID || page->sizeclass != sc - slab_classes)
+			Sys_Error ("Z_CheckHeap: slab page without SLABID\n");
+		if (page->next && page->next->prev != page)
+			Sys_Error ("Z_CheckHeap: slab page doesn't have proper back link\n");
+		if ((page->used == page->count) != full)
+			Sys_Error ("Z_CheckHeap: slab page on the wrong list\n");
+
+		free = 0;
+		for (slot = page->freelist ; slot ; slot = *(slabslot_t **)(slot + 1))
+		{
+			if (slot->id != SLABID || slot->tag || (byte *)slot - slot->offset != (byte *)page)
+				Sys_Error ("Z_CheckHeap: trashed slab slot\n");
+			if (++free > page->count)
+				Sys_Error ("Z_CheckHeap: slab free list loops\n");
+		}
+		if (free + page->used != page->count)
+			Sys_Error ("Z_CheckHeap: slab page has lost slots\n");
+	}
+}
+
 /*
 ========================
 Z_CheckHeap
@@ -247,11 +599,13 @@ Z_CheckHeap
 void Z_CheckHeap (void)
 {
 	memblock_t	*block;
-	
+	slabclass_t	*sc;
+	int			i;
+
 	for (block = mainzone->blocklist.next ; ; block = block->next)
 	{
 		if (block->next == &mainzone->blocklist)
-			break;			// all blocks have been hit	
+			break;			// all blocks have been hit
 		if ( (byte *)block + block->size != (byte *)block->next)
 			Sys_Error ("Z_CheckHeap: block size does not touch the next block\n");
 		if ( block->next->prev != block)
@@ -259,6 +613,46 @@ void Z_CheckHeap (void)
 		if (!block->tag && !block->next->tag)
 			Sys_Error ("Z_CheckHeap: two consecutive free blocks\n");
 	}
+
+	for (i=0, sc=slab_classes ; i<NUM_SLABCLASSES ; i++, sc++)
+	{
+		Z_CheckSlabs (sc, sc->partial, false);
+		Z_CheckSlabs (sc, sc->full, true);
+	}
+}
+
+/*
+========================
+Z_Stats
+========================
+*/
+static void Z_Stats (void)
+{
+	memblock_t	*block;
+	slabclass_t	*sc;
+	int			i, used, free;
+	double		slots;
+
+	used = free = 0;
+	for (block = mainzone->blocklist.next ; block != &mainzone->blocklist ; block = block->next)
+	{
+		if (!block->tag)
+			free += block->size;
+		else if (block->tag != SLABTAG)
+			used += block->size;
+	}
+
+	Con_Printf ("zone: %iK, %iK in big blocks, %iK free\n", mainzone->size / 1024, used / 1024, free / 1024);
+	if (z_bigbytes || z_mallocedpages)
+		Con_Printf ("      zone full: %iK big blocks and %i slab pages malloced\n", z_bigbytes / 1024, z_mallocedpages);
+
+	Con_Printf ("slot pages   live   peak   waste    allocs     frees\n");
+	for (i=0, sc=slab_classes ; i<NUM_SLABCLASSES ; i++, sc++)
+	{
+		slots = (double)sc->allocs * sc->size;
+		Con_Printf ("%4i %5i %6i %6i %6i%% %9i %9i\n", sc->size, sc->pages, sc->live, sc->peak,
+			slots ? (int)((slots - sc->requested) * 100 / slots) : 0, sc->allocs, sc->frees);
+	}
 }
 
 //============================================================================
@@ -270,6 +664,8 @@ typedef struct
 	int		sentinal;
 	int		size;		// including sizeof(hunk_t), -1 = not allocated
 	char	name[8];
+	int		budget;		// hunkbudget_t charged for it
+	int		pad[3];		// keep the data 16 byte aligned
 } hunk_t;
 
 byte	*hunk_base;
@@ -279,88 +675,311 @@ int		hunk_low_used;
 int		hunk_high_used;
 
 qboolean	hunk_tempactive;
+
+static sys_mutex_t	hunk_mutex;
 int		hunk_tempmark;
 
+/*
+When the block from -heapsize is full, the low and the high hunk each go on
+in segments malloced as needed.  A side stays in its grown segments until it
+is freed back below them, so allocation order is still a stack, and marks
+keep working: the marks of grown segments count on from hunk_size as if
+the segments were laid end to end above the block.  The cache only ever
+lives in the first block.
+*/
+typedef struct hunkseg_s
+{
+	byte		*base;
+	int			size;
+	int			used;
+	int			start;		// mark at the bottom of the segment
+	struct hunkseg_s	*next;
+} hunkseg_t;
+
+#define	HUNK_GROWSIZE	0x800000	// default size of a grown segment
+
+static hunkseg_t	*hunk_lowsegs, *hunk_highsegs;	// oldest first
+static int			hunk_growsize = HUNK_GROWSIZE;
+static int			hunk_grownbytes;				// malloced in segments now
+static int			hunk_growcount;					// segments ever malloced
+
+typedef struct
+{
+	char	*name;
+	int		used;
+	int		peak;
+	int		limit;			// 0 = none, only warned about
+	qboolean	warned;
+} hunkbudgetinfo_t;
+
+static hunkbudgetinfo_t	hunk_budgets[NUM_HUNKBUDGETS] =
+{
+	{"engine"},
+	{"server"},
+	{"world"},
+	{"models"},
+	{"client"},
+	{"sound"},
+	{"temp"}
+};
+
+static int		hunk_budget = hb_engine;
+static int		hunk_used, hunk_peak;
+
 void R_FreeTextures (void);
 
 /*
 ==============
-Hunk_Check
+Hunk_SetBudget
 
-Run consistancy and sentinal trahing checks
+Later allocations are charged to budget, returns the previous one
 ==============
 */
-void Hunk_Check (void)
+int Hunk_SetBudget (int budget)
 {
-	hunk_t	*h;
-	
-	for (h = (hunk_t *)hunk_base ; (byte *)h != hunk_base + hunk_low_used ; )
-	{
-		if (h->sentinal != HUNK_SENTINAL)
-			Sys_Error ("Hunk_Check: trahsed sentinal");
-		if (h->size < 16 || h->size + (byte *)h - hunk_base > hunk_size)
-			Sys_Error ("Hunk_Check: bad size");
-		h = (hunk_t *)((byte *)h+h->size);
+	int		old;
+
+	if (budget < 0 || budget >= NUM_HUNKBUDGETS)
+		Sys_Error ("Hunk_SetBudget: bad budget %i", budget);
+
+	old = hunk_budget;
+	hunk_budget = budget;
+	return old;
+}
+
+/*
+==============
+Hunk_Charge
+==============
+*/
+static void Hunk_Charge (hunk_t *h, int budget)
+{
+	hunkbudgetinfo_t	*b;
+
+	h->budget = budget;
+	b = &hunk_budgets[budget];
+	b->used += h->size;
+	if (b->used > b->peak)
+		b->peak = b->used;
+
+	hunk_used += h->size;
+	if (hunk_used > hunk_peak)
+		hunk_peak = hunk_used;
+
+	if (b->limit && b->used > b->limit && !b->warned && !Job_ThreadNum ())
+	{	// a job thread can't print, the next main thread allocation warns
+		b->warned = true;
+		Con_Printf ("WARNING: %s hunk budget exceeded, %iK of %iK\n", b->name, b->used / 1024, b->limit / 1024);
 	}
 }
 
 /*
 ==============
-Hunk_Print
+Hunk_Release
 
-If "all" is specified, every single allocation is printed.
-Otherwise, allocations with the same name will be totaled up before printing.
+Takes the blocks from start to end off their budgets
 ==============
 */
-void Hunk_Print (qboolean all)
+static void Hunk_Release (byte *start, byte *end)
 {
-	hunk_t	*h, *next, *endlow, *starthigh, *endhigh;
-	int		count, sum;
-	int		totalblocks;
-	char	name[9];
+	hunk_t	*h;
 
-	name[8] = 0;
-	count = 0;
-	sum = 0;
-	totalblocks = 0;
-	
-	h = (hunk_t *)hunk_base;
-	endlow = (hunk_t *)(hunk_base + hunk_low_used);
-	starthigh = (hunk_t *)(hunk_base + hunk_size - hunk_high_used);
-	endhigh = (hunk_t *)(hunk_base + hunk_size);
+	for (h = (hunk_t *)start ; (byte *)h < end ; h = (hunk_t *)((byte *)h + h->size))
+	{
+		if (h->sentinal != HUNK_SENTINAL || h->size < (int)sizeof(hunk_t))
+			Sys_Error ("Hunk_Release: trahsed sentinal");
+		hunk_budgets[h->budget].used -= h->size;
+		hunk_used -= h->size;
+		if (hunk_budgets[h->budget].used <= hunk_budgets[h->budget].limit)
+			hunk_budgets[h->budget].warned = false;
+	}
+}
 
-	Con_Printf ("          :%8i total hunk size\n", hunk_size);
-	Con_Printf ("-------------------------\n");
+/*
+==============
+Hunk_LastSegment
+==============
+*/
+static hunkseg_t *Hunk_LastSegment (hunkseg_t *chain)
+{
+	while (chain && chain->next)
+		chain = chain->next;
+	return chain;
+}
 
-	while (1)
+/*
+==============
+Hunk_NewSegment
+
+Mallocs a segment with room for at least size bytes on the end of a side
+==============
+*/
+static hunkseg_t *Hunk_NewSegment (hunkseg_t **chain, int size)
+{
+	hunkseg_t	*seg, *last;
+	int			segsize;
+
+	last = Hunk_LastSegment (*chain);
+
+	segsize = size > hunk_growsize ? size : hunk_growsize;
+	seg = malloc (sizeof(hunkseg_t) + segsize + 15);
+	if (!seg)
+		return NULL;
+
+	seg->base = (byte *)(((size_t)(seg + 1) + 15) & ~15);
+	seg->size = segsize;
+	seg->used = 0;
+	seg->start = last ? last->start + last->size : hunk_size;
+	seg->next = NULL;
+	if (last)
+		last->next = seg;
+	else
+		*chain = seg;
+
+	hunk_grownbytes += segsize;
+	hunk_growcount++;
+	if (!Job_ThreadNum ())		// a job thread can't print, hunk_growcount keeps it
+		Con_DPrintf ("Hunk grew by %iK\n", segsize / 1024);
+
+	return seg;
+}
+
+/*
+==============
+Hunk_GrowAlloc
+
+Takes size bytes from the newest grown segment of a side, mallocing a
+new segment when it doesn't fit
+==============
+*/
+static hunk_t *Hunk_GrowAlloc (hunkseg_t **chain, int size)
+{
+	hunkseg_t	*seg;
+	byte		*h;
+
+	seg = Hunk_LastSegment (*chain);
+	if (!seg || seg->size - seg->used < size)
 	{
-	//
-	// skip to the high hunk if done with low hunk
-	//
-		if ( h == endlow )
+		seg = Hunk_NewSegment (chain, size);
+		if (!seg)
+			return NULL;
+	}
+
+	h = seg->base + seg->used;
+	seg->used += size;
+	return (hunk_t *)h;
+}
+
+/*
+==============
+Hunk_ShrinkToMark
+
+Frees a side's grown segments back to mark, returns false if the mark is
+below all of them
+==============
+*/
+static qboolean Hunk_ShrinkToMark (hunkseg_t **chain, int mark)
+{
+	hunkseg_t	*seg, **link;
+
+	for (link = chain ; *link ; )
+	{
+		seg = *link;
+		if (mark <= seg->start)
+		{	// the whole segment goes
+			Hunk_Release (seg->base, seg->base + seg->used);
+			*link = seg->next;
+			hunk_grownbytes -= seg->size;
+			free (seg);
+			continue;
+		}
+
+		if (mark - seg->start < seg->used)
 		{
-			Con_Printf ("-------------------------\n");
-			Con_Printf ("          :%8i REMAINING\n", hunk_size - hunk_low_used - hunk_high_used);
-			Con_Printf ("-------------------------\n");
-			h = starthigh;
+			Hunk_Release (seg->base + mark - seg->start, seg->base + seg->used);
+			memset (seg->base + mark - seg->start, 0, seg->used - (mark - seg->start));
+			seg->used = mark - seg->start;
 		}
-		
-	//
-	// if totally done, break
-	//
-		if ( h == endhigh )
-			break;
+		link = &seg->next;
+	}
+
+	return mark >= hunk_size;
+}
+
+/*
+==============
+Hunk_SideMark
+==============
+*/
+static int Hunk_SideMark (hunkseg_t *chain, int used)
+{
+	if (!chain)
+		return used;
+
+	while (chain->next)
+		chain = chain->next;
+	return chain->start + chain->used;
+}
+
+/*
+==============
+Hunk_Check
 
+Run consistancy and sentinal trahing checks
+==============
+*/
+static void Hunk_CheckBlocks (byte *start, byte *end)
+{
+	hunk_t	*h;
+
+	for (h = (hunk_t *)start ; (byte *)h != end ; )
+	{
+		if (h->sentinal != HUNK_SENTINAL)
+			Sys_Error ("Hunk_Check: trahsed sentinal");
+		if (h->size < 16 || h->size + (byte *)h > end)
+			Sys_Error ("Hunk_Check: bad size");
+		h = (hunk_t *)((byte *)h+h->size);
+	}
+}
+
+void Hunk_Check (void)
+{
+	hunkseg_t	*seg;
+
+	Hunk_CheckBlocks (hunk_base, hunk_base + hunk_low_used);
+	for (seg = hunk_lowsegs ; seg ; seg = seg->next)
+		Hunk_CheckBlocks (seg->base, seg->base + seg->used);
+}
+
+/*
+==============
+Hunk_Print
+
+If "all" is specified, every single allocation is printed.
+Otherwise, allocations with the same name will be totaled up before printing.
+==============
+*/
+static int Hunk_PrintBlocks (byte *start, byte *end, qboolean all)
+{
+	hunk_t	*h, *next;
+	int		sum, totalblocks;
+	char	name[9];
+
+	name[8] = 0;
+	sum = 0;
+	totalblocks = 0;
+
+	for (h = (hunk_t *)start ; (byte *)h != end ; h = next)
+	{
 	//
 	// run consistancy checks
 	//
 		if (h->sentinal != HUNK_SENTINAL)
 			Sys_Error ("Hunk_Check: trahsed sentinal");
-		if (h->size < 16 || h->size + (byte *)h - hunk_base > hunk_size)
+		if (h->size < 16 || h->size + (byte *)h > end)
 			Sys_Error ("Hunk_Check: bad size");
-			
+
 		next = (hunk_t *)((byte *)h+h->size);
-		count++;
 		totalblocks++;
 		sum += h->size;
 
@@ -370,25 +989,50 @@ void Hunk_Print (qboolean all)
 		memcpy (name, h->name, 8);
 		if (all)
 			Con_Printf ("%8p :%8i %8s\n",h, h->size, name);
-			
+
 	//
 	// print the total
 	//
-		if (next == endlow || next == endhigh || 
-		strncmp (h->name, next->name, 8) )
+		if ((byte *)next == end || strncmp (h->name, next->name, 8) )
 		{
 			if (!all)
 				Con_Printf ("          :%8i %8s (TOTAL)\n",sum, name);
-			count = 0;
 			sum = 0;
 		}
+	}
+
+	return totalblocks;
+}
+
+void Hunk_Print (qboolean all)
+{
+	hunkseg_t	*seg;
+	int			totalblocks;
 
-		h = next;
+	Con_Printf ("          :%8i total hunk size\n", hunk_size);
+	Con_Printf ("-------------------------\n");
+
+	totalblocks = Hunk_PrintBlocks (hunk_base, hunk_base + hunk_low_used, all);
+	for (seg = hunk_lowsegs ; seg ; seg = seg->next)
+	{
+		Con_Printf ("---- low segment %8i\n", seg->size);
+		totalblocks += Hunk_PrintBlocks (seg->base, seg->base + seg->used, all);
+	}
+
+	Con_Printf ("-------------------------\n");
+	Con_Printf ("          :%8i REMAINING\n", hunk_size - hunk_low_used - hunk_high_used);
+	Con_Printf ("-------------------------\n");
+
+	totalblocks += Hunk_PrintBlocks (hunk_base + hunk_size - hunk_high_used, hunk_base + hunk_size, all);
+	for (seg = hunk_highsegs ; seg ; seg = seg->next)
+	{
+		Con_Printf ("---- high segment %8i\n", seg->size);
+		totalblocks += Hunk_PrintBlocks (seg->base, seg->base + seg->used, all);
 	}
 
 	Con_Printf ("-------------------------\n");
 	Con_Printf ("%8i total blocks\n", totalblocks);
-	
+
 }
 
 /*
@@ -399,30 +1043,43 @@ Hunk_AllocName
 void *Hunk_AllocName (int size, char *name)
 {
 	hunk_t	*h;
-	
+
 #ifdef PARANOID
 	Hunk_Check ();
 #endif
 
 	if (size < 0)
 		Sys_Error ("Hunk_Alloc: bad size: %i", size);
-		
+
 	size = sizeof(hunk_t) + ((size+15)&~15);
-	
-	if (hunk_size - hunk_low_used - hunk_high_used < size)
-		Sys_Error ("Hunk_Alloc: failed on %i bytes",size);
-	
-	h = (hunk_t *)(hunk_base + hunk_low_used);
-	hunk_low_used += size;
 
-	Cache_FreeLow (hunk_low_used);
+	Sys_LockMutex (hunk_mutex);		// job threads allocate while loading
+
+	if (!hunk_lowsegs && hunk_size - hunk_low_used - hunk_high_used >= size)
+	{
+		h = (hunk_t *)(hunk_base + hunk_low_used);
+		hunk_low_used += size;
+
+		Cache_FreeLow (hunk_low_used);
+	}
+	else
+	{
+		h = Hunk_GrowAlloc (&hunk_lowsegs, size);
+		if (!h)
+			Sys_Error ("Hunk_Alloc: failed on %i bytes",size);
+	}
+
+	memset (h, 0, sizeof(hunk_t));
 
-	memset (h, 0, size);
-	
 	h->size = size;
 	h->sentinal = HUNK_SENTINAL;
 	Q_strncpy (h->name, name, 8);
-	
+	Hunk_Charge (h, hunk_budget);
+
+	Sys_UnlockMutex (hunk_mutex);
+
+	memset (h+1, 0, size - sizeof(hunk_t));
+
 	return (void *)(h+1);
 }
 
@@ -431,168 +1088,686 @@ void *Hunk_AllocName (int size, char *name)
 Hunk_Alloc
 ===================
 */
-void *Hunk_Alloc (int size)
+void *Hunk_Alloc (int size)
+{
+	return Hunk_AllocName (size, "unknown");
+}
+
+int	Hunk_LowMark (void)
+{
+	return Hunk_SideMark (hunk_lowsegs, hunk_low_used);
+}
+
+/*
+===================
+Hunk_LowContiguous
+
+True if everything allocated on the low hunk since mark is in one piece of
+memory, so it can be copied out as a whole and offsets within it hold
+===================
+*/
+qboolean Hunk_LowContiguous (int mark)
+{
+	hunkseg_t	*last;
+	qboolean	whole;
+
+	Sys_LockMutex (hunk_mutex);
+	last = Hunk_LastSegment (hunk_lowsegs);
+	whole = !last || mark >= last->start;
+	Sys_UnlockMutex (hunk_mutex);
+
+	return whole;
+}
+
+/*
+===================
+Hunk_LowSizeSince
+
+Bytes allocated on the low hunk since mark, leaving out the space marks
+skip between segments
+===================
+*/
+int Hunk_LowSizeSince (int mark)
+{
+	hunkseg_t	*seg;
+	int			size;
+
+	Sys_LockMutex (hunk_mutex);
+
+	size = 0;
+	if (mark < hunk_low_used)
+		size = hunk_low_used - mark;
+
+	for (seg = hunk_lowsegs ; seg ; seg = seg->next)
+	{
+		if (mark <= seg->start)
+			size += seg->used;
+		else if (mark < seg->start + seg->used)
+			size += seg->start + seg->used - mark;
+	}
+
+	Sys_UnlockMutex (hunk_mutex);
+
+	return size;
+}
+
+/*
+===================
+Hunk_ReserveLow
+
+Makes sure the next size bytes of low hunk allocations (headers included,
+as Hunk_LowSizeSince counts them) come out of one piece of memory
+===================
+*/
+void Hunk_ReserveLow (int size)
+{
+	hunkseg_t	*last;
+
+	Sys_LockMutex (hunk_mutex);
+
+	last = Hunk_LastSegment (hunk_lowsegs);
+	if (last ? last->size - last->used < size : hunk_size - hunk_low_used - hunk_high_used < size)
+	{
+		if (!Hunk_NewSegment (&hunk_lowsegs, size))
+			Sys_Error ("Hunk_ReserveLow: failed on %i bytes", size);
+	}
+
+	Sys_UnlockMutex (hunk_mutex);
+}
+
+void Hunk_FreeToLowMark (int mark)
+{
+	if (mark < 0 || mark > Hunk_LowMark ())
+		Sys_Error ("Hunk_FreeToLowMark: bad mark %i", mark);
+
+	Sys_LockMutex (hunk_mutex);
+	if (!Hunk_ShrinkToMark (&hunk_lowsegs, mark))
+	{
+		Hunk_Release (hunk_base + mark, hunk_base + hunk_low_used);
+		memset (hunk_base + mark, 0, hunk_low_used - mark);
+		hunk_low_used = mark;
+	}
+	Sys_UnlockMutex (hunk_mutex);
+}
+
+int	Hunk_HighMark (void)
+{
+	if (hunk_tempactive)
+	{
+		hunk_tempactive = false;
+		Hunk_FreeToHighMark (hunk_tempmark);
+	}
+
+	return Hunk_SideMark (hunk_highsegs, hunk_high_used);
+}
+
+void Hunk_FreeToHighMark (int mark)
+{
+	if (hunk_tempactive)
+	{
+		hunk_tempactive = false;
+		Hunk_FreeToHighMark (hunk_tempmark);
+	}
+	if (mark < 0 || mark > Hunk_SideMark (hunk_highsegs, hunk_high_used))
+		Sys_Error ("Hunk_FreeToHighMark: bad mark %i", mark);
+
+	Sys_LockMutex (hunk_mutex);
+	if (!Hunk_ShrinkToMark (&hunk_highsegs, mark))
+	{
+		Hunk_Release (hunk_base + hunk_size - hunk_high_used, hunk_base + hunk_size - mark);
+		memset (hunk_base + hunk_size - hunk_high_used, 0, hunk_high_used - mark);
+		hunk_high_used = mark;
+	}
+	Sys_UnlockMutex (hunk_mutex);
+}
+
+
+/*
+===================
+Hunk_HighAllocName
+===================
+*/
+static void *Hunk_HighAllocBudget (int size, char *name, int budget)
+{
+	hunk_t	*h;
+
+	if (size < 0)
+		Sys_Error ("Hunk_HighAllocName: bad size: %i", size);
+
+	if (hunk_tempactive)
+	{
+		Hunk_FreeToHighMark (hunk_tempmark);
+		hunk_tempactive = false;
+	}
+
+#ifdef PARANOID
+	Hunk_Check ();
+#endif
+
+	size = sizeof(hunk_t) + ((size+15)&~15);
+
+	Sys_LockMutex (hunk_mutex);
+
+	if (!hunk_highsegs && hunk_size - hunk_low_used - hunk_high_used >= size)
+	{
+		hunk_high_used += size;
+		Cache_FreeHigh (hunk_high_used);
+
+		h = (hunk_t *)(hunk_base + hunk_size - hunk_high_used);
+	}
+	else
+	{
+		h = Hunk_GrowAlloc (&hunk_highsegs, size);
+		if (!h)
+		{
+			Sys_UnlockMutex (hunk_mutex);
+			Con_Printf ("Hunk_HighAlloc: failed on %i bytes\n",size);
+			return NULL;
+		}
+	}
+
+	memset (h, 0, sizeof(hunk_t));
+	h->size = size;
+	h->sentinal = HUNK_SENTINAL;
+	Q_strncpy (h->name, name, 8);
+	Hunk_Charge (h, budget);
+
+	Sys_UnlockMutex (hunk_mutex);
+
+	memset (h+1, 0, size - sizeof(hunk_t));
+
+	return (void *)(h+1);
+}
+
+void *Hunk_HighAllocName (int size, char *name)
+{
+	return Hunk_HighAllocBudget (size, name, hunk_budget);
+}
+
+
+/*
+=================
+Hunk_TempAlloc
+
+Return space from the top of the hunk
+=================
+*/
+void *Hunk_TempAlloc (int size)
+{
+	void	*buf;
+
+	size = (size+15)&~15;
+
+	if (hunk_tempactive)
+	{
+		Hunk_FreeToHighMark (hunk_tempmark);
+		hunk_tempactive = false;
+	}
+
+	hunk_tempmark = Hunk_HighMark ();
+
+	buf = Hunk_HighAllocBudget (size, "temp", hb_temp);
+
+	hunk_tempactive = true;
+
+	return buf;
+}
+
+/*
+=================
+Hunk_Stats_f
+
+memstats [hunk | all | zone [all] | cache | budget <name> <KB>]
+=================
+*/
+static void Hunk_Stats_f (void)
+{
+	hunkbudgetinfo_t	*b;
+	hunkseg_t	*seg;
+	int			i, low, high;
+
+	if (Cmd_Argc() > 1 && !Q_strcmp (Cmd_Argv(1), "budget"))
+	{
+		if (Cmd_Argc() != 4)
+		{
+			Con_Printf ("memstats budget <name> <KB> : warns when a budget goes over, 0 for none\n");
+			return;
+		}
+		for (i=0, b=hunk_budgets ; i<NUM_HUNKBUDGETS ; i++, b++)
+			if (!Q_strcmp (b->name, Cmd_Argv(2)))
+				break;
+		if (i == NUM_HUNKBUDGETS)
+		{
+			Con_Printf ("No budget named %s\n", Cmd_Argv(2));
+			return;
+		}
+		b->limit = Q_atoi (Cmd_Argv(3)) * 1024;
+		b->warned = false;
+		return;
+	}
+
+	if (Cmd_Argc() > 1 && !Q_strcmp (Cmd_Argv(1), "zone"))
+	{
+		Z_Stats ();
+		if (Cmd_Argc() > 2 && !Q_strcmp (Cmd_Argv(2), "all"))
+			Z_Print (mainzone);
+		return;
+	}
+
+	if (Cmd_Argc() > 1 && !Q_strcmp (Cmd_Argv(1), "cache"))
+	{
+		Cache_Stats ();
+		return;
+	}
+
+	if (Cmd_Argc() > 1)
+	{
+		Hunk_Print (!Q_strcmp (Cmd_Argv(1), "all"));
+		return;
+	}
+
+	low = hunk_low_used;
+	for (seg = hunk_lowsegs ; seg ; seg = seg->next)
+		low += seg->used;
+	high = hunk_high_used;
+	for (seg = hunk_highsegs ; seg ; seg = seg->next)
+		high += seg->used;
+
+	Con_Printf ("hunk: %iK block, %iK in grown segments (%i grown since start)\n",
+		hunk_size / 1024, hunk_grownbytes / 1024, hunk_growcount);
+	Con_Printf ("      %iK low, %iK high, %iK peak\n", low / 1024, high / 1024, hunk_peak / 1024);
+	Con_Printf ("cache: %iK between the low and high hunk\n",
+		(hunk_size - hunk_low_used - hunk_high_used) / 1024);
+	Con_Printf ("budget       used     peak    limit\n");
+	for (i=0, b=hunk_budgets ; i<NUM_HUNKBUDGETS ; i++, b++)
+	{
+		if (b->limit)
+			Con_Printf ("%-8s %7iK %7iK %7iK%s\n", b->name, b->used / 1024, b->peak / 1024, b->limit / 1024,
+				b->used > b->limit ? " OVER" : "");
+		else
+			Con_Printf ("%-8s %7iK %7iK        -\n", b->name, b->used / 1024, b->peak / 1024);
+	}
+}
+
+/*
+===============================================================================
+
+CACHE MEMORY
+
+Blocks are kept in address order.  The holes between them are free blocks
+(user NULL) on free lists by power of two size, so an allocation takes the
+first fit from its own class or the head of any bigger one.  The space
+between the low hunk and the first block, and between the last block and
+the high hunk, are the edges; a free block never sits at either end of the
+list, it melts into the edge instead.
+
+When nothing fits, least recently used blocks are thrown out in batches
+until a hole is big enough, instead of one by one with a full retry each.
+Cache_Compact slides blocks down over the holes a little every frame.
+
+===============================================================================
+*/
+
+typedef struct cache_system_s
+{
+	int						size;		// including this header
+	cache_user_t			*user;		// NULL for a free block
+	char					name[16];
+	struct cache_system_s	*prev, *next;
+	struct cache_system_s	*lru_prev, *lru_next;	// for LRU flushing, or the free list
+} cache_system_t;
+
+#define	CACHE_MINFREE		((sizeof(cache_system_t) + 15) & ~15)	// smallest hole kept as a block
+#define	NUM_CACHECLASSES	32
+#define	CACHE_EVICTBATCH	32			// a batch frees at least 1/32 of the cache
+#define	CACHE_COMPACTBYTES	0x40000		// moved by Cache_Compact per frame
+
+cache_system_t	cache_head;
+
+static cache_system_t	*cache_free[NUM_CACHECLASSES];
+static unsigned			cache_freemask;		// classes with free blocks
+static int				cache_freebytes;	// in holes, not counting the edges
+static int				cache_holes;
+
+static sys_mutex_t	cache_mutex;
+
+static struct
+{
+	int		checks, hits;
+	int		allocs;
+	int		evictions, evictbatches;
+	double	evictbytes;
+	int		moves;						// out of the way of the hunk
+	int		compactmoves;
+	double	compactbytes;
+} cache_stats;
+
+/*
+===========
+Cache_Lock / Cache_Unlock
+===========
+*/
+void Cache_Lock (void)
+{
+	Sys_LockMutex (cache_mutex);
+}
+
+void Cache_Unlock (void)
+{
+	Sys_UnlockMutex (cache_mutex);
+}
+
+void Cache_UnlinkLRU (cache_system_t *cs)
+{
+	if (!cs->lru_next || !cs->lru_prev)
+		Sys_Error ("Cache_UnlinkLRU: NULL link");
+
+	cs->lru_next->lru_prev = cs->lru_prev;
+	cs->lru_prev->lru_next = cs->lru_next;
+
+	cs->lru_prev = cs->lru_next = NULL;
+}
+
+void Cache_MakeLRU (cache_system_t *cs)
+{
+	if (cs->lru_next || cs->lru_prev)
+		Sys_Error ("Cache_MakeLRU: active link");
+
+	cache_head.lru_next->lru_prev = cs;
+	cs->lru_next = cache_head.lru_next;
+	cs->lru_prev = &cache_head;
+	cache_head.lru_next = cs;
+}
+
+/*
+===========
+Cache_SizeClass
+===========
+*/
+static int Cache_SizeClass (int size)
+{
+	int		c;
+
+	for (c=0 ; size > 1 ; c++)
+		size >>= 1;
+	return c;
+}
+
+/*
+===========
+Cache_AddFree / Cache_RemoveFree
+===========
+*/
+static void Cache_AddFree (cache_system_t *cs)
 {
-	return Hunk_AllocName (size, "unknown");
+	int		c;
+
+	c = Cache_SizeClass (cs->size);
+	cs->user = NULL;
+	cs->lru_prev = NULL;
+	cs->lru_next = cache_free[c];
+	if (cs->lru_next)
+		cs->lru_next->lru_prev = cs;
+	cache_free[c] = cs;
+	cache_freemask |= 1u << c;
+	cache_freebytes += cs->size;
+	cache_holes++;
 }
 
-int	Hunk_LowMark (void)
+static void Cache_RemoveFree (cache_system_t *cs)
 {
-	return hunk_low_used;
+	int		c;
+
+	c = Cache_SizeClass (cs->size);
+	if (cs->lru_prev)
+		cs->lru_prev->lru_next = cs->lru_next;
+	else
+		cache_free[c] = cs->lru_next;
+	if (cs->lru_next)
+		cs->lru_next->lru_prev = cs->lru_prev;
+	if (!cache_free[c])
+		cache_freemask &= ~(1u << c);
+	cs->lru_prev = cs->lru_next = NULL;
+	cache_freebytes -= cs->size;
+	cache_holes--;
 }
 
-void Hunk_FreeToLowMark (int mark)
+/*
+===========
+Cache_LinkAfter
+===========
+*/
+static void Cache_LinkAfter (cache_system_t *prev, cache_system_t *cs)
 {
-	if (mark < 0 || mark > hunk_low_used)
-		Sys_Error ("Hunk_FreeToLowMark: bad mark %i", mark);
-	memset (hunk_base + mark, 0, hunk_low_used - mark);
-	hunk_low_used = mark;
+	cs->prev = prev;
+	cs->next = prev->next;
+	cs->next->prev = cs;
+	prev->next = cs;
 }
 
-int	Hunk_HighMark (void)
+static void Cache_Unlink (cache_system_t *cs)
 {
-	if (hunk_tempactive)
-	{
-		hunk_tempactive = false;
-		Hunk_FreeToHighMark (hunk_tempmark);
-	}
-
-	return hunk_high_used;
+	cs->prev->next = cs->next;
+	cs->next->prev = cs->prev;
+	cs->next = cs->prev = NULL;
 }
 
-void Hunk_FreeToHighMark (int mark)
+/*
+===========
+Cache_Bottom / Cache_Top
+
+Ends of the cache area, between the low and high hunk
+===========
+*/
+static byte *Cache_Bottom (void)
 {
-	if (hunk_tempactive)
-	{
-		hunk_tempactive = false;
-		Hunk_FreeToHighMark (hunk_tempmark);
-	}
-	if (mark < 0 || mark > hunk_high_used)
-		Sys_Error ("Hunk_FreeToHighMark: bad mark %i", mark);
-	memset (hunk_base + hunk_size - hunk_high_used, 0, hunk_high_used - mark);
-	hunk_high_used = mark;
+	return hunk_base + hunk_low_used;
 }
 
+static byte *Cache_Top (void)
+{
+	return hunk_base + hunk_size - hunk_high_used;
+}
 
 /*
-===================
-Hunk_HighAllocName
-===================
+===========
+Cache_Release
+
+Turns an allocated block into a hole, merged with its neighbours or the
+edges.  Returns the size of the space it ended up in.
+===========
 */
-void *Hunk_HighAllocName (int size, char *name)
+static int Cache_Release (cache_system_t *cs)
 {
-	hunk_t	*h;
+	cache_system_t	*other;
 
-	if (size < 0)
-		Sys_Error ("Hunk_HighAllocName: bad size: %i", size);
+	cs->user = NULL;
 
-	if (hunk_tempactive)
-	{
-		Hunk_FreeToHighMark (hunk_tempmark);
-		hunk_tempactive = false;
+	other = cs->prev;
+	if (other != &cache_head && !other->user)
+	{	// merge into the hole below
+		Cache_RemoveFree (other);
+		other->size += cs->size;
+		Cache_Unlink (cs);
+		cs = other;
 	}
 
-#ifdef PARANOID
-	Hunk_Check ();
-#endif
-
-	size = sizeof(hunk_t) + ((size+15)&~15);
-
-	if (hunk_size - hunk_low_used - hunk_high_used < size)
-	{
-		Con_Printf ("Hunk_HighAlloc: failed on %i bytes\n",size);
-		return NULL;
+	other = cs->next;
+	if (other != &cache_head && !other->user)
+	{	// take in the hole above
+		Cache_RemoveFree (other);
+		cs->size += other->size;
+		Cache_Unlink (other);
 	}
 
-	hunk_high_used += size;
-	Cache_FreeHigh (hunk_high_used);
-
-	h = (hunk_t *)(hunk_base + hunk_size - hunk_high_used);
+	if (cs->prev == &cache_head)
+	{	// becomes part of the bottom edge
+		other = cs->next;
+		Cache_Unlink (cs);
+		if (other == &cache_head)
+			return Cache_Top () - Cache_Bottom ();
+		return (byte *)other - Cache_Bottom ();
+	}
 
-	memset (h, 0, size);
-	h->size = size;
-	h->sentinal = HUNK_SENTINAL;
-	Q_strncpy (h->name, name, 8);
+	if (cs->next == &cache_head)
+	{	// becomes part of the top edge
+		other = cs->prev;
+		Cache_Unlink (cs);
+		return Cache_Top () - ((byte *)other + other->size);
+	}
 
-	return (void *)(h+1);
+	Cache_AddFree (cs);
+	return cs->size;
 }
 
-
 /*
-=================
-Hunk_TempAlloc
+===========
+Cache_Take
 
-Return space from the top of the hunk
-=================
+Allocates the start of a hole, the rest stays a hole
+===========
 */
-void *Hunk_TempAlloc (int size)
+static cache_system_t *Cache_Take (cache_system_t *hole, int size)
 {
-	void	*buf;
+	cache_system_t	*rest;
+	int				extra;
 
-	size = (size+15)&~15;
-	
-	if (hunk_tempactive)
+	Cache_RemoveFree (hole);
+
+	extra = hole->size - size;
+	if (extra >= (int)CACHE_MINFREE)
 	{
-		Hunk_FreeToHighMark (hunk_tempmark);
-		hunk_tempactive = false;
+		hole->size = size;
+		rest = (cache_system_t *)((byte *)hole + size);
+		memset (rest, 0, sizeof(*rest));
+		rest->size = extra;
+		Cache_LinkAfter (hole, rest);
+		Cache_AddFree (rest);
 	}
-	
-	hunk_tempmark = Hunk_HighMark ();
-
-	buf = Hunk_HighAllocName (size, "temp");
-
-	hunk_tempactive = true;
+	// else the slack stays in the block
 
-	return buf;
+	return hole;
 }
 
 /*
-===============================================================================
-
-CACHE MEMORY
+============
+Cache_TryAlloc
 
-===============================================================================
+Looks for a free block of memory between the high and low hunk marks
+Size should already include the header and padding.  The block has to lie
+between floor and ceiling, if they are given.
+============
 */
-
-typedef struct cache_system_s
+cache_system_t *Cache_TryAlloc (int size, byte *floor, byte *ceiling)
 {
-	int						size;		// including this header
-	cache_user_t			*user;
-	char					name[16];
-	struct cache_system_s	*prev, *next;
-	struct cache_system_s	*lru_prev, *lru_next;	// for LRU flushing	
-} cache_system_t;
+	cache_system_t	*cs, *new;
+	byte			*start;
+	int				c;
 
-cache_system_t *Cache_TryAlloc (int size, qboolean nobottom);
+	if (!floor)
+		floor = Cache_Bottom ();
+	if (!ceiling)
+		ceiling = Cache_Top ();
 
-cache_system_t	cache_head;
+// holes, first fit in the own class, anything from the bigger ones
+	for (c = Cache_SizeClass (size) ; c < NUM_CACHECLASSES ; c++)
+	{
+		if (!(cache_freemask & (1u << c)))
+			continue;
+		for (cs = cache_free[c] ; cs ; cs = cs->lru_next)
+		{
+			if (cs->size < size)
+				continue;
+			if ((byte *)cs < floor || (byte *)cs + size > ceiling)
+				continue;
+			new = Cache_Take (cs, size);
+			goto found;
+		}
+	}
+
+// is the cache completely empty?
+	if (cache_head.next == &cache_head)
+	{
+		start = Cache_Bottom ();
+		if (start < floor)
+			start = floor;
+		if (start + size > ceiling)
+			return NULL;
+
+		new = (cache_system_t *)start;
+		memset (new, 0, sizeof(*new));
+		new->size = size;
+		Cache_LinkAfter (&cache_head, new);
+		goto found;
+	}
+
+// on top of the last block
+	cs = cache_head.prev;
+	start = (byte *)cs + cs->size;
+	if (start >= floor && start + size <= ceiling && start + size <= Cache_Top ())
+	{
+		new = (cache_system_t *)start;
+		memset (new, 0, sizeof(*new));
+		new->size = size;
+		Cache_LinkAfter (cs, new);
+		goto found;
+	}
+
+// under the first block
+	cs = cache_head.next;
+	start = (byte *)cs - size;
+	if (start >= floor && start >= Cache_Bottom () && start + size <= ceiling)
+	{
+		new = (cache_system_t *)start;
+		memset (new, 0, sizeof(*new));
+		new->size = size;
+		Cache_LinkAfter (&cache_head, new);
+		goto found;
+	}
+
+	return NULL;		// couldn't allocate
+
+found:
+	new->lru_prev = new->lru_next = NULL;
+	return new;
+}
 
 /*
 ===========
 Cache_Move
+
+Copies a block somewhere between floor and ceiling, or throws it out
 ===========
 */
-void Cache_Move ( cache_system_t *c)
+void Cache_Move (cache_system_t *c, byte *floor, byte *ceiling)
 {
 	cache_system_t		*new;
+	int					size;
 
-// we are clearing up space at the bottom, so only allocate it late
-	new = Cache_TryAlloc (c->size, true);
+	size = c->size;
+	new = Cache_TryAlloc (c->size, floor, ceiling);
 	if (new)
 	{
-//		Con_Printf ("cache_move ok\n");
-
-		Q_memcpy ( new+1, c+1, c->size - sizeof(cache_system_t) );
+		Q_memcpy (new+1, c+1, c->size - sizeof(cache_system_t));
 		new->user = c->user;
 		Q_memcpy (new->name, c->name, sizeof(new->name));
-		Cache_Free (c->user);
 		new->user->data = (void *)(new+1);
+
+	// take over the place in the LRU list
+		new->lru_prev = c->lru_prev;
+		new->lru_next = c->lru_next;
+		new->lru_prev->lru_next = new;
+		new->lru_next->lru_prev = new;
+		c->lru_prev = c->lru_next = NULL;
+
+		Cache_Release (c);
+		cache_stats.moves++;
 	}
 	else
 	{
-//		Con_Printf ("cache_move failed\n");
-
 		Cache_Free (c->user);		// tough luck...
+		cache_stats.evictions++;
+		cache_stats.evictbytes += size;
 	}
 }
 
@@ -606,16 +1781,18 @@ Throw things out until the hunk can be expanded to the given point
 void Cache_FreeLow (int new_low_hunk)
 {
 	cache_system_t	*c;
-	
+
+	Cache_Lock ();
 	while (1)
 	{
 		c = cache_head.next;
 		if (c == &cache_head)
-			return;		// nothing in cache at all
+			break;		// nothing in cache at all
 		if ((byte *)c >= hunk_base + new_low_hunk)
-			return;		// there is space to grow the hunk
-		Cache_Move ( c );	// reclaim the space
+			break;		// there is space to grow the hunk
+		Cache_Move (c, hunk_base + new_low_hunk, NULL);	// reclaim the space
 	}
+	Cache_Unlock ();
 }
 
 /*
@@ -627,126 +1804,55 @@ Throw things out until the hunk can be expanded to the given point
 */
 void Cache_FreeHigh (int new_high_hunk)
 {
-	cache_system_t	*c, *prev;
-	
-	prev = NULL;
+	cache_system_t	*c;
+
+	Cache_Lock ();
 	while (1)
 	{
 		c = cache_head.prev;
 		if (c == &cache_head)
-			return;		// nothing in cache at all
+			break;		// nothing in cache at all
 		if ( (byte *)c + c->size <= hunk_base + hunk_size - new_high_hunk)
-			return;		// there is space to grow the hunk
-		if (c == prev)
-			Cache_Free (c->user);	// didn't move out of the way
-		else
-		{
-			Cache_Move (c);	// try to move it
-			prev = c;
-		}
+			break;		// there is space to grow the hunk
+		Cache_Move (c, NULL, hunk_base + hunk_size - new_high_hunk);	// try to move it
 	}
-}
-
-void Cache_UnlinkLRU (cache_system_t *cs)
-{
-	if (!cs->lru_next || !cs->lru_prev)
-		Sys_Error ("Cache_UnlinkLRU: NULL link");
-
-	cs->lru_next->lru_prev = cs->lru_prev;
-	cs->lru_prev->lru_next = cs->lru_next;
-	
-	cs->lru_prev = cs->lru_next = NULL;
-}
-
-void Cache_MakeLRU (cache_system_t *cs)
-{
-	if (cs->lru_next || cs->lru_prev)
-		Sys_Error ("Cache_MakeLRU: active link");
-
-	cache_head.lru_next->lru_prev = cs;
-	cs->lru_next = cache_head.lru_next;
-	cs->lru_prev = &cache_head;
-	cache_head.lru_next = cs;
+	Cache_Unlock ();
 }
 
 /*
 ============
-Cache_TryAlloc
+Cache_EvictBatch
 
-Looks for a free block of memory between the high and low hunk marks
-Size should already include the header and padding
+Throws out least recently used blocks until a hole of size opens up, or a
+batch worth of memory is gone.  The caller retries after each batch.
 ============
 */
-cache_system_t *Cache_TryAlloc (int size, qboolean nobottom)
+static void Cache_EvictBatch (int size)
 {
-	cache_system_t	*cs, *new;
-	
-// is the cache completely empty?
-
-	if (!nobottom && cache_head.prev == &cache_head)
-	{
-		if (hunk_size - hunk_high_used - hunk_low_used < size)
-			Sys_Error ("Cache_TryAlloc: %i is greater then free hunk", size);
-
-		new = (cache_system_t *) (hunk_base + hunk_low_used);
-		memset (new, 0, sizeof(*new));
-		new->size = size;
+	cache_system_t	*cs;
+	int				budget, freed, hole;
 
-		cache_head.prev = cache_head.next = new;
-		new->prev = new->next = &cache_head;
-		
-		Cache_MakeLRU (new);
-		return new;
-	}
-	
-// search from the bottom up for space
+	budget = (Cache_Top () - Cache_Bottom ()) / CACHE_EVICTBATCH;
+	if (budget < size)
+		budget = size;
 
-	new = (cache_system_t *) (hunk_base + hunk_low_used);
-	cs = cache_head.next;
-	
-	do
+	cache_stats.evictbatches++;
+	for (freed = 0 ; freed < budget ; )
 	{
-		if (!nobottom || cs != cache_head.next)
-		{
-			if ( (byte *)cs - (byte *)new >= size)
-			{	// found space
-				memset (new, 0, sizeof(*new));
-				new->size = size;
-				
-				new->next = cs;
-				new->prev = cs->prev;
-				cs->prev->next = new;
-				cs->prev = new;
-				
-				Cache_MakeLRU (new);
-	
-				return new;
-			}
-		}
-
-	// continue looking		
-		new = (cache_system_t *)((byte *)cs + cs->size);
-		cs = cs->next;
+		cs = cache_head.lru_prev;
+		if (cs == &cache_head)
+			break;
 
-	} while (cs != &cache_head);
-	
-// try to allocate one at the very end
-	if ( hunk_base + hunk_size - hunk_high_used - (byte *)new >= size)
-	{
-		memset (new, 0, sizeof(*new));
-		new->size = size;
-		
-		new->next = &cache_head;
-		new->prev = cache_head.prev;
-		cache_head.prev->next = new;
-		cache_head.prev = new;
-		
-		Cache_MakeLRU (new);
+		freed += cs->size;
+		cache_stats.evictions++;
+		cache_stats.evictbytes += cs->size;
 
-		return new;
+		cs->user->data = NULL;
+		Cache_UnlinkLRU (cs);
+		hole = Cache_Release (cs);
+		if (hole >= size)
+			break;
 	}
-	
-	return NULL;		// couldn't allocate
 }
 
 /*
@@ -758,8 +1864,10 @@ Throw everything out, so new data will be demand cached
 */
 void Cache_Flush (void)
 {
+	Cache_Lock ();
 	while (cache_head.next != &cache_head)
 		Cache_Free ( cache_head.next->user );	// reclaim the space
+	Cache_Unlock ();
 }
 
 
@@ -775,8 +1883,73 @@ void Cache_Print (void)
 
 	for (cd = cache_head.next ; cd != &cache_head ; cd = cd->next)
 	{
-		Con_Printf ("%8i : %s\n", cd->size, cd->name);
+		if (cd->user)
+			Con_Printf ("%8i : %s\n", cd->size, cd->name);
+		else
+			Con_Printf ("%8i : (free)\n", cd->size);
+	}
+}
+
+/*
+============
+Cache_PrintStats
+============
+*/
+static void Cache_PrintStats (void (*print) (char *fmt, ...))
+{
+	cache_system_t	*cs;
+	int				edges, largest, total, used, blocks;
+
+	Cache_Lock ();
+
+	used = blocks = 0;
+	largest = 0;
+	for (cs = cache_head.next ; cs != &cache_head ; cs = cs->next)
+	{
+		if (cs->user)
+		{
+			used += cs->size;
+			blocks++;
+		}
+		else if (cs->size > largest)
+			largest = cs->size;
+	}
+
+	if (cache_head.next == &cache_head)
+		edges = Cache_Top () - Cache_Bottom ();
+	else
+	{
+		edges = (byte *)cache_head.next - Cache_Bottom ();
+		if (edges > largest)
+			largest = edges;
+		cs = cache_head.prev;
+		total = Cache_Top () - ((byte *)cs + cs->size);
+		if (total > largest)
+			largest = total;
+		edges += total;
 	}
+	if (edges > largest)
+		largest = edges;	// empty cache
+	total = cache_freebytes + edges;
+
+	print ("cache: %i blocks in %iK, %iK free in %i holes and the edges\n",
+		blocks, used / 1024, total / 1024, cache_holes);
+	print ("       %i%% fragmented, largest free %iK\n",
+		total ? 100 - (int)((double)largest * 100 / total) : 0, largest / 1024);
+	print ("       %i%% hit rate over %i checks, %i allocs\n",
+		cache_stats.checks ? (int)((double)cache_stats.hits * 100 / cache_stats.checks) : 0,
+		cache_stats.checks, cache_stats.allocs);
+	print ("       %i evicted in %i batches (%iK), %i moved for the hunk\n",
+		cache_stats.evictions, cache_stats.evictbatches, (int)(cache_stats.evictbytes / 1024), cache_stats.moves);
+	print ("       %i compacted (%iK)\n",
+		cache_stats.compactmoves, (int)(cache_stats.compactbytes / 1024));
+
+	Cache_Unlock ();
+}
+
+static void Cache_Stats (void)
+{
+	Cache_PrintStats (Con_Printf);
 }
 
 /*
@@ -788,16 +1961,70 @@ Cache_Report
 void Cache_Report (void)
 {
 	Con_DPrintf ("%4.1f megabyte data cache\n", (hunk_size - hunk_high_used - hunk_low_used) / (float)(1024*1024) );
+	Cache_PrintStats (Con_DPrintf);
 }
 
 /*
 ============
 Cache_Compact
 
+Slides blocks down over the holes, at most CACHE_COMPACTBYTES a call.
+Called at the top of the frame, when nothing holds on to cache data.
 ============
 */
 void Cache_Compact (void)
 {
+	cache_system_t	*hole, *cs, *prev, *next, *new;
+	int				moved, holesize;
+
+	if (!cache_freemask)
+		return;		// nothing to close up
+
+	PROF_BEGIN ("Cache_Compact");
+	Cache_Lock ();
+
+	moved = 0;
+	for (hole = cache_head.next ; hole != &cache_head && moved < CACHE_COMPACTBYTES ; )
+	{
+		if (hole->user)
+		{
+			hole = hole->next;
+			continue;
+		}
+
+	// a hole is never last, so cs is an allocated block
+		cs = hole->next;
+		prev = hole->prev;
+		next = cs->next;
+		holesize = hole->size;
+		Cache_RemoveFree (hole);
+
+		memmove (hole, cs, cs->size);
+		new = hole;
+		new->prev = prev;
+		new->next = next;
+		prev->next = new;
+		next->prev = new;
+		new->lru_prev->lru_next = new;
+		new->lru_next->lru_prev = new;
+		new->user->data = (void *)(new+1);
+
+		moved += new->size;
+		cache_stats.compactmoves++;
+		cache_stats.compactbytes += new->size;
+
+	// the hole is now above the block
+		hole = (cache_system_t *)((byte *)new + new->size);
+		memset (hole, 0, sizeof(*hole));
+		hole->size = holesize;
+		Cache_LinkAfter (new, hole);
+		Cache_Release (hole);
+
+		hole = new->next;
+	}
+
+	Cache_Unlock ();
+	PROF_END ();
 }
 
 /*
@@ -810,6 +2037,9 @@ void Cache_Init (void)
 {
 	cache_head.next = cache_head.prev = &cache_head;
 	cache_head.lru_next = cache_head.lru_prev = &cache_head;
+	cache_head.user = (cache_user_t *)&cache_head;	// never looks free
+
+	cache_mutex = Sys_CreateMutex ();
 
 	Cmd_AddCommand ("flush", Cache_Flush);
 }
@@ -828,15 +2058,14 @@ void Cache_Free (cache_user_t *c)
 	if (!c->data)
 		Sys_Error ("Cache_Free: not allocated");
 
+	Cache_Lock ();
 	cs = ((cache_system_t *)c->data) - 1;
 
-	cs->prev->next = cs->next;
-	cs->next->prev = cs->prev;
-	cs->next = cs->prev = NULL;
-
 	c->data = NULL;
 
 	Cache_UnlinkLRU (cs);
+	Cache_Release (cs);
+	Cache_Unlock ();
 }
 
 
@@ -850,16 +2079,23 @@ void *Cache_Check (cache_user_t *c)
 {
 	cache_system_t	*cs;
 
-	if (!c->data)
-		return NULL;
+	void			*data;
 
-	cs = ((cache_system_t *)c->data) - 1;
+	Cache_Lock ();
+	cache_stats.checks++;
+	data = c->data;
+	if (data)
+	{
+		cs = ((cache_system_t *)data) - 1;
 
-// move to head of LRU
-	Cache_UnlinkLRU (cs);
-	Cache_MakeLRU (cs);
-	
-	return c->data;
+	// move to head of LRU
+		Cache_UnlinkLRU (cs);
+		Cache_MakeLRU (cs);
+		cache_stats.hits++;
+	}
+	Cache_Unlock ();
+
+	return data;
 }
 
 
@@ -874,32 +2110,38 @@ void *Cache_Alloc (cache_user_t *c, int size, char *name)
 
 	if (c->data)
 		Sys_Error ("Cache_Alloc: allready allocated");
-	
+
 	if (size <= 0)
 		Sys_Error ("Cache_Alloc: size %i", size);
 
 	size = (size + sizeof(cache_system_t) + 15) & ~15;
 
-// find memory for it	
+	Cache_Lock ();
+
+// find memory for it
 	while (1)
 	{
-		cs = Cache_TryAlloc (size, false);
+		cs = Cache_TryAlloc (size, NULL, NULL);
 		if (cs)
 		{
 			strncpy (cs->name, name, sizeof(cs->name)-1);
 			c->data = (void *)(cs+1);
 			cs->user = c;
+			Cache_MakeLRU (cs);
 			break;
 		}
-	
-	// free the least recently used cahedat
+
+	// free a batch of the least recently used cahedat
 		if (cache_head.lru_prev == &cache_head)
 			Sys_Error ("Cache_Alloc: out of memory");
 													// not enough memory at all
-		Cache_Free ( cache_head.lru_prev->user );
-	} 
-	
-	return Cache_Check (c);
+		Cache_EvictBatch (size);
+	}
+
+	cache_stats.allocs++;
+	Cache_Unlock ();
+
+	return c->data;
 }
 
 //============================================================================
@@ -914,13 +2156,24 @@ void Memory_Init (void *buf, int size)
 {
 	int p;
 	int zonesize = DYNAMIC_SIZE;
+	int	pad;
 
-	hunk_base = buf;
-	hunk_size = size;
+// hunk blocks are 16 byte aligned for sse, but malloc only promises 8
+	pad = (16 - ((size_t)buf & 15)) & 15;
+	hunk_base = (byte *)buf + pad;
+	hunk_size = (size - pad) & ~15;
 	hunk_low_used = 0;
 	hunk_high_used = 0;
+	hunk_mutex = Sys_CreateMutex ();
+
+	p = COM_CheckParm ("-hunkgrow");
+	if (p && p < com_argc-1)
+		hunk_growsize = Q_atoi (com_argv[p+1]) * 1024;
+	if (hunk_growsize < 0x100000)
+		hunk_growsize = 0x100000;
 	
 	Cache_Init ();
+	Cmd_AddCommand ("memstats", Hunk_Stats_f);
 	p = COM_CheckParm ("-zone");
 	if (p)
 	{
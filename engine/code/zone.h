@@ -24,7 +24,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 H_??? The hunk manages the entire memory block given to quake.  It must be
 contiguous.  Memory can be allocated from either the low or high end in a
 stack fashion.  The only way memory is released is by resetting one of the
-pointers.
+pointers.  When the block is full, either end goes on in segments malloced
+as needed (-hunkgrow <KB> sets their size), still freed by mark.
+
+Every hunk allocation is charged to the current budget, see Hunk_SetBudget.
+"memstats" reports the budgets and their high-water marks.
 
 Hunk allocations should be given a name, so the Hunk_Print () function
 can display usage.
@@ -37,7 +41,9 @@ server allocations when changing to a higher video mode.
 
 Z_??? Zone memory functions used for small, dynamic allocations like text
 strings from command input.  There is only about 48K for it, allocated at
-the very bottom of the hunk.
+the very bottom of the hunk.  Small requests come from power of two slabs
+in O(1), big ones from a first fit list, and both fall back to malloc when
+the zone is full.  "memstats zone" shows the per class counts.
 
 Cache_??? Cache memory is for objects that can be dynamically loaded and
 can usefully stay persistant between levels.  The size of the cache
@@ -100,12 +106,29 @@ void *Hunk_HighAllocName (int size, char *name);
 
 int	Hunk_LowMark (void);
 void Hunk_FreeToLowMark (int mark);
+qboolean Hunk_LowContiguous (int mark);
+int Hunk_LowSizeSince (int mark);
+void Hunk_ReserveLow (int size);
 
 int	Hunk_HighMark (void);
 void Hunk_FreeToHighMark (int mark);
 
 void *Hunk_TempAlloc (int size);
 
+typedef enum
+{
+	hb_engine,		// startup
+	hb_server,		// progs, edicts, clients
+	hb_world,		// brush models
+	hb_models,		// alias models and sprites
+	hb_client,
+	hb_sound,
+	hb_temp,		// Hunk_TempAlloc, charged automatically
+	NUM_HUNKBUDGETS
+} hunkbudget_t;
+
+int Hunk_SetBudget (int budget);	// returns the previous budget
+
 void Hunk_Check (void);
 
 typedef struct cache_user_s
@@ -126,6 +149,15 @@ void *Cache_Alloc (cache_user_t *c, int size, char *name);
 // wasn't enough room.
 
 void Cache_Report (void);
+// size, hit rate, evictions and fragmentation, "memstats cache" at any time
+
+void Cache_Compact (void);
+// closes up some of the holes, once a frame while no cache data is held
+
+void Cache_Lock (void);
+void Cache_Unlock (void);
+// the cache is shared with the sound mixer thread; every Cache_ call takes
+// the lock itself, hold it explicitly to keep data from moving between calls
 
 
 
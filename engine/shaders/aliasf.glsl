@@ -0,0 +1,12 @@
+const char *aliasf = STRINGIFY(
+uniform sampler2D skin;
+
+varying vec3 color;
+
+void main(void)
+{
+	vec4 texel = texture2D(skin, gl_TexCoord[0].st);
+
+	gl_FragColor = vec4(texel.rgb * color, texel.a);
+}
+);
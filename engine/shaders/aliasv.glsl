@@ -0,0 +1,32 @@
+const char *aliasv = STRINGIFY(
+uniform float Blend;
+uniform vec3 ShadeVector;
+uniform float ShadeLight;
+uniform vec3 LightVec;
+uniform vec3 LightColor;
+uniform float Fullbright;
+
+attribute vec4 Pose1Vert;
+attribute vec3 Pose1Normal;
+attribute vec4 Pose2Vert;
+attribute vec3 Pose2Normal;
+attribute vec2 TexCoord;
+
+varying vec3 color;
+
+void main(void)
+{
+	vec4 vert = vec4(mix(Pose1Vert.xyz, Pose2Vert.xyz, Blend), 1.0);
+	vec3 normal = mix(Pose1Normal, Pose2Normal, Blend);
+	normal *= inversesqrt(max(dot(normal, normal), 0.0001));
+
+	// the r_avertexnormal_dots table for any yaw, then the light from above
+	float shade = dot(normal, ShadeVector);
+	shade = shade < 0.0 ? 1.0 + shade * (13.0 / 44.0) : 1.0 + shade;
+	float light = shade * ShadeLight + max(dot(normal, LightVec), 0.0);
+
+	gl_TexCoord[0] = vec4(TexCoord, 0.0, 1.0);
+	gl_Position    = gl_ModelViewProjectionMatrix * vert;
+	color          = clamp(mix(light * LightColor, vec3(1.0), Fullbright), 0.0, 1.0);
+}
+);